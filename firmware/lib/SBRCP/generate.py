@@ -0,0 +1,328 @@
+# -*- coding: utf-8 -*-
+#
+# Description:  SBRCP code generator: message structures for C++ (firmware, sbr-qt) and the Python codec (sbr-py)
+#               from the message schema sbrcp.json
+# License:      GPLv3
+# File:         generate.py
+#
+# Usage:        python3 generate.py           writes src/SBRCPMessages.h and ../../../sbr-py/SBRCPMessages.py
+#               python3 generate.py --check   exits with 1 if the generated files are not up to date
+
+import json
+import os
+import re
+import struct
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SCHEMA = os.path.join(HERE, 'sbrcp.json')
+CPP_OUTPUT = os.path.join(HERE, 'src', 'SBRCPMessages.h')
+PY_OUTPUT = os.path.normpath(os.path.join(HERE, '..', '..', '..', 'sbr-py', 'SBRCPMessages.py'))
+
+# schema type: (C++ type, struct format character)
+TYPES = {
+    'uint8': ('uint8_t', 'B'),
+    'int8': ('int8_t', 'b'),
+    'uint16': ('uint16_t', 'H'),
+    'int16': ('int16_t', 'h'),
+    'uint32': ('uint32_t', 'I'),
+    'int32': ('int32_t', 'i'),
+    'float': ('float', 'f'),
+}
+DIRECTIONS = ('pcToRobot', 'robotToPc')
+
+LICENSE = '''/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+'''
+
+
+def snake(name):
+    return re.sub(r'(?<!^)(?=[A-Z])', '_', name).lower()
+
+
+def load(path):
+    """
+    Read and check the schema, compute field offsets and payload sizes
+    :param path: schema file
+    :return: schema dictionary, every message gets 'size' (fixed payload bytes), 'min_size' (without optional fields)
+             and 'variable' (last field takes the rest of the payload)
+    """
+    with open(path) as f:
+        schema = json.load(f)
+    max_payload = schema['maxPayload']
+    ids = set()
+    for m in schema['messages']:
+        m['id'] = int(m['id'], 0)
+        assert m['id'] not in ids, 'duplicate message id 0x{:02X}'.format(m['id'])
+        assert m['direction'] in DIRECTIONS, '{}: unknown direction {}'.format(m['name'], m['direction'])
+        ids.add(m['id'])
+        offset = 0
+        min_size = None
+        m['variable'] = False
+        for i, field in enumerate(m['fields']):
+            assert field['type'] in TYPES, '{}.{}: unknown type {}'.format(m['name'], field['name'], field['type'])
+            size = struct.calcsize('<' + TYPES[field['type']][1])
+            count = field.get('count', 1)
+            if count == 'variable':
+                assert i == len(m['fields']) - 1, '{}.{}: only the last field can be variable'.format(m['name'], field['name'])
+                m['variable'] = True
+                count = (max_payload - offset) // size
+                min_size = offset if min_size is None else min_size
+            if field.get('optional'):
+                min_size = offset if min_size is None else min_size
+            else:
+                assert min_size is None or m['variable'], '{}.{}: required field after an optional one'.format(m['name'], field['name'])
+            field['offset'] = offset
+            field['size'] = size
+            field['length'] = count
+            offset += size * count
+        m['size'] = offset
+        m['min_size'] = offset if min_size is None else min_size
+        assert m['size'] <= max_payload, '{}: payload {} bytes, maximum {}'.format(m['name'], m['size'], max_payload)
+    for group in schema['constants']:
+        for c in group['values']:
+            c['value'] = c['value'] if isinstance(c['value'], int) else int(c['value'], 0)
+    return schema
+
+
+def hex_value(value, width):
+    return '0x{:0{}X}'.format(value, width)
+
+
+def constant_width(c):
+    return 4 if c['value'] > 0xFF or c['name'].startswith('FEATURE_') else 2
+
+
+def comment(doc):
+    return ' //' + doc if doc else ''
+
+
+def generate_cpp(schema):
+    out = [LICENSE, '', '/**',
+           '* \\file SBRCPMessages.h',
+           '* \\brief SBRCP message types, constants and payload structures, generated by generate.py from sbrcp.json - do not edit',
+           '* \\copyright GNU GPLv3',
+           '**/', '',
+           '#ifndef SBRCPMESSAGES_H_',
+           '#define SBRCPMESSAGES_H_',
+           '#include <stdint.h>', '',
+           '//payload structures overlay the little-endian payload bytes',
+           '#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)',
+           '#error SBRCP payload structures need a little-endian target',
+           '#endif', '',
+           '#define _SBRCP_MAX_PAYLOAD_SIZE ({}) //maximum payload size in one packet (in bytes)'.format(schema['maxPayload']), '',
+           '#define SBRCP_PROTOCOL_VERSION {} //protocol version sent in DATA_HELLO'.format(schema['protocolVersion']), '',
+           '//serial protocol data types']
+    for m in schema['messages']:
+        out.append('#define {} {}'.format(m['type'], hex_value(m['id'], 2)))
+    for group in schema['constants']:
+        out += ['', '//' + group['group']]
+        for c in group['values']:
+            out.append('#define {} {}{}'.format(c['name'], hex_value(c['value'], constant_width(c)), comment(c.get('doc'))))
+
+    for direction, title in zip(DIRECTIONS, ('PC-to-robot', 'robot-to-PC')):
+        messages = [m for m in schema['messages'] if m['direction'] == direction]
+        out += ['', '', '//{} payloads'.format(title)]
+        for m in messages:
+            name = 'SBRCP_{}_t'.format(m['name'])
+            out += ['', '//{}, {}'.format(m['doc'], m['type']),
+                    'struct __attribute__((packed, may_alias)) {}'.format(name), '{',
+                    '\tstatic const uint8_t TYPE = {};'.format(m['type']),
+                    '\tstatic const uint8_t MIN_SIZE = {}; //minimum valid payload size'.format(m['min_size'])]
+            for field in m['fields']:
+                ctype = TYPES[field['type']][0]
+                array = '[{}]'.format(field['length']) if field.get('count', 1) != 1 else ''
+                doc = field.get('doc', '')
+                if field.get('optional'):
+                    doc = 'optional' + (', ' + doc if doc else '')
+                if field.get('count') == 'variable':
+                    doc = 'variable length (at most {}), {}'.format(field['length'], doc)
+                out.append('\t{} {}{};{}'.format(ctype, field['name'], array, comment(doc)))
+            out.append('};')
+            out.append('static_assert(sizeof({}) == {}, "{} doesn\'t match the schema");'.format(name, m['size'], name))
+        macro = 'SBRCP_' + snake(direction).upper()
+        out += ['', '//{} messages: X(payload structure, handler function name)'.format(title),
+                '#define {}(X) \\'.format(macro)]
+        out += ['\tX(SBRCP_{}_t, on{}) \\'.format(m['name'], m['name']) for m in messages[:-1]]
+        out.append('\tX(SBRCP_{}_t, on{})'.format(messages[-1]['name'], messages[-1]['name']))
+        function = 'SBRCP_is' + direction[0].upper() + direction[1:]
+        out += ['', '//true for {} data types'.format(title),
+                'static inline bool {}(uint8_t type)'.format(function), '{',
+                '\treturn ' + '\n\t\t|| '.join('(type == {})'.format(m['type']) for m in messages) + ';', '}']
+    out += ['#endif', '']
+    return '\n'.join(out)
+
+
+def generate_py(schema):
+    out = ['# -*- coding: utf-8 -*-', '#',
+           '# Description:  SBRCP message types, constants and payload codec, generated by generate.py from sbrcp.json - do not edit',
+           '# License:      GPLv3',
+           '# File:         SBRCPMessages.py', '',
+           'import struct', '',
+           'PROTOCOL_VERSION = {}'.format(schema['protocolVersion']),
+           'MAX_PAYLOAD = {}'.format(schema['maxPayload']), '']
+    for m in schema['messages']:
+        out.append('{} = {}'.format(m['type'], hex_value(m['id'], 2)))
+    for group in schema['constants']:
+        out += ['', '# ' + group['group']]
+        for c in group['values']:
+            out.append('{} = {}{}'.format(c['name'], hex_value(c['value'], constant_width(c)),
+                                          '    # ' + c['doc'] if c.get('doc') else ''))
+    out += ['', '', PY_CODEC, '',
+            '# name, type, direction, fields: (name, struct format, count or None for scalars, optional), variable tail field',
+            'MESSAGES = [']
+    for m in schema['messages']:
+        fields = []
+        tail = None
+        for field in m['fields']:
+            fmt = TYPES[field['type']][1]
+            if field.get('count') == 'variable':
+                tail = (snake(field['name']), fmt)
+                continue
+            count = field['length'] if field.get('count', 1) != 1 else None
+            fields.append((snake(field['name']), fmt, count, bool(field.get('optional'))))
+        out.append('    Message({!r}, {}, {!r}, ['.format(m['name'], m['type'], m['direction']))
+        out += ['        {!r},'.format(f) for f in fields]
+        out.append('    ]{}),'.format(', ' + repr(tail) if tail else ''))
+    out += [']', 'BY_TYPE = {m.type: m for m in MESSAGES}', 'BY_NAME = {m.name: m for m in MESSAGES}',
+            'PC_TO_ROBOT_TYPES = [m.type for m in MESSAGES if m.direction == \'pcToRobot\']',
+            'ROBOT_TO_PC_TYPES = [m.type for m in MESSAGES if m.direction == \'robotToPc\']', '', '',
+            PY_FUNCTIONS]
+    return '\n'.join(out)
+
+
+PY_CODEC = '''class Message:
+    """
+    Payload layout of one message type, fields are little-endian and packed as in the C++ SBRCP_..._t structures
+    """
+    def __init__(self, name, type, direction, fields, tail=None):
+        self.name = name
+        self.type = type
+        self.direction = direction
+        self.fields = [f[0] for f in fields]
+        self.layout = []                    # (name, offset, struct.Struct, count or None, optional)
+        offset = 0
+        fmt = '<'
+        self.min_size = None
+        for field, f, count, optional in fields:
+            s = struct.Struct('<{}{}'.format(count or 1, f))
+            if optional and self.min_size is None:
+                self.min_size = offset
+            self.layout.append((field, offset, s, count, optional))
+            offset += s.size
+            fmt += '{}{}'.format(count or 1, f)
+        self.struct = struct.Struct(fmt)    # all fixed fields, for fast packing of complete payloads
+        self.size = offset
+        self.min_size = offset if self.min_size is None else self.min_size
+        self.tail = tail                    # (name, struct format) of the field taking the rest of the payload
+
+    def encode(self, **values):
+        """
+        Encode payload, optional fields are sent up to the first missing one
+        :param values: field values (lists for arrays, bytes for the variable field)
+        :return: type byte and payload
+        """
+        payload = bytes([self.type])
+        for name, offset, s, count, optional in self.layout:
+            if name not in values:
+                assert optional, '{}: missing field {}'.format(self.name, name)
+                break
+            payload += s.pack(*values[name]) if count else s.pack(values[name])
+        if self.tail and self.tail[0] in values:
+            tail = values[self.tail[0]]
+            payload += tail if self.tail[1] == 'B' else struct.pack('<{}{}'.format(len(tail), self.tail[1]), *tail)
+        return payload
+
+    def decode(self, payload):
+        """
+        Decode payload, missing optional fields are left out
+        :param payload: payload bytes (without the type byte, CRC and LF-CR)
+        :return: dictionary of field values, None if the payload is too short
+        """
+        if len(payload) < self.min_size:
+            return None
+        result = {}
+        if len(payload) >= self.size:
+            values = self.struct.unpack_from(payload)
+            i = 0
+            for name, offset, s, count, optional in self.layout:
+                if count:
+                    result[name] = list(values[i:i + count])
+                    i += count
+                else:
+                    result[name] = values[i]
+                    i += 1
+        else:
+            for name, offset, s, count, optional in self.layout:
+                if offset + s.size > len(payload):
+                    break
+                v = s.unpack_from(payload, offset)
+                result[name] = list(v) if count else v[0]
+        if self.tail:
+            rest = payload[self.size:]
+            size = struct.calcsize('<' + self.tail[1])
+            result[self.tail[0]] = bytes(rest) if self.tail[1] == 'B' else \\
+                list(struct.unpack('<{}{}'.format(len(rest) // size, self.tail[1]), rest[:len(rest) // size * size]))
+        return result
+'''
+
+PY_FUNCTIONS = '''def encode(name, **values):
+    """
+    Encode message
+    :param name: message name (e.g. 'CmdMotors')
+    :param values: field values in snake case (e.g. motor_a=10, motor_b=-10)
+    :return: type byte and payload, without CRC and LF-CR
+    """
+    return BY_NAME[name].encode(**values)
+
+
+def decode(frame_type, payload):
+    """
+    Decode message payload
+    :param frame_type: type byte
+    :param payload: payload bytes
+    :return: (message name, dictionary of field values), (None, None) for unknown types and too short payloads
+    """
+    message = BY_TYPE.get(frame_type)
+    if message is None:
+        return None, None
+    values = message.decode(payload)
+    return (message.name, values) if values is not None else (None, None)
+'''
+
+
+def main():
+    schema = load(SCHEMA)
+    outputs = [(CPP_OUTPUT, generate_cpp(schema)), (PY_OUTPUT, generate_py(schema))]
+    check = '--check' in sys.argv[1:]
+    stale = False
+    for path, text in outputs:
+        old = open(path).read() if os.path.exists(path) else None
+        if old == text:
+            continue
+        if check:
+            print('{} is not up to date'.format(path))
+            stale = True
+        else:
+            with open(path, 'w') as f:
+                f.write(text)
+            print('written {}'.format(path))
+    return 1 if stale else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
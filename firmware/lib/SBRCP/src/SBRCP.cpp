@@ -30,16 +30,19 @@
 SBRCP::SBRCP(void (*callback)(SBRCP_data_t*))
 {
 	processedDataCallback = callback;
+	framesParsed = 0;
+	crcErrors = 0;
 }
 
-void SBRCP::parseRx(uint8_t *data, uint16_t len)
+bool SBRCP::parseRx(uint8_t *data, uint16_t len)
 {
 	if(len < 3) 
-		return; //valid data must contain: a type byte, at least one data byte, a CRC
-	if(len > (_SBRCP_MAX_PAYLOAD_SIZE + 2)) 
-		return; //if frame is too long (longer than max. payload size + type byte + crc byte), drop it
+		return false; //valid data must contain: a type byte, at least one data byte, a CRC
+	if(len > (_SBRCP_MAX_PAYLOAD_SIZE + 4)) 
+		return false; //if frame is too long (longer than max. payload size + type byte + crc byte + LF-CR), drop it
 	SBRCP_data_t d; //data structure
 	d.type = *(data); //save data type
+	d.size = 0;
 	uint8_t crc = crc8(CRC8_INITIAL_VAL, d.type); //initialize crc and recalculate for the first data byte
 	
 	for(uint16_t i = 1; i < (len - 3); i++)
@@ -50,10 +53,13 @@ void SBRCP::parseRx(uint8_t *data, uint16_t len)
 	}
 	
 	if(crc != *(data + len - 3)) //check if crc matches
-		return; //if not, abort
-	else
-		(*processedDataCallback)(&d); //if so, call callback function
-	
+	{
+		crcErrors++;
+		return false; //if not, abort
+	}
+	framesParsed++;
+	(*processedDataCallback)(&d); //if so, call callback function
+	return true;
 }
 
 void SBRCP::parseTx(SBRCP_data_t *data, uint8_t *buf, uint8_t *len)
@@ -74,6 +80,30 @@ void SBRCP::parseTx(SBRCP_data_t *data, uint8_t *buf, uint8_t *len)
 	(*len) += 3;
 }
 
+bool SBRCP::dispatch(const SBRCP_handler_t *table, uint8_t count, const SBRCP_data_t *data)
+{
+	for(uint8_t i = 0; i < count; i++) //few entries, a linear scan needs no type-indexed table in SRAM
+	{
+		if(table[i].type != data->type)
+			continue;
+		if(data->size < table[i].minSize)
+			return false;
+		(*table[i].handler)(data);
+		return true;
+	}
+	return false;
+}
+
+uint16_t SBRCP::getFramesParsed(void)
+{
+	return framesParsed;
+}
+
+uint16_t SBRCP::getCrcErrors(void)
+{
+	return crcErrors;
+}
+
 uint8_t SBRCP::crc8(uint8_t lastCRC, uint8_t data)
 {
 	uint8_t crc = lastCRC ^ data;
@@ -0,0 +1,153 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file SBRCP.h
+* \brief Self balancing robot communication protocol
+* \author Piotr Wilkon <pwilkon@student.agh.edu.pl>
+* \copyright Copyright 2021 Piotr Wilkon, licensed under GNU GPLv3
+**/
+
+#ifndef SBRCP_H_
+#define SBRCP_H_
+#include <stdint.h>
+#include <stddef.h>
+#include "SBRCPMessages.h" //data types, constants and payload structures generated from sbrcp.json
+
+#define CRC8_INITIAL_VAL 0xFF
+#define CRC8_POLYNOMIAL 0x07
+
+typedef struct
+{
+	uint8_t type; //data type (first byte of the packet)
+	uint8_t payload[_SBRCP_MAX_PAYLOAD_SIZE]; //packet payload
+	uint8_t size; //payload length
+} SBRCP_data_t;
+
+//dispatch table entry, see SBRCP_HANDLER()
+typedef struct
+{
+	uint8_t type; //data type
+	uint8_t minSize; //shorter payloads are rejected
+	void (*handler)(const SBRCP_data_t*); //called for valid packets
+} SBRCP_handler_t;
+
+/**
+* \brief Zero-copy view of a received payload
+* \param[in] *data Packet
+* \return Payload structure overlaying the packet payload, NULL if the type doesn't match or the payload is too short
+**/
+template <typename T> inline const T *SBRCP_view(const SBRCP_data_t *data)
+{
+	return ((data->type == T::TYPE) && (data->size >= T::MIN_SIZE)) ? (const T*)data->payload : NULL;
+}
+
+/**
+* \brief Prepares a packet for encoding in place
+* \param[out] *data Packet, gets the type and the payload size
+* \param[in] size Payload size, the whole structure by default (less for optional or variable fields)
+* \return Payload structure overlaying the packet payload, to be filled by the caller
+**/
+template <typename T> inline T *SBRCP_init(SBRCP_data_t *data, uint8_t size = sizeof(T))
+{
+	data->type = T::TYPE;
+	data->size = size;
+	return (T*)data->payload;
+}
+
+//true if an optional field is present in a payload of the given size
+#define SBRCP_HAS(T, field, size) ((size) >= offsetof(T, field) + sizeof(((T*)0)->field))
+
+//calls a typed handler, the payload is already checked by SBRCP::dispatch()
+template <typename T, void (*H)(const T*, uint8_t)> void SBRCP_call(const SBRCP_data_t *data)
+{
+	H((const T*)data->payload, data->size);
+}
+
+//dispatch table entry for handler void name(const T *payload, uint8_t size), usable with the generated X-macro lists:
+//static const SBRCP_handler_t handlers[] = {SBRCP_PC_TO_ROBOT(SBRCP_HANDLER)};
+#define SBRCP_HANDLER(T, name) {T::TYPE, T::MIN_SIZE, &SBRCP_call<T, name>},
+
+class SBRCP
+{
+private:
+	void (*processedDataCallback)(SBRCP_data_t*); //callback function to be called when the packet is processed
+	uint16_t framesParsed; //valid frames (wraps around)
+	uint16_t crcErrors; //frames with CRC mismatch (wraps around)
+public:
+	/**
+	* \brief SBRCP library initializer
+	* \param[in] *callback Pointer to the function that should be called when a packet is received
+	**/
+	SBRCP(void (*callback)(SBRCP_data_t*));
+	/**
+	* \brief Parses incoming frame and calls the callback function
+	* \param[in] *data Incoming frame
+	* \param[in] len Incoming frame length
+	* \return True if the frame was valid and the callback was called
+	**/
+	bool parseRx(uint8_t *data, uint16_t len);
+	/**
+	* \brief Parses outcoming data structure into frame
+	* \param[in] *data Data structure to be processed
+	* \param[out] *buf Frame buffer
+	* \param[in] *len Frame buffer data length
+	**/
+	void parseTx(SBRCP_data_t *data, uint8_t *buf, uint8_t *len);
+	/**
+	* \brief Calls the handler of a packet from a dispatch table
+	* \param[in] *table Handlers, one per data type
+	* \param[in] count Number of handlers
+	* \param[in] *data Packet
+	* \return False if there is no handler for the type or the payload is too short
+	**/
+	static bool dispatch(const SBRCP_handler_t *table, uint8_t count, const SBRCP_data_t *data);
+	/**
+	* \brief CRC8 calculation, one byte at a time starting from CRC8_INITIAL_VAL
+	**/
+	static uint8_t crc8(uint8_t lastCRC, uint8_t data);
+	/**
+	* \brief Gets the number of valid frames passed to the callback function
+	**/
+	uint16_t getFramesParsed(void);
+	/**
+	* \brief Gets the number of frames dropped because of CRC mismatch
+	**/
+	uint16_t getCrcErrors(void);
+};
+
+/**
+* \brief Checks if a frame contains LF-CR, where the robot (SerialFrame) would cut it short
+* \param[in] *data Packet
+* \param[in] crc Also check the last payload byte followed by the CRC, false for the bytes that don't depend on the CRC
+* \return True if 0x0A followed by 0x0D appears in the type, payload and CRC bytes
+**/
+inline bool SBRCP_hasFrameEnd(const SBRCP_data_t *data, bool crc = true)
+{
+	uint8_t previous = data->type;
+	uint8_t c = SBRCP::crc8(CRC8_INITIAL_VAL, data->type);
+	for(uint8_t i = 0; i < data->size; i++)
+	{
+		if((previous == '\n') && (data->payload[i] == '\r'))
+			return true;
+		previous = data->payload[i];
+		c = SBRCP::crc8(c, data->payload[i]);
+	}
+	return crc && (previous == '\n') && (c == '\r');
+}
+#endif
\ No newline at end of file
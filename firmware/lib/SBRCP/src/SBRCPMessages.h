@@ -0,0 +1,453 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file SBRCPMessages.h
+* \brief SBRCP message types, constants and payload structures, generated by generate.py from sbrcp.json - do not edit
+* \copyright GNU GPLv3
+**/
+
+#ifndef SBRCPMESSAGES_H_
+#define SBRCPMESSAGES_H_
+#include <stdint.h>
+
+//payload structures overlay the little-endian payload bytes
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__)
+#error SBRCP payload structures need a little-endian target
+#endif
+
+#define _SBRCP_MAX_PAYLOAD_SIZE (30) //maximum payload size in one packet (in bytes)
+
+#define SBRCP_PROTOCOL_VERSION 1 //protocol version sent in DATA_HELLO
+
+//serial protocol data types
+#define DATA_CMD_MOTORS 0x2F
+#define DATA_CMD_MOTORS_SEQ 0x2D
+#define DATA_CMD_RATE 0xA7
+#define DATA_CMD_TELEMETRY 0xB3
+#define DATA_CMD_HELLO 0xC1
+#define DATA_CMD_SENSOR 0xC5
+#define DATA_CMD_STATS 0xC7
+#define DATA_CMD_PING 0xC9
+#define DATA_CMD_RELIABLE 0xCB
+#define DATA_CMD_BAUD 0xCD
+#define DATA_CMD_MEMORY 0xCF
+#define DATA_MPU 0x35
+#define DATA_MPU_KEY 0x36
+#define DATA_MPU_DELTA 0x37
+#define DATA_MPU_TS 0x38
+#define DATA_MPU_EVENT 0x39
+#define DATA_HELLO 0x3A
+#define DATA_STATS 0x3B
+#define DATA_PONG 0x3C
+#define DATA_ACK 0x3D
+#define DATA_BAUD 0x3E
+#define DATA_MEMORY 0x3F
+#define DATA_ERROR 0xEE
+
+//telemetry modes (DATA_CMD_TELEMETRY)
+#define TELEMETRY_FULL 0x00 //every sample sent as a DATA_MPU packet
+#define TELEMETRY_COMPRESSED 0x01 //DATA_MPU_KEY keyframes followed by DATA_MPU_DELTA packets
+#define TELEMETRY_TIMESTAMPED 0x02 //every sample sent as a DATA_MPU_TS packet with the robot time of the reading
+#define TELEMETRY_EVENT 0x03 //send-on-delta: a sample is sent as a DATA_MPU_EVENT packet only if a channel changed by more than its threshold since the last sent one, or after the maximum silence
+
+//feature flags (DATA_HELLO)
+#define FEATURE_COMPRESSED_TELEMETRY 0x0001 //DATA_CMD_TELEMETRY, DATA_MPU_KEY, DATA_MPU_DELTA
+#define FEATURE_SENSOR_CONFIG 0x0002 //DATA_CMD_SENSOR
+#define FEATURE_STATS 0x0004 //DATA_CMD_STATS, DATA_STATS
+#define FEATURE_PING 0x0008 //DATA_CMD_PING, DATA_PONG
+#define FEATURE_TIMESTAMPS 0x0010 //TELEMETRY_TIMESTAMPED, DATA_MPU_TS
+#define FEATURE_RELIABLE 0x0020 //DATA_CMD_RELIABLE, DATA_ACK, DATA_CMD_MOTORS_SEQ
+#define FEATURE_BAUD 0x0040 //DATA_CMD_BAUD, DATA_BAUD (serial connection)
+#define FEATURE_MEMORY 0x0080 //DATA_CMD_MEMORY, DATA_MEMORY
+#define FEATURE_EVENT_TELEMETRY 0x0100 //TELEMETRY_EVENT, DATA_MPU_EVENT
+
+//connection types (DATA_HELLO)
+#define CONNECTION_SERIAL 0x00 //UART, cable or Bluetooth
+#define CONNECTION_WIFI 0x01 //ESP32 in AT commands mode, UDP
+
+//sensor configuration (DATA_CMD_SENSOR)
+#define SENSOR_UNCHANGED 0xFF //value that leaves the setting unchanged
+
+//reliable delivery (DATA_CMD_RELIABLE, DATA_ACK, DATA_CMD_MOTORS_SEQ)
+#define SEQ_WINDOW 0x0200 //sequence numbers up to this far behind the last accepted one are duplicates or stale, older ones start a new session (covers the motor sequence skip past LF-CR)
+#define ACK_APPLIED 0x00 //command applied
+#define ACK_DUPLICATE 0x01 //retransmission of a command already applied, not applied again
+#define ACK_REJECTED 0x02 //unknown or too short command, not applied
+
+//baud rate negotiation (DATA_CMD_BAUD, DATA_BAUD)
+#define BAUD_PROPOSE 0x00 //answer, then switch to the baud rate until it is committed
+#define BAUD_PROBE 0x01 //echo the pattern at the current baud rate
+#define BAUD_COMMIT 0x02 //keep the proposed baud rate
+#define BAUD_ACCEPTED 0x00 //the robot switches after this answer
+#define BAUD_UNSUPPORTED 0x01 //baud rate not available (clock error over 3 %, WiFi connection), not switched
+#define BAUD_PROBED 0x02 //pattern echoed
+#define BAUD_COMMITTED 0x03 //proposed baud rate kept
+#define BAUD_NOT_PENDING 0x04 //commit without a pending switch (already committed or fallen back), baud is the current rate
+#define BAUD_PROBE_TIMEOUT 0x01F4 //milliseconds after the switch before the robot falls back to the previous baud rate without a commit
+
+//memory usage flags (DATA_MEMORY)
+#define MEMORY_STATIC_ALLOCATION 0x01 //built with _STATIC_ALLOCATION, long-lived objects are in static storage and heapSize is the use of the static pool
+#define MEMORY_POOL_EXHAUSTED 0x02 //an allocation didn't fit into the static pool and failed
+
+//event telemetry (DATA_CMD_TELEMETRY, DATA_MPU_EVENT)
+#define EVENT_CHANGE 0x01 //a channel changed by more than its threshold
+#define EVENT_SILENCE 0x02 //nothing sent for the maximum silence, the values are still valid
+#define EVENT_START 0x04 //first sample after the mode or rate setting, the host has no previous value
+#define EVENT_ACCEL_THRESHOLD 0x64 //default accelerometer threshold in mm/s^2
+#define EVENT_GYRO_THRESHOLD 0x14 //default gyroscope threshold in mrad/s
+#define EVENT_MAX_SILENCE 0x01F4 //default maximum silence in milliseconds
+
+//error codes (DATA_ERROR)
+#define ERROR_OTHER 0x00
+#define ERROR_MPU_INIT 0x01
+#define ERROR_MPU_READ 0x02
+#define ERROR_ILLEGAL_CMD 0x03
+
+
+//PC-to-robot payloads
+
+//motor speed setting, DATA_CMD_MOTORS
+struct __attribute__((packed, may_alias)) SBRCP_CmdMotors_t
+{
+	static const uint8_t TYPE = DATA_CMD_MOTORS;
+	static const uint8_t MIN_SIZE = 4; //minimum valid payload size
+	int16_t motorA; //-255 to 255, 0 stops the motor
+	int16_t motorB;
+};
+static_assert(sizeof(SBRCP_CmdMotors_t) == 4, "SBRCP_CmdMotors_t doesn't match the schema");
+
+//sequenced motor speed setting, latest wins, DATA_CMD_MOTORS_SEQ
+struct __attribute__((packed, may_alias)) SBRCP_CmdMotorsSeq_t
+{
+	static const uint8_t TYPE = DATA_CMD_MOTORS_SEQ;
+	static const uint8_t MIN_SIZE = 6; //minimum valid payload size
+	uint16_t sequence; //incremented for every command, stale commands are dropped
+	int16_t motorA; //as in DATA_CMD_MOTORS
+	int16_t motorB;
+};
+static_assert(sizeof(SBRCP_CmdMotorsSeq_t) == 6, "SBRCP_CmdMotorsSeq_t doesn't match the schema");
+
+//MPU6050 data interval setting, DATA_CMD_RATE
+struct __attribute__((packed, may_alias)) SBRCP_CmdRate_t
+{
+	static const uint8_t TYPE = DATA_CMD_RATE;
+	static const uint8_t MIN_SIZE = 4; //minimum valid payload size
+	uint32_t interval; //in microseconds
+};
+static_assert(sizeof(SBRCP_CmdRate_t) == 4, "SBRCP_CmdRate_t doesn't match the schema");
+
+//telemetry mode setting, DATA_CMD_TELEMETRY
+struct __attribute__((packed, may_alias)) SBRCP_CmdTelemetry_t
+{
+	static const uint8_t TYPE = DATA_CMD_TELEMETRY;
+	static const uint8_t MIN_SIZE = 1; //minimum valid payload size
+	uint8_t mode; //TELEMETRY_...
+	uint8_t batch; //optional, maximum samples in a delta packet
+	uint8_t keyInterval; //optional, samples between keyframes
+	uint16_t accelThreshold; //optional, TELEMETRY_EVENT accelerometer threshold in mm/s^2, 0 for EVENT_ACCEL_THRESHOLD
+	uint16_t gyroThreshold; //optional, TELEMETRY_EVENT gyroscope threshold in mrad/s, 0 for EVENT_GYRO_THRESHOLD
+	uint16_t maxSilence; //optional, TELEMETRY_EVENT maximum time without a packet in milliseconds, 0 for EVENT_MAX_SILENCE
+};
+static_assert(sizeof(SBRCP_CmdTelemetry_t) == 9, "SBRCP_CmdTelemetry_t doesn't match the schema");
+
+//capabilities request (handshake), DATA_CMD_HELLO
+struct __attribute__((packed, may_alias)) SBRCP_CmdHello_t
+{
+	static const uint8_t TYPE = DATA_CMD_HELLO;
+	static const uint8_t MIN_SIZE = 0; //minimum valid payload size
+	uint8_t protocolVersion; //optional
+};
+static_assert(sizeof(SBRCP_CmdHello_t) == 1, "SBRCP_CmdHello_t doesn't match the schema");
+
+//sensor configuration setting, DATA_CMD_SENSOR
+struct __attribute__((packed, may_alias)) SBRCP_CmdSensor_t
+{
+	static const uint8_t TYPE = DATA_CMD_SENSOR;
+	static const uint8_t MIN_SIZE = 1; //minimum valid payload size
+	uint8_t accelRange; //0-3 for 2, 4, 8 and 16 G or SENSOR_UNCHANGED
+	uint8_t gyroRange; //optional, 0-3 for 250, 500, 1000 and 2000 deg/s or SENSOR_UNCHANGED
+	uint8_t filterBandwidth; //optional, 0-6 for 260, 184, 94, 44, 21, 10 and 5 Hz or SENSOR_UNCHANGED
+};
+static_assert(sizeof(SBRCP_CmdSensor_t) == 3, "SBRCP_CmdSensor_t doesn't match the schema");
+
+//runtime statistics request, DATA_CMD_STATS
+struct __attribute__((packed, may_alias)) SBRCP_CmdStats_t
+{
+	static const uint8_t TYPE = DATA_CMD_STATS;
+	static const uint8_t MIN_SIZE = 0; //minimum valid payload size
+	uint16_t interval; //optional, period of further packets in milliseconds, 0 for none
+};
+static_assert(sizeof(SBRCP_CmdStats_t) == 2, "SBRCP_CmdStats_t doesn't match the schema");
+
+//ping, DATA_CMD_PING
+struct __attribute__((packed, may_alias)) SBRCP_CmdPing_t
+{
+	static const uint8_t TYPE = DATA_CMD_PING;
+	static const uint8_t MIN_SIZE = 0; //minimum valid payload size
+	uint32_t token; //optional, echoed in DATA_PONG
+};
+static_assert(sizeof(SBRCP_CmdPing_t) == 4, "SBRCP_CmdPing_t doesn't match the schema");
+
+//acknowledged command (configuration), retransmitted until DATA_ACK, DATA_CMD_RELIABLE
+struct __attribute__((packed, may_alias)) SBRCP_CmdReliable_t
+{
+	static const uint8_t TYPE = DATA_CMD_RELIABLE;
+	static const uint8_t MIN_SIZE = 3; //minimum valid payload size
+	uint16_t sequence; //incremented for every new command, the same for retransmissions
+	uint8_t command; //type of the wrapped PC-to-robot packet
+	uint8_t payload[27]; //variable length (at most 27), payload of the wrapped packet, the rest of the payload
+};
+static_assert(sizeof(SBRCP_CmdReliable_t) == 30, "SBRCP_CmdReliable_t doesn't match the schema");
+
+//baud rate negotiation step, answered with DATA_BAUD, DATA_CMD_BAUD
+struct __attribute__((packed, may_alias)) SBRCP_CmdBaud_t
+{
+	static const uint8_t TYPE = DATA_CMD_BAUD;
+	static const uint8_t MIN_SIZE = 7; //minimum valid payload size
+	uint32_t baud; //proposed or committed baud rate, ignored by BAUD_PROBE
+	uint16_t token; //copied to the answer
+	uint8_t action; //BAUD_PROPOSE, BAUD_PROBE or BAUD_COMMIT
+	uint8_t pattern[23]; //variable length (at most 23), probe data echoed by BAUD_PROBE, the rest of the payload
+};
+static_assert(sizeof(SBRCP_CmdBaud_t) == 30, "SBRCP_CmdBaud_t doesn't match the schema");
+
+//memory usage request, answered with DATA_MEMORY, DATA_CMD_MEMORY
+struct __attribute__((packed, may_alias)) SBRCP_CmdMemory_t
+{
+	static const uint8_t TYPE = DATA_CMD_MEMORY;
+	static const uint8_t MIN_SIZE = 0; //minimum valid payload size
+	uint8_t repaint; //optional, not 0 paints the free RAM again after the answer, so the next answer shows the stack peak since this request
+};
+static_assert(sizeof(SBRCP_CmdMemory_t) == 1, "SBRCP_CmdMemory_t doesn't match the schema");
+
+//PC-to-robot messages: X(payload structure, handler function name)
+#define SBRCP_PC_TO_ROBOT(X) \
+	X(SBRCP_CmdMotors_t, onCmdMotors) \
+	X(SBRCP_CmdMotorsSeq_t, onCmdMotorsSeq) \
+	X(SBRCP_CmdRate_t, onCmdRate) \
+	X(SBRCP_CmdTelemetry_t, onCmdTelemetry) \
+	X(SBRCP_CmdHello_t, onCmdHello) \
+	X(SBRCP_CmdSensor_t, onCmdSensor) \
+	X(SBRCP_CmdStats_t, onCmdStats) \
+	X(SBRCP_CmdPing_t, onCmdPing) \
+	X(SBRCP_CmdReliable_t, onCmdReliable) \
+	X(SBRCP_CmdBaud_t, onCmdBaud) \
+	X(SBRCP_CmdMemory_t, onCmdMemory)
+
+//true for PC-to-robot data types
+static inline bool SBRCP_isPcToRobot(uint8_t type)
+{
+	return (type == DATA_CMD_MOTORS)
+		|| (type == DATA_CMD_MOTORS_SEQ)
+		|| (type == DATA_CMD_RATE)
+		|| (type == DATA_CMD_TELEMETRY)
+		|| (type == DATA_CMD_HELLO)
+		|| (type == DATA_CMD_SENSOR)
+		|| (type == DATA_CMD_STATS)
+		|| (type == DATA_CMD_PING)
+		|| (type == DATA_CMD_RELIABLE)
+		|| (type == DATA_CMD_BAUD)
+		|| (type == DATA_CMD_MEMORY);
+}
+
+
+//robot-to-PC payloads
+
+//MPU6050 data packet, DATA_MPU
+struct __attribute__((packed, may_alias)) SBRCP_Mpu_t
+{
+	static const uint8_t TYPE = DATA_MPU;
+	static const uint8_t MIN_SIZE = 24; //minimum valid payload size
+	float values[6]; //accelerometer X, Y, Z in m/s^2, gyroscope X, Y, Z in rad/s
+};
+static_assert(sizeof(SBRCP_Mpu_t) == 24, "SBRCP_Mpu_t doesn't match the schema");
+
+//MPU6050 keyframe packet (compressed telemetry), DATA_MPU_KEY
+struct __attribute__((packed, may_alias)) SBRCP_MpuKey_t
+{
+	static const uint8_t TYPE = DATA_MPU_KEY;
+	static const uint8_t MIN_SIZE = 14; //minimum valid payload size
+	uint8_t sequence; //sample counter
+	uint8_t ranges; //accelerometer range (lower nibble) and gyroscope range (upper nibble)
+	int16_t raw[6]; //raw accelerometer X, Y, Z and gyroscope X, Y, Z
+};
+static_assert(sizeof(SBRCP_MpuKey_t) == 14, "SBRCP_MpuKey_t doesn't match the schema");
+
+//MPU6050 delta packet (compressed telemetry), DATA_MPU_DELTA
+struct __attribute__((packed, may_alias)) SBRCP_MpuDelta_t
+{
+	static const uint8_t TYPE = DATA_MPU_DELTA;
+	static const uint8_t MIN_SIZE = 1; //minimum valid payload size
+	uint8_t sequence; //sample counter of the first sample
+	uint8_t deltas[29]; //variable length (at most 29), zigzag varint deltas, the rest of the payload
+};
+static_assert(sizeof(SBRCP_MpuDelta_t) == 30, "SBRCP_MpuDelta_t doesn't match the schema");
+
+//timestamped MPU6050 data packet (timestamped telemetry), DATA_MPU_TS
+struct __attribute__((packed, may_alias)) SBRCP_MpuTs_t
+{
+	static const uint8_t TYPE = DATA_MPU_TS;
+	static const uint8_t MIN_SIZE = 28; //minimum valid payload size
+	uint32_t robotTime; //robot micros() right after the reading
+	float values[6]; //as in DATA_MPU
+};
+static_assert(sizeof(SBRCP_MpuTs_t) == 28, "SBRCP_MpuTs_t doesn't match the schema");
+
+//send-on-delta MPU6050 data packet (event telemetry), DATA_MPU_EVENT
+struct __attribute__((packed, may_alias)) SBRCP_MpuEvent_t
+{
+	static const uint8_t TYPE = DATA_MPU_EVENT;
+	static const uint8_t MIN_SIZE = 30; //minimum valid payload size
+	uint32_t robotTime; //robot micros() right after the reading
+	uint8_t sequence; //packet counter, a gap means lost packets and the values between are unknown
+	uint8_t reason; //EVENT_... flags
+	float values[6]; //as in DATA_MPU
+};
+static_assert(sizeof(SBRCP_MpuEvent_t) == 30, "SBRCP_MpuEvent_t doesn't match the schema");
+
+//capabilities packet, DATA_HELLO
+struct __attribute__((packed, may_alias)) SBRCP_Hello_t
+{
+	static const uint8_t TYPE = DATA_HELLO;
+	static const uint8_t MIN_SIZE = 20; //minimum valid payload size
+	uint8_t protocolVersion;
+	uint8_t firmwareMajor;
+	uint8_t firmwareMinor;
+	uint16_t features; //FEATURE_... flags
+	uint8_t connection; //CONNECTION_...
+	uint8_t accelRange;
+	uint8_t gyroRange;
+	uint8_t filterBandwidth;
+	uint8_t telemetryMode;
+	uint32_t interval; //MPU data interval in microseconds
+	uint16_t minInterval; //in microseconds
+	uint16_t minCompressedInterval; //in microseconds
+	uint8_t maxPayload; //in bytes
+	uint8_t maxBatch; //samples in a delta packet
+};
+static_assert(sizeof(SBRCP_Hello_t) == 20, "SBRCP_Hello_t doesn't match the schema");
+
+//runtime statistics packet, DATA_STATS
+struct __attribute__((packed, may_alias)) SBRCP_Stats_t
+{
+	static const uint8_t TYPE = DATA_STATS;
+	static const uint8_t MIN_SIZE = 22; //minimum valid payload size
+	uint32_t uptime; //in milliseconds
+	uint16_t loopMax; //since the previous packet, in microseconds
+	uint16_t loopMean; //since the previous packet, in microseconds
+	uint16_t loops; //since the previous packet
+	uint16_t frames; //counters below wrap around
+	uint16_t crcErrors;
+	uint16_t rxOverflows;
+	uint16_t txDropped;
+	uint16_t mpuFailures;
+	uint16_t freeSram; //low-water mark in bytes
+	uint16_t motorCommands; //optional, DATA_CMD_MOTORS_SEQ received
+	uint16_t staleMotors; //optional, DATA_CMD_MOTORS_SEQ dropped as older than the last one or replaced before being applied
+	uint16_t duplicateCommands; //optional, DATA_CMD_RELIABLE retransmissions of commands already applied
+};
+static_assert(sizeof(SBRCP_Stats_t) == 28, "SBRCP_Stats_t doesn't match the schema");
+
+//ping answer packet, DATA_PONG
+struct __attribute__((packed, may_alias)) SBRCP_Pong_t
+{
+	static const uint8_t TYPE = DATA_PONG;
+	static const uint8_t MIN_SIZE = 8; //minimum valid payload size
+	uint32_t token; //copied from DATA_CMD_PING
+	uint32_t robotTime; //robot micros() when the ping was handled
+};
+static_assert(sizeof(SBRCP_Pong_t) == 8, "SBRCP_Pong_t doesn't match the schema");
+
+//DATA_CMD_RELIABLE acknowledgement, sent after the command is handled, DATA_ACK
+struct __attribute__((packed, may_alias)) SBRCP_Ack_t
+{
+	static const uint8_t TYPE = DATA_ACK;
+	static const uint8_t MIN_SIZE = 3; //minimum valid payload size
+	uint16_t sequence; //copied from DATA_CMD_RELIABLE
+	uint8_t status; //ACK_...
+};
+static_assert(sizeof(SBRCP_Ack_t) == 3, "SBRCP_Ack_t doesn't match the schema");
+
+//DATA_CMD_BAUD answer, sent at the baud rate the command was received at, DATA_BAUD
+struct __attribute__((packed, may_alias)) SBRCP_Baud_t
+{
+	static const uint8_t TYPE = DATA_BAUD;
+	static const uint8_t MIN_SIZE = 7; //minimum valid payload size
+	uint32_t baud; //proposed baud rate (BAUD_ACCEPTED, BAUD_UNSUPPORTED), otherwise the current one
+	uint16_t token; //copied from DATA_CMD_BAUD
+	uint8_t status; //BAUD_...
+	uint8_t pattern[23]; //variable length (at most 23), probe data copied from BAUD_PROBE, empty otherwise
+};
+static_assert(sizeof(SBRCP_Baud_t) == 30, "SBRCP_Baud_t doesn't match the schema");
+
+//memory usage packet, DATA_MEMORY
+struct __attribute__((packed, may_alias)) SBRCP_Memory_t
+{
+	static const uint8_t TYPE = DATA_MEMORY;
+	static const uint8_t MIN_SIZE = 11; //minimum valid payload size
+	uint16_t ramSize; //SRAM size in bytes
+	uint16_t staticSize; //.data and .bss in bytes, fixed at build time
+	uint16_t heapSize; //heap in use in bytes, with MEMORY_STATIC_ALLOCATION the static pool in use
+	uint16_t stackPeak; //deepest stack use in bytes since reset or the last repaint, interrupts included
+	uint16_t unusedMin; //bytes between the heap and the deepest stack use that were never written, the margin left
+	uint8_t flags; //MEMORY_...
+};
+static_assert(sizeof(SBRCP_Memory_t) == 11, "SBRCP_Memory_t doesn't match the schema");
+
+//error packet, DATA_ERROR
+struct __attribute__((packed, may_alias)) SBRCP_Error_t
+{
+	static const uint8_t TYPE = DATA_ERROR;
+	static const uint8_t MIN_SIZE = 1; //minimum valid payload size
+	uint8_t code; //ERROR_...
+};
+static_assert(sizeof(SBRCP_Error_t) == 1, "SBRCP_Error_t doesn't match the schema");
+
+//robot-to-PC messages: X(payload structure, handler function name)
+#define SBRCP_ROBOT_TO_PC(X) \
+	X(SBRCP_Mpu_t, onMpu) \
+	X(SBRCP_MpuKey_t, onMpuKey) \
+	X(SBRCP_MpuDelta_t, onMpuDelta) \
+	X(SBRCP_MpuTs_t, onMpuTs) \
+	X(SBRCP_MpuEvent_t, onMpuEvent) \
+	X(SBRCP_Hello_t, onHello) \
+	X(SBRCP_Stats_t, onStats) \
+	X(SBRCP_Pong_t, onPong) \
+	X(SBRCP_Ack_t, onAck) \
+	X(SBRCP_Baud_t, onBaud) \
+	X(SBRCP_Memory_t, onMemory) \
+	X(SBRCP_Error_t, onError)
+
+//true for robot-to-PC data types
+static inline bool SBRCP_isRobotToPc(uint8_t type)
+{
+	return (type == DATA_MPU)
+		|| (type == DATA_MPU_KEY)
+		|| (type == DATA_MPU_DELTA)
+		|| (type == DATA_MPU_TS)
+		|| (type == DATA_MPU_EVENT)
+		|| (type == DATA_HELLO)
+		|| (type == DATA_STATS)
+		|| (type == DATA_PONG)
+		|| (type == DATA_ACK)
+		|| (type == DATA_BAUD)
+		|| (type == DATA_MEMORY)
+		|| (type == DATA_ERROR);
+}
+#endif
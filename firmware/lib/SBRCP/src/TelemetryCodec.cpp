@@ -0,0 +1,311 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file TelemetryCodec.cpp
+* \brief Compressed MPU6050 telemetry (keyframes + zigzag/varint coded deltas) and send-on-delta event telemetry
+* \copyright GNU GPLv3
+**/
+
+
+#include "TelemetryCodec.h"
+#include <math.h>
+
+static_assert(sizeof(((SBRCP_MpuKey_t*)0)->raw) == TELEMETRY_CHANNELS * sizeof(int16_t), "keyframe must carry TELEMETRY_CHANNELS values");
+
+//encodes a delta as zigzag varint, returns number of bytes written (1 to 3)
+static uint8_t putVarint(uint8_t *buf, int16_t delta)
+{
+	uint16_t v = ((uint16_t)delta << 1) ^ (uint16_t)(delta >> 15); //zigzag: small negative and positive values become small unsigned values
+	uint8_t n = 0;
+	while(v >= 0x80)
+	{
+		buf[n++] = (v & 0x7F) | 0x80; //7 bits per byte, MSB set if more bytes follow
+		v >>= 7;
+	}
+	buf[n++] = v;
+	return n;
+}
+
+TelemetryEncoder::TelemetryEncoder(void (*callback)(SBRCP_data_t*))
+{
+	encodedDataCallback = callback;
+	seq = 0;
+	ranges = 0;
+	configure(1, _TELEMETRY_KEYFRAME_INTERVAL);
+}
+
+void TelemetryEncoder::configure(uint8_t batch, uint8_t keyInterval)
+{
+	if(batch == 0)
+		batch = 1;
+	if(batch > _TELEMETRY_MAX_BATCH)
+		batch = _TELEMETRY_MAX_BATCH;
+	if(keyInterval == 0)
+		keyInterval = 1;
+	this->batch = batch;
+	this->keyInterval = keyInterval;
+	reset();
+}
+
+void TelemetryEncoder::setRanges(uint8_t accelRange, uint8_t gyroRange)
+{
+	ranges = (accelRange & 0x0F) | ((gyroRange & 0x0F) << 4);
+	reset();
+}
+
+void TelemetryEncoder::reset(void)
+{
+	pending = 0;
+	frame.size = 0;
+	sinceKey = keyInterval; //next sample will be a keyframe
+}
+
+void TelemetryEncoder::flush(void)
+{
+	if(pending == 0)
+		return;
+	(*encodedDataCallback)(&frame);
+	pending = 0;
+	frame.size = 0;
+}
+
+void TelemetryEncoder::push(const int16_t *sample)
+{
+	if(sinceKey >= keyInterval) //keyframe: |seq|ranges|6 x int16|
+	{
+		flush(); //deltas must be received before the keyframe
+		SBRCP_data_t key;
+		SBRCP_MpuKey_t *k = SBRCP_init<SBRCP_MpuKey_t>(&key);
+		k->sequence = seq;
+		k->ranges = ranges;
+		for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+		{
+			k->raw[i] = sample[i];
+			last[i] = sample[i];
+		}
+		seq++;
+		sinceKey = 1;
+		(*encodedDataCallback)(&key);
+		return;
+	}
+
+	uint8_t tmp[3 * TELEMETRY_CHANNELS]; //worst case: 3 bytes per channel
+	uint8_t n = 0;
+	for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+		n += putVarint(&tmp[n], (int16_t)(sample[i] - last[i])); //wrapping 16-bit difference is decoded exactly
+
+	if((pending > 0) && (frame.size + n > _SBRCP_MAX_PAYLOAD_SIZE)) //sample doesn't fit into this packet
+		flush();
+
+	if(pending == 0) //delta packet: |seq of the first sample|zigzag varint deltas...|
+	{
+		SBRCP_init<SBRCP_MpuDelta_t>(&frame, 1)->sequence = seq;
+	}
+	for(uint8_t i = 0; i < n; i++)
+		frame.payload[frame.size++] = tmp[i];
+	for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+		last[i] = sample[i];
+	pending++;
+	seq++;
+	sinceKey++;
+
+	if(pending >= batch)
+		flush();
+}
+
+int16_t TelemetryEncoder::accelToRaw(float acc, uint8_t range)
+{
+	return (int16_t)lroundf(acc / _GRAVITY_STANDARD * TelemetryDecoder::accelScale(range));
+}
+
+int16_t TelemetryEncoder::gyroToRaw(float gyro, uint8_t range)
+{
+	return (int16_t)lroundf(gyro / _DPS_TO_RADS * TelemetryDecoder::gyroScale(range));
+}
+
+
+
+EventEncoder::EventEncoder()
+{
+	seq = 0;
+	configure(0, 0, 0);
+}
+
+void EventEncoder::configure(uint16_t accelThreshold, uint16_t gyroThreshold, uint16_t maxSilence)
+{
+	this->accelThreshold = (accelThreshold ? accelThreshold : EVENT_ACCEL_THRESHOLD) * 0.001f;
+	this->gyroThreshold = (gyroThreshold ? gyroThreshold : EVENT_GYRO_THRESHOLD) * 0.001f;
+	this->maxSilence = (maxSilence ? maxSilence : EVENT_MAX_SILENCE) * 1000UL;
+	reset();
+}
+
+void EventEncoder::reset(void)
+{
+	started = false;
+}
+
+bool EventEncoder::push(const float *sample, uint32_t time, SBRCP_data_t *packet)
+{
+	uint8_t reason = 0;
+	if(!started)
+		reason = EVENT_START;
+	else
+	{
+		for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+		{
+			float threshold = (i < 3) ? accelThreshold : gyroThreshold;
+			if(fabsf(sample[i] - last[i]) > threshold)
+			{
+				reason = EVENT_CHANGE;
+				break;
+			}
+		}
+		if((uint32_t)(time - lastTime) >= maxSilence) //wrapping difference, micros() overflows every 71 minutes
+			reason |= EVENT_SILENCE;
+	}
+	if(reason == 0)
+		return false;
+	SBRCP_MpuEvent_t *e = SBRCP_init<SBRCP_MpuEvent_t>(packet);
+	e->robotTime = time;
+	e->sequence = seq;
+	e->reason = reason;
+	for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+		e->values[i] = sample[i];
+	return true;
+}
+
+void EventEncoder::sent(const SBRCP_data_t *packet)
+{
+	const SBRCP_MpuEvent_t *e = SBRCP_view<SBRCP_MpuEvent_t>(packet);
+	if(e == NULL)
+		return;
+	for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+		last[i] = e->values[i];
+	lastTime = e->robotTime;
+	seq++;
+	started = true;
+}
+
+
+
+TelemetryDecoder::TelemetryDecoder()
+{
+	nextSeq = 0;
+	ranges = 0;
+	synced = false;
+	lostPackets = 0;
+}
+
+uint8_t TelemetryDecoder::decode(SBRCP_data_t *data, int16_t *samples, uint8_t maxSamples)
+{
+	if(maxSamples == 0)
+		return 0;
+	const SBRCP_MpuKey_t *k = SBRCP_view<SBRCP_MpuKey_t>(data);
+	if(k != NULL)
+	{
+		ranges = k->ranges;
+		for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+		{
+			last[i] = k->raw[i];
+			samples[i] = last[i];
+		}
+		nextSeq = k->sequence + 1;
+		synced = true;
+		return 1;
+	}
+	const SBRCP_MpuDelta_t *delta = SBRCP_view<SBRCP_MpuDelta_t>(data);
+	if((delta == NULL) || (data->size < 2))
+		return 0;
+	if(!synced || delta->sequence != nextSeq) //a packet was lost, wait for the next keyframe
+	{
+		synced = false;
+		lostPackets++;
+		return 0;
+	}
+
+	uint8_t count = 0;
+	uint8_t channel = 0;
+	uint16_t v = 0;
+	uint8_t shift = 0;
+	int16_t sample[TELEMETRY_CHANNELS];
+	for(uint8_t i = 0; i + 1 < data->size; i++)
+	{
+		v |= (uint16_t)(delta->deltas[i] & 0x7F) << shift;
+		if(delta->deltas[i] & 0x80) //more bytes follow
+		{
+			shift += 7;
+			if(shift > 14) //corrupted varint
+				break;
+			continue;
+		}
+		sample[channel] = (int16_t)(last[channel] + (int16_t)((v >> 1) ^ -(v & 1))); //undo zigzag and add delta
+		v = 0;
+		shift = 0;
+		if(++channel == TELEMETRY_CHANNELS)
+		{
+			for(uint8_t j = 0; j < TELEMETRY_CHANNELS; j++)
+			{
+				last[j] = sample[j];
+				samples[count * TELEMETRY_CHANNELS + j] = sample[j];
+			}
+			channel = 0;
+			if(++count == maxSamples)
+				break;
+		}
+	}
+	if(channel != 0 || shift != 0 || count == 0) //packet ends in the middle of a sample
+	{
+		synced = false;
+		lostPackets++;
+		return count;
+	}
+	nextSeq += count;
+	return count;
+}
+
+uint32_t TelemetryDecoder::getLostPackets(void)
+{
+	return lostPackets;
+}
+
+void TelemetryDecoder::toSI(const int16_t *raw, float *si)
+{
+	float a = _GRAVITY_STANDARD / accelScale(ranges & 0x0F);
+	float g = _DPS_TO_RADS / gyroScale(ranges >> 4);
+	si[0] = raw[0] * a;
+	si[1] = raw[1] * a;
+	si[2] = raw[2] * a;
+	si[3] = raw[3] * g;
+	si[4] = raw[4] * g;
+	si[5] = raw[5] * g;
+}
+
+float TelemetryDecoder::accelScale(uint8_t range)
+{
+	//MPU6050_RANGE_2_G, MPU6050_RANGE_4_G, MPU6050_RANGE_8_G, MPU6050_RANGE_16_G
+	static const float scale[4] = {16384.f, 8192.f, 4096.f, 2048.f};
+	return scale[range & 0x03];
+}
+
+float TelemetryDecoder::gyroScale(uint8_t range)
+{
+	//MPU6050_RANGE_250_DEG, MPU6050_RANGE_500_DEG, MPU6050_RANGE_1000_DEG, MPU6050_RANGE_2000_DEG
+	static const float scale[4] = {131.f, 65.5f, 32.8f, 16.4f};
+	return scale[range & 0x03];
+}
\ No newline at end of file
@@ -0,0 +1,175 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file TelemetryCodec.h
+* \brief Compressed MPU6050 telemetry (keyframes + zigzag/varint coded deltas) and send-on-delta event telemetry
+* \copyright GNU GPLv3
+**/
+
+#ifndef TELEMETRYCODEC_H_
+#define TELEMETRYCODEC_H_
+#include <stdint.h>
+#include "SBRCP.h"
+
+#define TELEMETRY_CHANNELS 6 //accelerometer X, Y, Z, gyroscope X, Y, Z
+#define _TELEMETRY_KEYFRAME_INTERVAL 50 //default number of samples between keyframes (resync period)
+#define _TELEMETRY_MAX_BATCH 4 //maximum number of samples in a delta packet (at least 6 bytes per sample)
+
+#define _GRAVITY_STANDARD 9.80665f //m/s^2 per g, same as SENSORS_GRAVITY_STANDARD
+#define _DPS_TO_RADS 0.017453293f //same as SENSORS_DPS_TO_RADS
+
+class TelemetryEncoder
+{
+private:
+	void (*encodedDataCallback)(SBRCP_data_t*); //callback function to be called when a packet is ready
+	SBRCP_data_t frame; //delta packet being assembled
+	int16_t last[TELEMETRY_CHANNELS]; //last encoded sample
+	uint8_t seq; //sequence number of the next sample
+	uint8_t sinceKey; //samples encoded since the last keyframe
+	uint8_t keyInterval; //samples between keyframes
+	uint8_t batch; //samples per delta packet
+	uint8_t pending; //samples in the delta packet being assembled
+	uint8_t ranges; //accelerometer range (low nibble) and gyroscope range (high nibble)
+	void flush(void);
+public:
+	/**
+	* \brief Encoder initializer
+	* \param[in] *callback Pointer to the function that should be called when a packet is ready to be sent
+	**/
+	TelemetryEncoder(void (*callback)(SBRCP_data_t*));
+	/**
+	* \brief Sets encoder parameters and forces a keyframe
+	* \param[in] batch Samples per delta packet (1 to _TELEMETRY_MAX_BATCH). 1 sends every sample immediately.
+	* \param[in] keyInterval Samples between keyframes
+	**/
+	void configure(uint8_t batch, uint8_t keyInterval);
+	/**
+	* \brief Sets sensor ranges sent in keyframes and forces a keyframe
+	* \param[in] accelRange Accelerometer range (mpu6050_accel_range_t value)
+	* \param[in] gyroRange Gyroscope range (mpu6050_gyro_range_t value)
+	**/
+	void setRanges(uint8_t accelRange, uint8_t gyroRange);
+	/**
+	* \brief Drops the packet being assembled and forces a keyframe
+	**/
+	void reset(void);
+	/**
+	* \brief Encodes a sample and calls the callback function for every finished packet
+	* \param[in] *sample Raw sensor values (TELEMETRY_CHANNELS elements)
+	**/
+	void push(const int16_t *sample);
+	/**
+	* \brief Converts acceleration to raw sensor value
+	* \param[in] acc Acceleration in m/s^2
+	* \param[in] range Accelerometer range (mpu6050_accel_range_t value)
+	* \return Raw sensor value
+	**/
+	static int16_t accelToRaw(float acc, uint8_t range);
+	/**
+	* \brief Converts angular rate to raw sensor value
+	* \param[in] gyro Angular rate in rad/s
+	* \param[in] range Gyroscope range (mpu6050_gyro_range_t value)
+	* \return Raw sensor value
+	**/
+	static int16_t gyroToRaw(float gyro, uint8_t range);
+};
+
+//send-on-delta telemetry: a sample is sent only if a channel moved away from the last sent value by more than its threshold,
+//or if nothing was sent for the maximum silence, so the host can hold the last value until the next packet
+class EventEncoder
+{
+private:
+	float last[TELEMETRY_CHANNELS]; //last sent sample
+	float accelThreshold; //in m/s^2
+	float gyroThreshold; //in rad/s
+	uint32_t maxSilence; //in microseconds
+	uint32_t lastTime; //robot time of the last sent sample
+	uint8_t seq; //sequence number of the next packet
+	bool started; //a sample was sent since the last reset
+public:
+	EventEncoder();
+	/**
+	* \brief Sets encoder parameters, the next sample is sent with EVENT_START
+	* \param[in] accelThreshold Accelerometer threshold in mm/s^2, 0 for EVENT_ACCEL_THRESHOLD
+	* \param[in] gyroThreshold Gyroscope threshold in mrad/s, 0 for EVENT_GYRO_THRESHOLD
+	* \param[in] maxSilence Maximum time without a packet in milliseconds, 0 for EVENT_MAX_SILENCE
+	**/
+	void configure(uint16_t accelThreshold, uint16_t gyroThreshold, uint16_t maxSilence);
+	/**
+	* \brief Forgets the last sent sample, the next sample is sent with EVENT_START
+	**/
+	void reset(void);
+	/**
+	* \brief Checks a sample and builds a DATA_MPU_EVENT packet if it has to be sent.
+	* The last sent sample is updated by sent(), so a packet that couldn't be sent is tried again with the next sample.
+	* \param[in] *sample Acceleration in m/s^2 and angular rate in rad/s (TELEMETRY_CHANNELS values)
+	* \param[in] time Robot time of the reading in microseconds
+	* \param[out] *packet Packet to send
+	* \return True if the packet should be sent
+	**/
+	bool push(const float *sample, uint32_t time, SBRCP_data_t *packet);
+	/**
+	* \brief Takes a packet built by push() as sent
+	* \param[in] *packet Sent packet
+	**/
+	void sent(const SBRCP_data_t *packet);
+};
+
+class TelemetryDecoder
+{
+private:
+	int16_t last[TELEMETRY_CHANNELS]; //last decoded sample
+	uint8_t nextSeq; //expected sequence number of the next sample
+	uint8_t ranges; //sensor ranges from the last keyframe
+	bool synced; //true if a keyframe was received and no sample was lost since
+	uint32_t lostPackets; //number of delta packets dropped because of a sequence gap or corruption
+public:
+	TelemetryDecoder();
+	/**
+	* \brief Decodes a DATA_MPU_KEY or DATA_MPU_DELTA packet
+	* \param[in] *data Received packet
+	* \param[out] *samples Raw samples, TELEMETRY_CHANNELS values per sample
+	* \param[in] maxSamples Size of the samples buffer (in samples), should be at least _TELEMETRY_MAX_BATCH
+	* \return Number of decoded samples. 0 if the packet was dropped (decoder waits for the next keyframe).
+	**/
+	uint8_t decode(SBRCP_data_t *data, int16_t *samples, uint8_t maxSamples);
+	/**
+	* \brief Gets the number of delta packets dropped because of a sequence gap or corruption
+	**/
+	uint32_t getLostPackets(void);
+	/**
+	* \brief Converts a raw sample to SI units using ranges from the last keyframe
+	* \param[in] *raw Raw sample (TELEMETRY_CHANNELS values)
+	* \param[out] *si Acceleration in m/s^2 and angular rate in rad/s (TELEMETRY_CHANNELS values)
+	**/
+	void toSI(const int16_t *raw, float *si);
+	/**
+	* \brief Gets accelerometer scale
+	* \param[in] range Accelerometer range (mpu6050_accel_range_t value)
+	* \return Raw value per g
+	**/
+	static float accelScale(uint8_t range);
+	/**
+	* \brief Gets gyroscope scale
+	* \param[in] range Gyroscope range (mpu6050_gyro_range_t value)
+	* \return Raw value per deg/s
+	**/
+	static float gyroScale(uint8_t range);
+};
+#endif
\ No newline at end of file
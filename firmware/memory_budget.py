@@ -0,0 +1,225 @@
+# -*- coding: utf-8 -*-
+#
+# Description:  firmware memory budget: flash and RAM of every module from the linker map file, the largest stack frames
+#               (-fstack-usage) and the heap; fails the build if the static RAM doesn't leave the stack reserve free
+# License:      GPLv3
+# File:         memory_budget.py
+#
+# Usage:        run by PlatformIO after linking (extra_scripts in platformio.ini), so a firmware that doesn't fit is never uploaded
+#               python3 memory_budget.py .pio/build/uno/firmware.map [--flash 32256] [--ram 2048] [--reserve 512] [--static]
+
+import argparse
+import glob
+import os
+import re
+import sys
+
+FLASH_SIZE = 32256          # ATmega328P flash without the bootloader
+RAM_SIZE = 2048
+RAM_RESERVE = 512           # bytes kept free for the stack and the heap, DATA_MEMORY stackPeak plus a margin
+TOP_MODULES = 16            # modules listed, the rest is summed up
+TOP_FRAMES = 8              # stack frames listed
+FLASH_SECTIONS = ('.text', '.data')     # .data initial values are stored in flash
+RAM_SECTIONS = ('.data', '.bss', '.noinit')
+TOOLCHAIN_LIBRARIES = ('gcc', 'c', 'm', 'stdc++', 'supc++')
+
+ARCHIVE_HEADERS = ('Archive member included to satisfy reference by file (symbol)', 'Archive member included because of file (symbol)')
+MAP_HEADER = 'Linker script and memory map'
+OUTPUT_SECTION = re.compile(r'^(\.\S+)(?:\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+))?')
+INPUT_SECTION = re.compile(r'^ (\S+)(?:\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(.+))?$')
+INPUT_CONTINUATION = re.compile(r'^\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(.+)$')
+ARCHIVE_MEMBER = re.compile(r'^(.+?\.a\(.+?\))(?:\s+(.+) \((.+)\))?$')
+REFERENCE = re.compile(r'^\s+(.+) \((.+)\)$')
+STACK_USAGE = re.compile(r'^(.*?):(\d+):(\d+):(.*)$')
+
+
+def module_name(path, build_dir):
+    """
+    Module of an input file: 'src/main.cpp' for sources, 'SBRCP/TelemetryCodec.cpp' for library and framework members,
+    'libgcc' for the toolchain libraries
+    """
+    member = re.match(r'^(.*)\((.*)\)$', path)
+    if member:
+        archive = os.path.basename(member.group(1))
+        name = archive[3:-2] if archive.startswith('lib') and archive.endswith('.a') else archive
+        if name in TOOLCHAIN_LIBRARIES:
+            return 'lib' + name
+        return '{}/{}'.format(name, re.sub(r'\.o$', '', member.group(2)))
+    path = os.path.normpath(path)
+    if build_dir and os.path.abspath(path).startswith(os.path.abspath(build_dir) + os.sep):
+        parts = os.path.relpath(os.path.abspath(path), os.path.abspath(build_dir)).split(os.sep)
+        return re.sub(r'\.o$', '', '/'.join(parts[-2:]))
+    return re.sub(r'\.o$', '', os.path.basename(path))
+
+
+def parse_map(path, build_dir=None):
+    """
+    Read a GNU ld map file
+    :param path: map file
+    :param build_dir: object files under it are named by their path relative to it
+    :return: {module: [flash, RAM]} in bytes, {output section: size} and {archive member: (needed by, symbol)}
+    """
+    modules = {}
+    sections = {}
+    members = {}
+    part = None
+    output = None
+    pending = None          # input section whose address and size are on the next line
+    member = None
+    with open(path, errors='replace') as f:
+        for line in f:
+            line = line.rstrip('\n')
+            if line in ARCHIVE_HEADERS:
+                part = 'archive'
+                continue
+            if line == MAP_HEADER:
+                part = 'map'
+                continue
+            if part == 'archive':
+                if line and not line[0].isspace():
+                    m = ARCHIVE_MEMBER.match(line)
+                    if m is None:               # next part of the file
+                        part = None
+                        continue
+                    member = m.group(1)
+                    if m.group(2):
+                        members[member] = (m.group(2), m.group(3))
+                elif member is not None:
+                    m = REFERENCE.match(line)
+                    if m:
+                        members[member] = (m.group(1), m.group(2))
+                    member = None
+                continue
+            if part != 'map' or not line:
+                continue
+            if not line[0].isspace():           # output section
+                m = OUTPUT_SECTION.match(line)
+                output = m.group(1) if m else None
+                if m and m.group(3) and output in FLASH_SECTIONS + RAM_SECTIONS:
+                    sections[output] = sections.get(output, 0) + int(m.group(3), 16)
+                pending = None
+                continue
+            if output not in FLASH_SECTIONS + RAM_SECTIONS:
+                continue
+            m = INPUT_SECTION.match(line)
+            if m and not m.group(1).startswith('0x'):
+                if m.group(1).startswith('*'):     # *fill* and linker script patterns
+                    pending = None
+                    continue
+                if m.group(2) is None:
+                    pending = m.group(1)
+                    continue
+                size, file = int(m.group(3), 16), m.group(4)
+            elif pending is not None and INPUT_CONTINUATION.match(line):
+                m = INPUT_CONTINUATION.match(line)
+                size, file = int(m.group(2), 16), m.group(3)
+            else:                               # symbol or assignment
+                continue
+            pending = None
+            if size == 0:
+                continue
+            sizes = modules.setdefault(module_name(file.strip(), build_dir), [0, 0])
+            if output in FLASH_SECTIONS:
+                sizes[0] += size
+            if output in RAM_SECTIONS:
+                sizes[1] += size
+    return modules, sections, members
+
+
+def parse_stack_usage(directory):
+    """
+    Read the -fstack-usage files (*.su) under a directory
+    :return: list of (bytes, function, location, qualifier), largest first
+    """
+    frames = []
+    for path in glob.glob(os.path.join(directory, '**', '*.su'), recursive=True):
+        with open(path, errors='replace') as f:
+            for line in f:
+                fields = line.rstrip('\n').split('\t')
+                m = STACK_USAGE.match(fields[0])
+                if len(fields) < 3 or m is None:
+                    continue
+                location = '{}:{}'.format(os.path.basename(m.group(1)), m.group(2))
+                frames.append((int(fields[1]), m.group(4), location, fields[2]))
+    return sorted(frames, reverse=True)
+
+
+def report(map_path, flash_size=FLASH_SIZE, ram_size=RAM_SIZE, reserve=RAM_RESERVE, static=False, build_dir=None):
+    """
+    Print the memory report
+    :param static: static allocation mode, malloc() must not be linked
+    :return: True if the firmware fits
+    """
+    build_dir = build_dir or os.path.dirname(os.path.abspath(map_path))
+    modules, sections, members = parse_map(map_path, build_dir)
+    flash = sum(sections.get(s, 0) for s in FLASH_SECTIONS)
+    ram = sum(sections.get(s, 0) for s in RAM_SECTIONS)
+    print('Memory budget{}: flash {} of {} B ({:.1f} %), static RAM {} of {} B ({:.1f} %)'.format(
+        ' (static allocation)' if static else '', flash, flash_size, 100. * flash / flash_size, ram, ram_size, 100. * ram / ram_size))
+    ordered = sorted(modules.items(), key=lambda m: (m[1][1] * 16 + m[1][0]), reverse=True)    # RAM is the scarce one
+    print('  {:<48} {:>7} {:>6}'.format('module', 'flash', 'RAM'))
+    for name, (f, r) in ordered[:TOP_MODULES]:
+        print('  {:<48} {:>7} {:>6}'.format(name, f, r))
+    rest = ordered[TOP_MODULES:]
+    if rest:
+        print('  {:<48} {:>7} {:>6}'.format('{} more modules'.format(len(rest)), sum(m[1][0] for m in rest), sum(m[1][1] for m in rest)))
+    other = (flash - sum(m[1][0] for m in ordered), ram - sum(m[1][1] for m in ordered))
+    if other != (0, 0):
+        print('  {:<48} {:>7} {:>6}'.format('fill and linker-generated', other[0], other[1]))
+
+    fits = True
+    free = ram_size - ram
+    if flash > flash_size:
+        print('FLASH BUDGET EXCEEDED by {} B'.format(flash - flash_size))
+        fits = False
+    if free < reserve:
+        print('RAM BUDGET EXCEEDED: {} B left for the stack and the heap, {} B reserved'.format(free, reserve))
+        fits = False
+    else:
+        print('RAM left for the stack and the heap: {} B, {} B reserved, {} B spare'.format(free, reserve, free - reserve))
+
+    malloc = [m for m in members if re.search(r'\(malloc\.o\)$', m)]
+    if malloc:
+        needed_by, symbol = members[malloc[0]]
+        print('Heap: malloc() linked, needed by {} ({})'.format(module_name(needed_by, build_dir), symbol))
+        if static:
+            print('STATIC ALLOCATION BROKEN: something allocates from the heap')
+            fits = False
+    else:
+        print('Heap: malloc() not linked')
+
+    frames = parse_stack_usage(build_dir)
+    if frames:
+        print('Largest stack frames (bytes, function, location), the call chain adds them up:')
+        for size, function, location, qualifier in frames[:TOP_FRAMES]:
+            print('  {:>5} {} ({}{})'.format(size, function, location, '' if qualifier == 'static' else ', ' + qualifier))
+    return fits
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Firmware memory budget from a GNU ld map file')
+    parser.add_argument('map', help='linker map file (-Wl,-Map)')
+    parser.add_argument('--flash', type=int, default=FLASH_SIZE, help='flash size in bytes')
+    parser.add_argument('--ram', type=int, default=RAM_SIZE, help='RAM size in bytes')
+    parser.add_argument('--reserve', type=int, default=RAM_RESERVE, help='bytes that must stay free for the stack and the heap')
+    parser.add_argument('--static', action='store_true', help='static allocation mode, fail if malloc() is linked')
+    parser.add_argument('--build-dir', help='directory with the object and .su files (default: the map file directory)')
+    args = parser.parse_args()
+    return 0 if report(args.map, args.flash, args.ram, args.reserve, args.static, args.build_dir) else 1
+
+
+def after_link(source, target, env):
+    board = env.BoardConfig()
+    static = any('_STATIC_ALLOCATION' in str(d) for d in env.get('CPPDEFINES', []))
+    fits = report(env.subst('$BUILD_DIR/${PROGNAME}.map'), int(board.get('upload.maximum_size', FLASH_SIZE)),
+                  int(board.get('upload.maximum_ram_size', RAM_SIZE)), int(env.GetProjectOption('custom_ram_reserve', RAM_RESERVE)),
+                  static, env.subst('$BUILD_DIR'))
+    return 0 if fits else 1     # a failing action stops the build before the upload
+
+
+if __name__ == '__main__':
+    sys.exit(main())
+else:                           # PlatformIO (SCons) extra script
+    Import('env')
+    env.Append(LINKFLAGS=['-Wl,-Map,${BUILD_DIR}/${PROGNAME}.map'])
+    env.AddPostAction('$BUILD_DIR/${PROGNAME}.elf', after_link)
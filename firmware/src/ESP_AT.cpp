@@ -23,7 +23,7 @@
 **/
 #include "ESP_AT.h"
 
-void ESP_AT::init(String ssid, String pass, String dstIP, String dstPort, String srcPort)
+void ESP_AT::init(const char *ssid, const char *pass, const char *dstIP, const char *dstPort, const char *srcPort)
 {
 	Serial.println("AT+CIPCLOSE"); //close existing connections
 	delay(30);
@@ -39,7 +39,7 @@ public:
 	* \param dstPort Destination port (as string)
 	* \param srcPort Source port (as string)
 	**/
-	void init(String ssid, String pass, String dstIP, String dstPort, String srcPort);
+	void init(const char *ssid, const char *pass, const char *dstIP, const char *dstPort, const char *srcPort);
 	/**
 	* \brief Sends data using WiFi
 	* \param *data Pointer to data
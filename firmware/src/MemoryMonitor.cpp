@@ -0,0 +1,131 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file MemoryMonitor.cpp
+* \brief SRAM usage: stack high-water mark by stack painting, heap and static data size, static pool for the static allocation mode
+* \copyright GNU GPLv3
+**/
+
+#include "MemoryMonitor.h"
+#include <Arduino.h>
+
+//avr-libc and linker symbols: the heap starts at __heap_start (end of .bss and .noinit) and grows up to the stack,
+//the stack grows down from __stack (RAMEND)
+extern uint8_t __heap_start, __stack;
+extern char *__brkval; //heap top, 0 until the first malloc()
+
+//fills the RAM between the static data and the top of the stack with MEMORY_PAINT right after reset, before the stack is used
+//(.init1 runs before the stack pointer setup and the .data and .bss initialization, so it must not use the stack)
+void memoryPaint(void) __attribute__((naked, used, section(".init1")));
+void memoryPaint(void)
+{
+	__asm volatile(
+		"	ldi r30, lo8(__heap_start)\n"
+		"	ldi r31, hi8(__heap_start)\n"
+		"	ldi r24, %0\n"
+		"	ldi r25, hi8(__stack)\n"
+		"	rjmp 2f\n"
+		"1:	st Z+, r24\n"
+		"2:	cpi r30, lo8(__stack)\n"
+		"	cpc r31, r25\n"
+		"	brlo 1b\n"
+		"	breq 1b\n"
+		:: "M"(MEMORY_PAINT));
+}
+
+#ifdef _STATIC_ALLOCATION
+//long-lived objects created with new (libraries allocate in begin()) are placed in a static pool counted in .bss, so the build-time
+//memory report covers them and malloc() is not linked; delete doesn't free anything, objects live until reset
+static uint8_t pool[_STATIC_POOL_SIZE];
+static uint16_t poolUsed = 0;
+static bool poolExhausted = false;
+
+void *operator new(size_t size)
+{
+	if(size > (size_t)(_STATIC_POOL_SIZE - poolUsed))
+	{
+		poolExhausted = true;
+		return NULL;
+	}
+	void *p = &pool[poolUsed];
+	poolUsed += size;
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *)
+{
+}
+
+void operator delete[](void *)
+{
+}
+
+void operator delete(void *, size_t)
+{
+}
+
+void operator delete[](void *, size_t)
+{
+}
+#endif
+
+static uint8_t *heapTop(void)
+{
+	return (__brkval != 0) ? (uint8_t*)__brkval : &__heap_start;
+}
+
+void memoryUsage(MemoryUsage_t *u)
+{
+	uint8_t *start = heapTop();
+	uint8_t *p = start;
+	while((p <= &__stack) && (*p == MEMORY_PAINT))
+		p++;
+	u->ramSize = RAMEND - RAMSTART + 1;
+	u->staticSize = (uintptr_t)&__heap_start - RAMSTART;
+	u->stackPeak = (uintptr_t)&__stack - (uintptr_t)p + 1;
+	u->unusedMin = p - start;
+#ifdef _STATIC_ALLOCATION
+	u->heapSize = poolUsed;
+	u->staticAllocation = true;
+	u->poolExhausted = poolExhausted;
+#else
+	u->heapSize = start - &__heap_start;
+	u->staticAllocation = false;
+	u->poolExhausted = false;
+#endif
+}
+
+void memoryRepaint(void)
+{
+	//an interrupt only writes below the stack pointer while this code doesn't run, so the area below it is free
+	uint8_t *end = (uint8_t*)SP;
+	for(uint8_t *p = heapTop(); p < end; p++)
+		*p = MEMORY_PAINT;
+}
+
+uint16_t memoryFree(void)
+{
+	uint8_t top; //the current top of the stack
+	return (uintptr_t)&top - (uintptr_t)heapTop();
+}
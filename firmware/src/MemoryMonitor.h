@@ -0,0 +1,65 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file MemoryMonitor.h
+* \brief SRAM usage: stack high-water mark by stack painting, heap and static data size, static pool for the static allocation mode
+* \copyright GNU GPLv3
+**/
+
+#ifndef MEMORYMONITOR_H_
+#define MEMORYMONITOR_H_
+#include <stdint.h>
+#include <stddef.h>
+
+#define MEMORY_PAINT 0xC5 //pattern written to the free RAM at startup, bytes still holding it were never used by the stack or the heap
+
+#ifndef _STATIC_POOL_SIZE
+#define _STATIC_POOL_SIZE 48 //bytes for objects created with new in the static allocation mode (Adafruit MPU6050: I2C device and 3 sensor objects)
+#endif
+
+//memory usage in bytes
+typedef struct
+{
+	uint16_t ramSize; //SRAM size
+	uint16_t staticSize; //.data and .bss (static storage, incl. the static pool)
+	uint16_t heapSize; //heap in use, in the static allocation mode the static pool in use
+	uint16_t stackPeak; //deepest stack use since reset or memoryRepaint(), interrupts included
+	uint16_t unusedMin; //bytes between the heap and the deepest stack use that were never written
+	bool staticAllocation; //built with _STATIC_ALLOCATION
+	bool poolExhausted; //an allocation didn't fit into the static pool
+} MemoryUsage_t;
+
+/**
+* \brief Gets the current memory usage. Scans the painted area from the heap top upwards, up to 2 KB (about 0.5 ms at 16 MHz).
+* A stack byte that happens to hold MEMORY_PAINT is taken as unused, heap blocks freed below the heap top count as used.
+* \param[out] *u Memory usage
+**/
+void memoryUsage(MemoryUsage_t *u);
+
+/**
+* \brief Paints the free RAM between the heap and the current stack pointer again, so the next memoryUsage() gives the stack peak
+* since this call
+**/
+void memoryRepaint(void);
+
+/**
+* \brief Gets the current number of free bytes between the heap and the stack
+**/
+uint16_t memoryFree(void);
+#endif
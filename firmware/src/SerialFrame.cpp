@@ -25,11 +25,21 @@
 
 #include "SerialFrame.h"
 
-
-SerialFrame::SerialFrame(void (*callback)(uint8_t*, uint16_t))
+SerialFrame::SerialFrame(bool (*callback)(uint8_t*, uint16_t))
 {
 	parsedFrameCallback = callback;
 	len = 0;
+	overflows = 0;
+}
+
+uint16_t SerialFrame::getOverflows(void)
+{
+	return overflows;
+}
+
+void SerialFrame::reset(void)
+{
+	len = 0;
 }
 
 void SerialFrame::parseRawData(SerialFrame_type type)
@@ -45,6 +55,7 @@ void SerialFrame::parseRawData(SerialFrame_type type)
 		if(len == _RAW_DATA_BUFFER_SIZE) 
 		{
 			len = 0; //buffer overflow
+			overflows++;
 		}
 		if(type == bluetooth)
 		{
@@ -52,9 +63,10 @@ void SerialFrame::parseRawData(SerialFrame_type type)
 			{
 				for(uint8_t j = 0; j < len; j++) //look for frame type byte
 				{
-					if(data[j] == DATA_CMD_RATE || data[j] == DATA_CMD_MOTORS) //correct frames must begin with any of these bytes
+					if(SBRCP_isPcToRobot(data[j])) //correct frames must begin with any of these bytes
 					{
-						(*parsedFrameCallback)(&data[j], len - j); //if found, call the callback function
+						if((*parsedFrameCallback)(&data[j], len - j)) //if found, call the callback function
+							break; //a valid frame ends the search, later type bytes are part of its payload
 					}
 				}			
 				//there can be more consecutive frames
@@ -90,7 +102,7 @@ void SerialFrame::parseRawData(SerialFrame_type type)
 			}		
 			for(; i < len; i++) //look for frames
 			{
-				if(data[i] == DATA_CMD_RATE || data[i] == DATA_CMD_MOTORS) //correct frames must begin with any of these bytes
+				if(SBRCP_isPcToRobot(data[i])) //correct frames must begin with any of these bytes
 				{
 					for(uint16_t j = i + 1; j < len - 2; j++) //and must also end with LF-CR
 					{
@@ -43,19 +43,28 @@ class SerialFrame
 private:
 	uint8_t data[_RAW_DATA_BUFFER_SIZE]; //raw received data buffer
 	uint16_t len; //buffer length
+	uint16_t overflows; //buffer overflows (wraps around)
 	
-	void (*parsedFrameCallback)(uint8_t*, uint16_t); //callback function for received frames
+	bool (*parsedFrameCallback)(uint8_t*, uint16_t); //callback function for received frames, returns true for a valid frame
 	
 public:
 	/**
 	* \brief Library initializer
-	* \param[in] *callback Pointer to a callback function that handles received frames
+	* \param[in] *callback Pointer to a callback function that handles received frames and returns true for valid ones
 	**/
-	SerialFrame(void (*callback)(uint8_t*, uint16_t));
+	SerialFrame(bool (*callback)(uint8_t*, uint16_t));
 	/**
 	* \brief Parses raw incoming data from Serial object
 	* \attention Must be executed in the main loop
 	**/
 	void parseRawData(SerialFrame_type type);
+	/**
+	* \brief Gets the number of raw data buffer overflows
+	**/
+	uint16_t getOverflows(void);
+	/**
+	* \brief Drops buffered data, e.g. bytes received at the previous baud rate
+	**/
+	void reset(void);
 };
 #endif
\ No newline at end of file
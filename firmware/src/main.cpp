@@ -30,12 +30,27 @@
 #include "SBRCP.h"
 #include "SerialFrame.h"
 #include "ESP_AT.h"
+#include "TelemetryCodec.h"
+#include "MemoryMonitor.h"
+
+#define _FIRMWARE_VERSION_MAJOR 1 //firmware version sent in DATA_HELLO
+#define _FIRMWARE_VERSION_MINOR 8
 
 #define _DATA_INTERVAL_US 5000000 //inital MPU data rate in microseconds (at least 5000). Can be changed by a command.
+#define _MIN_DATA_INTERVAL_US 5000 //minimum MPU data rate in microseconds for full (uncompressed) telemetry
+#define _MIN_COMPRESSED_INTERVAL_US 2000 //minimum MPU data rate in microseconds for compressed and event telemetry
+#define _MIN_STATS_INTERVAL_MS 100 //minimum interval of periodic statistics packets in milliseconds
+#define _SERIAL_BAUD 115200 //initial serial baud rate, a faster one can be negotiated by the PC (DATA_CMD_BAUD)
+#define _MAX_BAUD_ERROR_PERCENT 3 //baud rates the UART can't generate more accurately are refused (115200 is 2.1 % off at 16 MHz)
+#define _MAX_BAUD_PROBE_ERRORS 2 //CRC errors after a baud rate switch that make the robot fall back before BAUD_PROBE_TIMEOUT
 
 
 //#define _CONNECTION_WIFI //connection using ESP32 WiFi
 
+//_STATIC_ALLOCATION (build flag, set by the uno_static environment in platformio.ini) places all long-lived objects in static storage:
+//the motors are global objects and library allocations go to the static pool of MemoryMonitor.cpp, so the heap isn't used
+//and the build-time memory report (memory_budget.py) accounts for every object
+
 #define _SSID "sbr" //WiFi AP SSID
 #define _PASS "pass123456789" //AP password, at least 8 characters
 #define _DEST_IP "192.168.4.2" //destination IP. Source IP is always 192.168.4.1
@@ -57,15 +72,9 @@
 #define PWMA 6
 #define PWMB 3
 
-//serial protocol error definitions
-#define ERROR_OTHER 0x00
-#define ERROR_MPU_INIT 0x01
-#define ERROR_MPU_READ 0x02
-#define ERROR_ILLEGAL_CMD 0x03
-
 
 
-#if (_DATA_INTERVAL_US < 5000)
+#if (_DATA_INTERVAL_US < _MIN_DATA_INTERVAL_US)
 #error MPU rate must be at least 5000us
 #endif
 
@@ -73,128 +82,496 @@
 Adafruit_MPU6050 mpu; //MPU6050 object
 uint32_t nextDataTimerTick = 0; //software timer counter for data
 uint32_t dataTimerInterval = _DATA_INTERVAL_US;
+uint8_t telemetryMode = TELEMETRY_FULL; //telemetry mode, can be changed by a command
+uint8_t accelRange = MPU6050_RANGE_4_G; //accelerometer range. Possible values are 2, 4, 8 and 16 G. Can be changed by a command.
+uint8_t gyroRange = MPU6050_RANGE_500_DEG; //gyroscope range (250, 500, 1000 or 2000 deg). Can be changed by a command.
+uint8_t filterBandwidth = MPU6050_BAND_21_HZ; //filter bandwidth (5, 10, 21, 44, 94, 184 or 260 Hz). Can be changed by a command.
+uint16_t statsInterval = 0; //statistics packet interval in milliseconds, 0 if sent only on request. Can be changed by a command.
+uint32_t nextStatsTick = 0; //software timer counter for statistics
+
+//runtime statistics, counters wrap around, loop timing is reset after every statistics packet
+uint16_t loopMax = 0; //longest loop() duration in microseconds
+uint32_t loopSum = 0; //sum of loop() durations in microseconds
+uint16_t loopCount = 0; //number of loop() runs
+uint16_t txDropped = 0; //telemetry packets dropped because the serial TX buffer was full
+uint16_t mpuFailures = 0; //failed MPU6050 reads
+uint16_t freeMemoryMin = 0xFFFF; //free SRAM low-water mark in bytes
+uint16_t motorCommands = 0; //sequenced motor commands received
+uint16_t staleMotors = 0; //sequenced motor commands dropped as stale or replaced by a newer one before being applied
+uint16_t duplicateCommands = 0; //reliable command retransmissions not applied again
+
+//reliable delivery, sequence numbers are accepted unless they are up to SEQ_WINDOW behind the last one (duplicates, stale)
+uint16_t lastCommandSeq = 0; //last applied reliable command
+bool commandSeqValid = false;
+uint16_t lastMotorSeq = 0; //last accepted sequenced motor command
+bool motorSeqValid = false;
+bool motorsPending = false; //the latest motor command is applied once per loop, after all received frames are parsed
+int16_t pendingMotorA = 0, pendingMotorB = 0;
+
+//baud rate negotiation, a switch is pending until the PC commits it
+uint32_t serialBaud = _SERIAL_BAUD; //current baud rate
+uint32_t fallbackBaud = _SERIAL_BAUD; //last committed baud rate, restored if the pending switch fails
+bool baudPending = false;
+uint32_t baudSwitchTime = 0; //millis() at the switch
+uint16_t baudCrcErrors = 0; //CRC error counter at the switch
 
 
 void parseRxData(SBRCP_data_t *data);
-void parseRxFrame(uint8_t *, uint16_t);
+bool parseRxFrame(uint8_t *, uint16_t);
+void sendPacket(SBRCP_data_t *data);
 
 
+#ifdef _STATIC_ALLOCATION
+//constructed before setup(), pinMode() and digitalWrite() work before the Arduino init()
+Motor motorAObject(AIN1, AIN2, PWMA);
+#ifdef _INVERT_ROTATION //rotation inversion, explained at the top of this file
+Motor motorBObject(BIN1, BIN2, PWMB);
+#else
+Motor motorBObject(BIN2, BIN1, PWMB);
+#endif
+Motor *motorA = &motorAObject, *motorB = &motorBObject;
+#else
 Motor *motorA, *motorB;
+#endif
 SBRCP protocol(&parseRxData);
 SerialFrame frameHandler(&parseRxFrame);
 ESP_AT esp;
+TelemetryEncoder encoder(&sendPacket);
+EventEncoder eventEncoder;
+
+/**
+ * \brief Updates the free SRAM low-water mark (space between the heap and the stack)
+ */
+void updateFreeMemory(void)
+{
+  uint16_t free = memoryFree();
+  if(free < freeMemoryMin)
+    freeMemoryMin = free;
+}
+
+/**
+ * \brief Converts packet to a frame and sends it to a PC
+ */
+void sendPacket(SBRCP_data_t *data)
+{
+  uint8_t buf[_SBRCP_MAX_PAYLOAD_SIZE + 4] = {0}; //frame buffer
+  uint8_t len = 0;
+  updateFreeMemory(); //the deepest point of every call chain
+  protocol.parseTx(data, buf, &len);
+#ifdef _CONNECTION_WIFI
+  uint8_t needed = len + 19; //"AT+CIPSEND=nn" and two CR-LF
+#else
+  uint8_t needed = len;
+#endif
+  //writing to a full TX buffer blocks until it has room and delays the loop, so telemetry is dropped instead
+  bool telemetry = (data->type == DATA_MPU) || (data->type == DATA_MPU_KEY) || (data->type == DATA_MPU_DELTA)
+                   || (data->type == DATA_MPU_TS) || (data->type == DATA_MPU_EVENT);
+  if(telemetry && (Serial.availableForWrite() < needed))
+  {
+    txDropped++;
+    return;
+  }
+#ifdef _CONNECTION_WIFI
+  esp.send(buf, len); //send packet
+#else
+  Serial.write(buf, len);
+#endif
+}
+
+/**
+ * \brief Sends error packet to a PC
+ */
+void sendError(uint8_t code)
+{
+  SBRCP_data_t t;
+  SBRCP_init<SBRCP_Error_t>(&t)->code = code;
+  sendPacket(&t);
+}
+
+/**
+ * \brief Sends firmware capabilities and current configuration to a PC
+ */
+void sendHello(void)
+{
+  SBRCP_data_t t;
+  SBRCP_Hello_t *hello = SBRCP_init<SBRCP_Hello_t>(&t);
+  hello->protocolVersion = SBRCP_PROTOCOL_VERSION;
+  hello->firmwareMajor = _FIRMWARE_VERSION_MAJOR;
+  hello->firmwareMinor = _FIRMWARE_VERSION_MINOR;
+  hello->features = FEATURE_COMPRESSED_TELEMETRY | FEATURE_SENSOR_CONFIG | FEATURE_STATS | FEATURE_PING | FEATURE_TIMESTAMPS
+                    | FEATURE_RELIABLE | FEATURE_MEMORY | FEATURE_EVENT_TELEMETRY;
+#ifdef _CONNECTION_WIFI
+  hello->connection = CONNECTION_WIFI;
+#else
+  hello->features |= FEATURE_BAUD; //the ESP32 UART rate is fixed
+  hello->connection = CONNECTION_SERIAL;
+#endif
+  hello->accelRange = accelRange;
+  hello->gyroRange = gyroRange;
+  hello->filterBandwidth = filterBandwidth;
+  hello->telemetryMode = telemetryMode;
+  hello->interval = dataTimerInterval;
+  hello->minInterval = _MIN_DATA_INTERVAL_US;
+  hello->minCompressedInterval = _MIN_COMPRESSED_INTERVAL_US;
+  hello->maxPayload = _SBRCP_MAX_PAYLOAD_SIZE;
+  hello->maxBatch = _TELEMETRY_MAX_BATCH;
+  sendPacket(&t);
+}
+
+/**
+ * \brief Sends runtime statistics to a PC and resets loop timing
+ */
+void sendStats(void)
+{
+  SBRCP_data_t t;
+  SBRCP_Stats_t *stats = SBRCP_init<SBRCP_Stats_t>(&t);
+  stats->uptime = millis();
+  stats->loopMax = loopMax;
+  stats->loopMean = (loopCount > 0) ? loopSum / loopCount : 0;
+  stats->loops = loopCount;
+  stats->frames = protocol.getFramesParsed();
+  stats->crcErrors = protocol.getCrcErrors();
+  stats->rxOverflows = frameHandler.getOverflows();
+  stats->txDropped = txDropped;
+  stats->mpuFailures = mpuFailures;
+  stats->freeSram = freeMemoryMin;
+  stats->motorCommands = motorCommands;
+  stats->staleMotors = staleMotors;
+  stats->duplicateCommands = duplicateCommands;
+  loopMax = 0;
+  loopSum = 0;
+  loopCount = 0;
+  sendPacket(&t);
+}
+
+/**
+ * \brief Applies sensor configuration to MPU6050
+ */
+void configureMPU(void)
+{
+  mpu.setAccelerometerRange((mpu6050_accel_range_t)accelRange);
+  mpu.setGyroRange((mpu6050_gyro_range_t)gyroRange);
+  mpu.setFilterBandwidth((mpu6050_bandwidth_t)filterBandwidth);
+  encoder.setRanges(accelRange, gyroRange); //ranges are sent in keyframes, so the PC can convert raw values
+}
 
 /**
  * \brief Reads MPU6050 data, converts it and sends to a PC
  */
 void readMPUdata(void)
 {
-  uint8_t buf[32] = {0}; //frame buffer
-  uint8_t len = 0;
   SBRCP_data_t t; //packet structure
   
   sensors_event_t a, g, temp; //special structures for mpu data
   if(mpu.getEvent(&a, &g, &temp) != true) //read data
   {
-    t.type = DATA_ERROR; //if read failed
-    t.payload[0] = ERROR_MPU_READ;
-    t.size = 1;
-    protocol.parseTx(&t, buf, &len);
-#ifdef _CONNECTION_WIFI
-    esp.send(buf, len); //send error packet
-#else
-    Serial.write(buf, len);
-#endif
+    mpuFailures++;
+    sendError(ERROR_MPU_READ); //if read failed
     return;
   }
+  uint32_t sampleTime = micros(); //for host clock synchronization in timestamped mode
 
-  t.type = DATA_MPU; //data type
+  if(telemetryMode == TELEMETRY_COMPRESSED) //convert data back to raw sensor values and pass it to the encoder
+  {
+    int16_t raw[TELEMETRY_CHANNELS];
+    raw[0] = TelemetryEncoder::accelToRaw(a.acceleration.x, accelRange);
+    raw[1] = TelemetryEncoder::accelToRaw(a.acceleration.y, accelRange);
+    raw[2] = TelemetryEncoder::accelToRaw(a.acceleration.z, accelRange);
+    raw[3] = TelemetryEncoder::gyroToRaw(g.gyro.x, gyroRange);
+    raw[4] = TelemetryEncoder::gyroToRaw(g.gyro.y, gyroRange);
+    raw[5] = TelemetryEncoder::gyroToRaw(g.gyro.z, gyroRange);
+    encoder.push(raw); //encoder calls sendPacket() for every finished packet
+    return;
+  }
 
-  uint32_t tmp = 0; //temporary variable for type conversion
-  memcpy(&tmp, &(a.acceleration.x), 4); //copy data to uint32_t type variable address to make bit manipulation possible
-  t.payload[0] = tmp & 0xFF; //copy data to the buffer
-  t.payload[1] = (tmp & 0xFF00) >> 8;
-  t.payload[2] = (tmp & 0xFF0000) >> 16;
-  t.payload[3] = (tmp & 0xFF000000) >> 24;
-  
-  memcpy(&tmp, &(a.acceleration.y), 4);
-  t.payload[4] = tmp & 0xFF;
-  t.payload[5] = (tmp & 0xFF00) >> 8;
-  t.payload[6] = (tmp & 0xFF0000) >> 16;
-  t.payload[7] = (tmp & 0xFF000000) >> 24;
-
-  memcpy(&tmp, &(a.acceleration.z), 4);
-  t.payload[8] = tmp & 0xFF;
-  t.payload[9] = (tmp & 0xFF00) >> 8;
-  t.payload[10] = (tmp & 0xFF0000) >> 16;
-  t.payload[11] = (tmp & 0xFF000000) >> 24;
-
-  memcpy(&tmp, &(g.gyro.x), 4);
-  t.payload[12] = tmp & 0xFF;
-  t.payload[13] = (tmp & 0xFF00) >> 8;
-  t.payload[14] = (tmp & 0xFF0000) >> 16;
-  t.payload[15] = (tmp & 0xFF000000) >> 24;
-
-  memcpy(&tmp, &(g.gyro.y), 4);
-  t.payload[16] = tmp & 0xFF;
-  t.payload[17] = (tmp & 0xFF00) >> 8;
-  t.payload[18] = (tmp & 0xFF0000) >> 16;
-  t.payload[19] = (tmp & 0xFF000000) >> 24;
-
-  memcpy(&tmp, &(g.gyro.z), 4);
-  t.payload[20] = tmp & 0xFF;
-  t.payload[21] = (tmp & 0xFF00) >> 8;
-  t.payload[22] = (tmp & 0xFF0000) >> 16;
-  t.payload[23] = (tmp & 0xFF000000) >> 24;
-
-  t.size = 24;
-
-  protocol.parseTx(&t, buf, &len);
+  float values[TELEMETRY_CHANNELS] = {a.acceleration.x, a.acceleration.y, a.acceleration.z, g.gyro.x, g.gyro.y, g.gyro.z};
+  if(telemetryMode == TELEMETRY_EVENT) //sampled at every tick, sent only on a change or after the maximum silence
+  {
+    if(!eventEncoder.push(values, sampleTime, &t))
+      return;
+    uint16_t dropped = txDropped;
+    sendPacket(&t);
+    if(txDropped == dropped) //a dropped packet is not taken as sent, the next sample tries again
+      eventEncoder.sent(&t);
+    return;
+  }
+  if(telemetryMode == TELEMETRY_TIMESTAMPED) //the same data preceded by the sample time
+  {
+    SBRCP_MpuTs_t *mpuData = SBRCP_init<SBRCP_MpuTs_t>(&t);
+    mpuData->robotTime = sampleTime;
+    for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+      mpuData->values[i] = values[i];
+  }
+  else
+  {
+    SBRCP_Mpu_t *mpuData = SBRCP_init<SBRCP_Mpu_t>(&t);
+    for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+      mpuData->values[i] = values[i];
+  }
+
+  sendPacket(&t);
+}
+
+/**
+ * \brief Checks if the UART can generate a baud rate, with the same divisor as HardwareSerial (double speed mode)
+ */
+bool isBaudSupported(uint32_t baud)
+{
+  if((baud < 9600) || (baud > F_CPU / 8))
+    return false;
+  uint32_t divisor = (F_CPU / 4 / baud - 1) / 2 + 1;
+  uint32_t actual = F_CPU / 8 / divisor;
+  uint32_t error = (actual > baud) ? actual - baud : baud - actual;
+  return error * 100 <= baud * _MAX_BAUD_ERROR_PERCENT;
+}
+
+/**
+ * \brief Changes the serial baud rate after the pending data is sent
+ */
+void switchBaud(uint32_t baud)
+{
+  Serial.flush();
+  Serial.end();
+  Serial.begin(baud);
+  serialBaud = baud;
+  frameHandler.reset(); //bytes received during the switch are garbage
+}
+
+//command handlers, called by parseRxData() with a payload of at least MIN_SIZE bytes
+
+//setting MPU rate
+void onCmdRate(const SBRCP_CmdRate_t *cmd, uint8_t)
+{
+  uint32_t minVal = ((telemetryMode == TELEMETRY_COMPRESSED) || (telemetryMode == TELEMETRY_EVENT)) ? _MIN_COMPRESSED_INTERVAL_US : _MIN_DATA_INTERVAL_US;
+  //the rate must be at least 5000 usec (2000 usec for compressed and event telemetry)
+  dataTimerInterval = (cmd->interval < minVal) ? minVal : cmd->interval;
+  eventEncoder.reset(); //the host drops samples at the old rate, so it gets the current values again
+}
+
+//setting motors' speeds
+void onCmdMotors(const SBRCP_CmdMotors_t *cmd, uint8_t)
+{
+  motorA->set(cmd->motorA);
+  motorB->set(cmd->motorB);
+}
+
+//true if a sequence number is within SEQ_WINDOW behind (or equal to) the last one
+bool isOldSequence(uint16_t seq, uint16_t last, bool valid)
+{
+  int16_t diff = (int16_t)(seq - last);
+  return valid && (diff <= 0) && (diff >= -(int16_t)SEQ_WINDOW);
+}
+
+//setting motors' speeds, latest wins: older commands (e.g. delayed in the ESP32 buffer) are dropped
+void onCmdMotorsSeq(const SBRCP_CmdMotorsSeq_t *cmd, uint8_t)
+{
+  motorCommands++;
+  if(isOldSequence(cmd->sequence, lastMotorSeq, motorSeqValid))
+  {
+    staleMotors++;
+    return;
+  }
+  if(motorsPending) //a newer command arrived in the same loop
+    staleMotors++;
+  lastMotorSeq = cmd->sequence;
+  motorSeqValid = true;
+  pendingMotorA = cmd->motorA;
+  pendingMotorB = cmd->motorB;
+  motorsPending = true;
+}
+
+//setting telemetry mode
+void onCmdTelemetry(const SBRCP_CmdTelemetry_t *cmd, uint8_t size)
+{
+  if(cmd->mode == TELEMETRY_COMPRESSED)
+  {
+    uint8_t batch = SBRCP_HAS(SBRCP_CmdTelemetry_t, batch, size) ? cmd->batch : 1; //optional samples per packet
+    uint8_t keyInterval = SBRCP_HAS(SBRCP_CmdTelemetry_t, keyInterval, size) ? cmd->keyInterval : _TELEMETRY_KEYFRAME_INTERVAL; //optional keyframe interval
+    encoder.configure(batch, keyInterval); //also forces a keyframe
+    telemetryMode = TELEMETRY_COMPRESSED;
+  }
+  else if(cmd->mode == TELEMETRY_EVENT)
+  {
+    uint16_t accelThreshold = SBRCP_HAS(SBRCP_CmdTelemetry_t, accelThreshold, size) ? cmd->accelThreshold : 0; //0 for the defaults
+    uint16_t gyroThreshold = SBRCP_HAS(SBRCP_CmdTelemetry_t, gyroThreshold, size) ? cmd->gyroThreshold : 0;
+    uint16_t maxSilence = SBRCP_HAS(SBRCP_CmdTelemetry_t, maxSilence, size) ? cmd->maxSilence : 0;
+    eventEncoder.configure(accelThreshold, gyroThreshold, maxSilence); //the next sample is sent in any case
+    telemetryMode = TELEMETRY_EVENT;
+  }
+  else
+  {
+    telemetryMode = (cmd->mode == TELEMETRY_TIMESTAMPED) ? TELEMETRY_TIMESTAMPED : TELEMETRY_FULL;
+    if(dataTimerInterval < _MIN_DATA_INTERVAL_US) //full packets don't fit into the link at compressed rates
+      dataTimerInterval = _MIN_DATA_INTERVAL_US;
+  }
+}
+
+//capabilities request, sent by every host on connect
+void onCmdHello(const SBRCP_CmdHello_t *, uint8_t)
+{
+  //a new host starts its sequence numbers at random, they must not be compared with those of the previous one
+  commandSeqValid = false;
+  motorSeqValid = false;
+  sendHello();
+}
+
+//setting sensor ranges and filter bandwidth
+void onCmdSensor(const SBRCP_CmdSensor_t *cmd, uint8_t size)
+{
+  uint8_t newAccelRange = (cmd->accelRange == SENSOR_UNCHANGED) ? accelRange : cmd->accelRange;
+  uint8_t newGyroRange = (SBRCP_HAS(SBRCP_CmdSensor_t, gyroRange, size) && cmd->gyroRange != SENSOR_UNCHANGED) ? cmd->gyroRange : gyroRange;
+  uint8_t newFilterBandwidth = (SBRCP_HAS(SBRCP_CmdSensor_t, filterBandwidth, size) && cmd->filterBandwidth != SENSOR_UNCHANGED)
+                               ? cmd->filterBandwidth : filterBandwidth;
+  if((newAccelRange > MPU6050_RANGE_16_G) || (newGyroRange > MPU6050_RANGE_2000_DEG) || (newFilterBandwidth > MPU6050_BAND_5_HZ))
+  {
+    sendError(ERROR_ILLEGAL_CMD);
+    return;
+  }
+  accelRange = newAccelRange;
+  gyroRange = newGyroRange;
+  filterBandwidth = newFilterBandwidth;
+  configureMPU();
+  sendHello(); //acknowledge with the new configuration
+}
+
+//statistics request, optionally with a new period
+void onCmdStats(const SBRCP_CmdStats_t *cmd, uint8_t size)
+{
+  if(SBRCP_HAS(SBRCP_CmdStats_t, interval, size))
+  {
+    statsInterval = cmd->interval;
+    if((statsInterval != 0) && (statsInterval < _MIN_STATS_INTERVAL_MS))
+      statsInterval = _MIN_STATS_INTERVAL_MS;
+    nextStatsTick = millis() + statsInterval;
+  }
+  sendStats(); //answer immediately, also acknowledges the new period
+}
+
+//round trip measurement, the token is echoed with the robot time
+void onCmdPing(const SBRCP_CmdPing_t *cmd, uint8_t size)
+{
+  SBRCP_data_t t;
+  SBRCP_Pong_t *pong = SBRCP_init<SBRCP_Pong_t>(&t);
+  pong->robotTime = micros();
+  pong->token = SBRCP_HAS(SBRCP_CmdPing_t, token, size) ? cmd->token : 0;
+  sendPacket(&t);
+}
+
+//baud rate negotiation: the robot answers a proposal at the current rate, switches and falls back to the last committed rate unless
+//the PC commits the new one within BAUD_PROBE_TIMEOUT
+void onCmdBaud(const SBRCP_CmdBaud_t *cmd, uint8_t size)
+{
+  SBRCP_data_t t;
+  SBRCP_Baud_t *answer = SBRCP_init<SBRCP_Baud_t>(&t, offsetof(SBRCP_Baud_t, pattern));
+  answer->baud = serialBaud;
+  answer->token = cmd->token;
+  if(cmd->action == BAUD_PROPOSE)
+  {
+    answer->baud = cmd->baud;
 #ifdef _CONNECTION_WIFI
-  esp.send(buf, len); //send packet
+    answer->status = BAUD_UNSUPPORTED;
 #else
-  Serial.write(buf, len);
+    answer->status = isBaudSupported(cmd->baud) ? BAUD_ACCEPTED : BAUD_UNSUPPORTED;
 #endif
+    sendPacket(&t);
+    if(answer->status != BAUD_ACCEPTED)
+      return;
+    if(!baudPending) //a proposal during probing falls back to the last committed rate as well
+      fallbackBaud = serialBaud;
+    switchBaud(cmd->baud);
+    baudPending = true;
+    baudSwitchTime = millis();
+    baudCrcErrors = protocol.getCrcErrors();
+  }
+  else if(cmd->action == BAUD_PROBE) //link test, full size frames in both directions
+  {
+    uint8_t length = size - offsetof(SBRCP_CmdBaud_t, pattern);
+    answer->status = BAUD_PROBED;
+    memcpy(answer->pattern, cmd->pattern, length);
+    t.size += length;
+    sendPacket(&t);
+  }
+  else if(cmd->action == BAUD_COMMIT)
+  {
+    answer->status = BAUD_NOT_PENDING; //a repeated commit whose answer was lost gets the current rate
+    if(baudPending && (cmd->baud == serialBaud))
+    {
+      baudPending = false;
+      answer->status = BAUD_COMMITTED;
+    }
+    sendPacket(&t);
+  }
+  else
+    sendError(ERROR_ILLEGAL_CMD);
+}
+
+//memory usage request, the stack peak covers everything since reset (or the last repaint) including interrupts
+void onCmdMemory(const SBRCP_CmdMemory_t *cmd, uint8_t size)
+{
+  MemoryUsage_t usage;
+  memoryUsage(&usage);
+  SBRCP_data_t t;
+  SBRCP_Memory_t *memory = SBRCP_init<SBRCP_Memory_t>(&t);
+  memory->ramSize = usage.ramSize;
+  memory->staticSize = usage.staticSize;
+  memory->heapSize = usage.heapSize;
+  memory->stackPeak = usage.stackPeak;
+  memory->unusedMin = usage.unusedMin;
+  memory->flags = (usage.staticAllocation ? MEMORY_STATIC_ALLOCATION : 0) | (usage.poolExhausted ? MEMORY_POOL_EXHAUSTED : 0);
+  sendPacket(&t);
+  if(SBRCP_HAS(SBRCP_CmdMemory_t, repaint, size) && cmd->repaint)
+    memoryRepaint();
+}
+
+void onCmdReliable(const SBRCP_CmdReliable_t *cmd, uint8_t size);
+
+//dispatch table generated from the message schema, every PC-to-robot message needs its handler
+const SBRCP_handler_t commandHandlers[] = {SBRCP_PC_TO_ROBOT(SBRCP_HANDLER)};
+
+//acknowledged command, applied once and acknowledged after its answer (if any)
+void onCmdReliable(const SBRCP_CmdReliable_t *cmd, uint8_t size)
+{
+  SBRCP_data_t t;
+  SBRCP_Ack_t *ack = SBRCP_init<SBRCP_Ack_t>(&t);
+  ack->sequence = cmd->sequence;
+  if(isOldSequence(cmd->sequence, lastCommandSeq, commandSeqValid)) //the acknowledgement was lost, the command is not applied again
+  {
+    duplicateCommands++;
+    ack->status = ACK_DUPLICATE;
+    sendPacket(&t);
+    return;
+  }
+  SBRCP_data_t inner;
+  inner.type = cmd->command;
+  inner.size = size - offsetof(SBRCP_CmdReliable_t, payload);
+  memcpy(inner.payload, cmd->payload, inner.size);
+  ack->status = ACK_REJECTED;
+  //a baud rate switch would make the acknowledgement unreadable
+  if((inner.type != DATA_CMD_RELIABLE) && (inner.type != DATA_CMD_BAUD) && SBRCP::dispatch(commandHandlers, sizeof(commandHandlers) / sizeof(commandHandlers[0]), &inner))
+  {
+    lastCommandSeq = cmd->sequence;
+    commandSeqValid = true;
+    ack->status = ACK_APPLIED;
+  }
+  sendPacket(&t);
 }
 
 //callback function for parsed packets
 void parseRxData(SBRCP_data_t *data)
 {
-    //check for command type
-    if(data->type == DATA_CMD_RATE) //command for setting MPU rate
-    {
-      uint32_t val = data->payload[0]; //read 32-bit value
-      val |= ((uint32_t)data->payload[1] << 8);
-      val |= ((uint32_t)data->payload[2] << 16);
-      val |= ((uint32_t)data->payload[3] << 24);
-
-      if(val < 5000) //the rate must be at least 5000 usec
-      {
-        val = 5000;
-      }
-      dataTimerInterval = val;
-    }
-    else if(data->type == DATA_CMD_MOTORS) //setting motors' speeds
-    {
-      int16_t val1 = data->payload[0]; //read 16-bit values
-      val1 |= (data->payload[1] << 8);
-      int16_t val2 = data->payload[2];
-      val2 |= (data->payload[3] << 8);
-      motorA->set(val1);
-      motorB->set(val2);
-    }
+  if(!SBRCP::dispatch(commandHandlers, sizeof(commandHandlers) / sizeof(commandHandlers[0]), data)) //unknown type or too short to be valid
+    sendError(ERROR_ILLEGAL_CMD);
 }
 
 //wrapper function to pass processed received frame to a protocol parser
-void parseRxFrame(uint8_t *data, uint16_t len)
+bool parseRxFrame(uint8_t *data, uint16_t len)
 {
-  protocol.parseRx(data, len);
+  return protocol.parseRx(data, len);
 }
 
 void setup()
 {
-  
-  
+#ifndef _STATIC_ALLOCATION
   motorA = new Motor(AIN1, AIN2, PWMA);
 
 #ifdef _INVERT_ROTATION //rotation inversion, explained at the top of this file
@@ -202,40 +579,29 @@ void setup()
 #else
   motorB = new Motor(BIN2, BIN1, PWMB);
 #endif
+#endif
 
 #ifdef _CONNECTION_WIFI
   Serial.begin(250000); 
   delay(3000);
   esp.init(_SSID, _PASS, _DEST_IP, _DEST_PORT, _SRC_PORT);
 #else
-  Serial.begin(115200); 
+  Serial.begin(_SERIAL_BAUD); 
 #endif
 
   if (!mpu.begin()) //try to initialize MPU6050
   {
-    uint8_t buf[5] = {0};
-    uint8_t len = 0;
-    SBRCP_data_t t;
-    t.type = DATA_ERROR;
-    t.payload[0] = ERROR_MPU_INIT;
-    t.size = 1;
-    protocol.parseTx(&t, buf, &len);
-#ifdef _CONNECTION_WIFI    
-    esp.send(buf, len); //send error packet
-#else
-  Serial.write(buf, len);
-#endif
+    sendError(ERROR_MPU_INIT); //send error packet
     while (1);;
   }
   
-  mpu.setAccelerometerRange(MPU6050_RANGE_4_G); //set accelerometer range. Possible values are 2, 4, 8 and 16 G
-  mpu.setGyroRange(MPU6050_RANGE_500_DEG); //set gyroscope range (250, 500, 1000 or 2000 deg)
-  mpu.setFilterBandwidth(MPU6050_BAND_21_HZ); //set filter bandwidth (5, 10, 21, 44, 94, 184 or 260 Hz)
+  configureMPU(); //set initial ranges and filter bandwidth
 }
 
 
 void loop() 
 {
+  uint32_t loopStart = micros();
   //simple software timer handling
   //the micros() timer overflows every ~70 minutes. We don't really need to worry about that, because nextTimerTick has the same type as micros() counter 
   //and they will overflow and wrap around 0 identically, so everything should be "in phase" all the time.
@@ -249,4 +615,31 @@ void loop()
 #else
   frameHandler.parseRawData(bluetooth);
 #endif
+  if(motorsPending)
+  {
+    motorsPending = false;
+    motorA->set(pendingMotorA);
+    motorB->set(pendingMotorB);
+  }
+  if(baudPending && (((millis() - baudSwitchTime) >= BAUD_PROBE_TIMEOUT)
+                     || ((uint16_t)(protocol.getCrcErrors() - baudCrcErrors) > _MAX_BAUD_PROBE_ERRORS)))
+  {
+    baudPending = false; //not committed, the PC can't send or receive at the new rate (e.g. a Bluetooth module with a fixed rate)
+    switchBaud(fallbackBaud);
+  }
+  if((statsInterval != 0) && ((int32_t)(millis() - nextStatsTick) >= 0))
+  {
+    nextStatsTick += statsInterval;
+    sendStats();
+  }
+  uint32_t loopTime = micros() - loopStart;
+  if(loopTime > 0xFFFF)
+    loopTime = 0xFFFF;
+  if(loopTime > loopMax)
+    loopMax = loopTime;
+  if(loopCount < 0xFFFF) //the mean stays valid if statistics are not read for a long time
+  {
+    loopSum += loopTime;
+    loopCount++;
+  }
 }
@@ -10,8 +10,29 @@
 # TODO: better conversion byte->int than b'\n'[0]
 
 import crc8
-import struct
+import time
 import serial
+import Telemetry
+import SBRCPMessages
+from SBRCPMessages import PROTOCOL_VERSION, SENSOR_UNCHANGED, TELEMETRY_FULL, TELEMETRY_COMPRESSED, TELEMETRY_TIMESTAMPED, \
+    TELEMETRY_EVENT
+
+FEATURES = {SBRCPMessages.FEATURE_COMPRESSED_TELEMETRY: 'compressed_telemetry', SBRCPMessages.FEATURE_SENSOR_CONFIG: 'sensor_config',
+            SBRCPMessages.FEATURE_STATS: 'stats', SBRCPMessages.FEATURE_PING: 'ping', SBRCPMessages.FEATURE_TIMESTAMPS: 'timestamps',
+            SBRCPMessages.FEATURE_RELIABLE: 'reliable', SBRCPMessages.FEATURE_BAUD: 'baud', SBRCPMessages.FEATURE_MEMORY: 'memory',
+            SBRCPMessages.FEATURE_EVENT_TELEMETRY: 'event_telemetry'}
+ERRORS = {getattr(SBRCPMessages, name): name for name in dir(SBRCPMessages) if name.startswith('ERROR_')}
+EVENT_REASONS = {SBRCPMessages.EVENT_CHANGE: 'change', SBRCPMessages.EVENT_SILENCE: 'silence', SBRCPMessages.EVENT_START: 'start'}
+STATS_FIELDS = {'loop_max': 'loop_max_us', 'loop_mean': 'loop_mean_us'}   # SBRCPMessages names with units, others are kept
+ACCEL_RANGES_G = [2, 4, 8, 16]                          # accelerometer range codes
+GYRO_RANGES_DPS = [250, 500, 1000, 2000]                # gyroscope range codes
+FILTER_BANDWIDTHS_HZ = [260, 184, 94, 44, 21, 10, 5]    # MPU6050 DLPF codes
+ROBOT_FRAME_TYPES = SBRCPMessages.ROBOT_TO_PC_TYPES
+BAUD_ACTIONS = {'propose': SBRCPMessages.BAUD_PROPOSE, 'probe': SBRCPMessages.BAUD_PROBE, 'commit': SBRCPMessages.BAUD_COMMIT}
+BAUD_STATUSES = {SBRCPMessages.BAUD_ACCEPTED: 'accepted', SBRCPMessages.BAUD_UNSUPPORTED: 'unsupported', SBRCPMessages.BAUD_PROBED: 'probed',
+                 SBRCPMessages.BAUD_COMMITTED: 'committed', SBRCPMessages.BAUD_NOT_PENDING: 'not_pending'}
+BAUD_PROBES = 8                         # probe exchanges before a new baud rate is committed
+BAUD_SETTLE = 0.02                      # seconds after switching before the first probe
 
 
 class Connectivity:
@@ -23,12 +44,17 @@ class Connectivity:
                             WIFI: {'local_ip': ..., 'local_port': ..., 'robot_ip': ..., 'robot_port': ...}
                             BT: TBD
                             UART: {'port': ..., 'speed' ..., 'timeout' ...}
+                            optional for all: 'record': file name, all received bytes are appended to it
         TODO: WIFI/BT timeout ???
         """
         self.serial = None
         self.wifi = None
         self.bt = None
         self.received_bytes = b''
+        self.messages = []                              # decoded messages waiting to be returned by read()
+        self.decoder = Telemetry.TelemetryDecoder()     # compressed telemetry state
+        self.record = open(parameters['record'], 'ab') if parameters.get('record') else None
+        self.capabilities = None                        # robot capabilities, see hello()
         self.connection = connection_type.upper()
 
         if self.connection == 'WIFI':
@@ -52,20 +78,24 @@ class Connectivity:
     def extract_frame(self):
         """
         Extract frame from the stream. Search for beginning tag and end tags. Do not interpret
+        End tags can also appear inside binary payload, so the frame must have a valid CRC
         :return: None if incomplete/broken frame, byte frame if complete.
         """
-        if len(self.received_bytes) < 2:
+        if len(self.received_bytes) < 4:
             return None     # frame to short
         if self.received_bytes[-1] != b'\r'[0] or self.received_bytes[-2] != b'\n'[0]:
             return None     # there no end of the frame
 
-        # beginning of the frame: 0x35 (MPU frame), 0xEE (correct frame with error code)
-        if self.received_bytes[0] in [b'\x35'[0], b'\xEE'[0]]:
-            byte_frame = self.received_bytes
-            self.received_bytes = b''
-            return byte_frame
+        # beginning of the frame: 0x35 (MPU frame), 0x36/0x37 (compressed MPU frames), 0x3A (capabilities),
+        # 0xEE (correct frame with error code)
+        for start in range(max(0, len(self.received_bytes) - Telemetry.MAX_FRAME), len(self.received_bytes) - 3):
+            if self.received_bytes[start] in ROBOT_FRAME_TYPES \
+                    and self.crc8(self.received_bytes[start:-3])[0] == self.received_bytes[-3]:
+                byte_frame = self.received_bytes[start:]
+                self.received_bytes = b''
+                return byte_frame
 
-        self.received_bytes = b''     # broken frame, clear it
+        self.received_bytes = self.received_bytes[-Telemetry.MAX_FRAME:]     # keep the tail, it may be a part of a longer frame
         return None
 
     def crc8(self, byte_frame):
@@ -85,33 +115,54 @@ class Connectivity:
         :return: json packed frame
         """
         empty_result = {'type': None}
-        if byte_frame[0] == b'\x35'[0]:                 # MPU package
-            if len(byte_frame) != 28:                   # wrong message length
-                return empty_result
-            if self.crc8(byte_frame[:-3])[0] != byte_frame[-3]:       # corrupted frame
-                return empty_result
-            acc_x = struct.unpack('<f', byte_frame[1:5])[0]
-            acc_y = struct.unpack('<f', byte_frame[5:9])[0]
-            acc_z = struct.unpack('<f', byte_frame[9:13])[0]
-            gyro_x = struct.unpack('<f', byte_frame[13:17])[0]
-            gyro_y = struct.unpack('<f', byte_frame[17:21])[0]
-            gyro_z = struct.unpack('<f', byte_frame[21:25])[0]
-            return {'type': 'MPUdata', 'acc_x': acc_x, 'acc_y': acc_y, 'acc_z': acc_z, 'gyro_x': gyro_x, 'gyro_y': gyro_y,'gyro_z': gyro_z}
-        elif byte_frame[0] == b'\xEE'[0]:                  # package with error code
-            if len(byte_frame) != 5:
-                return empty_result
-            if self.crc8(byte_frame[:-3])[0] != byte_frame[-3]:       # corrupted frame
-                return empty_result
-            error_code = 'UNKNOWN_ERROR'
-            if byte_frame[1] == 0:
-                error_code = 'ERROR_OTHER'
-            elif byte_frame[1] == 1:
-                error_code = 'ERROR_MPU_READ'
-            elif byte_frame[1] == 2:
-                error_code = 'ERROR_MPU_INIT'
-            elif byte_frame[1] == 3:
-                error_code = 'ERROR_ILLEGAL_CMD'
-            return {'type': 'ERROR', 'code': error_code}
+        if self.crc8(byte_frame[:-3])[0] != byte_frame[-3]:      # corrupted frame
+            return empty_result
+        name, values = SBRCPMessages.decode(byte_frame[0], byte_frame[1:-3])
+        if name in ['Mpu', 'MpuTs', 'MpuEvent']:            # MPU package, optionally with the robot time of the reading
+            acc_x, acc_y, acc_z, gyro_x, gyro_y, gyro_z = values['values']
+            message = {'type': 'MPUdata', 'acc_x': acc_x, 'acc_y': acc_y, 'acc_z': acc_z, 'gyro_x': gyro_x, 'gyro_y': gyro_y,'gyro_z': gyro_z}
+            if name != 'Mpu':
+                message['robot_us'] = values['robot_time']
+            if name == 'MpuEvent':                          # send-on-delta, the values hold until the next packet
+                message['event_sequence'] = values['sequence']
+                message['event_reasons'] = [reason for flag, reason in EVENT_REASONS.items() if values['reason'] & flag]
+            return message
+        elif name == 'Error':                               # package with error code
+            return {'type': 'ERROR', 'code': ERRORS.get(values['code'], 'UNKNOWN_ERROR')}
+        elif name in ['MpuKey', 'MpuDelta']:                # compressed MPU package(s)
+            samples = []
+            for raw in self.decoder.decode(byte_frame[0], byte_frame[1:-3]):
+                acc_x, acc_y, acc_z, gyro_x, gyro_y, gyro_z = self.decoder.to_si(raw)
+                samples.append({'type': 'MPUdata', 'acc_x': acc_x, 'acc_y': acc_y, 'acc_z': acc_z, 'gyro_x': gyro_x, 'gyro_y': gyro_y,'gyro_z': gyro_z})
+            return {'type': 'MPUbatch', 'samples': samples}
+        elif name == 'Hello':                               # capabilities and configuration
+            return {'type': 'HELLO', 'protocol_version': values['protocol_version'],
+                    'firmware': '{}.{}'.format(values['firmware_major'], values['firmware_minor']),
+                    'features': [feature for flag, feature in FEATURES.items() if values['features'] & flag],
+                    'connection': 'WIFI' if values['connection'] == SBRCPMessages.CONNECTION_WIFI else 'SERIAL',
+                    'accel_range_g': ACCEL_RANGES_G[values['accel_range'] & 0x03],
+                    'gyro_range_dps': GYRO_RANGES_DPS[values['gyro_range'] & 0x03],
+                    'dlpf_hz': FILTER_BANDWIDTHS_HZ[min(values['filter_bandwidth'], 6)],
+                    'telemetry': {TELEMETRY_COMPRESSED: 'compressed', TELEMETRY_TIMESTAMPED: 'timestamped',
+                                  TELEMETRY_EVENT: 'event'}.get(values['telemetry_mode'], 'full'),
+                    'rate': values['interval'],
+                    'min_rate': values['min_interval'], 'min_compressed_rate': values['min_compressed_interval'],
+                    'max_payload': values['max_payload'], 'max_batch': values['max_batch']}
+        elif name == 'Stats':                               # runtime statistics, counters wrap around at 65536
+            stats = {'type': 'STATS', 'uptime_ms': values.pop('uptime')}
+            stats.update({STATS_FIELDS.get(field, field): value for field, value in values.items()})
+            return stats
+        elif name == 'Pong':                                # ping answer with the robot time
+            return {'type': 'PONG', 'token': values['token'], 'robot_us': values['robot_time']}
+        elif name == 'Baud':                                # baud rate negotiation answer
+            return {'type': 'BAUD', 'baud': values['baud'], 'token': values['token'],
+                    'status': BAUD_STATUSES.get(values['status'], 'unknown'), 'pattern': values['pattern']}
+        elif name == 'Memory':                              # memory usage in bytes
+            flags = values.pop('flags')
+            memory = {'type': 'MEMORY', 'static_allocation': bool(flags & SBRCPMessages.MEMORY_STATIC_ALLOCATION),
+                      'pool_exhausted': bool(flags & SBRCPMessages.MEMORY_POOL_EXHAUSTED)}
+            memory.update(values)
+            return memory
         return empty_result
 
     def read(self):
@@ -121,35 +172,157 @@ class Connectivity:
                  'type': 'MPU" - payload from MPU sensors
         """
         message = {'type': None}   # not ready
+        if self.messages:          # compressed packets carry more than one sample
+            return self.messages.pop(0)
         if self.connection == 'UART':
             rx_data = self.serial.read(size=1)  # read byte by byte
             if rx_data:
+                if self.record:
+                    self.record.write(rx_data)
                 self.received_bytes += rx_data
                 frame = self.extract_frame()
                 if frame:
                     message = self.decode_frame(frame)
+                    if message['type'] == 'MPUbatch':
+                        self.messages += message['samples']
+                        return self.messages.pop(0) if self.messages else {'type': None}
                     return message
         return message
 
+    def hello(self, timeout=1.0):
+        """
+        Capability handshake, should be called after connecting. Other messages received in the meantime are kept for read()
+        :param timeout: time to wait for the answer in seconds
+        :return: capabilities dictionary ('HELLO' message), None if the robot firmware doesn't support the handshake
+        """
+        self.write({'type': 'Hello'})
+        pending = []
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            msg = self.read()
+            if msg['type'] == 'HELLO':
+                self.capabilities = msg
+                break
+            if msg['type'] is not None:
+                pending.append(msg)
+        self.messages = pending + self.messages
+        return self.capabilities
+
+    def baud_request(self, action, baud, token, pattern=b'', timeout=0.1):
+        """
+        Send a baud rate negotiation command and wait for its answer. Other messages received in the meantime are kept for read()
+        :param action: 'propose', 'probe' or 'commit'
+        :param baud: baud rate
+        :param token: 16 bit number identifying the answer
+        :param pattern: probe bytes echoed by the robot
+        :param timeout: time to wait for the answer in seconds
+        :return: 'BAUD' message, None on timeout
+        """
+        self.write({'type': 'Baud', 'action': action, 'baud': baud, 'token': token, 'pattern': pattern})
+        pending = []
+        answer = None
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            msg = self.read()
+            if msg['type'] == 'BAUD' and msg['token'] == token:
+                answer = msg
+                break
+            if msg['type'] is not None:
+                pending.append(msg)
+        self.messages = pending + self.messages
+        return answer
+
+    def negotiate_baud(self, baud):
+        """
+        Switch the serial connection to another baud rate: the robot answers the proposal at the current rate and switches, both sides
+        exchange probes at the new rate and the host commits it. The robot falls back to the previous rate by itself if the commit
+        doesn't arrive (BAUD_PROBE_TIMEOUT) or it receives corrupted frames, the host falls back if a probe fails.
+        Needs the 'baud' feature (see hello()), only for UART connections
+        :param baud: new baud rate
+        :return: True if switched, False if the robot refused the rate or the probes failed (the previous rate is kept)
+        """
+        previous = self.serial.baudrate
+        token = int(time.time() * 1000) & 0x7FFF           # new tokens for every negotiation, answers of old ones are ignored
+        if token <= 0x0D0A <= token + BAUD_PROBES + 1:      # LF-CR would split the frame
+            token = 0x0D0B
+        answer = self.baud_request('propose', baud, token)
+        if answer is None or answer['status'] != 'accepted':
+            return False
+        self.serial.flush()
+        self.serial.baudrate = baud
+        time.sleep(BAUD_SETTLE)
+        self.serial.reset_input_buffer()
+        self.received_bytes = b''
+        for i in range(BAUD_PROBES):
+            pattern = bytes((token + i * 37 + k * 11) & 0xFF | 0x01 for k in range(16))    # odd bytes, never LF
+            answer = self.baud_request('probe', baud, token + 1 + i, pattern)
+            if answer is None or answer['status'] != 'probed' or answer['pattern'] != pattern:
+                break
+        else:
+            answer = self.baud_request('commit', baud, token + BAUD_PROBES + 1)
+            if answer is not None and answer['status'] in ['committed', 'not_pending'] and answer['baud'] == baud:
+                return True
+        self.serial.baudrate = previous                     # the robot falls back after BAUD_PROBE_TIMEOUT
+        time.sleep(SBRCPMessages.BAUD_PROBE_TIMEOUT / 1000 + BAUD_SETTLE)
+        self.serial.reset_input_buffer()
+        self.received_bytes = b''
+        return False
+
     def write(self, payload):
         """
         Write (send) data to robot
         :param payload: format: {'type', 'payload'}
                         MPU reading rate: 'type': 'MPUrate', 'rate': number of ms between reading
                         Motors speed: type =='SetMotors', 'left': ..., 'right': ...: speed +-255
+                        Telemetry mode: type == 'Telemetry', 'mode': 'full'/'compressed'/'timestamped'/'event', optional 'batch':
+                                        samples per packet (1-4), optional 'key_interval': samples between keyframes,
+                                        event mode: optional 'accel_threshold' in m/s^2, 'gyro_threshold' in rad/s and
+                                        'max_silence_ms' (robot defaults if not given)
+                        Capabilities request: type == 'Hello', answered with 'HELLO' message
+                        Sensor configuration: type == 'SensorConfig', optional 'accel_range_g' (2, 4, 8, 16),
+                                        'gyro_range_dps' (250, 500, 1000, 2000), 'dlpf_hz' (260, 184, 94, 44, 21, 10, 5),
+                                        answered with 'HELLO' message (or 'ERROR' for illegal values)
+                        Runtime statistics: type == 'Stats', optional 'interval' in ms (0 - only this request, default),
+                                        answered with 'STATS' message
+                        Ping: type == 'Ping', optional 'token' (32 bit), answered with 'PONG' message with the same token
+                        Memory usage: type == 'Memory', optional 'repaint' (True - the next answer gives the stack peak since
+                                        this request), answered with 'MEMORY' message
+                        Baud rate negotiation: type == 'Baud', 'action': 'propose'/'probe'/'commit', 'baud', 'token' (16 bit),
+                                        optional 'pattern' (bytes), answered with 'BAUD' message, see negotiate_baud()
         """
         if payload['type'] == 'SetMotors':
-            byte_frame = b'\x2F'
-            byte_frame += struct.pack('<hh', payload['left'], payload['right'])
-            byte_frame += self.crc8(byte_frame)     # add crc
-            byte_frame += b'\n\r'
+            byte_frame = SBRCPMessages.encode('CmdMotors', motor_a=payload['left'], motor_b=payload['right'])
             print('byte frame: {}\n'.format(byte_frame))
-            self.serial.write(byte_frame)
         elif payload['type'] == 'MPUrate':
-            byte_frame = b'\xA7'
-            byte_frame += struct.pack('<I', payload['rate'])
-            byte_frame += self.crc8(byte_frame)     # add crc
-            byte_frame += b'\n\r'
-            self.serial.write(byte_frame)
+            byte_frame = SBRCPMessages.encode('CmdRate', interval=payload['rate'])
+        elif payload['type'] == 'Telemetry':
+            mode = {'compressed': TELEMETRY_COMPRESSED, 'timestamped': TELEMETRY_TIMESTAMPED,
+                    'event': TELEMETRY_EVENT}.get(payload['mode'], TELEMETRY_FULL)
+            thresholds = {}
+            if mode == TELEMETRY_EVENT:                     # in mm/s^2, mrad/s and ms, 0 for the robot defaults
+                thresholds = {'accel_threshold': int(round(payload.get('accel_threshold', 0) * 1000)),
+                              'gyro_threshold': int(round(payload.get('gyro_threshold', 0) * 1000)),
+                              'max_silence': payload.get('max_silence_ms', 0)}
+            byte_frame = SBRCPMessages.encode('CmdTelemetry', mode=mode, batch=payload.get('batch', 1),
+                                              key_interval=payload.get('key_interval', Telemetry.KEYFRAME_INTERVAL), **thresholds)
+        elif payload['type'] == 'Hello':
+            byte_frame = SBRCPMessages.encode('CmdHello', protocol_version=PROTOCOL_VERSION)
+        elif payload['type'] == 'SensorConfig':
+            accel = ACCEL_RANGES_G.index(payload['accel_range_g']) if 'accel_range_g' in payload else SENSOR_UNCHANGED
+            gyro = GYRO_RANGES_DPS.index(payload['gyro_range_dps']) if 'gyro_range_dps' in payload else SENSOR_UNCHANGED
+            dlpf = FILTER_BANDWIDTHS_HZ.index(payload['dlpf_hz']) if 'dlpf_hz' in payload else SENSOR_UNCHANGED
+            byte_frame = SBRCPMessages.encode('CmdSensor', accel_range=accel, gyro_range=gyro, filter_bandwidth=dlpf)
+        elif payload['type'] == 'Stats':
+            byte_frame = SBRCPMessages.encode('CmdStats', interval=payload.get('interval', 0))
+        elif payload['type'] == 'Ping':
+            byte_frame = SBRCPMessages.encode('CmdPing', token=payload.get('token', 0))
+        elif payload['type'] == 'Memory':
+            byte_frame = SBRCPMessages.encode('CmdMemory', repaint=int(payload.get('repaint', False)))
+        elif payload['type'] == 'Baud':
+            byte_frame = SBRCPMessages.encode('CmdBaud', baud=payload['baud'], token=payload['token'],
+                                              action=BAUD_ACTIONS[payload['action']], pattern=payload.get('pattern', b''))
         else:
             assert False, 'Unsupported message PC->robot: {}'.format(payload['type'])
+        byte_frame += self.crc8(byte_frame)     # add crc
+        byte_frame += b'\n\r'
+        self.serial.write(byte_frame)
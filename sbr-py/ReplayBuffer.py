@@ -0,0 +1,216 @@
+# -*- coding: utf-8 -*-
+#
+# Description:  experience replay buffer for on-line reinforcement learning, numpy front end of the C++ ReplayBuffer (sbr-qt/tools/replay)
+# License:      GPLv3
+# File:         ReplayBuffer.py
+
+import ctypes
+import os
+import sys
+import time
+import numpy as np
+
+LIBRARY = os.environ.get('SBR_REPLAY_LIB', os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'sbr-qt', 'tools', 'replay',
+                                                        'libsbr-replay.so'))
+ACTIONS = 2                     # motor A, B commands (REPLAY_ACTIONS)
+MPU_CHANNELS = ('acc_x', 'acc_y', 'acc_z', 'gyro_x', 'gyro_y', 'gyro_z')
+
+_float_p = ctypes.POINTER(ctypes.c_float)
+
+
+class _Batch(ctypes.Structure):
+    # ReplayBatch_t
+    _fields_ = [('size', ctypes.c_uint32), ('index', ctypes.POINTER(ctypes.c_uint32)), ('sequence', ctypes.POINTER(ctypes.c_uint64)),
+                ('observation', _float_p), ('action', _float_p), ('reward', _float_p), ('next_observation', _float_p),
+                ('done', ctypes.POINTER(ctypes.c_uint8)), ('weight', _float_p)]
+
+
+def _load(path):
+    lib = ctypes.CDLL(path)
+    p = ctypes.c_void_p
+    lib.sbr_replay_create.restype = p
+    lib.sbr_replay_create.argtypes = [ctypes.c_uint32, ctypes.c_uint16, ctypes.c_uint16, ctypes.c_float, ctypes.c_float, ctypes.c_uint64]
+    lib.sbr_replay_destroy.argtypes = [p]
+    lib.sbr_replay_capacity.restype = ctypes.c_uint32
+    lib.sbr_replay_capacity.argtypes = [p]
+    lib.sbr_replay_insert.restype = ctypes.c_uint64
+    lib.sbr_replay_insert.argtypes = [p, p, p, ctypes.c_float, p, ctypes.c_int]
+    lib.sbr_replay_insert_many.restype = ctypes.c_uint64
+    lib.sbr_replay_insert_many.argtypes = [p, ctypes.c_uint32, p, p, p, p, p]
+    lib.sbr_replay_sync.restype = ctypes.c_uint32
+    lib.sbr_replay_sync.argtypes = [p]
+    lib.sbr_replay_sample.restype = ctypes.POINTER(_Batch)
+    lib.sbr_replay_sample.argtypes = [p, ctypes.c_uint32, ctypes.c_float]
+    lib.sbr_replay_update.argtypes = [p, p, p, p, ctypes.c_uint32]
+    lib.sbr_replay_inserted.restype = ctypes.c_uint64
+    lib.sbr_replay_inserted.argtypes = [p]
+    lib.sbr_replay_size.restype = ctypes.c_uint32
+    lib.sbr_replay_size.argtypes = [p]
+    lib.sbr_replay_total.restype = ctypes.c_float
+    lib.sbr_replay_total.argtypes = [p]
+    return lib
+
+
+def observation(message, features=()):
+    """
+    Observation from an 'MPUdata' message of Connectivity.read() or TelemetryBus.read()
+    :param message: message dictionary
+    :param features: further observation values (e.g. rolling statistics)
+    :return: float32 array, the six MPU channels then the features
+    """
+    return np.array([message[c] for c in MPU_CHANNELS] + list(features), dtype=np.float32)
+
+
+class ReplayBuffer:
+    def __init__(self, observation_size, capacity=1 << 20, max_batch=1024, alpha=0.6, epsilon=1e-3, seed=1, library=LIBRARY):
+        """
+        Fixed-capacity transition storage, the oldest transitions are overwritten. The ctypes calls release the GIL: insert() and step()
+        can be called from an I/O thread while another thread samples; sync(), sample() and update_priorities() belong to one thread.
+        :param observation_size: values per observation, 6 MPU channels plus features
+        :param capacity: transitions, rounded up to a power of 2
+        :param max_batch: largest batch size
+        :param alpha: priority exponent, 0 samples uniformly
+        :param epsilon: added to the absolute TD error
+        :param seed: sampling random number generator seed
+        :param library: path of libsbr-replay.so
+        """
+        self.lib = _load(library)
+        self.handle = self.lib.sbr_replay_create(capacity, observation_size, max_batch, alpha, epsilon, seed)
+        self.observation_size = observation_size
+        self.capacity = self.lib.sbr_replay_capacity(self.handle)
+        self.max_batch = max_batch
+        self.views = None           # numpy views of the C++ batch arrays, created with the first batch
+        self.previous = None        # observation and action of the last step()
+
+    def insert(self, observation, action, reward, next_observation, done):
+        """
+        Store one transition
+        :return: insert number of the transition
+        """
+        o = np.ascontiguousarray(observation, dtype=np.float32)
+        a = np.ascontiguousarray(action, dtype=np.float32)
+        n = np.ascontiguousarray(next_observation, dtype=np.float32)
+        return self.lib.sbr_replay_insert(self.handle, o.ctypes.data, a.ctypes.data, reward, n.ctypes.data, int(done))
+
+    def insert_many(self, observations, actions, rewards, next_observations, dones):
+        """
+        Store transitions given as arrays with one row per transition, e.g. a recorded session decoded with Telemetry.decode_batch()
+        """
+        o = np.ascontiguousarray(observations, dtype=np.float32)
+        a = np.ascontiguousarray(actions, dtype=np.float32)
+        r = np.ascontiguousarray(rewards, dtype=np.float32)
+        n = np.ascontiguousarray(next_observations, dtype=np.float32)
+        d = np.ascontiguousarray(dones, dtype=np.uint8)
+        assert o.shape == n.shape == (len(r), self.observation_size) and a.shape == (len(r), ACTIONS) and d.shape == r.shape
+        return self.lib.sbr_replay_insert_many(self.handle, len(r), o.ctypes.data, a.ctypes.data, r.ctypes.data, n.ctypes.data,
+                                               d.ctypes.data)
+
+    def step(self, observation, action, reward=0.0, done=False):
+        """
+        Build transitions from a stream: call with every new observation and the action sent for it. The reward and done flag belong
+        to the previous action; the transition (previous observation, previous action, reward, observation, done) is stored.
+        """
+        if self.previous is not None:
+            self.insert(self.previous[0], self.previous[1], reward, observation, done)
+        self.previous = None if done else (observation, action)
+
+    def sync(self):
+        """
+        Make the transitions inserted since the last call available for sampling, with the highest priority so far
+        :return: number of transitions added
+        """
+        return self.lib.sbr_replay_sync(self.handle)
+
+    def sample(self, batch_size, beta=0.4):
+        """
+        Sample transitions with probability proportional to their priority
+        :param batch_size: at most max_batch
+        :param beta: importance sampling exponent
+        :return: dictionary of numpy views of the C++ batch arrays (no copy), valid until the next sample(): 'index', 'sequence',
+                 'observation', 'action', 'reward', 'next_observation', 'done', 'weight'
+        """
+        batch = self.lib.sbr_replay_sample(self.handle, batch_size, beta).contents
+        if self.views is None:
+            m, o = self.max_batch, self.observation_size
+            self.views = {'index': np.ctypeslib.as_array(batch.index, (m,)),
+                          'sequence': np.ctypeslib.as_array(batch.sequence, (m,)),
+                          'observation': np.ctypeslib.as_array(batch.observation, (m, o)),
+                          'action': np.ctypeslib.as_array(batch.action, (m, ACTIONS)),
+                          'reward': np.ctypeslib.as_array(batch.reward, (m,)),
+                          'next_observation': np.ctypeslib.as_array(batch.next_observation, (m, o)),
+                          'done': np.ctypeslib.as_array(batch.done, (m,)),
+                          'weight': np.ctypeslib.as_array(batch.weight, (m,))}
+        size = batch.size
+        return {name: view[:size] for name, view in self.views.items()}
+
+    def update_priorities(self, batch, errors):
+        """
+        Set the priorities of sampled transitions from their TD errors, transitions overwritten since are skipped
+        :param batch: dictionary returned by sample()
+        :param errors: TD error per transition
+        """
+        e = np.ascontiguousarray(errors, dtype=np.float32)
+        assert len(e) == len(batch['index'])
+        self.lib.sbr_replay_update(self.handle, batch['index'].ctypes.data, batch['sequence'].ctypes.data, e.ctypes.data, len(e))
+
+    def inserted(self):
+        return self.lib.sbr_replay_inserted(self.handle)
+
+    def total_priority(self):
+        return self.lib.sbr_replay_total(self.handle)
+
+    def __len__(self):
+        return self.lib.sbr_replay_size(self.handle)
+
+    def close(self):
+        if self.handle:
+            self.views = None
+            self.lib.sbr_replay_destroy(self.handle)
+            self.handle = None
+
+
+if __name__ == "__main__":
+    # fills a buffer and reports the cost of every call from Python: python ReplayBuffer.py [capacity] [batch]
+    capacity = int(sys.argv[1]) if len(sys.argv) > 1 else 1 << 20
+    batch_size = int(sys.argv[2]) if len(sys.argv) > 2 else 256
+    if not os.path.exists(LIBRARY):
+        print('{} not found, build it with: cd sbr-qt/tools/replay/ && qmake replay.pro && make'.format(LIBRARY))
+        sys.exit(1)
+    size = 14                   # 6 MPU channels and 8 features
+    buffer = ReplayBuffer(size, capacity)
+    rng = np.random.default_rng(1)
+    chunk = 1 << 16
+    start = time.perf_counter()
+    for first in range(0, buffer.capacity, chunk):
+        o = rng.standard_normal((chunk, size), dtype=np.float32)
+        buffer.insert_many(o, rng.integers(-255, 256, (chunk, ACTIONS)), rng.standard_normal(chunk, dtype=np.float32), o,
+                           np.zeros(chunk, dtype=np.uint8))
+    fill = time.perf_counter() - start
+    start = time.perf_counter()
+    buffer.sync()
+    print('{} transitions: insert_many {:.0f} ns/transition (with the random data), sync {:.0f} ns/transition'.format(
+        buffer.capacity, fill * 1e9 / buffer.capacity, (time.perf_counter() - start) * 1e9 / buffer.capacity))
+
+    calls = 2000
+    o, a = np.zeros(size, dtype=np.float32), np.zeros(ACTIONS, dtype=np.float32)
+    start = time.perf_counter()
+    for i in range(calls):
+        buffer.insert(o, a, 0.0, o, False)
+    print('insert {:.2f} us per call'.format((time.perf_counter() - start) * 1e6 / calls))
+
+    sample_time = update_time = 0.0
+    address = None
+    for i in range(calls):
+        start = time.perf_counter()
+        batch = buffer.sample(batch_size)
+        sample_time += time.perf_counter() - start
+        assert len(batch['index']) == batch_size
+        address = address or batch['observation'].ctypes.data
+        assert batch['observation'].ctypes.data == address            # the same memory every time, not a copy
+        errors = batch['reward'] - 0.5
+        start = time.perf_counter()
+        buffer.update_priorities(batch, errors)
+        update_time += time.perf_counter() - start
+    print('batch of {}: sample {:.1f} us, update_priorities {:.1f} us per call'.format(batch_size, sample_time * 1e6 / calls,
+                                                                                       update_time * 1e6 / calls))
+    buffer.close()
@@ -0,0 +1,323 @@
+# -*- coding: utf-8 -*-
+#
+# Description:  SBRCP message types, constants and payload codec, generated by generate.py from sbrcp.json - do not edit
+# License:      GPLv3
+# File:         SBRCPMessages.py
+
+import struct
+
+PROTOCOL_VERSION = 1
+MAX_PAYLOAD = 30
+
+DATA_CMD_MOTORS = 0x2F
+DATA_CMD_MOTORS_SEQ = 0x2D
+DATA_CMD_RATE = 0xA7
+DATA_CMD_TELEMETRY = 0xB3
+DATA_CMD_HELLO = 0xC1
+DATA_CMD_SENSOR = 0xC5
+DATA_CMD_STATS = 0xC7
+DATA_CMD_PING = 0xC9
+DATA_CMD_RELIABLE = 0xCB
+DATA_CMD_BAUD = 0xCD
+DATA_CMD_MEMORY = 0xCF
+DATA_MPU = 0x35
+DATA_MPU_KEY = 0x36
+DATA_MPU_DELTA = 0x37
+DATA_MPU_TS = 0x38
+DATA_MPU_EVENT = 0x39
+DATA_HELLO = 0x3A
+DATA_STATS = 0x3B
+DATA_PONG = 0x3C
+DATA_ACK = 0x3D
+DATA_BAUD = 0x3E
+DATA_MEMORY = 0x3F
+DATA_ERROR = 0xEE
+
+# telemetry modes (DATA_CMD_TELEMETRY)
+TELEMETRY_FULL = 0x00    # every sample sent as a DATA_MPU packet
+TELEMETRY_COMPRESSED = 0x01    # DATA_MPU_KEY keyframes followed by DATA_MPU_DELTA packets
+TELEMETRY_TIMESTAMPED = 0x02    # every sample sent as a DATA_MPU_TS packet with the robot time of the reading
+TELEMETRY_EVENT = 0x03    # send-on-delta: a sample is sent as a DATA_MPU_EVENT packet only if a channel changed by more than its threshold since the last sent one, or after the maximum silence
+
+# feature flags (DATA_HELLO)
+FEATURE_COMPRESSED_TELEMETRY = 0x0001    # DATA_CMD_TELEMETRY, DATA_MPU_KEY, DATA_MPU_DELTA
+FEATURE_SENSOR_CONFIG = 0x0002    # DATA_CMD_SENSOR
+FEATURE_STATS = 0x0004    # DATA_CMD_STATS, DATA_STATS
+FEATURE_PING = 0x0008    # DATA_CMD_PING, DATA_PONG
+FEATURE_TIMESTAMPS = 0x0010    # TELEMETRY_TIMESTAMPED, DATA_MPU_TS
+FEATURE_RELIABLE = 0x0020    # DATA_CMD_RELIABLE, DATA_ACK, DATA_CMD_MOTORS_SEQ
+FEATURE_BAUD = 0x0040    # DATA_CMD_BAUD, DATA_BAUD (serial connection)
+FEATURE_MEMORY = 0x0080    # DATA_CMD_MEMORY, DATA_MEMORY
+FEATURE_EVENT_TELEMETRY = 0x0100    # TELEMETRY_EVENT, DATA_MPU_EVENT
+
+# connection types (DATA_HELLO)
+CONNECTION_SERIAL = 0x00    # UART, cable or Bluetooth
+CONNECTION_WIFI = 0x01    # ESP32 in AT commands mode, UDP
+
+# sensor configuration (DATA_CMD_SENSOR)
+SENSOR_UNCHANGED = 0xFF    # value that leaves the setting unchanged
+
+# reliable delivery (DATA_CMD_RELIABLE, DATA_ACK, DATA_CMD_MOTORS_SEQ)
+SEQ_WINDOW = 0x0200    # sequence numbers up to this far behind the last accepted one are duplicates or stale, older ones start a new session (covers the motor sequence skip past LF-CR)
+ACK_APPLIED = 0x00    # command applied
+ACK_DUPLICATE = 0x01    # retransmission of a command already applied, not applied again
+ACK_REJECTED = 0x02    # unknown or too short command, not applied
+
+# baud rate negotiation (DATA_CMD_BAUD, DATA_BAUD)
+BAUD_PROPOSE = 0x00    # answer, then switch to the baud rate until it is committed
+BAUD_PROBE = 0x01    # echo the pattern at the current baud rate
+BAUD_COMMIT = 0x02    # keep the proposed baud rate
+BAUD_ACCEPTED = 0x00    # the robot switches after this answer
+BAUD_UNSUPPORTED = 0x01    # baud rate not available (clock error over 3 %, WiFi connection), not switched
+BAUD_PROBED = 0x02    # pattern echoed
+BAUD_COMMITTED = 0x03    # proposed baud rate kept
+BAUD_NOT_PENDING = 0x04    # commit without a pending switch (already committed or fallen back), baud is the current rate
+BAUD_PROBE_TIMEOUT = 0x01F4    # milliseconds after the switch before the robot falls back to the previous baud rate without a commit
+
+# memory usage flags (DATA_MEMORY)
+MEMORY_STATIC_ALLOCATION = 0x01    # built with _STATIC_ALLOCATION, long-lived objects are in static storage and heapSize is the use of the static pool
+MEMORY_POOL_EXHAUSTED = 0x02    # an allocation didn't fit into the static pool and failed
+
+# event telemetry (DATA_CMD_TELEMETRY, DATA_MPU_EVENT)
+EVENT_CHANGE = 0x01    # a channel changed by more than its threshold
+EVENT_SILENCE = 0x02    # nothing sent for the maximum silence, the values are still valid
+EVENT_START = 0x04    # first sample after the mode or rate setting, the host has no previous value
+EVENT_ACCEL_THRESHOLD = 0x64    # default accelerometer threshold in mm/s^2
+EVENT_GYRO_THRESHOLD = 0x14    # default gyroscope threshold in mrad/s
+EVENT_MAX_SILENCE = 0x01F4    # default maximum silence in milliseconds
+
+# error codes (DATA_ERROR)
+ERROR_OTHER = 0x00
+ERROR_MPU_INIT = 0x01
+ERROR_MPU_READ = 0x02
+ERROR_ILLEGAL_CMD = 0x03
+
+
+class Message:
+    """
+    Payload layout of one message type, fields are little-endian and packed as in the C++ SBRCP_..._t structures
+    """
+    def __init__(self, name, type, direction, fields, tail=None):
+        self.name = name
+        self.type = type
+        self.direction = direction
+        self.fields = [f[0] for f in fields]
+        self.layout = []                    # (name, offset, struct.Struct, count or None, optional)
+        offset = 0
+        fmt = '<'
+        self.min_size = None
+        for field, f, count, optional in fields:
+            s = struct.Struct('<{}{}'.format(count or 1, f))
+            if optional and self.min_size is None:
+                self.min_size = offset
+            self.layout.append((field, offset, s, count, optional))
+            offset += s.size
+            fmt += '{}{}'.format(count or 1, f)
+        self.struct = struct.Struct(fmt)    # all fixed fields, for fast packing of complete payloads
+        self.size = offset
+        self.min_size = offset if self.min_size is None else self.min_size
+        self.tail = tail                    # (name, struct format) of the field taking the rest of the payload
+
+    def encode(self, **values):
+        """
+        Encode payload, optional fields are sent up to the first missing one
+        :param values: field values (lists for arrays, bytes for the variable field)
+        :return: type byte and payload
+        """
+        payload = bytes([self.type])
+        for name, offset, s, count, optional in self.layout:
+            if name not in values:
+                assert optional, '{}: missing field {}'.format(self.name, name)
+                break
+            payload += s.pack(*values[name]) if count else s.pack(values[name])
+        if self.tail and self.tail[0] in values:
+            tail = values[self.tail[0]]
+            payload += tail if self.tail[1] == 'B' else struct.pack('<{}{}'.format(len(tail), self.tail[1]), *tail)
+        return payload
+
+    def decode(self, payload):
+        """
+        Decode payload, missing optional fields are left out
+        :param payload: payload bytes (without the type byte, CRC and LF-CR)
+        :return: dictionary of field values, None if the payload is too short
+        """
+        if len(payload) < self.min_size:
+            return None
+        result = {}
+        if len(payload) >= self.size:
+            values = self.struct.unpack_from(payload)
+            i = 0
+            for name, offset, s, count, optional in self.layout:
+                if count:
+                    result[name] = list(values[i:i + count])
+                    i += count
+                else:
+                    result[name] = values[i]
+                    i += 1
+        else:
+            for name, offset, s, count, optional in self.layout:
+                if offset + s.size > len(payload):
+                    break
+                v = s.unpack_from(payload, offset)
+                result[name] = list(v) if count else v[0]
+        if self.tail:
+            rest = payload[self.size:]
+            size = struct.calcsize('<' + self.tail[1])
+            result[self.tail[0]] = bytes(rest) if self.tail[1] == 'B' else \
+                list(struct.unpack('<{}{}'.format(len(rest) // size, self.tail[1]), rest[:len(rest) // size * size]))
+        return result
+
+
+# name, type, direction, fields: (name, struct format, count or None for scalars, optional), variable tail field
+MESSAGES = [
+    Message('CmdMotors', DATA_CMD_MOTORS, 'pcToRobot', [
+        ('motor_a', 'h', None, False),
+        ('motor_b', 'h', None, False),
+    ]),
+    Message('CmdMotorsSeq', DATA_CMD_MOTORS_SEQ, 'pcToRobot', [
+        ('sequence', 'H', None, False),
+        ('motor_a', 'h', None, False),
+        ('motor_b', 'h', None, False),
+    ]),
+    Message('CmdRate', DATA_CMD_RATE, 'pcToRobot', [
+        ('interval', 'I', None, False),
+    ]),
+    Message('CmdTelemetry', DATA_CMD_TELEMETRY, 'pcToRobot', [
+        ('mode', 'B', None, False),
+        ('batch', 'B', None, True),
+        ('key_interval', 'B', None, True),
+        ('accel_threshold', 'H', None, True),
+        ('gyro_threshold', 'H', None, True),
+        ('max_silence', 'H', None, True),
+    ]),
+    Message('CmdHello', DATA_CMD_HELLO, 'pcToRobot', [
+        ('protocol_version', 'B', None, True),
+    ]),
+    Message('CmdSensor', DATA_CMD_SENSOR, 'pcToRobot', [
+        ('accel_range', 'B', None, False),
+        ('gyro_range', 'B', None, True),
+        ('filter_bandwidth', 'B', None, True),
+    ]),
+    Message('CmdStats', DATA_CMD_STATS, 'pcToRobot', [
+        ('interval', 'H', None, True),
+    ]),
+    Message('CmdPing', DATA_CMD_PING, 'pcToRobot', [
+        ('token', 'I', None, True),
+    ]),
+    Message('CmdReliable', DATA_CMD_RELIABLE, 'pcToRobot', [
+        ('sequence', 'H', None, False),
+        ('command', 'B', None, False),
+    ], ('payload', 'B')),
+    Message('CmdBaud', DATA_CMD_BAUD, 'pcToRobot', [
+        ('baud', 'I', None, False),
+        ('token', 'H', None, False),
+        ('action', 'B', None, False),
+    ], ('pattern', 'B')),
+    Message('CmdMemory', DATA_CMD_MEMORY, 'pcToRobot', [
+        ('repaint', 'B', None, True),
+    ]),
+    Message('Mpu', DATA_MPU, 'robotToPc', [
+        ('values', 'f', 6, False),
+    ]),
+    Message('MpuKey', DATA_MPU_KEY, 'robotToPc', [
+        ('sequence', 'B', None, False),
+        ('ranges', 'B', None, False),
+        ('raw', 'h', 6, False),
+    ]),
+    Message('MpuDelta', DATA_MPU_DELTA, 'robotToPc', [
+        ('sequence', 'B', None, False),
+    ], ('deltas', 'B')),
+    Message('MpuTs', DATA_MPU_TS, 'robotToPc', [
+        ('robot_time', 'I', None, False),
+        ('values', 'f', 6, False),
+    ]),
+    Message('MpuEvent', DATA_MPU_EVENT, 'robotToPc', [
+        ('robot_time', 'I', None, False),
+        ('sequence', 'B', None, False),
+        ('reason', 'B', None, False),
+        ('values', 'f', 6, False),
+    ]),
+    Message('Hello', DATA_HELLO, 'robotToPc', [
+        ('protocol_version', 'B', None, False),
+        ('firmware_major', 'B', None, False),
+        ('firmware_minor', 'B', None, False),
+        ('features', 'H', None, False),
+        ('connection', 'B', None, False),
+        ('accel_range', 'B', None, False),
+        ('gyro_range', 'B', None, False),
+        ('filter_bandwidth', 'B', None, False),
+        ('telemetry_mode', 'B', None, False),
+        ('interval', 'I', None, False),
+        ('min_interval', 'H', None, False),
+        ('min_compressed_interval', 'H', None, False),
+        ('max_payload', 'B', None, False),
+        ('max_batch', 'B', None, False),
+    ]),
+    Message('Stats', DATA_STATS, 'robotToPc', [
+        ('uptime', 'I', None, False),
+        ('loop_max', 'H', None, False),
+        ('loop_mean', 'H', None, False),
+        ('loops', 'H', None, False),
+        ('frames', 'H', None, False),
+        ('crc_errors', 'H', None, False),
+        ('rx_overflows', 'H', None, False),
+        ('tx_dropped', 'H', None, False),
+        ('mpu_failures', 'H', None, False),
+        ('free_sram', 'H', None, False),
+        ('motor_commands', 'H', None, True),
+        ('stale_motors', 'H', None, True),
+        ('duplicate_commands', 'H', None, True),
+    ]),
+    Message('Pong', DATA_PONG, 'robotToPc', [
+        ('token', 'I', None, False),
+        ('robot_time', 'I', None, False),
+    ]),
+    Message('Ack', DATA_ACK, 'robotToPc', [
+        ('sequence', 'H', None, False),
+        ('status', 'B', None, False),
+    ]),
+    Message('Baud', DATA_BAUD, 'robotToPc', [
+        ('baud', 'I', None, False),
+        ('token', 'H', None, False),
+        ('status', 'B', None, False),
+    ], ('pattern', 'B')),
+    Message('Memory', DATA_MEMORY, 'robotToPc', [
+        ('ram_size', 'H', None, False),
+        ('static_size', 'H', None, False),
+        ('heap_size', 'H', None, False),
+        ('stack_peak', 'H', None, False),
+        ('unused_min', 'H', None, False),
+        ('flags', 'B', None, False),
+    ]),
+    Message('Error', DATA_ERROR, 'robotToPc', [
+        ('code', 'B', None, False),
+    ]),
+]
+BY_TYPE = {m.type: m for m in MESSAGES}
+BY_NAME = {m.name: m for m in MESSAGES}
+PC_TO_ROBOT_TYPES = [m.type for m in MESSAGES if m.direction == 'pcToRobot']
+ROBOT_TO_PC_TYPES = [m.type for m in MESSAGES if m.direction == 'robotToPc']
+
+
+def encode(name, **values):
+    """
+    Encode message
+    :param name: message name (e.g. 'CmdMotors')
+    :param values: field values in snake case (e.g. motor_a=10, motor_b=-10)
+    :return: type byte and payload, without CRC and LF-CR
+    """
+    return BY_NAME[name].encode(**values)
+
+
+def decode(frame_type, payload):
+    """
+    Decode message payload
+    :param frame_type: type byte
+    :param payload: payload bytes
+    :return: (message name, dictionary of field values), (None, None) for unknown types and too short payloads
+    """
+    message = BY_TYPE.get(frame_type)
+    if message is None:
+        return None, None
+    values = message.decode(payload)
+    return (message.name, values) if values is not None else (None, None)
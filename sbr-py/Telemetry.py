@@ -0,0 +1,325 @@
+# -*- coding: utf-8 -*-
+#
+# Description:  compressed telemetry codec: keyframes + zigzag/varint coded deltas (DATA_MPU_KEY/DATA_MPU_DELTA),
+#               send-on-delta event telemetry (DATA_MPU_EVENT)
+# License:      GPLv3
+# File:         Telemetry.py
+
+import crc8
+import numpy as np
+from SBRCPMessages import DATA_MPU, DATA_MPU_KEY, DATA_MPU_DELTA, DATA_MPU_TS, DATA_MPU_EVENT, DATA_CMD_TELEMETRY, TELEMETRY_FULL, \
+    TELEMETRY_COMPRESSED, MAX_PAYLOAD, BY_TYPE, EVENT_CHANGE, EVENT_SILENCE, EVENT_START, EVENT_ACCEL_THRESHOLD, EVENT_GYRO_THRESHOLD, \
+    EVENT_MAX_SILENCE
+
+MPU_KEY = BY_TYPE[DATA_MPU_KEY].struct      # keyframe payload: sequence, ranges, 6 x int16
+MPU_EVENT = BY_TYPE[DATA_MPU_EVENT].struct  # event payload: robot time, sequence, reason, 6 x float
+
+CHANNELS = 6                    # acc x, y, z, gyro x, y, z
+KEYFRAME_INTERVAL = 50          # default samples between keyframes (same as _TELEMETRY_KEYFRAME_INTERVAL)
+MAX_BATCH = 4                   # max samples per delta packet (same as _TELEMETRY_MAX_BATCH)
+MAX_FRAME = MAX_PAYLOAD + 4     # type, payload, CRC, LF-CR
+
+GRAVITY_STANDARD = 9.80665
+DPS_TO_RADS = 0.017453293
+ACCEL_SCALE = (16384.0, 8192.0, 4096.0, 2048.0)     # LSB/g for MPU6050_RANGE_2_G ... MPU6050_RANGE_16_G
+GYRO_SCALE = (131.0, 65.5, 32.8, 16.4)              # LSB/(deg/s) for MPU6050_RANGE_250_DEG ... MPU6050_RANGE_2000_DEG
+
+
+def crc(byte_frame):
+    """
+    CRC8 with non standard init value (same as Connectivity.crc8)
+    :param byte_frame: frame bytes without CRC and ending tags
+    :return: crc8 as int
+    """
+    hash_crc8 = crc8.crc8(initial_start=0xFF)
+    hash_crc8.update(byte_frame)
+    return hash_crc8.digest()[0]
+
+
+def split_frames(data):
+    """
+    Split recorded byte stream into frames. LF-CR may appear inside binary payload, so a frame is accepted
+    only when its CRC matches (the longest candidate first)
+    :param data: bytes received from the robot
+    :return: list of (type, payload) tuples
+    """
+    frames = []
+    start = 0
+    end = data.find(b'\n\r', 1)
+    while end >= 0:
+        stop = end + 2
+        for s in range(max(start, stop - MAX_FRAME), stop - 3):
+            if crc(data[s:stop - 3]) == data[stop - 3]:
+                frames.append((data[s], bytes(data[s + 1:stop - 3])))
+                start = stop
+                break
+        end = data.find(b'\n\r', end + 1)
+    return frames
+
+
+def raw_to_si(raw, ranges):
+    """
+    Convert raw sensor values to m/s^2 and rad/s
+    :param raw: numpy array (N, 6) of raw values
+    :param ranges: sensor ranges byte from keyframe (accel range low nibble, gyro range high nibble), scalar or (N,)
+    :return: numpy array (N, 6) of float32
+    """
+    ranges = np.asarray(ranges, dtype=np.uint8)
+    acc = GRAVITY_STANDARD / np.take(ACCEL_SCALE, ranges & 0x03)
+    gyro = DPS_TO_RADS / np.take(GYRO_SCALE, (ranges >> 4) & 0x03)
+    scale = np.stack(np.broadcast_arrays(acc, acc, acc, gyro, gyro, gyro), axis=-1)
+    return (raw * scale).astype(np.float32)
+
+
+def si_to_raw(si, accel_range=1, gyro_range=1):
+    """
+    Convert DATA_MPU values (m/s^2, rad/s) back to raw sensor values
+    :param si: array (N, 6)
+    :param accel_range: accelerometer range (1: MPU6050_RANGE_4_G)
+    :param gyro_range: gyroscope range (1: MPU6050_RANGE_500_DEG)
+    :return: numpy array (N, 6) of int16
+    """
+    si = np.asarray(si, dtype=np.float64)
+    scale = np.array([ACCEL_SCALE[accel_range] / GRAVITY_STANDARD] * 3 + [GYRO_SCALE[gyro_range] / DPS_TO_RADS] * 3)
+    return np.clip(np.rint(si * scale), -32768, 32767).astype(np.int16)
+
+
+def _put_varint(buf, delta):
+    v = ((delta << 1) ^ (delta >> 15)) & 0xFFFF     # zigzag
+    while v >= 0x80:
+        buf.append((v & 0x7F) | 0x80)
+        v >>= 7
+    buf.append(v)
+
+
+def _wrap16(v):
+    return ((v + 0x8000) & 0xFFFF) - 0x8000
+
+
+class TelemetryEncoder:
+    def __init__(self, batch=1, key_interval=KEYFRAME_INTERVAL, accel_range=1, gyro_range=1):
+        """
+        Python port of the firmware TelemetryEncoder, used to evaluate compression on recorded sessions
+        :param batch: samples per delta packet (1 to MAX_BATCH)
+        :param key_interval: samples between keyframes
+        :param accel_range: accelerometer range sent in keyframes
+        :param gyro_range: gyroscope range sent in keyframes
+        """
+        self.batch = min(max(batch, 1), MAX_BATCH)
+        self.key_interval = max(key_interval, 1)
+        self.ranges = (accel_range & 0x0F) | ((gyro_range & 0x0F) << 4)
+        self.seq = 0
+        self.since_key = self.key_interval
+        self.last = [0] * CHANNELS
+        self.frame = bytearray()
+        self.pending = 0
+
+    def _flush(self, out):
+        if self.pending:
+            out.append((DATA_MPU_DELTA, bytes(self.frame)))
+            self.pending = 0
+            self.frame = bytearray()
+
+    def push(self, sample):
+        """
+        Encode one raw sample
+        :param sample: 6 raw values
+        :return: list of finished (type, payload) packets
+        """
+        out = []
+        sample = [int(v) for v in sample]
+        if self.since_key >= self.key_interval:
+            self._flush(out)
+            out.append((DATA_MPU_KEY, MPU_KEY.pack(self.seq, self.ranges, *sample)))
+            self.last = sample
+            self.seq = (self.seq + 1) & 0xFF
+            self.since_key = 1
+            return out
+
+        tmp = bytearray()
+        for v, l in zip(sample, self.last):
+            _put_varint(tmp, _wrap16(v - l))
+        if self.pending and len(self.frame) + len(tmp) > MAX_PAYLOAD:
+            self._flush(out)
+        if not self.pending:
+            self.frame = bytearray([self.seq])
+        self.frame += tmp
+        self.last = sample
+        self.pending += 1
+        self.seq = (self.seq + 1) & 0xFF
+        self.since_key += 1
+        if self.pending >= self.batch:
+            self._flush(out)
+        return out
+
+
+class EventEncoder:
+    def __init__(self, accel_threshold=EVENT_ACCEL_THRESHOLD / 1000, gyro_threshold=EVENT_GYRO_THRESHOLD / 1000,
+                 max_silence_ms=EVENT_MAX_SILENCE):
+        """
+        Python port of the firmware EventEncoder (send-on-delta), used to evaluate event telemetry on recorded sessions
+        :param accel_threshold: in m/s^2, rounded to mm/s^2 as sent in DATA_CMD_TELEMETRY
+        :param gyro_threshold: in rad/s, rounded to mrad/s
+        :param max_silence_ms: maximum time without a packet
+        """
+        accel = np.float32(int(round(accel_threshold * 1000)) * np.float32(0.001))
+        gyro = np.float32(int(round(gyro_threshold * 1000)) * np.float32(0.001))
+        self.thresholds = np.array([accel] * 3 + [gyro] * 3, dtype=np.float32)
+        self.max_silence = int(max_silence_ms) * 1000
+        self.last = None
+        self.last_time = 0
+        self.seq = 0
+
+    def push(self, sample, time_us):
+        """
+        Check one sample, every built packet is taken as sent
+        :param sample: 6 values in m/s^2 and rad/s
+        :param time_us: robot time of the reading
+        :return: list with the (type, payload) packet, empty if the sample is not sent
+        """
+        sample = np.asarray(sample, dtype=np.float32)
+        if self.last is None:
+            reason = EVENT_START
+        else:
+            reason = EVENT_CHANGE if (np.abs(sample - self.last) > self.thresholds).any() else 0
+            if ((time_us - self.last_time) & 0xFFFFFFFF) >= self.max_silence:
+                reason |= EVENT_SILENCE
+        if not reason:
+            return []
+        payload = MPU_EVENT.pack(time_us & 0xFFFFFFFF, self.seq, reason, *sample.tolist())
+        self.last = sample
+        self.last_time = time_us
+        self.seq = (self.seq + 1) & 0xFF
+        return [(DATA_MPU_EVENT, payload)]
+
+
+class TelemetryDecoder:
+    def __init__(self):
+        """
+        Streaming decoder, one packet at a time (Python port of the C++ TelemetryDecoder)
+        """
+        self.last = [0] * CHANNELS
+        self.next_seq = 0
+        self.ranges = 0
+        self.synced = False
+        self.lost_packets = 0
+
+    def decode(self, frame_type, payload):
+        """
+        Decode DATA_MPU_KEY or DATA_MPU_DELTA payload
+        :return: list of raw samples (lists of 6 ints), empty if packet was dropped
+        """
+        if frame_type == DATA_MPU_KEY:
+            if len(payload) != MPU_KEY.size:
+                return []
+            seq, self.ranges, *sample = MPU_KEY.unpack(payload)
+            self.last = sample
+            self.next_seq = (seq + 1) & 0xFF
+            self.synced = True
+            return [list(sample)]
+        if frame_type != DATA_MPU_DELTA or len(payload) < 2:
+            return []
+        if not self.synced or payload[0] != self.next_seq:
+            self.synced = False
+            self.lost_packets += 1
+            return []
+
+        samples = []
+        sample = []
+        v = 0
+        shift = 0
+        for b in payload[1:]:
+            v |= (b & 0x7F) << shift
+            if b & 0x80:
+                shift += 7
+                continue
+            delta = (v >> 1) ^ -(v & 1)
+            sample.append(_wrap16(self.last[len(sample)] + delta))
+            v = 0
+            shift = 0
+            if len(sample) == CHANNELS:
+                samples.append(sample)
+                self.last = sample
+                sample = []
+        if sample or shift or not samples:
+            self.synced = False
+            self.lost_packets += 1
+            return samples
+        self.next_seq = (self.next_seq + len(samples)) & 0xFF
+        return samples
+
+    def to_si(self, sample):
+        """
+        Convert raw sample to acc (m/s^2) and gyro (rad/s) values using ranges from the last keyframe
+        """
+        return raw_to_si(np.asarray(sample), self.ranges).tolist()
+
+
+def decode_batch(frames):
+    """
+    Vectorized decoding of a whole recorded session. Only the synchronization bookkeeping is done per packet,
+    varint/zigzag decoding and delta integration are done with numpy over all packets at once.
+    :param frames: list of (type, payload) tuples, e.g. from split_frames(); other packet types are ignored
+    :return: (raw, ranges) - numpy array (N, 6) of int16 raw samples, numpy array (N,) of ranges bytes
+    """
+    frames = [f for f in frames if f[0] in (DATA_MPU_KEY, DATA_MPU_DELTA)]
+    if not frames:
+        return np.zeros((0, CHANNELS), dtype=np.int16), np.zeros(0, dtype=np.uint8)
+
+    # number of varints (terminating bytes) in every packet
+    lengths = np.fromiter((len(p) for _, p in frames), dtype=np.int64, count=len(frames))
+    buf = np.frombuffer(b''.join(p for _, p in frames), dtype=np.uint8)
+    offsets = np.concatenate(([0], np.cumsum(lengths)[:-1]))
+    terms = np.add.reduceat((buf < 0x80).astype(np.int64), offsets)
+
+    # per packet synchronization (same rules as TelemetryDecoder.decode)
+    keep = np.zeros(len(frames), dtype=bool)
+    counts = np.zeros(len(frames), dtype=np.int64)
+    synced = False
+    next_seq = 0
+    for i, (t, p) in enumerate(frames):
+        if t == DATA_MPU_KEY:
+            if lengths[i] == MPU_KEY.size:
+                keep[i], counts[i], synced, next_seq = True, 1, True, (p[0] + 1) & 0xFF
+            continue
+        n_var = terms[i] - (p[0] < 0x80)                    # sequence byte is not a varint
+        if lengths[i] < 2 or not synced or p[0] != next_seq or n_var % CHANNELS or (p[-1] & 0x80):
+            synced = False
+            continue
+        keep[i], counts[i] = True, n_var // CHANNELS
+        next_seq = (next_seq + counts[i]) & 0xFF
+
+    # varint + zigzag decoding of all kept delta packets at once
+    is_delta = keep & np.fromiter((t == DATA_MPU_DELTA for t, _ in frames), dtype=bool, count=len(frames))
+    mask = np.repeat(is_delta, lengths)
+    mask[offsets[is_delta]] = False                          # skip sequence bytes
+    vb = buf[mask]
+    term = vb < 0x80
+    var_idx = np.cumsum(term) - term                         # index of the varint every byte belongs to
+    starts = np.flatnonzero(np.concatenate(([True], term[:-1])))
+    pos = np.arange(len(vb)) - starts[var_idx]
+    values = np.bincount(var_idx, weights=(vb & 0x7F).astype(np.int64) << (7 * pos),
+                         minlength=int(term.sum())).astype(np.int64)
+    deltas = ((values >> 1) ^ -(values & 1)).reshape(-1, CHANNELS)
+
+    # interleave keyframes (absolute values) and deltas in stream order, integrate deltas per keyframe segment
+    rows = np.zeros((int(counts.sum()), CHANNELS), dtype=np.int64)
+    ranges = np.zeros(len(rows), dtype=np.uint8)
+    row_start = np.concatenate(([0], np.cumsum(counts)[:-1]))
+    is_key = keep & ~is_delta
+    key_rows = row_start[is_key]
+    key_payload = b''.join(frames[i][1] for i in np.flatnonzero(is_key))
+    keys = np.frombuffer(key_payload, dtype=np.dtype([('seq', 'u1'), ('ranges', 'u1'), ('v', '<i2', CHANNELS)]))
+    rows[key_rows] = keys['v']
+    delta_rows = np.ones(len(rows), dtype=bool)
+    delta_rows[key_rows] = False
+    rows[delta_rows] = deltas
+
+    # a delta packet received after a lost packet is dropped, so every segment starts with a keyframe
+    segment = np.cumsum(~delta_rows) - 1
+    ranges[:] = keys['ranges'][segment]
+    total = np.cumsum(rows, axis=0)
+    seg_first = key_rows[segment]
+    raw = total - total[seg_first] + rows[seg_first]
+    raw = ((raw + 0x8000) & 0xFFFF) - 0x8000
+    return raw.astype(np.int16), ranges
\ No newline at end of file
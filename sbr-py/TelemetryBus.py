@@ -0,0 +1,132 @@
+# -*- coding: utf-8 -*-
+#
+# Description:  shared-memory telemetry bus reader: samples published by sbr-bus (sbr-qt/tools/bus) for local consumers
+# License:      GPLv3
+# File:         TelemetryBus.py
+
+import mmap
+import struct
+import sys
+import time
+import numpy as np
+
+BUS_NAME = '/sbr-telemetry'     # default shared memory object (TELEMETRY_BUS_NAME)
+MAGIC = 0x53425242              # TELEMETRY_BUS_MAGIC
+VERSION = 1                     # TELEMETRY_BUS_VERSION
+CHANNELS = 6                    # acc x, y, z, gyro x, y, z
+
+# layout of TelemetryBusLayout_t and TelemetryBusSlot_t (sbr-qt/TelemetryBus.h)
+HEADER = struct.Struct('<IHHIIII')      # magic, version, channels, slots, slot size, producer pid, interval
+HEAD = struct.Struct('<Q')              # at 24: samples published
+HEARTBEAT_OFFSET = 32
+SLOTS_OFFSET = 128
+SLOT = np.dtype({'names': ['sequence', 'host_us', 'robot_us', 'timestamped', 'values'],
+                 'formats': ['<u8', '<u8', '<u8', '<u4', ('<f4', CHANNELS)], 'offsets': [0, 8, 16, 24, 28], 'itemsize': 64})
+
+
+class TelemetryBusReader:
+    def __init__(self, name=BUS_NAME, oldest=False):
+        """
+        Read-only view of the bus, any number of readers can't slow down the producer or each other
+        :param name: shared memory object name
+        :param oldest: start at the oldest sample in the ring, otherwise at the next published one
+        """
+        with open('/dev/shm' + name, 'rb') as f:
+            self.shm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, version, channels, self.slots, slot_size, _, _ = HEADER.unpack_from(self.shm, 0)
+        assert magic == MAGIC and version == VERSION and channels == CHANNELS and slot_size == SLOT.itemsize, \
+            '{}: not a telemetry bus of version {}'.format(name, VERSION)
+        self.ring = np.frombuffer(self.shm, dtype=SLOT, count=self.slots, offset=SLOTS_OFFSET)
+        head = self.head()
+        self.next = max(1, head - self.slots + 1) if oldest else head + 1
+        self.lost = 0       # samples overwritten before they were read
+
+    def head(self):
+        return HEAD.unpack_from(self.shm, 24)[0]
+
+    def interval(self):
+        """
+        :return: MPU data interval set on the robot in microseconds, 0 if not known
+        """
+        return HEADER.unpack_from(self.shm, 0)[6]
+
+    def producer_alive(self, timeout=1.0):
+        """
+        :param timeout: heartbeat age in seconds after which the producer is taken as dead
+        :return: True if sbr-bus updated its heartbeat recently
+        """
+        heartbeat = HEAD.unpack_from(self.shm, HEARTBEAT_OFFSET)[0]
+        return time.clock_gettime(time.CLOCK_MONOTONIC) * 1e6 - heartbeat < timeout * 1e6
+
+    def read_batch(self, max_samples=None):
+        """
+        Copy all new samples at once. Slots overwritten by the producer during the copy are detected by their sequence numbers
+        and counted as lost, as are samples overwritten before the call.
+        :param max_samples: maximum number of samples, None for all available
+        :return: structured numpy array with 'sequence', 'host_us' (CLOCK_MONOTONIC), 'robot_us', 'timestamped' and 'values'
+                 (acc x, y, z in m/s^2, gyro x, y, z in rad/s) fields, empty if there is nothing new
+        """
+        head = self.head()
+        if head - self.next >= self.slots:          # overtaken by the producer, resume half a ring behind it
+            resume = head - self.slots // 2 + 1
+            self.lost += resume - self.next
+            self.next = resume
+        count = head + 1 - self.next
+        if max_samples is not None:
+            count = min(count, max_samples)
+        if count <= 0:
+            return np.empty(0, dtype=SLOT)
+        first = (self.next - 1) % self.slots
+        indices = (first + np.arange(count)) % self.slots if first + count > self.slots else slice(first, first + count)
+        batch = self.ring[indices].copy()
+        expected = np.arange(self.next, self.next + count, dtype=np.uint64)
+        valid = (batch['sequence'] == expected) & (self.ring['sequence'][indices] == expected)   # unchanged after the copy
+        if not valid.all():         # the oldest slots were overwritten during the copy
+            self.lost += int(count - valid.sum())
+            batch = batch[valid]
+        self.next += count
+        return batch
+
+    def read(self):
+        """
+        Read the next sample
+        :return: 'MPUdata' message as from Connectivity.read() with 'sequence', 'host_us' and 'robot_us' (if timestamped), None if there
+                 is no new sample
+        """
+        batch = self.read_batch(1)
+        if len(batch) == 0:
+            return None
+        s = batch[0]
+        acc_x, acc_y, acc_z, gyro_x, gyro_y, gyro_z = (float(v) for v in s['values'])
+        message = {'type': 'MPUdata', 'acc_x': acc_x, 'acc_y': acc_y, 'acc_z': acc_z, 'gyro_x': gyro_x, 'gyro_y': gyro_y, 'gyro_z': gyro_z,
+                   'sequence': int(s['sequence']), 'host_us': int(s['host_us'])}
+        if s['timestamped']:
+            message['robot_us'] = int(s['robot_us'])
+        return message
+
+    def close(self):
+        self.ring = None
+        self.shm.close()
+
+
+if __name__ == "__main__":
+    # reads the bus for a few seconds and reports the read cost: python TelemetryBus.py [seconds] [name]
+    seconds = float(sys.argv[1]) if len(sys.argv) > 1 else 5.0
+    reader = TelemetryBusReader(sys.argv[2] if len(sys.argv) > 2 else BUS_NAME)
+    if not reader.producer_alive():
+        print('No producer heartbeat, is sbr-bus running?')
+    samples = 0
+    calls = 0
+    spent = 0.0
+    end = time.time() + seconds
+    while time.time() < end:
+        start = time.perf_counter()
+        batch = reader.read_batch()
+        if len(batch):
+            spent += time.perf_counter() - start
+            samples += len(batch)
+            calls += 1
+        else:
+            time.sleep(0.001)
+    print('{} samples ({:.1f}/s), {} lost, read_batch {:.1f} us per call, {:.0f} ns/sample'.format(
+        samples, samples / seconds, reader.lost, spent * 1e6 / max(calls, 1), spent * 1e9 / max(samples, 1)))
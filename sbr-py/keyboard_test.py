@@ -16,6 +16,8 @@ from Connectivity import Connectivity
 # connectivity setup
 uart_port = 'ttyUSB0'               # in case of UART connectivity
 uart_speed = 115200                 # serial port speed
+uart_fast_speed = None              # baud rate negotiated after the handshake (e.g. 500000), None keeps uart_speed
+uart_record = None                  # file name for recording received bytes (e.g. for telemetry_bench.py), None disables
 wifi_local_ip = '192.168.4.1'       # host (this) IP
 wifi_robot_ip = '192.158.4.2'       # remote (robot) IP
 wifi_local_port = '1234'            # host (this) port
@@ -79,7 +81,7 @@ if __name__ == "__main__":
     elif connectivity == 'BT':
         parameters = {'TBD'}
     elif connectivity == 'UART':
-        parameters = {'port': uart_port, 'speed': uart_speed, 'timeout': 0.01}
+        parameters = {'port': uart_port, 'speed': uart_speed, 'timeout': 0.01, 'record': uart_record}
     else:
         assert False, 'unsupported connectivity method: {}'.format(connectivity)
 
@@ -88,6 +90,14 @@ if __name__ == "__main__":
     print("Waiting 2.5s for Arduino to reboot because opening serial port creates a DTR pulse...")
     time.sleep(2.5)
 
+    capabilities = con.hello()
+    print('Robot capabilities: {}'.format(capabilities))
+    if connectivity == 'UART' and uart_fast_speed and capabilities and 'baud' in capabilities['features']:
+        print('Baud rate {}: {}'.format(uart_fast_speed, 'switched' if con.negotiate_baud(uart_fast_speed) else 'refused, kept {}'.format(uart_speed)))
+    if capabilities and 'compressed_telemetry' in capabilities['features']:
+        con.write({'type': 'Telemetry', 'mode': 'compressed', 'batch': 2})
+    # if capabilities and 'sensor_config' in capabilities['features']:
+    #     con.write({'type': 'SensorConfig', 'dlpf_hz': 44})      # less delay, more noise than default 21 Hz
     con.write({'type': 'MPUrate', 'rate': 100000})
     con.write({'type': 'SetMotors', 'left': 100, 'right': -100})
 
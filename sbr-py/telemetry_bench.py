@@ -0,0 +1,139 @@
+# -*- coding: utf-8 -*-
+#
+# Description:  compression ratio and decoder throughput of compressed telemetry, bandwidth of event (send-on-delta) telemetry
+#               on recorded sessions
+# License:      GPLv3
+# File:         telemetry_bench.py
+#
+# Usage:        python telemetry_bench.py [-i interval_us] <recording> [<recording> ...]
+#               recordings are raw bytes received from the robot (see 'record' parameter of Connectivity),
+#               full (DATA_MPU) and timestamped (DATA_MPU_TS) sessions are re-encoded, compressed and event sessions are only decoded
+
+import argparse
+import time
+import numpy as np
+import Telemetry
+
+LINK_BYTES_PER_S = 115200 / 10      # 115200 baud, 8N1
+FRAME_OVERHEAD = 4                  # type byte, CRC, LF-CR
+DATA_INTERVAL_US = 10000            # sample interval of full sessions, which carry no robot time
+EVENT_THRESHOLDS = ((0.05, 0.01), (0.1, 0.02), (0.2, 0.05), (0.5, 0.1))     # (m/s^2, rad/s), the robot default is the second
+
+
+def frame_bytes(frames):
+    return sum(len(p) + FRAME_OVERHEAD for _, p in frames)
+
+
+def bench_decoder(frames, n_samples):
+    t = time.perf_counter()
+    raw, ranges = Telemetry.decode_batch(frames)
+    Telemetry.raw_to_si(raw, ranges)
+    t_batch = time.perf_counter() - t
+
+    t = time.perf_counter()
+    decoder = Telemetry.TelemetryDecoder()
+    for frame_type, payload in frames:
+        decoder.decode(frame_type, payload)
+    t_stream = time.perf_counter() - t
+    print('    decoder: batch {:.2f} Msample/s, streaming {:.3f} Msample/s'
+          .format(n_samples / t_batch / 1e6, n_samples / t_stream / 1e6))
+    return raw
+
+
+def unwrap_us(robot_time):
+    """
+    :param robot_time: robot micros() values, wrapping at 32 bits
+    :return: int64 microseconds from the first value
+    """
+    steps = np.diff(np.asarray(robot_time, dtype=np.int64)) & 0xFFFFFFFF
+    return np.concatenate(([0], np.cumsum(steps)))
+
+
+def bench_events(si, times, full_bytes):
+    """
+    Re-encode a session in event mode for every threshold pair, the host holds the last received value until the next packet
+    :param si: numpy array (N, 6) in m/s^2 and rad/s
+    :param times: robot time of every sample in microseconds
+    :param full_bytes: bytes of the session in full mode
+    """
+    seconds = max(times[-1] - times[0], 1) / 1e6
+    n = len(si)
+    for accel, gyro in EVENT_THRESHOLDS:
+        encoder = Telemetry.EventEncoder(accel, gyro)
+        sent = np.fromiter((bool(encoder.push(sample, int(t))) for sample, t in zip(si, times)), dtype=bool, count=n)
+        indices = np.flatnonzero(sent)
+        event_bytes = len(indices) * (Telemetry.MPU_EVENT.size + FRAME_OVERHEAD)
+        held = si[indices[np.searchsorted(indices, np.arange(n), side='right') - 1]]
+        error = np.abs(si.astype(np.float64) - held)
+        gaps = np.diff(times[indices]) / 1000 if len(indices) > 1 else np.zeros(1)
+        print('    event {:.2f} m/s^2, {:.3f} rad/s: {:.1f} % of samples sent, {:.0f} B/s, {:.1f} % of full, '
+              'hold error max {:.3f} m/s^2 {:.4f} rad/s, rms {:.3f} m/s^2 {:.4f} rad/s, longest gap {:.0f} ms'
+              .format(accel, gyro, 100. * len(indices) / n, event_bytes / seconds, 100. * event_bytes / full_bytes,
+                      error[:, :3].max(), error[:, 3:].max(), np.sqrt((error[:, :3] ** 2).mean()), np.sqrt((error[:, 3:] ** 2).mean()),
+                      gaps.max()))
+
+
+def bench_recorded_events(events):
+    """
+    Bandwidth of a session recorded in event mode
+    :param events: list of DATA_MPU_EVENT payloads
+    """
+    decoded = [Telemetry.MPU_EVENT.unpack(p) for p in events]
+    times = unwrap_us([d[0] for d in decoded])
+    seconds = max(times[-1], 1) / 1e6
+    reasons = np.array([d[2] for d in decoded])
+    lost = sum((b[1] - a[1] - 1) & 0xFF for a, b in zip(decoded, decoded[1:]))
+    print('    recorded event stream: {:.1f} packets/s, {:.0f} B/s, {} on change, {} after silence, {} lost'
+          .format(len(events) / seconds, len(events) * (Telemetry.MPU_EVENT.size + FRAME_OVERHEAD) / seconds,
+                  int((reasons & Telemetry.EVENT_CHANGE != 0).sum()), int((reasons == Telemetry.EVENT_SILENCE).sum()), lost))
+
+
+def bench_file(name, interval):
+    frames = Telemetry.split_frames(open(name, 'rb').read())
+    full = [p for t, p in frames if t == Telemetry.DATA_MPU and len(p) == 24]
+    timestamped = [p for t, p in frames if t == Telemetry.DATA_MPU_TS and len(p) == 28]
+    events = [p for t, p in frames if t == Telemetry.DATA_MPU_EVENT and len(p) == Telemetry.MPU_EVENT.size]
+    compressed = [(t, p) for t, p in frames if t in (Telemetry.DATA_MPU_KEY, Telemetry.DATA_MPU_DELTA)]
+    print('{}: {} frames, {} full samples, {} timestamped samples, {} event packets, {} compressed packets'
+          .format(name, len(frames), len(full), len(timestamped), len(events), len(compressed)))
+
+    if compressed:
+        raw = bench_decoder(compressed, max(1, len(Telemetry.decode_batch(compressed)[0])))
+        bytes_per_sample = frame_bytes(compressed) / max(1, len(raw))
+        print('    recorded compressed stream: {:.2f} B/sample, max {:.0f} samples/s on the link'
+              .format(bytes_per_sample, LINK_BYTES_PER_S / bytes_per_sample))
+    if events:
+        bench_recorded_events(events)
+    if timestamped:         # robot times from the recording
+        si = np.frombuffer(b''.join(p[4:] for p in timestamped), dtype='<f4').reshape(-1, Telemetry.CHANNELS)
+        times = unwrap_us(np.frombuffer(b''.join(p[:4] for p in timestamped), dtype='<u4'))
+        print('    timestamped: {:.2f} B/sample, {:.0f} B/s'
+              .format(28. + FRAME_OVERHEAD, len(si) * (28 + FRAME_OVERHEAD) / (max(times[-1], 1) / 1e6)))
+        bench_events(si, times, len(si) * (24 + FRAME_OVERHEAD))
+    if not full:
+        return
+
+    si = np.frombuffer(b''.join(full), dtype='<f4').reshape(-1, Telemetry.CHANNELS)
+    raw = Telemetry.si_to_raw(si)
+    full_bytes = len(full) * (24 + FRAME_OVERHEAD)
+    print('    full: {:.2f} B/sample, max {:.0f} samples/s on the link'
+          .format(full_bytes / len(full), LINK_BYTES_PER_S * len(full) / full_bytes))
+    for batch in range(1, Telemetry.MAX_BATCH + 1):
+        encoder = Telemetry.TelemetryEncoder(batch=batch)
+        encoded = [f for sample in raw for f in encoder.push(sample)]
+        bytes_per_sample = frame_bytes(encoded) / len(raw)
+        print('    compressed, batch {}: {:.2f} B/sample, ratio {:.2f}, max {:.0f} samples/s on the link'
+              .format(batch, bytes_per_sample, full_bytes / len(full) / bytes_per_sample, LINK_BYTES_PER_S / bytes_per_sample))
+        decoded = bench_decoder(encoded, len(raw))
+        assert (decoded == raw[:len(decoded)]).all(), 'decoded samples differ from the recording'
+    bench_events(si, np.arange(len(si), dtype=np.int64) * interval, full_bytes)     # no robot time, evenly spaced
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Telemetry bandwidth on recorded sessions')
+    parser.add_argument('recordings', nargs='+', help='raw bytes received from the robot')
+    parser.add_argument('-i', '--interval', type=int, default=DATA_INTERVAL_US,
+                        help='sample interval of full sessions in microseconds (default {})'.format(DATA_INTERVAL_US))
+    args = parser.parse_args()
+    for recording in args.recordings:
+        bench_file(recording, args.interval)
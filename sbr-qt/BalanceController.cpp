@@ -0,0 +1,95 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file BalanceController.cpp
+* \brief PID tilt controller working on MPU6050 samples, outputs motor commands
+* \copyright GNU GPLv3
+**/
+
+#include "BalanceController.h"
+#include <math.h>
+
+BalanceController::BalanceController(const ControllerConfig_t &config)
+{
+	this->config = config;
+	reset();
+}
+
+void BalanceController::reset(void)
+{
+	tilt = 0.f;
+	integral = 0.f;
+	started = false;
+}
+
+float BalanceController::update(const float *sample, int16_t *motorA, int16_t *motorB)
+{
+	return control(estimate(sample), sample[config.gyroAxis], motorA, motorB);
+}
+
+float BalanceController::estimate(const float *sample)
+{
+	float rate = sample[config.gyroAxis];
+	float accelTilt = atan2f(-sample[config.accelForward], sample[config.accelUp]);
+	if(!started)
+		tilt = accelTilt;
+	else
+		tilt = config.complementary * (tilt + rate * config.interval) + (1.f - config.complementary) * accelTilt;
+	started = true;
+	return tilt;
+}
+
+float BalanceController::control(float angle, float rate, int16_t *motorA, int16_t *motorB)
+{
+	//positive gains always counteract the tilt, the direction follows the sign of the plant gain
+	float error = angle - config.setpoint;
+	float u = -config.direction * (config.kp * error + config.kd * rate + config.ki * integral);
+	float out = u;
+	if(out > _MOTOR_MAX)
+		out = _MOTOR_MAX;
+	else if(out < -_MOTOR_MAX)
+		out = -_MOTOR_MAX;
+	if(out == u) //anti-windup: integrate only when not saturated
+		integral += error * config.interval;
+	*motorA = (int16_t)lrintf(out);
+	*motorB = (int16_t)lrintf(config.motorSignB * out);
+	return u;
+}
+
+float BalanceController::getTilt(void)
+{
+	return tilt;
+}
+
+ControllerConfig_t BalanceController::defaultConfig(float interval)
+{
+	ControllerConfig_t c;
+	c.kp = 0.f;
+	c.ki = 0.f;
+	c.kd = 0.f;
+	c.setpoint = 0.f;
+	c.direction = 1.f;
+	c.complementary = 0.98f;
+	c.interval = interval;
+	c.gyroAxis = 4;
+	c.accelForward = 0;
+	c.accelUp = 2;
+	c.motorSignB = -1;
+	return c;
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file BalanceController.h
+* \brief PID tilt controller working on MPU6050 samples, outputs motor commands
+* \copyright GNU GPLv3
+**/
+
+#ifndef BALANCECONTROLLER_H_
+#define BALANCECONTROLLER_H_
+#include <stdint.h>
+
+#define _MOTOR_MAX 255 //motor command range is -255 to 255
+
+typedef struct
+{
+	float kp; //motor command per radian of tilt
+	float ki; //motor command per radian * second
+	float kd; //motor command per rad/s of tilt rate
+	float setpoint; //balance tilt in radians
+	float direction; //sign of the plant gain (PlantModel_t), 1 if a positive drive command accelerates the tilt in positive direction
+	float complementary; //complementary filter coefficient of the tilt estimate (gyro weight)
+	float interval; //sample interval in seconds
+	uint8_t gyroAxis; //gyroscope channel of the tilt axis (3, 4 or 5)
+	uint8_t accelForward; //accelerometer channel pointing forward (0, 1 or 2)
+	uint8_t accelUp; //accelerometer channel pointing up (0, 1 or 2)
+	int8_t motorSignB; //motor B command is motorSignB * drive command
+} ControllerConfig_t;
+
+class BalanceController
+{
+private:
+	ControllerConfig_t config;
+	float tilt; //complementary filter tilt estimate
+	float integral;
+	bool started;
+public:
+	/**
+	* \brief Controller initializer
+	* \param[in] &config Gains and sensor orientation
+	**/
+	BalanceController(const ControllerConfig_t &config);
+	/**
+	* \brief Resets the tilt estimate and the integrator
+	**/
+	void reset(void);
+	/**
+	* \brief Calculates motor commands for a sample
+	* \param[in] *sample Acc X, Y, Z in m/s^2, gyro X, Y, Z in rad/s
+	* \param[out] *motorA Motor A command (-255 to 255)
+	* \param[out] *motorB Motor B command
+	* \return Drive command before saturation
+	**/
+	float update(const float *sample, int16_t *motorA, int16_t *motorB);
+	/**
+	* \brief Updates the tilt estimate with a sample, without calculating motor commands
+	* \param[in] *sample Acc X, Y, Z in m/s^2, gyro X, Y, Z in rad/s
+	* \return Tilt estimate in radians
+	**/
+	float estimate(const float *sample);
+	/**
+	* \brief Calculates motor commands for a given state, e.g. predicted to the actuation time (StatePredictor)
+	* \param[in] angle Tilt in radians
+	* \param[in] rate Tilt rate in rad/s
+	* \param[out] *motorA Motor A command (-255 to 255)
+	* \param[out] *motorB Motor B command
+	* \return Drive command before saturation
+	**/
+	float control(float angle, float rate, int16_t *motorA, int16_t *motorB);
+	/**
+	* \brief Gets the current tilt estimate in radians
+	**/
+	float getTilt(void);
+	/**
+	* \brief Default settings with zero gains, same sensor orientation and motor mounting as SystemIdentifier::defaultConfig()
+	* \param[in] interval Sample interval in seconds
+	**/
+	static ControllerConfig_t defaultConfig(float interval);
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,146 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file ClockSync.cpp
+* \brief Robot to host clock offset and drift estimation from ping exchanges (DATA_CMD_PING/DATA_PONG)
+* \copyright GNU GPLv3
+**/
+
+#include "ClockSync.h"
+#include <math.h>
+
+ClockSync::ClockSync()
+{
+	reset();
+}
+
+void ClockSync::reset(void)
+{
+	count = 0;
+	robotHigh = 0;
+	unwrapped = false;
+	hostRef = 0.;
+	robotRef = 0.;
+	scale = 1.;
+	minRtt = 0;
+	synced = false;
+}
+
+uint64_t ClockSync::unwrap(uint32_t robotTime)
+{
+	if(!unwrapped)
+	{
+		robotHigh = robotTime;
+		unwrapped = true;
+		return robotHigh;
+	}
+	//signed 32-bit difference to the last value, so that slightly older timestamps don't look like a wrap
+	int32_t diff = (int32_t)(robotTime - (uint32_t)robotHigh);
+	if((diff < 0) && (robotHigh < (uint64_t)-diff)) //older than the first timestamp
+		return robotTime;
+	uint64_t t = robotHigh + diff;
+	if(diff > 0)
+		robotHigh = t;
+	return t;
+}
+
+void ClockSync::addExchange(uint64_t sent, uint32_t robotTime, uint64_t received)
+{
+	if(received < sent)
+		return;
+	ClockExchange_t &e = exchanges[count % CLOCK_SYNC_WINDOW];
+	e.host = (sent + received) / 2.;
+	e.robot = unwrap(robotTime);
+	e.rtt = received - sent;
+	count++;
+	fit();
+}
+
+//least squares line through the exchanges with low round trip time
+//exchanges delayed by queuing (rtt well above the minimum) have an asymmetric delay and are left out
+void ClockSync::fit(void)
+{
+	uint32_t n = (count < CLOCK_SYNC_WINDOW) ? count : CLOCK_SYNC_WINDOW;
+	minRtt = UINT32_MAX;
+	for(uint32_t i = 0; i < n; i++)
+	{
+		if(exchanges[i].rtt < minRtt)
+			minRtt = exchanges[i].rtt;
+	}
+	double limit = 1.5 * minRtt + 500.;
+
+	//sums relative to the newest exchange keep the numbers small
+	const ClockExchange_t &last = exchanges[(count - 1) % CLOCK_SYNC_WINDOW];
+	double sr = 0., sh = 0., srr = 0., srh = 0.;
+	uint32_t used = 0;
+	for(uint32_t i = 0; i < n; i++)
+	{
+		if(exchanges[i].rtt > limit)
+			continue;
+		double r = exchanges[i].robot - last.robot;
+		double h = exchanges[i].host - last.host;
+		sr += r;
+		sh += h;
+		srr += r * r;
+		srh += r * h;
+		used++;
+	}
+	double meanR = sr / used, meanH = sh / used;
+	double varR = srr / used - meanR * meanR;
+	scale = 1.;
+	if((used >= 2) && (varR > 1e6)) //at least 1 ms spread, otherwise only the offset is estimated
+	{
+		scale = (srh / used - meanR * meanH) / varR;
+		if(fabs(scale - 1.) > CLOCK_SYNC_MAX_DRIFT)
+			scale = 1. + copysign(CLOCK_SYNC_MAX_DRIFT, scale - 1.);
+	}
+	robotRef = last.robot + meanR;
+	hostRef = last.host + meanH;
+	synced = (count >= 2);
+}
+
+bool ClockSync::isSynced(void)
+{
+	return synced;
+}
+
+uint64_t ClockSync::toHost(uint64_t robotTime)
+{
+	return llround(hostRef + scale * ((double)robotTime - robotRef));
+}
+
+uint64_t ClockSync::toRobot(uint64_t hostTime)
+{
+	return llround(robotRef + ((double)hostTime - hostRef) / scale);
+}
+
+int64_t ClockSync::getOffset(uint64_t hostTime)
+{
+	return (int64_t)hostTime - (int64_t)toRobot(hostTime);
+}
+
+float ClockSync::getDrift(void)
+{
+	return (1. / scale - 1.) * 1e6;
+}
+
+uint32_t ClockSync::getMinRtt(void)
+{
+	return (count > 0) ? minRtt : 0;
+}
\ No newline at end of file
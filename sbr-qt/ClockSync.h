@@ -0,0 +1,100 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file ClockSync.h
+* \brief Robot to host clock offset and drift estimation from ping exchanges (DATA_CMD_PING/DATA_PONG)
+* \copyright GNU GPLv3
+**/
+
+#ifndef CLOCKSYNC_H_
+#define CLOCKSYNC_H_
+#include <stdint.h>
+
+#define CLOCK_SYNC_WINDOW 32 //latest exchanges used by the fit
+#define CLOCK_SYNC_MAX_DRIFT 0.01 //clamp of the drift estimate (1%, ceramic resonators of Arduino boards are within 0.5%)
+
+typedef struct
+{
+	double host; //host time in the middle of the exchange (microseconds)
+	double robot; //unwrapped robot time (microseconds)
+	uint32_t rtt; //round trip time in microseconds
+} ClockExchange_t;
+
+class ClockSync
+{
+private:
+	ClockExchange_t exchanges[CLOCK_SYNC_WINDOW];
+	uint32_t count; //exchanges added
+	uint64_t robotHigh; //unwrapped robot time of the last unwrap() call
+	bool unwrapped; //robotHigh is valid
+	//host = hostRef + scale * (robot - robotRef)
+	double hostRef, robotRef, scale;
+	uint32_t minRtt; //lowest round trip time in the window
+	bool synced;
+	void fit(void);
+public:
+	ClockSync();
+	/**
+	* \brief Forgets all exchanges, e.g. after the robot was reset
+	**/
+	void reset(void);
+	/**
+	* \brief Extends the 32-bit robot micros() value (wraps every 71 minutes) to 64 bits
+	* \param[in] robotTime Robot time, calls must come in roughly chronological order (less than 35 minutes apart)
+	* \return Unwrapped robot time in microseconds
+	**/
+	uint64_t unwrap(uint32_t robotTime);
+	/**
+	* \brief Adds an exchange: the robot time was read between sending the request and receiving the answer
+	* \param[in] sent Host time of the request in microseconds
+	* \param[in] robotTime Robot time from the answer
+	* \param[in] received Host time of the answer in microseconds
+	**/
+	void addExchange(uint64_t sent, uint32_t robotTime, uint64_t received);
+	/**
+	* \brief Checks if offset and drift are known (at least two exchanges)
+	**/
+	bool isSynced(void);
+	/**
+	* \brief Converts robot time to host time
+	* \param[in] robotTime Unwrapped robot time (unwrap())
+	* \return Host time in microseconds
+	**/
+	uint64_t toHost(uint64_t robotTime);
+	/**
+	* \brief Converts host time to unwrapped robot time
+	**/
+	uint64_t toRobot(uint64_t hostTime);
+	/**
+	* \brief Gets the clock offset (host time - robot time) at a given host time
+	* \return Offset in microseconds
+	**/
+	int64_t getOffset(uint64_t hostTime);
+	/**
+	* \brief Gets the robot clock drift relative to the host clock
+	* \return Drift in ppm, positive if the robot clock runs faster
+	**/
+	float getDrift(void);
+	/**
+	* \brief Gets the lowest round trip time in the window, half of it bounds the offset error (with symmetric paths)
+	* \return Round trip time in microseconds
+	**/
+	uint32_t getMinRtt(void);
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,154 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file EventLoop.cpp
+* \brief Single-threaded poll() event loop with file descriptor watches and intrusive timers (no allocation while running)
+* \copyright GNU GPLv3
+**/
+
+#include "EventLoop.h"
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+
+EventLoop::EventLoop()
+{
+	watchCount = 0;
+	timers = nullptr;
+	running = false;
+}
+
+uint64_t EventLoop::now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * 1000000ULL + t.tv_nsec / 1000;
+}
+
+bool EventLoop::watch(int fd, void (*callback)(void*), void *arg)
+{
+	if(watchCount >= EVENT_LOOP_MAX_WATCHES)
+		return false;
+	watches[watchCount].fd = fd;
+	watches[watchCount].callback = callback;
+	watches[watchCount].arg = arg;
+	watchCount++;
+	return true;
+}
+
+void EventLoop::unwatch(int fd)
+{
+	for(uint8_t i = 0; i < watchCount; i++)
+	{
+		if(watches[i].fd == fd)
+		{
+			watches[i] = watches[--watchCount];
+			return;
+		}
+	}
+}
+
+void EventLoop::schedule(EventTimer_t *timer, uint64_t delay)
+{
+	cancel(timer);
+	timer->deadline = now() + delay;
+	timer->scheduled = true;
+	//timers with equal deadlines fire in the order they were scheduled
+	EventTimer_t **p = &timers;
+	while((*p != nullptr) && ((*p)->deadline <= timer->deadline))
+		p = &(*p)->next;
+	timer->next = *p;
+	*p = timer;
+}
+
+void EventLoop::cancel(EventTimer_t *timer)
+{
+	if(!timer->scheduled)
+		return;
+	for(EventTimer_t **p = &timers; *p != nullptr; p = &(*p)->next)
+	{
+		if(*p == timer)
+		{
+			*p = timer->next;
+			break;
+		}
+	}
+	timer->scheduled = false;
+}
+
+void EventLoop::run(void)
+{
+	running = true;
+	while(running && ((watchCount > 0) || (timers != nullptr)))
+	{
+		struct timespec timeout, *t = nullptr; //no timers - wait for I/O only
+		if(timers != nullptr)
+		{
+			uint64_t current = now();
+			uint64_t wait = (timers->deadline > current) ? timers->deadline - current : 0;
+			timeout.tv_sec = wait / 1000000;
+			timeout.tv_nsec = (wait % 1000000) * 1000;
+			t = &timeout;
+		}
+
+		struct pollfd fds[EVENT_LOOP_MAX_WATCHES];
+		uint8_t count = watchCount;
+		for(uint8_t i = 0; i < count; i++)
+		{
+			fds[i].fd = watches[i].fd;
+			fds[i].events = POLLIN;
+			fds[i].revents = 0;
+		}
+		int ready = ppoll(fds, count, t, nullptr);
+		if((ready < 0) && (errno != EINTR))
+			break;
+
+		//I/O first, so that data that arrived together with a timeout is still delivered
+		for(uint8_t i = 0; (i < count) && (ready > 0) && running; i++)
+		{
+			if(fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+			{
+				//the callback may unwatch descriptors, so the watch is looked up again
+				for(uint8_t w = 0; w < watchCount; w++)
+				{
+					if(watches[w].fd == fds[i].fd)
+					{
+						watches[w].callback(watches[w].arg);
+						break;
+					}
+				}
+			}
+		}
+
+		uint64_t current = now();
+		while(running && (timers != nullptr) && (timers->deadline <= current))
+		{
+			EventTimer_t *timer = timers;
+			timers = timer->next;
+			timer->scheduled = false;
+			timer->callback(timer->arg);
+		}
+	}
+	running = false;
+}
+
+void EventLoop::stop(void)
+{
+	running = false;
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file EventLoop.h
+* \brief Single-threaded poll() event loop with file descriptor watches and intrusive timers (no allocation while running)
+* \copyright GNU GPLv3
+**/
+
+#ifndef EVENTLOOP_H_
+#define EVENTLOOP_H_
+#include <stdint.h>
+
+#define EVENT_LOOP_MAX_WATCHES 8 //maximum number of watched file descriptors
+
+//timer node, owned by the user (e.g. a member of an awaiter) and linked into the loop while scheduled
+typedef struct EventTimer
+{
+	uint64_t deadline; //loop time in microseconds
+	void (*callback)(void*); //called from run() when the deadline passes
+	void *arg;
+	struct EventTimer *next;
+	bool scheduled;
+} EventTimer_t;
+
+class EventLoop
+{
+private:
+	typedef struct
+	{
+		int fd;
+		void (*callback)(void*); //called when the file descriptor is readable
+		void *arg;
+	} Watch_t;
+
+	Watch_t watches[EVENT_LOOP_MAX_WATCHES];
+	uint8_t watchCount;
+	EventTimer_t *timers; //sorted by deadline
+	bool running;
+public:
+	EventLoop();
+	/**
+	* \brief Gets the loop time (steady clock)
+	* \return Time in microseconds
+	**/
+	static uint64_t now(void);
+	/**
+	* \brief Calls a function every time a file descriptor is readable
+	* \param[in] fd File descriptor
+	* \param[in] *callback Function to be called
+	* \param[in] *arg Callback argument
+	* \return False if there are already EVENT_LOOP_MAX_WATCHES watches
+	**/
+	bool watch(int fd, void (*callback)(void*), void *arg);
+	/**
+	* \brief Stops watching a file descriptor
+	**/
+	void unwatch(int fd);
+	/**
+	* \brief Schedules a timer (or moves an already scheduled one)
+	* \param[in] *timer Timer node with callback and arg set, must stay valid until it fires or is cancelled
+	* \param[in] delay Delay in microseconds, 0 to run it in the next iteration, after pending I/O
+	**/
+	void schedule(EventTimer_t *timer, uint64_t delay);
+	/**
+	* \brief Removes a scheduled timer, does nothing if it isn't scheduled
+	**/
+	void cancel(EventTimer_t *timer);
+	/**
+	* \brief Runs the loop until stop() is called or there is nothing to wait for
+	**/
+	void run(void);
+	/**
+	* \brief Makes run() return after the current callback
+	**/
+	void stop(void);
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,273 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file FeaturePipeline.cpp
+* \brief Incremental per-channel features of the MPU6050 stream (rolling statistics, filters, sliding DFT)
+* \copyright GNU GPLv3
+**/
+
+#include "FeaturePipeline.h"
+#include <math.h>
+#include <string.h>
+
+#define _DFT_DAMPING 0.99999f //sliding DFT damping factor, keeps rounding errors from accumulating
+#define _RESYNC_INTERVAL 4096 //samples between exact recalculations of the rolling statistics and DFT (amortized O(1))
+
+FeaturePipeline::FeaturePipeline(const FeatureConfig_t &config, uint32_t robots, void (*callback)(const FeatureVector_t*))
+{
+	this->config = config;
+	if(this->config.window < 2)
+		this->config.window = 2;
+	if(this->config.bins > FEATURE_MAX_BINS)
+		this->config.bins = FEATURE_MAX_BINS;
+	if(this->config.bins > this->config.window / 2 + 1)
+		this->config.bins = this->config.window / 2 + 1;
+	if(this->config.fir.size() > this->config.window)
+		this->config.fir.resize(this->config.window);
+	this->robots = robots;
+	featureCallback = callback;
+
+	uint32_t lanes = robots * FEATURE_LANES;
+	features.assign(robots, FeatureVector_t());
+	for(uint32_t r = 0; r < robots; r++)
+		features[r].robot = r;
+	history.assign((size_t)this->config.window * lanes, 0.f);
+	mean.assign(lanes, 0.f);
+	m2.assign(lanes, 0.f);
+	iirState.assign(2 * lanes, 0.f);
+	lastIir.assign(lanes, 0.f);
+	dftRe.assign((size_t)this->config.bins * lanes, 0.f);
+	dftIm.assign((size_t)this->config.bins * lanes, 0.f);
+	position.assign(robots, 0);
+	count.assign(robots, 0);
+
+	twiddleRe.resize(this->config.bins);
+	twiddleIm.resize(this->config.bins);
+	for(uint8_t k = 0; k < this->config.bins; k++)
+	{
+		double phi = 2. * M_PI * k / this->config.window;
+		twiddleRe[k] = _DFT_DAMPING * cos(phi);
+		twiddleIm[k] = _DFT_DAMPING * sin(phi);
+	}
+	dampingN = powf(_DFT_DAMPING, this->config.window);
+}
+
+void FeaturePipeline::push(uint32_t robot, const float *sample)
+{
+	if(robot >= robots)
+		return;
+	update(robot, sample);
+	if(featureCallback != NULL)
+		(*featureCallback)(&features[robot]);
+}
+
+void FeaturePipeline::pushAll(const float *samples)
+{
+	for(uint32_t r = 0; r < robots; r++)
+		update(r, &samples[r * FEATURE_CHANNELS]);
+	if(featureCallback != NULL)
+	{
+		for(uint32_t r = 0; r < robots; r++)
+			(*featureCallback)(&features[r]);
+	}
+}
+
+void FeaturePipeline::getFeatures(uint32_t robot, FeatureVector_t *features)
+{
+	if(robot < robots)
+		*features = this->features[robot];
+}
+
+//every loop below runs over FEATURE_LANES contiguous floats and is vectorized by the compiler
+void FeaturePipeline::update(uint32_t robot, const float *sample)
+{
+	const uint32_t lanes = robots * FEATURE_LANES;
+	const uint32_t base = robot * FEATURE_LANES;
+	const uint16_t window = config.window;
+	const uint16_t pos = position[robot];
+	FeatureVector_t &f = features[robot];
+
+	float x[FEATURE_LANES] = {0.f};
+	memcpy(x, sample, FEATURE_CHANNELS * sizeof(float));
+	float *__restrict old = &history[(size_t)pos * lanes + base]; //sample leaving the window (0 while the window fills up)
+	float *__restrict mu = &mean[base];
+	float *__restrict var = &m2[base];
+	float oldX[FEATURE_LANES];
+	memcpy(oldX, old, sizeof(oldX));
+	memcpy(old, x, sizeof(x));
+
+	//rolling mean and variance (Welford's algorithm, sliding window version once the window is full)
+	float tmp[FEATURE_LANES];
+	if(count[robot] < window)
+	{
+		float n = (float)(count[robot] + 1);
+		for(int l = 0; l < FEATURE_LANES; l++)
+		{
+			float delta = x[l] - mu[l];
+			mu[l] += delta / n;
+			var[l] += delta * (x[l] - mu[l]);
+			tmp[l] = var[l] / n;
+		}
+	}
+	else
+	{
+		float invN = 1.f / window;
+		for(int l = 0; l < FEATURE_LANES; l++)
+		{
+			float newMean = mu[l] + (x[l] - oldX[l]) * invN;
+			var[l] += (x[l] - oldX[l]) * (x[l] - newMean + oldX[l] - mu[l]);
+			mu[l] = newMean;
+			tmp[l] = (var[l] > 0.f) ? var[l] * invN : 0.f;
+		}
+	}
+	memcpy(f.value, x, sizeof(f.value));
+	memcpy(f.mean, mu, sizeof(f.mean));
+	memcpy(f.variance, tmp, sizeof(f.variance));
+
+	//IIR biquad (transposed direct form II) and derivative of its output
+	float *__restrict z1 = &iirState[base];
+	float *__restrict z2 = &iirState[lanes + base];
+	float *__restrict prev = &lastIir[base];
+	float deriv[FEATURE_LANES];
+	const float b0 = config.iir[0], b1 = config.iir[1], b2 = config.iir[2], a1 = config.iir[3], a2 = config.iir[4];
+	for(int l = 0; l < FEATURE_LANES; l++)
+	{
+		float y = b0 * x[l] + z1[l];
+		z1[l] = b1 * x[l] - a1 * y + z2[l];
+		z2[l] = b2 * x[l] - a2 * y;
+		tmp[l] = y;
+		deriv[l] = (y - prev[l]) * config.sampleRate;
+		prev[l] = y;
+	}
+	memcpy(f.iir, tmp, sizeof(f.iir));
+	memcpy(f.derivative, deriv, sizeof(f.derivative));
+
+	//FIR filter over the history ring buffer
+	float acc[FEATURE_LANES] = {0.f};
+	for(size_t t = 0; t < config.fir.size(); t++)
+	{
+		const float c = config.fir[t];
+		const float *__restrict h = &history[(size_t)((pos + window - t) % window) * lanes + base];
+		for(int l = 0; l < FEATURE_LANES; l++)
+			acc[l] += c * h[l];
+	}
+	memcpy(f.fir, acc, sizeof(f.fir));
+
+	//damped sliding DFT: X_k = r W_k X_k + W_k (x - r^N x_old)
+	float in[FEATURE_LANES];
+	for(int l = 0; l < FEATURE_LANES; l++)
+		in[l] = x[l] - dampingN * oldX[l];
+	for(uint8_t k = 0; k < config.bins; k++)
+	{
+		float *__restrict re = &dftRe[(size_t)k * lanes + base];
+		float *__restrict im = &dftIm[(size_t)k * lanes + base];
+		const float wr = twiddleRe[k] / _DFT_DAMPING, wi = twiddleIm[k] / _DFT_DAMPING;
+		const float dr = twiddleRe[k], di = twiddleIm[k];
+		for(int l = 0; l < FEATURE_LANES; l++)
+		{
+			float r = dr * re[l] - di * im[l] + wr * in[l];
+			float i = dr * im[l] + di * re[l] + wi * in[l];
+			re[l] = r;
+			im[l] = i;
+			tmp[l] = sqrtf(r * r + i * i);
+		}
+		memcpy(f.spectrum[k], tmp, sizeof(f.spectrum[k]));
+	}
+
+	position[robot] = (pos + 1) % window;
+	count[robot]++;
+	f.sample = count[robot];
+	if(((count[robot] % _RESYNC_INTERVAL) == 0) && (count[robot] >= window))
+		resync(robot);
+}
+
+//recalculates rolling statistics and DFT from the history, removes accumulated rounding errors
+void FeaturePipeline::resync(uint32_t robot)
+{
+	const uint32_t lanes = robots * FEATURE_LANES;
+	const uint32_t base = robot * FEATURE_LANES;
+	const uint16_t window = config.window;
+	const uint16_t newest = (position[robot] + window - 1) % window;
+
+	double s[FEATURE_LANES] = {0.}, s2[FEATURE_LANES] = {0.};
+	for(uint16_t i = 0; i < window; i++)
+	{
+		const float *h = &history[(size_t)i * lanes + base];
+		for(int l = 0; l < FEATURE_LANES; l++)
+			s[l] += h[l];
+	}
+	for(int l = 0; l < FEATURE_LANES; l++)
+		s[l] /= window;
+	for(uint16_t i = 0; i < window; i++)
+	{
+		const float *h = &history[(size_t)i * lanes + base];
+		for(int l = 0; l < FEATURE_LANES; l++)
+			s2[l] += (h[l] - s[l]) * (h[l] - s[l]);
+	}
+	for(int l = 0; l < FEATURE_LANES; l++)
+	{
+		mean[base + l] = s[l];
+		m2[base + l] = s2[l];
+	}
+
+	for(uint8_t k = 0; k < config.bins; k++) //X_k = W_k * sum((r W_k)^m x[n - m])
+	{
+		double re[FEATURE_LANES] = {0.}, im[FEATURE_LANES] = {0.};
+		for(uint16_t m = 0; m < window; m++)
+		{
+			const float *h = &history[(size_t)((newest + window - m) % window) * lanes + base];
+			double phi = 2. * M_PI * k * (m + 1) / window;
+			double a = pow(_DFT_DAMPING, m);
+			for(int l = 0; l < FEATURE_LANES; l++)
+			{
+				re[l] += a * cos(phi) * h[l];
+				im[l] += a * sin(phi) * h[l];
+			}
+		}
+		for(int l = 0; l < FEATURE_LANES; l++)
+		{
+			dftRe[(size_t)k * lanes + base + l] = re[l];
+			dftIm[(size_t)k * lanes + base + l] = im[l];
+		}
+	}
+}
+
+void FeaturePipeline::lowPass(float cutoff, float sampleRate, float *coeffs)
+{
+	double k = tan(M_PI * cutoff / sampleRate);
+	double q = M_SQRT1_2; //Butterworth
+	double norm = 1. / (1. + k / q + k * k);
+	coeffs[0] = k * k * norm;
+	coeffs[1] = 2. * coeffs[0];
+	coeffs[2] = coeffs[0];
+	coeffs[3] = 2. * (k * k - 1.) * norm;
+	coeffs[4] = (1. - k / q + k * k) * norm;
+}
+
+FeatureConfig_t FeaturePipeline::defaultConfig(float sampleRate)
+{
+	FeatureConfig_t c;
+	c.window = 64;
+	c.bins = 8;
+	c.sampleRate = sampleRate;
+	float cutoff = (sampleRate > 80.f) ? 20.f : sampleRate / 4.f;
+	lowPass(cutoff, sampleRate, c.iir);
+	c.fir.assign(5, 1.f / 5.f);
+	return c;
+}
\ No newline at end of file
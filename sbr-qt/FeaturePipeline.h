@@ -0,0 +1,118 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file FeaturePipeline.h
+* \brief Incremental per-channel features of the MPU6050 stream (rolling statistics, filters, sliding DFT)
+* \copyright GNU GPLv3
+**/
+
+#ifndef FEATUREPIPELINE_H_
+#define FEATUREPIPELINE_H_
+#include <stdint.h>
+#include <vector>
+
+#define FEATURE_CHANNELS 6 //accelerometer X, Y, Z, gyroscope X, Y, Z
+#define FEATURE_LANES 8 //channels are padded to 8 lanes, so every update is a fixed-width loop the compiler turns into SIMD
+#define FEATURE_MAX_BINS 16 //maximum number of sliding DFT bins
+
+//pipeline configuration
+typedef struct
+{
+	uint16_t window; //samples in the rolling window and sliding DFT length
+	uint8_t bins; //sliding DFT bins 0 to bins - 1 (at most FEATURE_MAX_BINS and window / 2 + 1)
+	float sampleRate; //sample rate in Hz, used by the derivative
+	float iir[5]; //biquad coefficients b0, b1, b2, a1, a2 (a0 = 1)
+	std::vector<float> fir; //FIR taps, newest sample first (at most window taps)
+} FeatureConfig_t;
+
+//features of one robot after a sample
+typedef struct
+{
+	uint32_t robot; //robot index in the fleet
+	uint64_t sample; //number of samples processed for this robot
+	float value[FEATURE_CHANNELS]; //latest sample
+	float mean[FEATURE_CHANNELS]; //rolling mean
+	float variance[FEATURE_CHANNELS]; //rolling variance
+	float iir[FEATURE_CHANNELS]; //IIR filter output
+	float fir[FEATURE_CHANNELS]; //FIR filter output
+	float derivative[FEATURE_CHANNELS]; //derivative of the IIR filter output, per second
+	float spectrum[FEATURE_MAX_BINS][FEATURE_CHANNELS]; //sliding DFT magnitudes
+} FeatureVector_t;
+
+class FeaturePipeline
+{
+private:
+	FeatureConfig_t config;
+	uint32_t robots; //fleet size
+	void (*featureCallback)(const FeatureVector_t*); //callback function to be called with features after every sample
+	std::vector<FeatureVector_t> features; //latest features of every robot
+
+	//per robot state, FEATURE_LANES floats per robot in every array ([slot][robot * FEATURE_LANES + lane])
+	std::vector<float> history; //last window samples (ring buffer)
+	std::vector<float> mean; //rolling mean
+	std::vector<float> m2; //rolling sum of squared differences from the mean
+	std::vector<float> iirState; //biquad state (transposed direct form II, 2 slots)
+	std::vector<float> lastIir; //previous IIR output
+	std::vector<float> dftRe, dftIm; //sliding DFT state (bins slots)
+	std::vector<float> twiddleRe, twiddleIm; //damped DFT twiddle factors per bin
+	float dampingN; //damping factor to the power of window
+	std::vector<uint16_t> position; //ring buffer position per robot
+	std::vector<uint64_t> count; //samples per robot
+
+	void update(uint32_t robot, const float *sample);
+	void resync(uint32_t robot);
+public:
+	/**
+	* \brief Pipeline initializer
+	* \param[in] &config Pipeline configuration
+	* \param[in] robots Number of robots in the fleet
+	* \param[in] *callback Pointer to the function that should be called with features after every sample, can be NULL
+	**/
+	FeaturePipeline(const FeatureConfig_t &config, uint32_t robots, void (*callback)(const FeatureVector_t*));
+	/**
+	* \brief Processes a sample of one robot, O(bins + FIR taps) per sample
+	* \param[in] robot Robot index
+	* \param[in] *sample FEATURE_CHANNELS values (acc X, Y, Z in m/s^2, gyro X, Y, Z in rad/s)
+	**/
+	void push(uint32_t robot, const float *sample);
+	/**
+	* \brief Processes one sample of every robot in the fleet
+	* \param[in] *samples FEATURE_CHANNELS values per robot, robots one after another
+	**/
+	void pushAll(const float *samples);
+	/**
+	* \brief Gets the latest features of a robot
+	* \param[in] robot Robot index
+	* \param[out] *features Feature vector
+	**/
+	void getFeatures(uint32_t robot, FeatureVector_t *features);
+	/**
+	* \brief Calculates 2nd order Butterworth low-pass biquad coefficients
+	* \param[in] cutoff Cutoff frequency in Hz
+	* \param[in] sampleRate Sample rate in Hz
+	* \param[out] *coeffs Coefficients b0, b1, b2, a1, a2
+	**/
+	static void lowPass(float cutoff, float sampleRate, float *coeffs);
+	/**
+	* \brief Default configuration: 64 samples window, 8 DFT bins, 20 Hz low-pass IIR, 5-tap moving average FIR
+	* \param[in] sampleRate Sample rate in Hz
+	**/
+	static FeatureConfig_t defaultConfig(float sampleRate);
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,107 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file PlantSimulator.cpp
+* \brief Tilt dynamics simulator of an identified plant model, produces MPU6050 samples
+* \copyright GNU GPLv3
+**/
+
+#include "PlantSimulator.h"
+#include <math.h>
+#include <string.h>
+
+#define _GRAVITY 9.80665f
+
+PlantSimulator::PlantSimulator(const SimConfig_t &config) : noise(0.f, 1.f)
+{
+	this->config = config;
+	float l = (config.model.interval > 0.f) ? roundf(config.model.lag / config.model.interval) : 0.f;
+	lag = (l < 0.f) ? 0 : ((l > SIM_MAX_LAG - 1) ? SIM_MAX_LAG - 1 : (uint8_t)l);
+	reset(0.f, 0.f, 0);
+}
+
+void PlantSimulator::reset(float tilt, float rate, uint32_t seed)
+{
+	this->tilt = tilt;
+	this->rate = rate;
+	memset(commands, 0, sizeof(commands));
+	commandPos = 0;
+	random.seed(seed);
+	noise.reset();
+}
+
+void PlantSimulator::sense(float *sample)
+{
+	sample[0] = -_GRAVITY * sinf(tilt) + config.accelNoise * noise(random);
+	sample[1] = config.accelNoise * noise(random);
+	sample[2] = _GRAVITY * cosf(tilt) + config.accelNoise * noise(random);
+	sample[3] = config.gyroNoise * noise(random);
+	sample[4] = rate + config.gyroNoise * noise(random);
+	sample[5] = config.gyroNoise * noise(random);
+}
+
+bool PlantSimulator::step(int16_t motorA, int16_t motorB)
+{
+	const PlantModel_t &m = config.model;
+	commandPos = (commandPos + 1) % SIM_MAX_LAG;
+	commands[commandPos] = (motorA + config.motorSignB * motorB) / 2.f;
+	float u = commands[(commandPos + SIM_MAX_LAG - lag) % SIM_MAX_LAG];
+	//dead zone: commands below it don't move the wheels
+	float effective = (fabsf(u) > m.deadzone) ? u - copysignf(m.deadzone, u) : 0.f;
+	double accel = m.stiffness * tilt - m.damping * rate + m.gain * effective + m.offset;
+	rate += accel * m.interval;
+	tilt += rate * m.interval;
+	return fabs(tilt) < config.fallTilt;
+}
+
+float PlantSimulator::getTilt(void)
+{
+	return tilt;
+}
+
+float PlantSimulator::getRate(void)
+{
+	return rate;
+}
+
+SimConfig_t PlantSimulator::defaultConfig(const PlantModel_t &model)
+{
+	SimConfig_t c;
+	c.model = model;
+	c.accelNoise = 0.04f;
+	c.gyroNoise = 0.002f;
+	c.fallTilt = M_PI / 4.f;
+	c.motorSignB = -1;
+	return c;
+}
+
+PlantModel_t PlantSimulator::defaultModel(float interval)
+{
+	PlantModel_t m;
+	m.stiffness = 60.f; //g / l
+	m.damping = 0.5f;
+	m.gain = -0.3f;
+	m.deadzone = 20.f;
+	m.offset = 0.f;
+	m.lag = interval;
+	m.interval = interval;
+	m.residual = 0.f;
+	m.samples = 0;
+	return m;
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file PlantSimulator.h
+* \brief Tilt dynamics simulator of an identified plant model, produces MPU6050 samples
+* \copyright GNU GPLv3
+**/
+
+#ifndef PLANTSIMULATOR_H_
+#define PLANTSIMULATOR_H_
+#include <stdint.h>
+#include <random>
+#include "SystemIdentifier.h"
+
+#define SIM_MAX_LAG (SYSID_MAX_LAG + 2) //command delay line length
+
+typedef struct
+{
+	PlantModel_t model;
+	float accelNoise; //accelerometer noise standard deviation in m/s^2
+	float gyroNoise; //gyroscope noise standard deviation in rad/s
+	float fallTilt; //tilt in radians at which the robot falls over
+	int8_t motorSignB; //drive command is (motorA + motorSignB * motorB) / 2, as in SysIdConfig_t
+} SimConfig_t;
+
+class PlantSimulator
+{
+private:
+	SimConfig_t config;
+	float commands[SIM_MAX_LAG]; //drive command delay line
+	uint8_t commandPos;
+	uint8_t lag; //model lag in samples
+	double tilt;
+	double rate;
+	std::mt19937 random;
+	std::normal_distribution<float> noise;
+public:
+	/**
+	* \brief Simulator initializer
+	* \param[in] &config Plant model and sensor noise
+	**/
+	PlantSimulator(const SimConfig_t &config);
+	/**
+	* \brief Starts a new episode
+	* \param[in] tilt Initial tilt in radians
+	* \param[in] rate Initial tilt rate in rad/s
+	* \param[in] seed Noise seed, the same seed gives the same episode
+	**/
+	void reset(float tilt, float rate, uint32_t seed);
+	/**
+	* \brief Gets the sample for the current state
+	* \param[out] *sample Acc X, Y, Z in m/s^2, gyro X, Y, Z in rad/s (X forward, Z up, tilt about Y)
+	**/
+	void sense(float *sample);
+	/**
+	* \brief Advances the simulation by one sample interval (semi-implicit Euler)
+	* \param[in] motorA Motor A command
+	* \param[in] motorB Motor B command
+	* \return False if the robot fell over
+	**/
+	bool step(int16_t motorA, int16_t motorB);
+	/**
+	* \brief Gets the true tilt in radians
+	**/
+	float getTilt(void);
+	/**
+	* \brief Gets the true tilt rate in rad/s
+	**/
+	float getRate(void);
+	/**
+	* \brief Default settings: MPU6050 noise at 44 Hz filter bandwidth, falls over at 45 degrees
+	* \param[in] &model Plant model
+	**/
+	static SimConfig_t defaultConfig(const PlantModel_t &model);
+	/**
+	* \brief Example model of the SBR robot (about 10 cm center of mass height), used without an identified model
+	* \param[in] interval Sample interval in seconds
+	**/
+	static PlantModel_t defaultModel(float interval);
+};
+#endif
\ No newline at end of file
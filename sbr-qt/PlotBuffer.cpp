@@ -0,0 +1,190 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file PlotBuffer.cpp
+* \brief Multi-resolution sample history for live plots: a raw ring plus min/max rings of coarser levels, so a view of any length costs about the same
+* \copyright GNU GPLv3
+**/
+
+#include "PlotBuffer.h"
+#include <math.h>
+#include <string.h>
+
+PlotBuffer::PlotBuffer(const PlotBufferConfig_t &config)
+{
+	this->config = config;
+	if(this->config.channels == 0)
+		this->config.channels = 1;
+	if(this->config.levels < 1)
+		this->config.levels = 1;
+	if(this->config.levels > PLOT_MAX_LEVELS)
+		this->config.levels = PLOT_MAX_LEVELS;
+	if(this->config.factor < 2)
+		this->config.factor = 2;
+	uint32_t capacity = 2;
+	while(capacity < this->config.capacity)
+		capacity <<= 1;
+	this->config.capacity = capacity;
+	mask = capacity - 1;
+	count = 0;
+	memset(filled, 0, sizeof(filled));
+
+	size_t size = (size_t)this->config.channels * capacity;
+	for(uint8_t l = 0; l < this->config.levels; l++)
+	{
+		blockSize[l] = (l == 0) ? 1 : blockSize[l - 1] * this->config.factor;
+		lo[l].assign(size, 0.f);
+		if(l > 0)
+			hi[l].assign(size, 0.f);
+	}
+	accLo.assign((size_t)this->config.levels * this->config.channels, 0.f);
+	accHi.assign((size_t)this->config.levels * this->config.channels, 0.f);
+}
+
+void PlotBuffer::append(const float *value)
+{
+	uint8_t channels = config.channels;
+	uint32_t slot = count & mask;
+	for(uint8_t c = 0; c < channels; c++)
+		lo[0][(size_t)c * config.capacity + slot] = value[c];
+	count++;
+	//every level accumulates the finished blocks of the level below, the raw samples for level 1
+	const float *inLo = value, *inHi = value;
+	for(uint8_t l = 1; l < config.levels; l++)
+	{
+		float *aLo = &accLo[(size_t)l * channels];
+		float *aHi = &accHi[(size_t)l * channels];
+		if(filled[l] == 0)
+		{
+			for(uint8_t c = 0; c < channels; c++)
+			{
+				aLo[c] = inLo[c];
+				aHi[c] = inHi[c];
+			}
+		}
+		else
+		{
+			for(uint8_t c = 0; c < channels; c++)
+			{
+				aLo[c] = (inLo[c] < aLo[c]) ? inLo[c] : aLo[c];
+				aHi[c] = (inHi[c] > aHi[c]) ? inHi[c] : aHi[c];
+			}
+		}
+		if(++filled[l] < config.factor)
+			break;
+		filled[l] = 0;
+		uint32_t block = (count / blockSize[l] - 1) & mask;
+		for(uint8_t c = 0; c < channels; c++)
+		{
+			lo[l][(size_t)c * config.capacity + block] = aLo[c];
+			hi[l][(size_t)c * config.capacity + block] = aHi[c];
+		}
+		inLo = aLo;
+		inHi = aHi;
+	}
+}
+
+uint64_t PlotBuffer::oldestBlock(uint8_t level) const
+{
+	uint64_t finished = count / blockSize[level];
+	return (finished > config.capacity) ? finished - config.capacity : 0;
+}
+
+uint8_t PlotBuffer::query(uint8_t channel, uint64_t first, uint64_t last, uint32_t columns, float *min, float *max) const
+{
+	if((columns == 0) || (channel >= config.channels))
+		return 0;
+	uint64_t span = (last > first) ? last - first : 1;
+	//the coarsest level with blocks not longer than a column, coarser if the finer one doesn't reach back to the first sample
+	uint8_t level = 0;
+	while((level + 1 < config.levels) && (blockSize[level + 1] * columns <= span))
+		level++;
+	while((level + 1 < config.levels) && (first < oldestBlock(level) * blockSize[level]))
+		level++;
+
+	uint64_t size = blockSize[level];
+	uint64_t oldest = oldestBlock(level);
+	uint64_t finished = count / size;
+	bool partial = (level > 0) && (count % size != 0); //the unfinished block is in the accumulators
+	const float *rowLo = &lo[level][(size_t)channel * config.capacity];
+	const float *rowHi = (level > 0) ? &hi[level][(size_t)channel * config.capacity] : rowLo;
+	for(uint32_t x = 0; x < columns; x++)
+	{
+		//blocks starting in the column, at least the one containing its first sample when the level is coarser than a column
+		uint64_t b0 = (first + span * x / columns) / size;
+		uint64_t b1 = (first + span * (x + 1) / columns) / size;
+		if(b1 <= b0)
+			b1 = b0 + 1;
+		float l = INFINITY, h = -INFINITY;
+		uint64_t from = (b0 > oldest) ? b0 : oldest;
+		uint64_t to = (b1 < finished) ? b1 : finished;
+		for(uint64_t b = from; b < to; b++)
+		{
+			uint32_t slot = b & mask;
+			l = (rowLo[slot] < l) ? rowLo[slot] : l;
+			h = (rowHi[slot] > h) ? rowHi[slot] : h;
+		}
+		if(partial && (b0 <= finished) && (finished < b1))
+		{
+			for(uint8_t k = 1; k <= level; k++) //the unfinished block is made of the unfinished blocks of all levels up to it
+			{
+				if(filled[k] == 0)
+					continue;
+				l = fminf(l, accLo[(size_t)k * config.channels + channel]);
+				h = fmaxf(h, accHi[(size_t)k * config.channels + channel]);
+			}
+		}
+		if(l > h)
+			l = h = NAN;
+		min[x] = l;
+		max[x] = h;
+	}
+	return level;
+}
+
+uint64_t PlotBuffer::getCount(void) const
+{
+	return count;
+}
+
+uint64_t PlotBuffer::getOldest(void) const
+{
+	uint8_t top = config.levels - 1;
+	return oldestBlock(top) * blockSize[top];
+}
+
+uint64_t PlotBuffer::getBlockSize(uint8_t level) const
+{
+	return (level < config.levels) ? blockSize[level] : 0;
+}
+
+const PlotBufferConfig_t &PlotBuffer::getConfig(void) const
+{
+	return config;
+}
+
+PlotBufferConfig_t PlotBuffer::defaultConfig(uint8_t channels)
+{
+	PlotBufferConfig_t c;
+	c.channels = channels;
+	c.capacity = 1 << 18;
+	c.levels = 4;
+	c.factor = 16;
+	return c;
+}
@@ -0,0 +1,102 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file PlotBuffer.h
+* \brief Multi-resolution sample history for live plots: a raw ring plus min/max rings of coarser levels, so a view of any length costs about the same
+* \copyright GNU GPLv3
+**/
+
+#ifndef PLOTBUFFER_H_
+#define PLOTBUFFER_H_
+#include <stdint.h>
+#include <vector>
+
+#define PLOT_MAX_LEVELS 8
+
+//buffer configuration
+typedef struct
+{
+	uint8_t channels; //values per sample
+	uint32_t capacity; //samples kept at level 0 and blocks at every coarser level (rounded up to a power of 2)
+	uint8_t levels; //level 0 keeps raw samples, level k the minimum and maximum of blocks of factor^k samples (1 to PLOT_MAX_LEVELS)
+	uint16_t factor; //block size ratio between levels
+} PlotBufferConfig_t;
+
+//not thread-safe, append() and query() are called from the same thread
+class PlotBuffer
+{
+private:
+	PlotBufferConfig_t config;
+	uint32_t mask; //capacity - 1
+	uint64_t count; //samples appended
+	uint64_t blockSize[PLOT_MAX_LEVELS];
+	uint32_t filled[PLOT_MAX_LEVELS]; //blocks of the level below (samples for level 1) in the unfinished block of every level
+	std::vector<float> lo[PLOT_MAX_LEVELS]; //block minimums (raw samples at level 0), [channel * capacity + block % capacity]
+	std::vector<float> hi[PLOT_MAX_LEVELS]; //block maximums, empty at level 0
+	std::vector<float> accLo, accHi; //minimum and maximum of the finished parts of the unfinished block of every level, [level * channels + channel]
+
+	uint64_t oldestBlock(uint8_t level) const;
+public:
+	/**
+	* \brief Buffer initializer, allocates all levels
+	* \param[in] &config Buffer configuration
+	**/
+	PlotBuffer(const PlotBufferConfig_t &config);
+	/**
+	* \brief Appends a sample, O(channels) amortized without allocation
+	* \param[in] *value config.channels values
+	**/
+	void append(const float *value);
+	/**
+	* \brief Gets the minimum and maximum of one channel for every pixel column of a view. The level is chosen so that a column
+	* spans at most about factor blocks, so the cost depends on the number of columns, not on the number of samples in the view.
+	* Samples older than the finer levels keep come from a coarser one.
+	* \param[in] channel Channel
+	* \param[in] first Number of the first sample in the view (from 0)
+	* \param[in] last Number of the sample after the view
+	* \param[in] columns Number of columns
+	* \param[out] *min Minimum per column, NaN if the column has no samples (not appended yet or no longer kept)
+	* \param[out] *max Maximum per column
+	* \return Level used
+	**/
+	uint8_t query(uint8_t channel, uint64_t first, uint64_t last, uint32_t columns, float *min, float *max) const;
+	/**
+	* \brief Gets the number of samples appended
+	**/
+	uint64_t getCount(void) const;
+	/**
+	* \brief Gets the number of the oldest sample still kept at the coarsest level
+	**/
+	uint64_t getOldest(void) const;
+	/**
+	* \brief Gets the number of samples per block of a level
+	**/
+	uint64_t getBlockSize(uint8_t level) const;
+	/**
+	* \brief Gets the buffer configuration, capacity rounded up
+	**/
+	const PlotBufferConfig_t &getConfig(void) const;
+	/**
+	* \brief Default configuration: 256 Ki samples per level, 4 levels with a factor of 16 (at 1 kHz about 4 minutes of raw samples,
+	* 70 minutes at 16 and 18 hours at 256 samples per block, 12 days in total), 7 MiB per channel
+	* \param[in] channels Values per sample
+	**/
+	static PlotBufferConfig_t defaultConfig(uint8_t channels);
+};
+#endif
@@ -0,0 +1,354 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file PlotView.cpp
+* \brief Live plot of a PlotBuffer: min/max columns from the buffer level matching the zoom, repainted by a fixed frame clock instead of every sample
+* \copyright GNU GPLv3
+**/
+
+#include "PlotView.h"
+#include <math.h>
+#include <string.h>
+#include <QPainter>
+#include <QPaintEvent>
+#include <QWheelEvent>
+#include <QMouseEvent>
+#include <QKeyEvent>
+#include <QElapsedTimer>
+
+#define _MARGIN_LEFT 70 //y axis labels
+#define _MARGIN_RIGHT 10
+#define _MARGIN_TOP 18 //panel title and legend
+#define _AXIS_HEIGHT 20 //time axis labels and status line
+#define _ZOOM_STEP 0.8 //span ratio per mouse wheel step
+#define _MIN_SPAN 16 //samples
+
+static const QColor channelColor[] = {QColor(220, 50, 47), QColor(40, 160, 40), QColor(38, 110, 210), QColor(180, 120, 0)};
+
+PlotView::PlotView(PlotBuffer *buffer, const PlotViewConfig_t &config, QWidget *parent) : QWidget(parent)
+{
+	this->buffer = buffer;
+	this->config = config;
+	if(this->config.fps == 0)
+		this->config.fps = 1;
+	if(this->config.interval == 0)
+		this->config.interval = 1;
+	follow = true;
+	end = 0;
+	span = 1;
+	setSpan(config.span);
+	changed = true;
+	drawnCount = 0;
+	plotWidth = 1;
+	dragging = false;
+	dragX = 0;
+	dragEnd = 0;
+	memset(&stats, 0, sizeof(stats));
+	setFocusPolicy(Qt::StrongFocus);
+	setAttribute(Qt::WA_OpaquePaintEvent); //every pixel is painted, Qt doesn't have to clear the background
+	frameTimer.setTimerType(Qt::PreciseTimer);
+	QObject::connect(&frameTimer, &QTimer::timeout, [this]()
+	{
+		onFrame();
+	});
+	frameTimer.start(1000 / this->config.fps);
+}
+
+void PlotView::addPanel(const QString &title, const QStringList &names, uint8_t first)
+{
+	PlotPanel_t p;
+	p.title = title;
+	p.names = names;
+	p.first = first;
+	p.channels = names.size();
+	panels.push_back(p);
+	changed = true;
+}
+
+void PlotView::setInterval(uint32_t interval)
+{
+	if(interval == 0)
+		return;
+	double seconds = span * config.interval * 1e-6;
+	config.interval = interval;
+	setSpan(seconds); //the visible time stays the same
+}
+
+void PlotView::setSpan(float seconds)
+{
+	span = seconds * 1e6 / config.interval;
+	if(span < _MIN_SPAN)
+		span = _MIN_SPAN;
+	changed = true;
+}
+
+void PlotView::setEnd(uint64_t end)
+{
+	follow = false;
+	scrollTo(end);
+}
+
+void PlotView::setFollow(bool follow)
+{
+	this->follow = follow;
+	if(!follow)
+		end = rightEdge();
+	changed = true;
+}
+
+const PlotViewStats_t &PlotView::getStats(void) const
+{
+	return stats;
+}
+
+//samples arrive at any time, the view is repainted only by the frame clock
+void PlotView::onFrame(void)
+{
+	if(changed || (buffer->getCount() != drawnCount))
+		update();
+}
+
+uint64_t PlotView::rightEdge(void) const
+{
+	if(!follow)
+		return end;
+	uint64_t count = buffer->getCount();
+	return (count > span) ? count : (uint64_t)span; //until the view is full, samples fill it from the left
+}
+
+void PlotView::scrollTo(uint64_t end)
+{
+	uint64_t count = buffer->getCount();
+	uint64_t oldest = buffer->getOldest();
+	if(end < oldest + _MIN_SPAN)
+		end = oldest + _MIN_SPAN;
+	follow = (end >= count);
+	this->end = follow ? count : end;
+	changed = true;
+}
+
+QString PlotView::formatTime(uint64_t sample) const
+{
+	double seconds = sample * (config.interval * 1e-6);
+	uint32_t s = (uint32_t)seconds;
+	return QString::asprintf("%u:%02u:%06.3f", s / 3600, (s / 60) % 60, seconds - (s / 60) * 60);
+}
+
+void PlotView::paint(QPainter *painter, const QRect &rect)
+{
+	QElapsedTimer timer;
+	timer.start();
+	painter->fillRect(rect, Qt::white);
+	QFontMetrics fm = painter->fontMetrics();
+	int columns = rect.width() - _MARGIN_LEFT - _MARGIN_RIGHT;
+	if((columns < 1) || panels.empty())
+		return;
+	uint64_t right = rightEdge();
+	uint64_t visible = (uint64_t)span;
+	uint64_t left = (right > visible) ? right - visible : 0;
+	int panelHeight = (rect.height() - _AXIS_HEIGHT) / panels.size();
+
+	uint8_t level = 0;
+	for(size_t i = 0; i < panels.size(); i++)
+	{
+		const PlotPanel_t &panel = panels[i];
+		QRect area(rect.left() + _MARGIN_LEFT, rect.top() + i * panelHeight + _MARGIN_TOP, columns, panelHeight - _MARGIN_TOP - 4);
+		if(area.height() < 2)
+			continue;
+		lo.resize((size_t)panel.channels * columns);
+		hi.resize((size_t)panel.channels * columns);
+		float yMin = INFINITY, yMax = -INFINITY;
+		for(uint8_t c = 0; c < panel.channels; c++)
+		{
+			float *l = &lo[(size_t)c * columns], *h = &hi[(size_t)c * columns];
+			level = buffer->query(panel.first + c, left, right, columns, l, h);
+			for(int x = 0; x < columns; x++)
+			{
+				if(l[x] < yMin) //false for NaN
+					yMin = l[x];
+				if(h[x] > yMax)
+					yMax = h[x];
+			}
+		}
+		if(yMin > yMax)
+		{
+			yMin = -1.f;
+			yMax = 1.f;
+		}
+		float margin = (yMax > yMin) ? 0.05f * (yMax - yMin) : 1.f;
+		yMin -= margin;
+		yMax += margin;
+		float scale = area.height() / (yMax - yMin);
+
+		painter->setPen(QColor(200, 200, 200));
+		painter->drawRect(area.adjusted(0, 0, -1, -1));
+		if((yMin < 0.f) && (yMax > 0.f))
+		{
+			int zero = area.bottom() - (int)(-yMin * scale);
+			painter->drawLine(area.left(), zero, area.right(), zero);
+		}
+		painter->setPen(Qt::black);
+		painter->drawText(rect.left() + _MARGIN_LEFT, area.top() - 4, panel.title);
+		painter->drawText(QRect(rect.left(), area.top(), _MARGIN_LEFT - 4, fm.height()), Qt::AlignRight, QString::number(yMax, 'g', 4));
+		painter->drawText(QRect(rect.left(), area.bottom() - fm.height(), _MARGIN_LEFT - 4, fm.height()), Qt::AlignRight,
+		                  QString::number(yMin, 'g', 4));
+		int legendX = rect.left() + _MARGIN_LEFT + fm.horizontalAdvance(panel.title) + 16;
+
+		//one polyline per channel through the minimum and maximum of every column, split at columns without samples
+		for(uint8_t c = 0; c < panel.channels; c++)
+		{
+			const QColor &color = channelColor[c % (sizeof(channelColor) / sizeof(channelColor[0]))];
+			painter->setPen(color);
+			painter->drawText(legendX, area.top() - 4, panel.names[c]);
+			legendX += fm.horizontalAdvance(panel.names[c]) + 12;
+			const float *l = &lo[(size_t)c * columns], *h = &hi[(size_t)c * columns];
+			points.clear();
+			for(int x = 0; x <= columns; x++)
+			{
+				if((x == columns) || isnan(l[x]))
+				{
+					if(points.size() > 1)
+						painter->drawPolyline(points.data(), (int)points.size());
+					else if(points.size() == 1)
+						painter->drawPoint(points[0]);
+					points.clear();
+					continue;
+				}
+				qreal px = area.left() + x + 0.5;
+				qreal yLo = area.bottom() - (l[x] - yMin) * scale;
+				qreal yHi = area.bottom() - (h[x] - yMin) * scale;
+				//the end nearer to the previous column first, so the connecting segment doesn't cross the column
+				if(!points.empty() && (fabs(points.back().y() - yHi) < fabs(points.back().y() - yLo)))
+				{
+					points.push_back(QPointF(px, yHi));
+					points.push_back(QPointF(px, yLo));
+				}
+				else
+				{
+					points.push_back(QPointF(px, yLo));
+					points.push_back(QPointF(px, yHi));
+				}
+			}
+		}
+	}
+
+	int axisY = rect.top() + panels.size() * panelHeight;
+	painter->setPen(Qt::black);
+	QRect axis(rect.left() + _MARGIN_LEFT, axisY, columns, _AXIS_HEIGHT);
+	painter->drawText(axis, Qt::AlignLeft | Qt::AlignVCenter, formatTime(left));
+	painter->drawText(axis, Qt::AlignRight | Qt::AlignVCenter, formatTime(right));
+	QString status = QString::asprintf("%.3g s visible, level %u (%llu samples per block), %llu samples%s", span * config.interval * 1e-6,
+	                                   level, (unsigned long long)buffer->getBlockSize(level), (unsigned long long)buffer->getCount(),
+	                                   follow ? "" : ", paused (End to follow)");
+	painter->drawText(axis, Qt::AlignHCenter | Qt::AlignVCenter, status);
+
+	drawnCount = buffer->getCount();
+	plotWidth = columns;
+	changed = false;
+	uint32_t us = timer.nsecsElapsed() / 1000;
+	stats.frames++;
+	stats.lastUs = us;
+	stats.totalUs += us;
+	if(us > stats.maxUs)
+		stats.maxUs = us;
+	stats.level = level;
+}
+
+void PlotView::paintEvent(QPaintEvent*)
+{
+	QPainter painter(this);
+	paint(&painter, rect());
+}
+
+void PlotView::wheelEvent(QWheelEvent *event)
+{
+	double steps = event->angleDelta().y() / 120.;
+	double ratio = pow(_ZOOM_STEP, steps);
+	double limit = (double)(buffer->getCount() - buffer->getOldest());
+	double newSpan = span * ratio;
+	if(newSpan < _MIN_SPAN)
+		newSpan = _MIN_SPAN;
+	if((newSpan > limit) && (newSpan > span)) //zooming out stops at the whole history
+		newSpan = (span > limit) ? span : limit;
+	if(follow)
+		span = newSpan; //zooms around the newest sample
+	else
+	{
+		//the sample under the cursor stays in place
+		double fraction = (event->position().x() - _MARGIN_LEFT) / plotWidth;
+		if(fraction < 0.)
+			fraction = 0.;
+		if(fraction > 1.)
+			fraction = 1.;
+		double cursor = end - span * (1. - fraction);
+		span = newSpan;
+		double newEnd = cursor + span * (1. - fraction);
+		scrollTo((newEnd > 0.) ? (uint64_t)newEnd : 0);
+	}
+	changed = true;
+	event->accept();
+}
+
+void PlotView::mousePressEvent(QMouseEvent *event)
+{
+	if(event->button() != Qt::LeftButton)
+		return;
+	dragging = true;
+	dragX = event->pos().x();
+	dragEnd = rightEdge();
+}
+
+void PlotView::mouseMoveEvent(QMouseEvent *event)
+{
+	if(!dragging)
+		return;
+	double shift = (double)(event->pos().x() - dragX) * span / plotWidth; //dragging to the right shows older samples
+	double newEnd = (double)dragEnd - shift;
+	follow = false;
+	scrollTo((newEnd > 0.) ? (uint64_t)newEnd : 0);
+}
+
+void PlotView::mouseReleaseEvent(QMouseEvent*)
+{
+	dragging = false;
+}
+
+void PlotView::mouseDoubleClickEvent(QMouseEvent*)
+{
+	setFollow(true);
+}
+
+void PlotView::keyPressEvent(QKeyEvent *event)
+{
+	if(event->key() == Qt::Key_End)
+		setFollow(true);
+	else if(event->key() == Qt::Key_Home)
+		setEnd(buffer->getOldest() + (uint64_t)span);
+	else
+		QWidget::keyPressEvent(event);
+}
+
+PlotViewConfig_t PlotView::defaultConfig(uint32_t interval)
+{
+	PlotViewConfig_t c;
+	c.fps = 30;
+	c.span = 10.f;
+	c.interval = interval;
+	return c;
+}
@@ -0,0 +1,147 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file PlotView.h
+* \brief Live plot of a PlotBuffer: min/max columns from the buffer level matching the zoom, repainted by a fixed frame clock instead of every sample
+* \copyright GNU GPLv3
+**/
+
+#ifndef PLOTVIEW_H_
+#define PLOTVIEW_H_
+#include <stdint.h>
+#include <vector>
+#include <QWidget>
+#include <QPointF>
+#include <QTimer>
+#include <QString>
+#include <QStringList>
+#include "PlotBuffer.h"
+
+class QPainter;
+
+//view configuration
+typedef struct
+{
+	uint16_t fps; //frame clock, the view is repainted at most this often and only if there are new samples or the view changed
+	float span; //initial visible time in seconds
+	uint32_t interval; //sample interval in microseconds, scales the time axis
+} PlotViewConfig_t;
+
+//channels drawn in one panel with a common scale
+typedef struct
+{
+	QString title;
+	QStringList names; //channel names for the legend
+	uint8_t first; //first buffer channel
+	uint8_t channels;
+} PlotPanel_t;
+
+typedef struct
+{
+	uint64_t frames; //frames painted
+	uint32_t lastUs; //time spent in the last frame in microseconds
+	uint32_t maxUs; //longest frame
+	uint64_t totalUs;
+	uint8_t level; //buffer level of the last frame
+} PlotViewStats_t;
+
+//mouse wheel zooms, dragging scrolls back in time, double click or End follows the newest samples again, Home shows the oldest ones
+class PlotView : public QWidget
+{
+private:
+	PlotBuffer *buffer;
+	PlotViewConfig_t config;
+	std::vector<PlotPanel_t> panels;
+	QTimer frameTimer;
+	bool follow; //the right edge follows the newest sample
+	uint64_t end; //number of the sample after the right edge when not following
+	double span; //visible samples
+	bool changed; //the view was changed since the last frame
+	uint64_t drawnCount; //samples in the buffer at the last frame
+	int plotWidth; //width of the plot area at the last frame
+	bool dragging;
+	int dragX;
+	uint64_t dragEnd;
+	std::vector<float> lo, hi; //query results of the panel being drawn, [channel * columns + column]
+	std::vector<QPointF> points;
+	PlotViewStats_t stats;
+
+	void onFrame(void);
+	uint64_t rightEdge(void) const;
+	void scrollTo(uint64_t end);
+	QString formatTime(uint64_t sample) const;
+protected:
+	void paintEvent(QPaintEvent *event) override;
+	void wheelEvent(QWheelEvent *event) override;
+	void mousePressEvent(QMouseEvent *event) override;
+	void mouseMoveEvent(QMouseEvent *event) override;
+	void mouseReleaseEvent(QMouseEvent *event) override;
+	void mouseDoubleClickEvent(QMouseEvent *event) override;
+	void keyPressEvent(QKeyEvent *event) override;
+public:
+	/**
+	* \brief View initializer, starts the frame clock
+	* \param[in] *buffer Sample history, appended to in the same thread
+	* \param[in] &config View configuration
+	* \param[in] *parent Parent widget, can be NULL
+	**/
+	PlotView(PlotBuffer *buffer, const PlotViewConfig_t &config, QWidget *parent = NULL);
+	/**
+	* \brief Adds a panel below the existing ones
+	* \param[in] &title Panel title with the unit
+	* \param[in] &names Channel names, one per channel
+	* \param[in] first First buffer channel of the panel
+	**/
+	void addPanel(const QString &title, const QStringList &names, uint8_t first);
+	/**
+	* \brief Sets the sample interval of the time axis, e.g. after a rate change
+	* \param[in] interval Sample interval in microseconds
+	**/
+	void setInterval(uint32_t interval);
+	/**
+	* \brief Sets the visible time
+	* \param[in] seconds Visible time in seconds
+	**/
+	void setSpan(float seconds);
+	/**
+	* \brief Stops following the newest samples and shows the samples before end
+	* \param[in] end Number of the sample after the right edge
+	**/
+	void setEnd(uint64_t end);
+	/**
+	* \brief Follows the newest samples
+	**/
+	void setFollow(bool follow);
+	/**
+	* \brief Draws the current view, used by paintEvent() and for offscreen rendering into a QImage
+	* \param[in] *painter Painter
+	* \param[in] &rect Target rectangle
+	**/
+	void paint(QPainter *painter, const QRect &rect);
+	/**
+	* \brief Gets the frame statistics
+	**/
+	const PlotViewStats_t &getStats(void) const;
+	/**
+	* \brief Default configuration: 30 frames per second, 10 s visible
+	* \param[in] interval Sample interval in microseconds
+	**/
+	static PlotViewConfig_t defaultConfig(uint32_t interval);
+};
+#endif
@@ -0,0 +1,295 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file ReliableChannel.cpp
+* \brief Command delivery classes: acknowledged and retransmitted configuration commands (DATA_CMD_RELIABLE), latest-wins motor commands (DATA_CMD_MOTORS_SEQ)
+* \copyright GNU GPLv3
+**/
+
+#include "ReliableChannel.h"
+#include <string.h>
+#include <random>
+
+static_assert(SEQ_WINDOW > 0x0B00 - 0x09FF, "commands from before the LF-CR skip of the motor sequence must stay stale");
+
+ReliableChannel::ReliableChannel(const ReliableConfig_t &config, bool (*send)(SBRCP_data_t *d, void *arg),
+                                 void (*result)(uint16_t sequence, uint8_t type, ReliableResult_t result, void *arg), void *arg)
+	: config(config), send(send), result(result), arg(arg)
+{
+	std::random_device seed;
+	commandSeq = seed();
+	motorSeq = seed();
+	enabled = false;
+	queueLength = 0;
+	inFlight = false;
+	sentTime = 0;
+	retransmits = 0;
+	timeout = config.initialTimeout;
+	srtt = 0;
+	rttvar = 0;
+	rttValid = false;
+	robotMotors = robotStale = robotDuplicates = 0;
+	motorsAtStats = 0;
+	robotCountersValid = false;
+	memset(&stats, 0, sizeof(stats));
+}
+
+void ReliableChannel::setEnabled(bool enabled)
+{
+	this->enabled = enabled;
+}
+
+bool ReliableChannel::isEnabled(void)
+{
+	return enabled;
+}
+
+uint32_t ReliableChannel::getRto(void)
+{
+	if(!rttValid)
+		return config.initialTimeout;
+	uint32_t rto = srtt + 4 * rttvar;
+	if(rto < config.minTimeout)
+		return config.minTimeout;
+	return (rto > config.maxTimeout) ? config.maxTimeout : rto;
+}
+
+//sends the first queued command
+void ReliableChannel::transmit(uint64_t now)
+{
+	if(queueLength == 0)
+		return;
+	if(!inFlight)
+	{
+		inFlight = true;
+		retransmits = 0;
+		timeout = getRto();
+	}
+	sentTime = now;
+	stats.transmissions++;
+	send(&queue[0], arg);
+}
+
+//removes the command in flight and sends the next one
+void ReliableChannel::finish(ReliableResult_t r, uint64_t now)
+{
+	const SBRCP_CmdReliable_t *cmd = (const SBRCP_CmdReliable_t*)queue[0].payload;
+	uint16_t seq = cmd->sequence;
+	uint8_t type = cmd->command;
+	inFlight = false;
+	queueLength--;
+	memmove(&queue[0], &queue[1], queueLength * sizeof(queue[0]));
+	if(r == delivered)
+		stats.configDelivered++;
+	else if(r == rejected)
+		stats.configRejected++;
+	else
+		stats.configUndelivered++;
+	transmit(now); //before the callback, which may queue another command
+	if(result != NULL)
+		result(seq, type, r, arg);
+}
+
+bool ReliableChannel::sendConfig(const SBRCP_data_t *command, uint64_t now, uint16_t *sequence)
+{
+	if(!enabled)
+	{
+		SBRCP_data_t d = *command;
+		stats.configUnreliable++;
+		return send(&d, arg);
+	}
+	if(command->size > sizeof(((SBRCP_CmdReliable_t*)0)->payload))
+		return false;
+	if(SBRCP_hasFrameEnd(command, false)) //LF-CR in the payload would split the frame on the robot, every retransmission would fail the same way
+		return false;
+
+	//a waiting command of the same type would be overwritten by this one anyway
+	for(uint8_t i = inFlight ? 1 : 0; i < queueLength; i++)
+	{
+		const SBRCP_CmdReliable_t *old = (const SBRCP_CmdReliable_t*)queue[i].payload;
+		if(old->command != command->type)
+			continue;
+		uint16_t seq = old->sequence;
+		queueLength--;
+		memmove(&queue[i], &queue[i + 1], (queueLength - i) * sizeof(queue[0]));
+		stats.configSuperseded++;
+		if(result != NULL)
+			result(seq, command->type, superseded, arg);
+		break;
+	}
+	if(queueLength == RELIABLE_QUEUE)
+		return false;
+
+	SBRCP_CmdReliable_t *cmd = SBRCP_init<SBRCP_CmdReliable_t>(&queue[queueLength], offsetof(SBRCP_CmdReliable_t, payload) + command->size);
+	cmd->command = command->type;
+	memcpy(cmd->payload, command->payload, command->size);
+	do
+	{
+		if(++commandSeq == 0x0D0A) //LF-CR would split the frame
+			commandSeq++;
+		cmd->sequence = commandSeq;
+	}
+	while(SBRCP_hasFrameEnd(&queue[queueLength])); //the last payload byte and the CRC, which changes with the sequence number
+	queueLength++;
+	stats.configQueued++;
+	if(sequence != NULL)
+		*sequence = commandSeq;
+	if(!inFlight)
+		transmit(now);
+	return true;
+}
+
+bool ReliableChannel::sendMotors(int16_t motorA, int16_t motorB)
+{
+	SBRCP_data_t d;
+	stats.motorsSent++;
+	if(!enabled)
+	{
+		stats.motorsUnsequenced++;
+		SBRCP_CmdMotors_t *cmd = SBRCP_init<SBRCP_CmdMotors_t>(&d);
+		cmd->motorA = motorA;
+		cmd->motorB = motorB;
+	}
+	else
+	{
+		//LF-CR would split the frame: in the sequence itself, or from its high byte and the low byte of motor A
+		//the skip moves up to 257 numbers ahead, within SEQ_WINDOW, so commands from before it are still taken as stale
+		if(((++motorSeq >> 8) == '\n') && ((motorA & 0xFF) == '\r'))
+			motorSeq = 0x0B00;
+		if(motorSeq == 0x0D0A)
+			motorSeq++;
+		SBRCP_CmdMotorsSeq_t *cmd = SBRCP_init<SBRCP_CmdMotorsSeq_t>(&d);
+		cmd->sequence = motorSeq;
+		cmd->motorA = motorA;
+		cmd->motorB = motorB;
+	}
+	if(SBRCP_hasFrameEnd(&d)) //speeds out of range that form LF-CR by themselves or with the CRC
+		return false;
+	return send(&d, arg);
+}
+
+bool ReliableChannel::onPacket(const SBRCP_data_t *d, uint64_t now)
+{
+	if(const SBRCP_Ack_t *ack = SBRCP_view<SBRCP_Ack_t>(d))
+	{
+		if(!inFlight || (ack->sequence != ((const SBRCP_CmdReliable_t*)queue[0].payload)->sequence))
+		{
+			stats.lateAcks++;
+			return true;
+		}
+		if(retransmits == 0) //answers to retransmitted commands are ambiguous (Karn's algorithm)
+		{
+			uint32_t rtt = now - sentTime;
+			if(!rttValid)
+			{
+				srtt = rtt;
+				rttvar = rtt / 2;
+				rttValid = true;
+			}
+			else
+			{
+				uint32_t err = (srtt > rtt) ? srtt - rtt : rtt - srtt;
+				rttvar = (3 * rttvar + err) / 4;
+				srtt = (7 * srtt + rtt) / 8;
+			}
+		}
+		finish((ack->status == ACK_REJECTED) ? rejected : delivered, now);
+		return true;
+	}
+
+	const SBRCP_Stats_t *s = SBRCP_view<SBRCP_Stats_t>(d);
+	if((s != NULL) && SBRCP_HAS(SBRCP_Stats_t, duplicateCommands, d->size))
+	{
+		if(robotCountersValid) //the counters wrap around at 65536
+		{
+			stats.motorsReceived += (uint16_t)(s->motorCommands - robotMotors);
+			stats.motorsStale += (uint16_t)(s->staleMotors - robotStale);
+			stats.duplicateCommands += (uint16_t)(s->duplicateCommands - robotDuplicates);
+			stats.motorsCounted += stats.motorsSent - motorsAtStats;
+		}
+		robotMotors = s->motorCommands;
+		robotStale = s->staleMotors;
+		robotDuplicates = s->duplicateCommands;
+		motorsAtStats = stats.motorsSent;
+		robotCountersValid = true;
+	}
+	return false;
+}
+
+uint64_t ReliableChannel::poll(uint64_t now)
+{
+	if(!inFlight)
+		return 0;
+	if(now - sentTime >= timeout)
+	{
+		if(retransmits >= config.maxRetransmits)
+		{
+			finish(undelivered, now);
+			return inFlight ? sentTime + timeout : 0;
+		}
+		retransmits++;
+		stats.retransmissions++;
+		timeout = (2 * timeout > config.maxTimeout) ? config.maxTimeout : 2 * timeout; //exponential backoff
+		transmit(now);
+	}
+	return sentTime + timeout;
+}
+
+bool ReliableChannel::isIdle(void)
+{
+	return queueLength == 0;
+}
+
+uint32_t ReliableChannel::getTimeout(void)
+{
+	return inFlight ? timeout : getRto();
+}
+
+uint32_t ReliableChannel::getRtt(void)
+{
+	return rttValid ? srtt : 0;
+}
+
+ReliableStats_t ReliableChannel::getStats(void)
+{
+	return stats;
+}
+
+float ReliableChannel::getConfigLoss(void)
+{
+	return (stats.transmissions > 0) ? (float)stats.retransmissions / stats.transmissions : 0.f;
+}
+
+float ReliableChannel::getMotorLoss(void)
+{
+	if(stats.motorsCounted == 0)
+		return 0.f;
+	float loss = 1.f - (float)stats.motorsReceived / stats.motorsCounted;
+	return (loss < 0.f) ? 0.f : loss;
+}
+
+ReliableConfig_t ReliableChannel::defaultConfig(void)
+{
+	ReliableConfig_t c;
+	c.initialTimeout = 50000;
+	c.minTimeout = 10000;
+	c.maxTimeout = 1000000;
+	c.maxRetransmits = 8;
+	return c;
+}
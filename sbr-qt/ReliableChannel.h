@@ -0,0 +1,177 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file ReliableChannel.h
+* \brief Command delivery classes: acknowledged and retransmitted configuration commands (DATA_CMD_RELIABLE), latest-wins motor commands (DATA_CMD_MOTORS_SEQ)
+* \copyright GNU GPLv3
+**/
+
+#ifndef RELIABLECHANNEL_H_
+#define RELIABLECHANNEL_H_
+#include <stdint.h>
+#include "SBRCP.h"
+
+#define RELIABLE_QUEUE 8 //configuration commands waiting for delivery, including the one in flight
+
+//delivery result of a configuration command
+typedef enum
+{
+	delivered, //applied by the robot (or applied before, if the first acknowledgement was lost)
+	rejected, //acknowledged, but not applied (unknown or too short command)
+	undelivered, //no acknowledgement after maxRetransmits retransmissions
+	superseded, //replaced by a newer command of the same type before it was sent
+} ReliableResult_t;
+
+typedef struct
+{
+	uint32_t initialTimeout; //retransmission timeout until the first round trip is measured, in microseconds
+	uint32_t minTimeout; //retransmission timeout bounds in microseconds
+	uint32_t maxTimeout;
+	uint8_t maxRetransmits; //retransmissions before a command is given up
+} ReliableConfig_t;
+
+//counters since the channel was created, robot counters since the first DATA_STATS with them
+typedef struct
+{
+	uint32_t configQueued; //configuration commands
+	uint32_t configDelivered;
+	uint32_t configRejected;
+	uint32_t configUndelivered;
+	uint32_t configSuperseded;
+	uint32_t transmissions; //configuration packets sent, including retransmissions
+	uint32_t retransmissions;
+	uint32_t lateAcks; //acknowledgements of commands no longer in flight (spurious retransmissions, duplicated datagrams)
+	uint32_t duplicateCommands; //retransmissions the robot didn't apply again (the acknowledgement was lost)
+	uint32_t motorsSent; //motor commands
+	uint32_t motorsCounted; //motor commands sent between the first and the last DATA_STATS, to compare with motorsReceived
+	uint32_t motorsReceived; //by the robot
+	uint32_t motorsStale; //dropped by the robot as older than an applied one or replaced before being applied
+	uint32_t configUnreliable; //configuration commands sent once as plain packets while the channel was disabled, delivery unknown
+	uint32_t motorsUnsequenced; //motor commands sent as DATA_CMD_MOTORS while the channel was disabled, the robot applies stale ones
+} ReliableStats_t;
+
+class ReliableChannel
+{
+private:
+	ReliableConfig_t config;
+	bool (*send)(SBRCP_data_t*, void*); //transport, returns false if the packet couldn't be sent
+	void (*result)(uint16_t, uint8_t, ReliableResult_t, void*); //delivery result
+	void *arg;
+	bool enabled;
+	SBRCP_data_t queue[RELIABLE_QUEUE]; //DATA_CMD_RELIABLE packets, the first one is in flight
+	uint8_t queueLength;
+	bool inFlight; //the first command was sent
+	uint64_t sentTime; //last transmission of the command in flight
+	uint8_t retransmits; //of the command in flight
+	uint32_t timeout; //current retransmission timeout, doubled after every retransmission
+	uint32_t srtt, rttvar; //smoothed round trip time and its variation (RFC 6298), in microseconds
+	bool rttValid;
+	uint16_t commandSeq, motorSeq; //last sequence numbers used
+	uint16_t robotMotors, robotStale, robotDuplicates; //robot counters from the last DATA_STATS
+	uint32_t motorsAtStats; //motorsSent at the last DATA_STATS
+	bool robotCountersValid;
+	ReliableStats_t stats;
+
+	uint32_t getRto(void);
+	void transmit(uint64_t now);
+	void finish(ReliableResult_t r, uint64_t now);
+public:
+	/**
+	* \brief Channel initializer, the sequence numbers start at random values, so that the robot doesn't take a new session for retransmissions
+	* \param[in] &config Retransmission settings
+	* \param[in] *send Function sending a packet to the robot, returns false on failure
+	* \param[in] *result Function called with the sequence number, wrapped command type and result of every tracked command, can be NULL
+	* \param[in] *arg Callback argument
+	**/
+	ReliableChannel(const ReliableConfig_t &config, bool (*send)(SBRCP_data_t *d, void *arg),
+	                void (*result)(uint16_t sequence, uint8_t type, ReliableResult_t result, void *arg), void *arg);
+	/**
+	* \brief Enables the delivery classes, for robots with FEATURE_RELIABLE. Disabled channel sends commands once, as plain packets, and
+	* counts them in configUnreliable and motorsUnsequenced (e.g. the handshake wasn't answered on a lossy link).
+	**/
+	void setEnabled(bool enabled);
+	/**
+	* \brief Checks if the delivery classes are enabled
+	**/
+	bool isEnabled(void);
+	/**
+	* \brief Sends a configuration command. Commands are delivered one at a time, in order, and the robot applies each of them once.
+	* A queued command that wasn't sent yet is replaced by a newer one of the same type.
+	* \param[in] *command PC-to-robot packet, e.g. DATA_CMD_RATE
+	* \param[in] now Host time in microseconds
+	* \param[out] *sequence Sequence number passed to the result callback, set only if the channel is enabled, can be NULL
+	* \return False if the queue is full, the payload contains LF-CR (the robot would cut the frame short) or the channel is disabled and the
+	* packet couldn't be sent
+	**/
+	bool sendConfig(const SBRCP_data_t *command, uint64_t now, uint16_t *sequence = NULL);
+	/**
+	* \brief Sends a motor command, not acknowledged. The robot drops commands older than the last applied one and applies only the latest of
+	* the commands received at once.
+	* \param[in] motorA Motor A speed in range -255 to 255
+	* \param[in] motorB Motor B speed
+	* \return False if the packet couldn't be sent or the speeds would form LF-CR
+	**/
+	bool sendMotors(int16_t motorA, int16_t motorB);
+	/**
+	* \brief Handles a received packet: DATA_ACK finishes the command in flight, DATA_STATS updates the robot counters
+	* \param[in] *d Packet
+	* \param[in] now Host time of the reception in microseconds
+	* \return True for DATA_ACK, which needs no other handling
+	**/
+	bool onPacket(const SBRCP_data_t *d, uint64_t now);
+	/**
+	* \brief Retransmits the command in flight if its timeout passed, or gives it up after maxRetransmits
+	* \param[in] now Host time in microseconds
+	* \return Host time of the next timeout, 0 if no command is in flight
+	**/
+	uint64_t poll(uint64_t now);
+	/**
+	* \brief Checks if all configuration commands are finished
+	**/
+	bool isIdle(void);
+	/**
+	* \brief Gets the current retransmission timeout
+	* \return Timeout in microseconds
+	**/
+	uint32_t getTimeout(void);
+	/**
+	* \brief Gets the smoothed round trip time of configuration commands
+	* \return Round trip time in microseconds, 0 if not measured yet
+	**/
+	uint32_t getRtt(void);
+	/**
+	* \brief Gets the delivery counters
+	**/
+	ReliableStats_t getStats(void);
+	/**
+	* \brief Gets the fraction of configuration packets that were retransmitted (lost in either direction or acknowledged too late)
+	**/
+	float getConfigLoss(void);
+	/**
+	* \brief Gets the fraction of motor commands that didn't reach the robot, from its DATA_STATS counters
+	* Commands still on the way when the statistics were sent count as lost.
+	* \return Loss, 0 until two DATA_STATS packets with the counters are received
+	**/
+	float getMotorLoss(void);
+	/**
+	* \brief Default settings: 50 ms initial timeout, 10 ms to 1 s bounds, 8 retransmissions
+	**/
+	static ReliableConfig_t defaultConfig(void);
+};
+#endif
@@ -0,0 +1,326 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file ReplayBuffer.cpp
+* \brief Experience replay buffer for on-line reinforcement learning: structure-of-arrays transition storage, lock-free insert from I/O threads and prioritized sampling with a sum tree
+* \copyright GNU GPLv3
+**/
+
+#include "ReplayBuffer.h"
+#include <math.h>
+#include <string.h>
+
+#define _MAX_ATTEMPTS 16 //draws for one batch item when the drawn transitions are being overwritten
+
+ReplayBuffer::ReplayBuffer(const ReplayConfig_t &config) : sequence(0)
+{
+	this->config = config;
+	uint32_t capacity = REPLAY_FANOUT;
+	while((capacity < this->config.capacity) && (capacity < (1u << 31)))
+		capacity <<= 1;
+	this->config.capacity = capacity;
+	if(this->config.observationSize == 0)
+		this->config.observationSize = 1;
+	if(this->config.maxBatch == 0)
+		this->config.maxBatch = 1;
+	mask = capacity - 1;
+	head.store(0, std::memory_order_relaxed);
+	std::vector<std::atomic<uint64_t>>(capacity).swap(sequence);
+	for(uint32_t i = 0; i < capacity; i++)
+		sequence[i].store(0, std::memory_order_relaxed);
+
+	uint16_t size = this->config.observationSize;
+	observation.assign((size_t)capacity * size, 0.f);
+	action.assign((size_t)capacity * REPLAY_ACTIONS, 0.f);
+	reward.assign(capacity, 0.f);
+	nextObservation.assign((size_t)capacity * size, 0.f);
+	done.assign(capacity, 0);
+
+	//level sizes from the leaves up, each rounded up to whole nodes so a scan always reads REPLAY_FANOUT values
+	uint32_t count[REPLAY_MAX_LEVELS];
+	uint8_t n = 0;
+	for(uint32_t c = capacity; n < REPLAY_MAX_LEVELS; c = (c + REPLAY_FANOUT - 1) / REPLAY_FANOUT)
+	{
+		count[n++] = (c + REPLAY_FANOUT - 1) / REPLAY_FANOUT * REPLAY_FANOUT;
+		if(c <= REPLAY_FANOUT)
+			break;
+	}
+	levels = n;
+	size_t total = 0;
+	for(uint8_t l = 0; l < levels; l++)
+		total += count[l];
+	treeMemory.assign(total + REPLAY_FANOUT, 0.f); //one node more for the alignment
+	float *p = treeMemory.data();
+	while(((uintptr_t)p % 64) != 0)
+		p++;
+	for(uint8_t l = 0; l < levels; l++) //tree[0] is the top level
+	{
+		tree[l] = p;
+		p += count[levels - 1 - l];
+	}
+	synced = 0;
+	maxPriority = 1.f;
+	random = config.seed ? config.seed : 0x9E3779B97F4A7C15ULL;
+
+	uint16_t m = this->config.maxBatch;
+	batchIndex.assign(m, 0);
+	batchSequence.assign(m, 0);
+	batchObservation.assign((size_t)m * size, 0.f);
+	batchAction.assign((size_t)m * REPLAY_ACTIONS, 0.f);
+	batchReward.assign(m, 0.f);
+	batchNextObservation.assign((size_t)m * size, 0.f);
+	batchDone.assign(m, 0);
+	batchWeight.assign(m, 0.f);
+	drawValue.assign(m, 0.f);
+	drawSlot.assign(m, 0);
+	batch.size = 0;
+	batch.index = batchIndex.data();
+	batch.sequence = batchSequence.data();
+	batch.observation = batchObservation.data();
+	batch.action = batchAction.data();
+	batch.reward = batchReward.data();
+	batch.nextObservation = batchNextObservation.data();
+	batch.done = batchDone.data();
+	batch.weight = batchWeight.data();
+}
+
+uint64_t ReplayBuffer::insert(const float *observation, const float *action, float reward, const float *nextObservation, bool done)
+{
+	uint64_t n = head.fetch_add(1, std::memory_order_relaxed);
+	uint32_t slot = n & mask;
+	uint16_t size = config.observationSize;
+	//seqlock: a sample() copying the slot meanwhile sees the change and draws another transition
+	sequence[slot].store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(&this->observation[(size_t)slot * size], observation, size * sizeof(float));
+	memcpy(&this->action[(size_t)slot * REPLAY_ACTIONS], action, REPLAY_ACTIONS * sizeof(float));
+	this->reward[slot] = reward;
+	memcpy(&this->nextObservation[(size_t)slot * size], nextObservation, size * sizeof(float));
+	this->done[slot] = done;
+	sequence[slot].store(n + 1, std::memory_order_release);
+	return n;
+}
+
+uint32_t ReplayBuffer::sync(void)
+{
+	uint64_t claimed = head.load(std::memory_order_acquire);
+	if(claimed - synced > config.capacity) //overwritten before they were added
+		synced = claimed - config.capacity;
+	uint32_t added = 0;
+	while(synced < claimed)
+	{
+		uint32_t slot = synced & mask;
+		uint64_t s = sequence[slot].load(std::memory_order_acquire);
+		if(s == synced + 1)
+		{
+			setPriority(slot, maxPriority);
+			added++;
+		}
+		else if(s <= synced) //still being written, the rest is added by the next call
+			break;
+		//otherwise already overwritten by a newer transition, which is added when it is reached
+		synced++;
+	}
+	return added;
+}
+
+//sets a leaf and recomputes the sums above it from their children, so rounding errors don't accumulate
+void ReplayBuffer::setPriority(uint32_t slot, float priority)
+{
+	tree[levels - 1][slot] = priority;
+	uint32_t i = slot;
+	for(int l = levels - 2; l >= 0; l--)
+	{
+		uint32_t parent = i / REPLAY_FANOUT;
+		const float *child = &tree[l + 1][parent * REPLAY_FANOUT];
+		float sum = 0.f;
+		for(uint32_t k = 0; k < REPLAY_FANOUT; k++)
+			sum += child[k];
+		tree[l][parent] = sum;
+		i = parent;
+	}
+}
+
+//descends all values at once, level by level: the cache misses of different values overlap instead of one waiting for another,
+//and every node is one cache line
+void ReplayBuffer::find(float *value, uint32_t *node, uint32_t count) const
+{
+	for(uint32_t i = 0; i < count; i++)
+		node[i] = 0;
+	for(uint8_t l = 0; l < levels; l++)
+	{
+		for(uint32_t i = 0; i < count; i++)
+		{
+			if(i + 8 < count) //the node of a later value, its cache miss overlaps with this scan
+				__builtin_prefetch(&tree[l][node[i + 8] * REPLAY_FANOUT]);
+			const float *child = &tree[l][node[i] * REPLAY_FANOUT];
+			float v = value[i];
+			uint32_t pick = 0;
+			bool found = false;
+			for(uint32_t k = 0; k < REPLAY_FANOUT; k++)
+			{
+				if(child[k] <= 0.f)
+					continue;
+				pick = k;
+				if(v < child[k])
+				{
+					found = true;
+					break;
+				}
+				v -= child[k];
+			}
+			value[i] = found ? v : child[pick]; //rounding past the end, the last child with a priority
+			node[i] = node[i] * REPLAY_FANOUT + pick;
+		}
+	}
+}
+
+//uniform in [0, 1), xorshift64*
+float ReplayBuffer::uniform(void)
+{
+	random ^= random >> 12;
+	random ^= random << 25;
+	random ^= random >> 27;
+	return ((random * 0x2545F4914F6CDD1DULL) >> 40) * (1.f / (1 << 24));
+}
+
+bool ReplayBuffer::copy(uint32_t slot, uint32_t item)
+{
+	uint64_t s = sequence[slot].load(std::memory_order_acquire);
+	if(s == 0)
+		return false;
+	uint16_t size = config.observationSize;
+	memcpy(&batchObservation[(size_t)item * size], &observation[(size_t)slot * size], size * sizeof(float));
+	memcpy(&batchAction[(size_t)item * REPLAY_ACTIONS], &action[(size_t)slot * REPLAY_ACTIONS], REPLAY_ACTIONS * sizeof(float));
+	batchReward[item] = reward[slot];
+	memcpy(&batchNextObservation[(size_t)item * size], &nextObservation[(size_t)slot * size], size * sizeof(float));
+	batchDone[item] = done[slot];
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if(sequence[slot].load(std::memory_order_relaxed) != s) //overwritten while copying
+		return false;
+	batchIndex[item] = slot;
+	batchSequence[item] = s - 1;
+	return true;
+}
+
+const ReplayBatch_t *ReplayBuffer::sample(uint32_t size, float beta)
+{
+	if(size > config.maxBatch)
+		size = config.maxBatch;
+	batch.size = 0;
+	float total = getTotalPriority();
+	uint32_t n = getSize();
+	if((total <= 0.f) || (n == 0) || (size == 0))
+		return &batch;
+	const float *leaf = tree[levels - 1];
+	uint16_t observationSize = config.observationSize;
+
+	//stratified over the total priority
+	float segment = total / size;
+	for(uint32_t k = 0; k < size; k++)
+		drawValue[k] = (k + uniform()) * segment;
+	find(drawValue.data(), drawSlot.data(), size);
+	float maxWeight = 0.f;
+	uint32_t filled = 0;
+	for(uint32_t k = 0; k < size; k++)
+	{
+		if(k + 8 < size) //rows of a later transition, their cache misses overlap with this copy
+		{
+			uint32_t ahead = drawSlot[k + 8];
+			__builtin_prefetch(&sequence[ahead]);
+			__builtin_prefetch(&observation[(size_t)ahead * observationSize]);
+			__builtin_prefetch(&nextObservation[(size_t)ahead * observationSize]);
+			__builtin_prefetch(&action[(size_t)ahead * REPLAY_ACTIONS]);
+			__builtin_prefetch(&reward[ahead]);
+			__builtin_prefetch(&done[ahead]);
+		}
+		uint32_t slot = drawSlot[k];
+		//a transition overwritten while it was copied is replaced by a draw from any stratum
+		bool copied = copy(slot, filled);
+		for(uint32_t attempt = 1; !copied && (attempt < _MAX_ATTEMPTS); attempt++)
+		{
+			float value = uniform() * total;
+			find(&value, &slot, 1);
+			copied = copy(slot, filled);
+		}
+		if(!copied)
+			continue;
+		float w = (beta > 0.f) ? powf(n * leaf[slot] / total, -beta) : 1.f;
+		batchWeight[filled] = w;
+		if(w > maxWeight)
+			maxWeight = w;
+		filled++;
+	}
+	if(maxWeight > 0.f)
+	{
+		for(uint32_t k = 0; k < filled; k++)
+			batchWeight[k] /= maxWeight;
+	}
+	batch.size = filled;
+	return &batch;
+}
+
+void ReplayBuffer::updatePriorities(const uint32_t *index, const uint64_t *sequence, const float *error, uint32_t count)
+{
+	for(uint32_t i = 0; i < count; i++)
+	{
+		uint32_t slot = index[i] & mask;
+		if(this->sequence[slot].load(std::memory_order_acquire) != sequence[i] + 1) //overwritten since it was sampled
+			continue;
+		float p = powf(fabsf(error[i]) + config.epsilon, config.alpha);
+		if(p > maxPriority)
+			maxPriority = p;
+		setPriority(slot, p);
+	}
+}
+
+uint64_t ReplayBuffer::getInserted(void) const
+{
+	return head.load(std::memory_order_relaxed);
+}
+
+uint32_t ReplayBuffer::getSize(void) const
+{
+	return (synced < config.capacity) ? (uint32_t)synced : config.capacity;
+}
+
+float ReplayBuffer::getTotalPriority(void) const
+{
+	float sum = 0.f;
+	for(uint32_t k = 0; k < REPLAY_FANOUT; k++)
+		sum += tree[0][k];
+	return sum;
+}
+
+const ReplayConfig_t &ReplayBuffer::getConfig(void) const
+{
+	return config;
+}
+
+ReplayConfig_t ReplayBuffer::defaultConfig(uint16_t observationSize)
+{
+	ReplayConfig_t c;
+	c.capacity = 1 << 20;
+	c.observationSize = observationSize;
+	c.maxBatch = 1024;
+	c.alpha = 0.6f;
+	c.epsilon = 1e-3f;
+	c.seed = 1;
+	return c;
+}
@@ -0,0 +1,152 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file ReplayBuffer.h
+* \brief Experience replay buffer for on-line reinforcement learning: structure-of-arrays transition storage, lock-free insert from I/O threads and prioritized sampling with a sum tree
+* \copyright GNU GPLv3
+**/
+
+#ifndef REPLAYBUFFER_H_
+#define REPLAYBUFFER_H_
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+#define REPLAY_ACTIONS 2 //motor A, B commands as in DATA_CMD_MOTORS
+#define REPLAY_FANOUT 16 //children per sum tree node, one 64-byte cache line of floats
+#define REPLAY_MAX_LEVELS 8 //16^8 transitions
+
+//buffer configuration
+typedef struct
+{
+	uint32_t capacity; //transitions kept, rounded up to a power of 2 (at least REPLAY_FANOUT), the oldest are overwritten
+	uint16_t observationSize; //values per observation: the six DATA_MPU channels, then features
+	uint16_t maxBatch; //largest batch sample() returns
+	float alpha; //priority exponent, 0 samples uniformly
+	float epsilon; //added to the absolute TD error, so every transition can still be sampled
+	uint64_t seed; //sampling random number generator
+} ReplayConfig_t;
+
+//sampled transitions, structure of arrays, reused by the next sample()
+typedef struct
+{
+	uint32_t size;
+	uint32_t *index; //slot, for updatePriorities()
+	uint64_t *sequence; //insert number of the transition, an update is ignored if the slot was overwritten since
+	float *observation; //size * observationSize
+	float *action; //size * REPLAY_ACTIONS
+	float *reward;
+	float *nextObservation; //size * observationSize
+	uint8_t *done; //1 if the episode ended with this transition
+	float *weight; //importance sampling weight (N * P(i))^-beta, normalized to a maximum of 1
+} ReplayBatch_t;
+
+//insert() can be called from any number of threads at once; sync(), sample() and updatePriorities() from one learner thread
+class ReplayBuffer
+{
+private:
+	ReplayConfig_t config;
+	uint32_t mask; //capacity - 1
+	alignas(64) std::atomic<uint64_t> head; //transitions claimed by insert()
+	alignas(64) std::vector<std::atomic<uint64_t>> sequence; //per slot: insert number + 1 once written, 0 while being written
+
+	//transition storage, one array per field
+	std::vector<float> observation, action, reward, nextObservation;
+	std::vector<uint8_t> done;
+
+	//learner state
+	uint64_t synced; //transitions before this insert number are in the sum tree
+	float maxPriority; //priority of new transitions
+	uint8_t levels;
+	std::vector<float> treeMemory;
+	float *tree[REPLAY_MAX_LEVELS]; //level 0 has up to REPLAY_FANOUT sums, the last level one priority per slot, all 64-byte aligned
+	uint64_t random; //xorshift state
+
+	std::vector<uint32_t> batchIndex;
+	std::vector<uint64_t> batchSequence;
+	std::vector<float> batchObservation, batchAction, batchReward, batchNextObservation, batchWeight;
+	std::vector<uint8_t> batchDone;
+	std::vector<float> drawValue; //sample() draws
+	std::vector<uint32_t> drawSlot;
+	ReplayBatch_t batch;
+
+	void setPriority(uint32_t slot, float priority);
+	void find(float *value, uint32_t *node, uint32_t count) const;
+	float uniform(void);
+	bool copy(uint32_t slot, uint32_t item);
+public:
+	/**
+	* \brief Buffer initializer, allocates the storage, the sum tree and the batch
+	* \param[in] &config Buffer configuration
+	**/
+	ReplayBuffer(const ReplayConfig_t &config);
+	/**
+	* \brief Stores a transition, lock-free and without allocation; may be called from several threads at once
+	* \param[in] *observation config.observationSize values
+	* \param[in] *action REPLAY_ACTIONS values
+	* \param[in] reward Reward
+	* \param[in] *nextObservation Observation after the action
+	* \param[in] done The episode ended with this transition
+	* \return Insert number of the transition (from 0)
+	**/
+	uint64_t insert(const float *observation, const float *action, float reward, const float *nextObservation, bool done);
+	/**
+	* \brief Adds the transitions finished since the last call to the sum tree with the highest priority so far (learner)
+	* \return Number of transitions added
+	**/
+	uint32_t sync(void);
+	/**
+	* \brief Samples transitions with probability proportional to their priority, stratified over the total priority, after sync().
+	* O(size * log16(capacity)); a transition overwritten while it is copied is replaced by another one.
+	* \param[in] size Batch size, at most config.maxBatch
+	* \param[in] beta Importance sampling exponent, 0 for weights of 1
+	* \return Batch, empty if the buffer is empty
+	**/
+	const ReplayBatch_t *sample(uint32_t size, float beta);
+	/**
+	* \brief Sets the priorities of sampled transitions to (|error| + epsilon)^alpha (learner)
+	* \param[in] *index Slots from the batch
+	* \param[in] *sequence Insert numbers from the batch
+	* \param[in] *error TD errors
+	* \param[in] count Number of transitions
+	**/
+	void updatePriorities(const uint32_t *index, const uint64_t *sequence, const float *error, uint32_t count);
+	/**
+	* \brief Gets the number of transitions inserted
+	**/
+	uint64_t getInserted(void) const;
+	/**
+	* \brief Gets the number of transitions that can be sampled
+	**/
+	uint32_t getSize(void) const;
+	/**
+	* \brief Gets the sum of the priorities
+	**/
+	float getTotalPriority(void) const;
+	/**
+	* \brief Gets the buffer configuration, capacity rounded up
+	**/
+	const ReplayConfig_t &getConfig(void) const;
+	/**
+	* \brief Default configuration: 1 Mi transitions, batches of up to 1024, alpha 0.6, epsilon 1e-3
+	* \param[in] observationSize Values per observation
+	**/
+	static ReplayConfig_t defaultConfig(uint16_t observationSize);
+};
+#endif
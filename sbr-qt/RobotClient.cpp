@@ -0,0 +1,780 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file RobotClient.cpp
+* \brief C++20 coroutine robot client (co_await robot.nextSample(), setMotors(), ping()) over serial or UDP, driven by EventLoop
+* \copyright GNU GPLv3
+**/
+
+#include "RobotClient.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+
+Robot *Robot::parsing = nullptr;
+
+//termios code of a baud rate, 0 if not supported
+static speed_t speedCode(int baud)
+{
+	static const struct
+	{
+		int baud;
+		speed_t code;
+	} speeds[] = {{9600, B9600}, {19200, B19200}, {38400, B38400}, {57600, B57600}, {115200, B115200},
+	              {230400, B230400}, {460800, B460800}, {500000, B500000}, {921600, B921600}, {1000000, B1000000},
+	              {1500000, B1500000}, {2000000, B2000000}};
+	for(uint8_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+	{
+		if(speeds[i].baud == baud)
+			return speeds[i].code;
+	}
+	return 0;
+}
+
+SampleAwaiter::SampleAwaiter(Robot *robot, uint32_t timeout) : robot(robot), timeout(timeout)
+{
+	sample.valid = false;
+	timer.callback = &SampleAwaiter::fire;
+	timer.arg = this;
+	timer.scheduled = false;
+	done = false;
+}
+
+SampleAwaiter::~SampleAwaiter()
+{
+	robot->loop->cancel(&timer);
+	if(robot->sampleWaiter == this)
+		robot->sampleWaiter = nullptr;
+}
+
+bool SampleAwaiter::await_ready()
+{
+	if(robot->queueTail != robot->queueHead) //already received
+	{
+		sample = robot->queue[robot->queueTail % ROBOT_SAMPLE_QUEUE];
+		robot->queueTail++;
+		return true;
+	}
+	return (robot->fd < 0) || (robot->sampleWaiter != nullptr); //no connection or another coroutine is waiting
+}
+
+void SampleAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+	handle = h;
+	robot->sampleWaiter = this;
+	robot->loop->schedule(&timer, timeout * 1000ULL);
+}
+
+void SampleAwaiter::fire(void *arg)
+{
+	SampleAwaiter *a = (SampleAwaiter*)arg;
+	if(!a->done) //timeout
+	{
+		a->robot->sampleWaiter = nullptr;
+		a->done = true;
+	}
+	a->handle.resume();
+}
+
+ResponseAwaiter::ResponseAwaiter(Robot *robot, SBRCP_data_t *request, uint8_t answerType, uint8_t matchLength, uint32_t timeout,
+                                 uint8_t attempts)
+	: robot(robot), timeout(timeout), request(*request), answerType(answerType), matchLength(matchLength), attempts(attempts)
+{
+	response.valid = false;
+	response.rtt = 0;
+	timer.callback = &ResponseAwaiter::fire;
+	timer.arg = this;
+	timer.scheduled = false;
+	next = nullptr;
+	pending = false;
+}
+
+ResponseAwaiter::~ResponseAwaiter()
+{
+	robot->loop->cancel(&timer);
+	if(!pending)
+		return;
+	for(ResponseAwaiter **p = &robot->responseWaiters; *p != nullptr; p = &(*p)->next)
+	{
+		if(*p == this)
+		{
+			*p = next;
+			break;
+		}
+	}
+}
+
+bool ResponseAwaiter::await_ready()
+{
+	sent = EventLoop::now();
+	return !robot->send(&request); //nothing to wait for if the request wasn't sent
+}
+
+void ResponseAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+	handle = h;
+	next = robot->responseWaiters;
+	robot->responseWaiters = this;
+	pending = true;
+	robot->loop->schedule(&timer, timeout * 1000ULL);
+}
+
+void ResponseAwaiter::fire(void *arg)
+{
+	ResponseAwaiter *a = (ResponseAwaiter*)arg;
+	if(a->pending && (a->attempts > 1) && a->robot->send(&a->request)) //timeout, the request or the answer may have been lost
+	{
+		a->attempts--;
+		a->sent = EventLoop::now();
+		a->robot->loop->schedule(&a->timer, a->timeout * 1000ULL);
+		return;
+	}
+	if(a->pending) //timeout of the last attempt
+	{
+		for(ResponseAwaiter **p = &a->robot->responseWaiters; *p != nullptr; p = &(*p)->next)
+		{
+			if(*p == a)
+			{
+				*p = a->next;
+				break;
+			}
+		}
+		a->pending = false;
+	}
+	a->handle.resume();
+}
+
+SleepAwaiter::SleepAwaiter(EventLoop *loop, uint32_t delay) : loop(loop), delay(delay)
+{
+	timer.callback = &SleepAwaiter::fire;
+	timer.arg = this;
+	timer.scheduled = false;
+}
+
+SleepAwaiter::~SleepAwaiter()
+{
+	loop->cancel(&timer);
+}
+
+void SleepAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+	handle = h;
+	loop->schedule(&timer, delay * 1000ULL);
+}
+
+void SleepAwaiter::fire(void *arg)
+{
+	((SleepAwaiter*)arg)->handle.resume();
+}
+
+ConfigAwaiter::ConfigAwaiter(Robot *robot, bool sent, bool tracked, uint16_t sequence) : robot(robot), sequence(sequence)
+{
+	result = sent ? delivered : undelivered;
+	done = !sent || !tracked;
+	timer.callback = &ConfigAwaiter::fire;
+	timer.arg = this;
+	timer.scheduled = false;
+	next = nullptr;
+	pending = !done;
+	if(pending) //linked right away, a command can be superseded before the coroutine awaits it
+	{
+		next = robot->configWaiters;
+		robot->configWaiters = this;
+	}
+}
+
+ConfigAwaiter::~ConfigAwaiter()
+{
+	robot->loop->cancel(&timer);
+	if(!pending)
+		return;
+	for(ConfigAwaiter **p = &robot->configWaiters; *p != nullptr; p = &(*p)->next)
+	{
+		if(*p == this)
+		{
+			*p = next;
+			break;
+		}
+	}
+}
+
+void ConfigAwaiter::await_suspend(std::coroutine_handle<> h)
+{
+	handle = h;
+}
+
+void ConfigAwaiter::fire(void *arg)
+{
+	((ConfigAwaiter*)arg)->handle.resume();
+}
+
+Robot::Robot(EventLoop *loop) : loop(loop), protocol(&Robot::onPacket),
+	reliable(ReliableChannel::defaultConfig(), &Robot::sendReliable, &Robot::onReliableResult, this)
+{
+	fd = -1;
+	udp = false;
+	memset(&remote, 0, sizeof(remote));
+	memset(&info, 0, sizeof(info));
+	rxLength = 0;
+	rxTime = 0;
+	queueHead = 0;
+	queueTail = 0;
+	sampleWaiter = nullptr;
+	responseWaiters = nullptr;
+	configWaiters = nullptr;
+	reliableTimer.callback = &Robot::onReliableTimer;
+	reliableTimer.arg = this;
+	reliableTimer.scheduled = false;
+	pingToken = 0;
+	baudToken = 0;
+	baudRate = 0;
+	samples = 0;
+	droppedSamples = 0;
+}
+
+Robot::~Robot()
+{
+	close();
+}
+
+bool Robot::openSerial(const char *device, int baud)
+{
+	speed_t code = speedCode(baud);
+	if(code == 0)
+		return false;
+
+	close();
+	int f = open(device, O_RDWR | O_NOCTTY);
+	if(f < 0)
+		return false;
+	struct termios t;
+	if(tcgetattr(f, &t) < 0)
+	{
+		::close(f);
+		return false;
+	}
+	cfmakeraw(&t);
+	cfsetspeed(&t, code);
+	t.c_cflag |= CLOCAL | CREAD;
+	t.c_cc[VMIN] = 0; //the loop reads only when data is available
+	t.c_cc[VTIME] = 0;
+	if(tcsetattr(f, TCSANOW, &t) < 0)
+	{
+		::close(f);
+		return false;
+	}
+	tcflush(f, TCIOFLUSH);
+	fd = f;
+	udp = false;
+	baudRate = baud;
+	rxLength = 0;
+	loop->watch(fd, &Robot::onReadable, this);
+	return true;
+}
+
+bool Robot::setBaudRate(int baud)
+{
+	speed_t code = speedCode(baud);
+	struct termios t;
+	if(udp || (fd < 0) || (code == 0) || (tcgetattr(fd, &t) < 0))
+		return false;
+	tcdrain(fd); //the last frame still goes out at the old rate
+	cfsetspeed(&t, code);
+	if(tcsetattr(fd, TCSANOW, &t) < 0)
+		return false;
+	baudRate = baud;
+	return true;
+}
+
+int Robot::getBaudRate(void)
+{
+	return baudRate;
+}
+
+bool Robot::openUdp(const char *robotIp, uint16_t robotPort, uint16_t localPort)
+{
+	close();
+	memset(&remote, 0, sizeof(remote));
+	remote.sin_family = AF_INET;
+	remote.sin_port = htons(robotPort);
+	if(inet_pton(AF_INET, robotIp, &remote.sin_addr) != 1)
+		return false;
+	int f = socket(AF_INET, SOCK_DGRAM, 0);
+	if(f < 0)
+		return false;
+	struct sockaddr_in local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_port = htons(localPort);
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	if(bind(f, (struct sockaddr*)&local, sizeof(local)) < 0)
+	{
+		::close(f);
+		return false;
+	}
+	fd = f;
+	udp = true;
+	baudRate = 0;
+	loop->watch(fd, &Robot::onReadable, this);
+	return true;
+}
+
+void Robot::close(void)
+{
+	if(fd < 0)
+		return;
+	loop->unwatch(fd);
+	::close(fd);
+	fd = -1;
+	loop->cancel(&reliableTimer);
+	failWaiters();
+}
+
+//finishes all waits with invalid results
+void Robot::failWaiters(void)
+{
+	if(sampleWaiter != nullptr)
+	{
+		sampleWaiter->done = true;
+		loop->schedule(&sampleWaiter->timer, 0);
+		sampleWaiter = nullptr;
+	}
+	while(responseWaiters != nullptr)
+	{
+		ResponseAwaiter *a = responseWaiters;
+		responseWaiters = a->next;
+		a->pending = false;
+		loop->schedule(&a->timer, 0);
+	}
+	while(configWaiters != nullptr)
+	{
+		ConfigAwaiter *a = configWaiters;
+		configWaiters = a->next;
+		a->pending = false;
+		a->done = true;
+		a->result = undelivered;
+		if(a->handle)
+			loop->schedule(&a->timer, 0);
+	}
+}
+
+bool Robot::send(SBRCP_data_t *d)
+{
+	if(fd < 0)
+		return false;
+	uint8_t buf[ROBOT_MAX_FRAME_SIZE];
+	uint8_t len = 0;
+	protocol.parseTx(d, buf, &len);
+	if(udp)
+		return sendto(fd, buf, len, 0, (struct sockaddr*)&remote, sizeof(remote)) == len;
+	for(uint8_t written = 0; written < len;)
+	{
+		ssize_t n = write(fd, &buf[written], len - written);
+		if(n <= 0)
+			return false;
+		written += n;
+	}
+	return true;
+}
+
+bool Robot::sendReliable(SBRCP_data_t *d, void *arg)
+{
+	return ((Robot*)arg)->send(d);
+}
+
+void Robot::onReliableResult(uint16_t sequence, uint8_t, ReliableResult_t result, void *arg)
+{
+	Robot *r = (Robot*)arg;
+	for(ConfigAwaiter **p = &r->configWaiters; *p != nullptr; p = &(*p)->next)
+	{
+		ConfigAwaiter *a = *p;
+		if(a->sequence != sequence)
+			continue;
+		*p = a->next;
+		a->pending = false;
+		a->done = true;
+		a->result = result;
+		if(a->handle) //resumed from the loop, not from inside the parser
+			r->loop->schedule(&a->timer, 0);
+		break;
+	}
+}
+
+void Robot::onReliableTimer(void *arg)
+{
+	((Robot*)arg)->pollReliable();
+}
+
+//retransmits due commands and schedules the next timeout
+void Robot::pollReliable(void)
+{
+	uint64_t now = EventLoop::now();
+	uint64_t next = reliable.poll(now);
+	if(next == 0)
+		loop->cancel(&reliableTimer);
+	else
+		loop->schedule(&reliableTimer, (next > now) ? next - now : 0);
+}
+
+void Robot::onReadable(void *arg)
+{
+	Robot *r = (Robot*)arg;
+	r->rxTime = EventLoop::now();
+	parsing = r;
+	if(r->udp)
+	{
+		uint8_t buf[512];
+		ssize_t n;
+		while((r->fd >= 0) && ((n = recv(r->fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0))
+			r->protocol.parseRx(buf, n);
+		return;
+	}
+
+	ssize_t n = read(r->fd, &r->rxBuffer[r->rxLength], sizeof(r->rxBuffer) - r->rxLength);
+	if(n <= 0)
+	{
+		if(n == 0) //device disconnected
+			r->close();
+		return;
+	}
+	r->rxLength += n;
+	//data may not come in one piece and there can be more than one frame in the buffer
+	//\n\r can also appear inside the binary payload, so a frame is accepted only if its CRC matches
+	uint16_t start = 0;
+	for(uint16_t i = 1; i < r->rxLength; i++)
+	{
+		if((r->rxBuffer[i - 1] != '\n') || (r->rxBuffer[i] != '\r'))
+			continue;
+		for(uint16_t s = start; (s + 3) <= i; s++) //the longest candidate first
+		{
+			if((i + 1 - s) > ROBOT_MAX_FRAME_SIZE)
+				continue;
+			if(r->protocol.parseRx(&r->rxBuffer[s], i + 1 - s))
+			{
+				start = i + 1;
+				break;
+			}
+		}
+	}
+	if(r->rxLength - start > ROBOT_MAX_FRAME_SIZE) //older bytes can't belong to any valid frame
+		start = r->rxLength - ROBOT_MAX_FRAME_SIZE;
+	memmove(r->rxBuffer, &r->rxBuffer[start], r->rxLength - start);
+	r->rxLength -= start;
+}
+
+void Robot::onPacket(SBRCP_data_t *d)
+{
+	parsing->handlePacket(d);
+}
+
+void Robot::handlePacket(SBRCP_data_t *d)
+{
+	if(reliable.onPacket(d, rxTime)) //acknowledgement, the next command may have been sent
+	{
+		pollReliable();
+		return;
+	}
+	if(const SBRCP_Mpu_t *mpu = SBRCP_view<SBRCP_Mpu_t>(d))
+	{
+		float v[TELEMETRY_CHANNELS];
+		for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+			v[i] = mpu->values[i];
+		pushSample(v, false, 0);
+	}
+	else if(const SBRCP_MpuTs_t *mpuTs = SBRCP_view<SBRCP_MpuTs_t>(d))
+	{
+		float v[TELEMETRY_CHANNELS];
+		for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+			v[i] = mpuTs->values[i];
+		pushSample(v, true, clock.unwrap(mpuTs->robotTime));
+	}
+	else if(const SBRCP_MpuEvent_t *event = SBRCP_view<SBRCP_MpuEvent_t>(d)) //send-on-delta, the sample holds until the next one
+	{
+		float v[TELEMETRY_CHANNELS];
+		for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+			v[i] = event->values[i];
+		pushSample(v, true, clock.unwrap(event->robotTime));
+	}
+	else if((d->type == DATA_MPU_KEY) || (d->type == DATA_MPU_DELTA))
+	{
+		int16_t raw[_TELEMETRY_MAX_BATCH * TELEMETRY_CHANNELS];
+		uint8_t n = decoder.decode(d, raw, _TELEMETRY_MAX_BATCH);
+		for(uint8_t i = 0; i < n; i++)
+		{
+			float v[TELEMETRY_CHANNELS];
+			decoder.toSI(&raw[i * TELEMETRY_CHANNELS], v);
+			pushSample(v, false, 0);
+		}
+	}
+	else if(const SBRCP_Hello_t *hello = SBRCP_view<SBRCP_Hello_t>(d))
+	{
+		info.valid = true;
+		info.protocolVersion = hello->protocolVersion;
+		info.firmwareMajor = hello->firmwareMajor;
+		info.firmwareMinor = hello->firmwareMinor;
+		info.features = hello->features;
+		info.connection = hello->connection;
+		info.accelRange = hello->accelRange;
+		info.gyroRange = hello->gyroRange;
+		info.filterBandwidth = hello->filterBandwidth;
+		info.telemetryMode = hello->telemetryMode;
+		info.interval = hello->interval;
+		info.minInterval = hello->minInterval;
+		info.minCompressedInterval = hello->minCompressedInterval;
+		info.maxPayload = hello->maxPayload;
+		info.maxBatch = hello->maxBatch;
+		reliable.setEnabled(hello->features & FEATURE_RELIABLE);
+	}
+
+	//every matching request gets the answer (e.g. a handshake and a ping sent as DATA_CMD_HELLO)
+	for(ResponseAwaiter **p = &responseWaiters; *p != nullptr;)
+	{
+		ResponseAwaiter *a = *p;
+		if((a->answerType != d->type) || (d->size < a->matchLength) || memcmp(a->request.payload, d->payload, a->matchLength))
+		{
+			p = &a->next;
+			continue;
+		}
+		*p = a->next;
+		if(const SBRCP_Pong_t *pong = SBRCP_view<SBRCP_Pong_t>(d))
+			clock.addExchange(a->sent, pong->robotTime, rxTime);
+		a->pending = false;
+		a->response.valid = true;
+		a->response.time = rxTime;
+		a->response.rtt = rxTime - a->sent;
+		a->response.data = *d;
+		loop->schedule(&a->timer, 0); //resumed from the loop, not from inside the parser
+	}
+}
+
+void Robot::pushSample(const float *v, bool timestamped, uint64_t robotTime)
+{
+	samples++;
+	if((sampleWaiter != nullptr) && (queueHead == queueTail))
+	{
+		SampleAwaiter *a = sampleWaiter;
+		sampleWaiter = nullptr;
+		a->sample.valid = true;
+		a->sample.time = rxTime;
+		a->sample.timestamped = timestamped;
+		a->sample.robotTime = robotTime;
+		memcpy(a->sample.value, v, sizeof(a->sample.value));
+		a->done = true;
+		loop->schedule(&a->timer, 0);
+		return;
+	}
+	if(queueHead - queueTail >= ROBOT_SAMPLE_QUEUE)
+	{
+		queueTail++;
+		droppedSamples++;
+	}
+	RobotSample_t &s = queue[queueHead % ROBOT_SAMPLE_QUEUE];
+	s.valid = true;
+	s.time = rxTime;
+	s.timestamped = timestamped;
+	s.robotTime = robotTime;
+	memcpy(s.value, v, sizeof(s.value));
+	queueHead++;
+}
+
+ResponseAwaiter Robot::connect(uint32_t timeout, uint8_t attempts)
+{
+	SBRCP_data_t d;
+	SBRCP_init<SBRCP_CmdHello_t>(&d)->protocolVersion = SBRCP_PROTOCOL_VERSION;
+	return ResponseAwaiter(this, &d, DATA_HELLO, 0, timeout, attempts);
+}
+
+ResponseAwaiter Robot::ping(uint32_t timeout)
+{
+	if(info.valid && !(info.features & FEATURE_PING))
+		return connect(timeout, 1);
+	SBRCP_data_t d;
+	SBRCP_CmdPing_t *cmd = SBRCP_init<SBRCP_CmdPing_t>(&d);
+	do
+		cmd->token = ++pingToken;
+	while(SBRCP_hasFrameEnd(&d)); //LF-CR would split the frame, the ping would time out every time the token comes up
+	return ResponseAwaiter(this, &d, DATA_PONG, sizeof(pingToken), timeout);
+}
+
+SampleAwaiter Robot::nextSample(uint32_t timeout)
+{
+	return SampleAwaiter(this, timeout);
+}
+
+SleepAwaiter Robot::sleep(uint32_t delay)
+{
+	return SleepAwaiter(loop, delay);
+}
+
+SendResult Robot::setMotors(int16_t m1, int16_t m2)
+{
+	return SendResult(reliable.sendMotors(m1, m2));
+}
+
+//queues a configuration command, plain packets are sent right away if the robot has no FEATURE_RELIABLE
+ConfigAwaiter Robot::sendConfig(SBRCP_data_t *d)
+{
+	uint16_t sequence = 0;
+	bool sent = (fd >= 0) && reliable.sendConfig(d, EventLoop::now(), &sequence);
+	if(sent && reliable.isEnabled())
+		pollReliable();
+	return ConfigAwaiter(this, sent, reliable.isEnabled(), sequence);
+}
+
+ConfigAwaiter Robot::setRate(uint32_t interval)
+{
+	SBRCP_data_t d;
+	SBRCP_init<SBRCP_CmdRate_t>(&d)->interval = interval;
+	return sendConfig(&d);
+}
+
+ConfigAwaiter Robot::setTelemetry(uint8_t mode, uint8_t batch, uint16_t accelThreshold, uint16_t gyroThreshold, uint16_t maxSilence)
+{
+	SBRCP_data_t d;
+	SBRCP_CmdTelemetry_t *cmd = SBRCP_init<SBRCP_CmdTelemetry_t>(&d);
+	cmd->mode = mode;
+	cmd->batch = batch;
+	cmd->keyInterval = _TELEMETRY_KEYFRAME_INTERVAL;
+	cmd->accelThreshold = accelThreshold;
+	cmd->gyroThreshold = gyroThreshold;
+	cmd->maxSilence = maxSilence;
+	return sendConfig(&d);
+}
+
+ResponseAwaiter Robot::requestStats(uint32_t timeout)
+{
+	SBRCP_data_t d;
+	SBRCP_init<SBRCP_CmdStats_t>(&d, 0); //no interval, a single answer
+	return ResponseAwaiter(this, &d, DATA_STATS, 0, timeout);
+}
+
+ResponseAwaiter Robot::requestMemory(bool repaint, uint32_t timeout)
+{
+	SBRCP_data_t d;
+	SBRCP_init<SBRCP_CmdMemory_t>(&d)->repaint = repaint;
+	return ResponseAwaiter(this, &d, DATA_MEMORY, 0, timeout);
+}
+
+ResponseAwaiter Robot::baudRequest(uint8_t action, uint32_t baud, const uint8_t *pattern, uint8_t length, uint32_t timeout)
+{
+	SBRCP_data_t d;
+	SBRCP_CmdBaud_t *cmd = SBRCP_init<SBRCP_CmdBaud_t>(&d, offsetof(SBRCP_CmdBaud_t, pattern) + length);
+	if(++baudToken == 0x0D0A) //LF-CR would split the frame
+		baudToken++;
+	cmd->baud = baud;
+	cmd->token = baudToken;
+	cmd->action = action;
+	if(length > 0)
+		memcpy(cmd->pattern, pattern, length);
+	//the answer has the same baud rate and token
+	return ResponseAwaiter(this, &d, DATA_BAUD, offsetof(SBRCP_Baud_t, status), timeout);
+}
+
+ResponseAwaiter Robot::probeBaud(const uint8_t *pattern, uint8_t length, uint32_t timeout)
+{
+	return baudRequest(BAUD_PROBE, baudRate, pattern, length, timeout);
+}
+
+RobotTask Robot::negotiateBaud(int baud, bool *ok)
+{
+	*ok = (baud == baudRate);
+	int previous = baudRate;
+	if(*ok || udp || (fd < 0) || !(info.features & FEATURE_BAUD) || (speedCode(baud) == 0))
+		co_return;
+	RobotResponse_t r = co_await baudRequest(BAUD_PROPOSE, baud, NULL, 0, ROBOT_DEFAULT_TIMEOUT_MS);
+	if(!r.valid || (SBRCP_view<SBRCP_Baud_t>(&r.data)->status != BAUD_ACCEPTED))
+		co_return;
+	setBaudRate(baud);
+	co_await sleep(ROBOT_BAUD_SETTLE_MS);
+	tcflush(fd, TCIFLUSH);
+	rxLength = 0;
+
+	//full size frames with varying bits, without LF
+	bool probed = true;
+	uint8_t pattern[sizeof(((SBRCP_CmdBaud_t*)0)->pattern)];
+	for(uint8_t i = 0; probed && (i < ROBOT_BAUD_PROBES); i++)
+	{
+		for(uint8_t k = 0; k < sizeof(pattern); k++)
+			pattern[k] = ((i * 31 + k * 97) & 0xFF) | 0x01; //odd bytes, 0x0A never appears
+		r = co_await probeBaud(pattern, sizeof(pattern));
+		probed = r.valid && (r.data.size == sizeof(SBRCP_Baud_t)) && !memcmp(SBRCP_view<SBRCP_Baud_t>(&r.data)->pattern, pattern, sizeof(pattern));
+	}
+	for(uint8_t i = 0; probed && (i < 3); i++) //a lost answer is repeated, the robot answers the second commit with BAUD_NOT_PENDING
+	{
+		r = co_await baudRequest(BAUD_COMMIT, baud, NULL, 0, ROBOT_BAUD_PROBE_TIMEOUT_MS);
+		const SBRCP_Baud_t *answer = r.valid ? SBRCP_view<SBRCP_Baud_t>(&r.data) : NULL;
+		if((answer != NULL) && ((answer->status == BAUD_COMMITTED) || (answer->status == BAUD_NOT_PENDING)))
+		{
+			*ok = true;
+			co_return;
+		}
+	}
+
+	//the robot falls back after BAUD_PROBE_TIMEOUT, unless a commit got through and only its answers were lost
+	setBaudRate(previous);
+	co_await sleep(BAUD_PROBE_TIMEOUT + ROBOT_BAUD_SETTLE_MS);
+	tcflush(fd, TCIFLUSH);
+	rxLength = 0;
+	r = co_await ping(ROBOT_BAUD_PROBE_TIMEOUT_MS);
+	if(r.valid || !probed)
+		co_return;
+	setBaudRate(baud);
+	r = co_await ping(ROBOT_BAUD_PROBE_TIMEOUT_MS);
+	*ok = r.valid;
+	if(!*ok)
+		setBaudRate(previous);
+}
+
+void Robot::flushSamples(void)
+{
+	queueTail = queueHead;
+}
+
+const RobotInfo_t *Robot::getInfo(void)
+{
+	return &info;
+}
+
+ClockSync *Robot::getClock(void)
+{
+	return &clock;
+}
+
+ReliableChannel *Robot::getChannel(void)
+{
+	return &reliable;
+}
+
+uint64_t Robot::getSamples(void)
+{
+	return samples;
+}
+
+uint32_t Robot::getDroppedSamples(void)
+{
+	return droppedSamples;
+}
+
+uint32_t Robot::getLostPackets(void)
+{
+	return decoder.getLostPackets();
+}
\ No newline at end of file
@@ -0,0 +1,486 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file RobotClient.h
+* \brief C++20 coroutine robot client (co_await robot.nextSample(), setMotors(), ping()) over serial or UDP, driven by EventLoop
+* \copyright GNU GPLv3
+**/
+
+#ifndef ROBOTCLIENT_H_
+#define ROBOTCLIENT_H_
+#include <stdint.h>
+#include <coroutine>
+#include <exception>
+#include <netinet/in.h>
+#include "ClockSync.h"
+#include "EventLoop.h"
+#include "ReliableChannel.h"
+#include "SBRCP.h"
+#include "TelemetryCodec.h"
+
+#define ROBOT_SAMPLE_QUEUE 32 //samples kept while no coroutine waits for them (power of 2), the oldest are dropped
+#define ROBOT_DEFAULT_TIMEOUT_MS 1000
+#define ROBOT_HELLO_TIMEOUT_MS 300 //handshake timeout of one attempt
+#define ROBOT_HELLO_ATTEMPTS 4 //handshake requests before the robot is taken for firmware without capabilities (e.g. lost UDP datagrams)
+#define ROBOT_MAX_FRAME_SIZE (_SBRCP_MAX_PAYLOAD_SIZE + 4) //type byte, payload, CRC, LF-CR
+#define ROBOT_BAUD_PROBES 8 //probe exchanges that must pass before a new baud rate is committed
+#define ROBOT_BAUD_PROBE_TIMEOUT_MS 100
+#define ROBOT_BAUD_SETTLE_MS 20 //time for the robot to switch its UART, bytes received meanwhile are dropped
+
+//MPU6050 sample
+typedef struct
+{
+	bool valid; //false on timeout or closed connection
+	uint64_t time; //EventLoop::now() when the packet was received, in microseconds
+	bool timestamped; //robotTime is valid (TELEMETRY_TIMESTAMPED, TELEMETRY_EVENT)
+	uint64_t robotTime; //robot time of the reading, unwrapped by ClockSync::unwrap(), in microseconds
+	float value[TELEMETRY_CHANNELS]; //acceleration X, Y, Z in m/s^2, angular rate X, Y, Z in rad/s
+} RobotSample_t;
+
+//answer to a request
+typedef struct
+{
+	bool valid; //false on timeout or closed connection
+	uint32_t rtt; //round trip time in microseconds, from the last transmission of a repeated request
+	uint64_t time; //EventLoop::now() when the answer was received
+	SBRCP_data_t data; //answer packet
+} RobotResponse_t;
+
+//robot capabilities and configuration received in DATA_HELLO
+typedef struct
+{
+	bool valid; //false until the robot answers the handshake
+	uint8_t protocolVersion;
+	uint8_t firmwareMajor;
+	uint8_t firmwareMinor;
+	uint16_t features; //FEATURE_... flags
+	uint8_t connection; //CONNECTION_SERIAL or CONNECTION_WIFI
+	uint8_t accelRange;
+	uint8_t gyroRange;
+	uint8_t filterBandwidth;
+	uint8_t telemetryMode;
+	uint32_t interval; //MPU data interval in microseconds
+	uint16_t minInterval; //minimum interval for full telemetry
+	uint16_t minCompressedInterval; //minimum interval for compressed telemetry
+	uint8_t maxPayload;
+	uint8_t maxBatch;
+} RobotInfo_t;
+
+class Robot;
+
+/**
+* \brief Coroutine returning nothing. Starts suspended: call start() (top level) or co_await it (from another task).
+* \attention Destroying a suspended task destroys its frame, pending waits are cancelled
+**/
+class RobotTask
+{
+public:
+	struct promise_type
+	{
+		std::coroutine_handle<> continuation; //task awaiting this one
+		RobotTask get_return_object()
+		{
+			return RobotTask(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+		std::suspend_always initial_suspend() noexcept
+		{
+			return {};
+		}
+		struct FinalAwaiter
+		{
+			bool await_ready() noexcept
+			{
+				return false;
+			}
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept
+			{
+				std::coroutine_handle<> c = h.promise().continuation;
+				return c ? c : std::noop_coroutine();
+			}
+			void await_resume() noexcept
+			{
+			}
+		};
+		FinalAwaiter final_suspend() noexcept
+		{
+			return {};
+		}
+		void return_void()
+		{
+		}
+		void unhandled_exception()
+		{
+			std::terminate();
+		}
+	};
+
+	RobotTask(RobotTask &&t) : handle(t.handle)
+	{
+		t.handle = nullptr;
+	}
+	RobotTask(const RobotTask&) = delete;
+	~RobotTask()
+	{
+		if(handle)
+			handle.destroy();
+	}
+	/**
+	* \brief Runs the task until its first suspension
+	**/
+	void start(void)
+	{
+		handle.resume();
+	}
+	/**
+	* \brief Checks if the task has finished
+	**/
+	bool isDone(void)
+	{
+		return !handle || handle.done();
+	}
+	bool await_ready()
+	{
+		return isDone();
+	}
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> c)
+	{
+		handle.promise().continuation = c;
+		return handle;
+	}
+	void await_resume()
+	{
+	}
+private:
+	std::coroutine_handle<promise_type> handle;
+	explicit RobotTask(std::coroutine_handle<promise_type> h) : handle(h)
+	{
+	}
+};
+
+//co_await robot.nextSample(), lives in the awaiting coroutine frame, so waiting doesn't allocate
+class SampleAwaiter
+{
+	friend class Robot;
+private:
+	Robot *robot;
+	uint32_t timeout; //in milliseconds
+	RobotSample_t sample;
+	std::coroutine_handle<> handle;
+	EventTimer_t timer; //timeout, also used to resume the coroutine from the event loop
+	bool done;
+	static void fire(void *arg);
+public:
+	SampleAwaiter(Robot *robot, uint32_t timeout);
+	SampleAwaiter(const SampleAwaiter&) = delete;
+	~SampleAwaiter();
+	bool await_ready();
+	void await_suspend(std::coroutine_handle<> h);
+	RobotSample_t await_resume()
+	{
+		return sample;
+	}
+};
+
+//co_await robot.ping(), robot.connect(): sends a request and waits for the answer
+class ResponseAwaiter
+{
+	friend class Robot;
+private:
+	Robot *robot;
+	uint32_t timeout; //in milliseconds
+	SBRCP_data_t request;
+	uint8_t answerType; //expected answer packet type
+	uint8_t matchLength; //number of leading payload bytes the answer must share with the request (ping token)
+	uint8_t attempts; //transmissions left, the request is sent again after every timeout until the last one
+	uint64_t sent; //EventLoop::now() when the request was sent
+	RobotResponse_t response;
+	std::coroutine_handle<> handle;
+	EventTimer_t timer;
+	ResponseAwaiter *next; //pending requests list
+	bool pending; //linked in the pending requests list
+	static void fire(void *arg);
+public:
+	ResponseAwaiter(Robot *robot, SBRCP_data_t *request, uint8_t answerType, uint8_t matchLength, uint32_t timeout, uint8_t attempts = 1);
+	ResponseAwaiter(const ResponseAwaiter&) = delete;
+	~ResponseAwaiter();
+	bool await_ready();
+	void await_suspend(std::coroutine_handle<> h);
+	RobotResponse_t await_resume()
+	{
+		return response;
+	}
+};
+
+//co_await robot.sleep()
+class SleepAwaiter
+{
+private:
+	EventLoop *loop;
+	uint32_t delay; //in milliseconds
+	std::coroutine_handle<> handle;
+	EventTimer_t timer;
+	static void fire(void *arg);
+public:
+	SleepAwaiter(EventLoop *loop, uint32_t delay);
+	SleepAwaiter(const SleepAwaiter&) = delete;
+	~SleepAwaiter();
+	bool await_ready()
+	{
+		return false;
+	}
+	void await_suspend(std::coroutine_handle<> h);
+	void await_resume()
+	{
+	}
+};
+
+//co_await robot.setRate(), robot.setTelemetry(): waits for the acknowledgement of a configuration command, co_await gives true if the
+//robot applied it (or if it was sent, for robots without FEATURE_RELIABLE)
+class ConfigAwaiter
+{
+	friend class Robot;
+private:
+	Robot *robot;
+	uint16_t sequence;
+	ReliableResult_t result;
+	bool done;
+	std::coroutine_handle<> handle;
+	EventTimer_t timer; //resumes the coroutine from the event loop
+	ConfigAwaiter *next; //pending commands list
+	bool pending; //linked in the pending commands list
+	static void fire(void *arg);
+public:
+	ConfigAwaiter(Robot *robot, bool sent, bool tracked, uint16_t sequence);
+	ConfigAwaiter(const ConfigAwaiter&) = delete;
+	~ConfigAwaiter();
+	bool await_ready()
+	{
+		return done;
+	}
+	void await_suspend(std::coroutine_handle<> h);
+	bool await_resume()
+	{
+		return result == delivered;
+	}
+};
+
+//result of a command without an answer, co_await gives true if the command was sent
+class SendResult
+{
+private:
+	bool sent;
+public:
+	explicit SendResult(bool sent) : sent(sent)
+	{
+	}
+	bool await_ready()
+	{
+		return true;
+	}
+	void await_suspend(std::coroutine_handle<>)
+	{
+	}
+	bool await_resume()
+	{
+		return sent;
+	}
+	explicit operator bool() const
+	{
+		return sent;
+	}
+};
+
+class Robot
+{
+	friend class SampleAwaiter;
+	friend class ResponseAwaiter;
+	friend class ConfigAwaiter;
+private:
+	EventLoop *loop;
+	int fd;
+	bool udp;
+	struct sockaddr_in remote; //robot address (UDP)
+	SBRCP protocol;
+	TelemetryDecoder decoder;
+	ClockSync clock; //fed by ping answers
+	ReliableChannel reliable; //configuration and motor command delivery
+	EventTimer_t reliableTimer; //retransmissions
+	ConfigAwaiter *configWaiters; //configuration commands waiting for the acknowledgement
+	RobotInfo_t info;
+	uint8_t rxBuffer[4 * ROBOT_MAX_FRAME_SIZE]; //serial data not yet parsed
+	uint16_t rxLength;
+	uint64_t rxTime; //receive time of the data being parsed
+	RobotSample_t queue[ROBOT_SAMPLE_QUEUE];
+	uint32_t queueHead, queueTail; //next sample to write, next sample to read
+	SampleAwaiter *sampleWaiter; //coroutine waiting for a sample
+	ResponseAwaiter *responseWaiters; //pending requests
+	uint32_t pingToken;
+	uint16_t baudToken;
+	int baudRate; //serial port baud rate, 0 for UDP
+	uint64_t samples; //samples received
+	uint32_t droppedSamples; //samples dropped because the queue was full
+
+	static Robot *parsing; //robot whose data is being parsed, SBRCP callbacks don't take a context argument
+	static void onPacket(SBRCP_data_t *d);
+	static void onReadable(void *arg);
+	void handlePacket(SBRCP_data_t *d);
+	void pushSample(const float *v, bool timestamped, uint64_t robotTime);
+	void failWaiters(void);
+	static bool sendReliable(SBRCP_data_t *d, void *arg);
+	static void onReliableResult(uint16_t sequence, uint8_t type, ReliableResult_t result, void *arg);
+	static void onReliableTimer(void *arg);
+	void pollReliable(void);
+	ConfigAwaiter sendConfig(SBRCP_data_t *d);
+	ResponseAwaiter baudRequest(uint8_t action, uint32_t baud, const uint8_t *pattern, uint8_t length, uint32_t timeout);
+public:
+	/**
+	* \brief Robot client initializer
+	* \param[in] *loop Event loop resuming the coroutines, the same loop must run all coroutines using this robot
+	**/
+	Robot(EventLoop *loop);
+	~Robot();
+	/**
+	* \brief Connects to a robot by a serial port (cable or Bluetooth)
+	* \param[in] *device Serial port, e.g. "/dev/ttyUSB0"
+	* \param[in] baud Baud rate (115200 for the robot firmware)
+	* \return True on success
+	**/
+	bool openSerial(const char *device, int baud);
+	/**
+	* \brief Changes the serial port baud rate after the pending data is sent, without telling the robot (see negotiateBaud())
+	* \param[in] baud Baud rate, one of the standard Linux rates from 9600 to 2000000
+	* \return True on success, false for UDP or an unsupported rate
+	**/
+	bool setBaudRate(int baud);
+	/**
+	* \brief Gets the serial port baud rate
+	* \return Baud rate, 0 for UDP
+	**/
+	int getBaudRate(void);
+	/**
+	* \brief Connects to a robot by UDP (ESP32)
+	* \param[in] *robotIp Robot address, e.g. "192.168.4.1"
+	* \param[in] robotPort Robot port (1235)
+	* \param[in] localPort Local port the robot sends to (1234)
+	* \return True on success
+	**/
+	bool openUdp(const char *robotIp, uint16_t robotPort, uint16_t localPort);
+	/**
+	* \brief Closes the connection, pending waits finish with valid = false
+	**/
+	void close(void);
+	/**
+	* \brief Sends a packet
+	* \return True on success
+	**/
+	bool send(SBRCP_data_t *d);
+	/**
+	* \brief Capabilities handshake (DATA_CMD_HELLO), the answer is also stored in getInfo()
+	* \param[in] timeout Timeout of one attempt in milliseconds
+	* \param[in] attempts Requests sent before giving up, a single lost datagram mustn't leave the session without the robot capabilities
+	* \return Awaitable giving RobotResponse_t with the DATA_HELLO packet, invalid if no attempt was answered
+	**/
+	ResponseAwaiter connect(uint32_t timeout = ROBOT_HELLO_TIMEOUT_MS, uint8_t attempts = ROBOT_HELLO_ATTEMPTS);
+	/**
+	* \brief Round trip measurement (DATA_CMD_PING), robots that answered the handshake without FEATURE_PING are pinged with DATA_CMD_HELLO
+	* Answers with the robot time also update the clock synchronization (getClock()).
+	* \return Awaitable giving RobotResponse_t with rtt and the DATA_PONG (or DATA_HELLO) packet
+	**/
+	ResponseAwaiter ping(uint32_t timeout = ROBOT_DEFAULT_TIMEOUT_MS);
+	/**
+	* \brief Waits for the next sample. Samples received while no coroutine waits are queued (ROBOT_SAMPLE_QUEUE).
+	* \return Awaitable giving RobotSample_t
+	* \attention Only one coroutine may wait for samples at a time, another one gets an invalid sample immediately
+	**/
+	SampleAwaiter nextSample(uint32_t timeout = ROBOT_DEFAULT_TIMEOUT_MS);
+	/**
+	* \brief Waits for a given time
+	**/
+	SleepAwaiter sleep(uint32_t delay);
+	/**
+	* \brief Sets motors, m1, m2 speeds in range -255 to 255. Sequenced and latest-wins for robots with FEATURE_RELIABLE, not acknowledged.
+	**/
+	SendResult setMotors(int16_t m1, int16_t m2);
+	/**
+	* \brief Sets MPU data interval in microseconds, acknowledged and retransmitted for robots with FEATURE_RELIABLE
+	**/
+	ConfigAwaiter setRate(uint32_t interval);
+	/**
+	* \brief Sets telemetry mode (TELEMETRY_FULL, TELEMETRY_COMPRESSED, TELEMETRY_TIMESTAMPED or TELEMETRY_EVENT) and samples per
+	* compressed packet, acknowledged and retransmitted for robots with FEATURE_RELIABLE. TELEMETRY_EVENT samples carry the robot time and
+	* hold until the next one, the thresholds (in mm/s^2, mrad/s and ms) are the robot defaults if 0.
+	**/
+	ConfigAwaiter setTelemetry(uint8_t mode, uint8_t batch, uint16_t accelThreshold = 0, uint16_t gyroThreshold = 0, uint16_t maxSilence = 0);
+	/**
+	* \brief Requests runtime statistics (DATA_CMD_STATS), the robot delivery counters also update getChannel()
+	* \return Awaitable giving RobotResponse_t with the DATA_STATS packet
+	**/
+	ResponseAwaiter requestStats(uint32_t timeout = ROBOT_DEFAULT_TIMEOUT_MS);
+	/**
+	* \brief Requests the memory usage (DATA_CMD_MEMORY, FEATURE_MEMORY robots)
+	* \param[in] repaint The robot paints its free RAM again after answering, so the next answer gives the stack peak since this one
+	* \return Awaitable giving RobotResponse_t with the DATA_MEMORY packet
+	**/
+	ResponseAwaiter requestMemory(bool repaint = false, uint32_t timeout = ROBOT_DEFAULT_TIMEOUT_MS);
+	/**
+	* \brief Switches both sides to a new baud rate (FEATURE_BAUD robots, serial connection): the robot accepts the proposal (DATA_CMD_BAUD)
+	* and switches, ROBOT_BAUD_PROBES probe exchanges with full size frames must pass, then the rate is committed.
+	* Otherwise both sides fall back to the previous rate, the robot after BAUD_PROBE_TIMEOUT.
+	* \param[in] baud Baud rate
+	* \param[out] *ok True if the new rate is used, false if the old one is kept
+	* \return Task to co_await
+	**/
+	RobotTask negotiateBaud(int baud, bool *ok);
+	/**
+	* \brief Link test at the current baud rate (DATA_CMD_BAUD with BAUD_PROBE), the robot echoes the pattern
+	* \param[in] *pattern Probe data, without 0x0A bytes (LF-CR inside the payload would split the frame on the robot)
+	* \param[in] length Pattern length, up to sizeof(SBRCP_CmdBaud_t::pattern) bytes
+	* \return Awaitable giving RobotResponse_t with the DATA_BAUD packet, its pattern must be compared by the caller
+	**/
+	ResponseAwaiter probeBaud(const uint8_t *pattern, uint8_t length, uint32_t timeout = ROBOT_BAUD_PROBE_TIMEOUT_MS);
+	/**
+	* \brief Drops queued samples, e.g. the ones received before a configuration change
+	**/
+	void flushSamples(void);
+	/**
+	* \brief Gets the robot capabilities from the last DATA_HELLO
+	**/
+	const RobotInfo_t *getInfo(void);
+	/**
+	* \brief Gets the robot to host clock synchronization, e.g. to convert RobotSample_t::robotTime to host time
+	**/
+	ClockSync *getClock(void);
+	/**
+	* \brief Gets the command delivery channel, e.g. for its counters. It is enabled by the handshake with a FEATURE_RELIABLE robot.
+	**/
+	ReliableChannel *getChannel(void);
+	/**
+	* \brief Gets the number of samples received
+	**/
+	uint64_t getSamples(void);
+	/**
+	* \brief Gets the number of samples dropped because no coroutine took them from the full queue
+	**/
+	uint32_t getDroppedSamples(void);
+	/**
+	* \brief Gets the number of compressed telemetry packets lost
+	**/
+	uint32_t getLostPackets(void);
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,92 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file SessionLog.cpp
+* \brief Recorded sessions: MPU6050 samples paired with the motor command active at that time (CSV)
+* \copyright GNU GPLv3
+**/
+
+#include "SessionLog.h"
+#include <inttypes.h>
+
+#define _SESSION_HEADER "time_us,acc_x,acc_y,acc_z,gyro_x,gyro_y,gyro_z,motor_a,motor_b"
+
+SessionLog::SessionLog()
+{
+	file = NULL;
+}
+
+SessionLog::~SessionLog()
+{
+	close();
+}
+
+bool SessionLog::open(const char *path)
+{
+	close();
+	file = fopen(path, "w");
+	if(file == NULL)
+		return false;
+	fprintf(file, "%s\n", _SESSION_HEADER);
+	return true;
+}
+
+void SessionLog::write(const SessionRecord_t *record)
+{
+	if(file == NULL)
+		return;
+	fprintf(file, "%" PRIu64 ",%.6g,%.6g,%.6g,%.6g,%.6g,%.6g,%d,%d\n", record->time, record->value[0], record->value[1], record->value[2],
+			record->value[3], record->value[4], record->value[5], record->motorA, record->motorB);
+}
+
+void SessionLog::close(void)
+{
+	if(file != NULL)
+		fclose(file);
+	file = NULL;
+}
+
+bool SessionLog::read(const char *path, std::vector<SessionRecord_t> &records)
+{
+	FILE *f = fopen(path, "r");
+	if(f == NULL)
+		return false;
+	char line[256];
+	while(fgets(line, sizeof(line), f) != NULL)
+	{
+		SessionRecord_t r;
+		int a, b;
+		if(sscanf(line, "%" SCNu64 ",%f,%f,%f,%f,%f,%f,%d,%d", &r.time, &r.value[0], &r.value[1], &r.value[2],
+				&r.value[3], &r.value[4], &r.value[5], &a, &b) != 9)
+			continue; //header or broken line
+		r.motorA = a;
+		r.motorB = b;
+		records.push_back(r);
+	}
+	fclose(f);
+	return true;
+}
+
+double SessionLog::interval(const std::vector<SessionRecord_t> &records)
+{
+	if(records.size() < 2 || records.back().time <= records.front().time)
+		return 0.;
+	//compressed telemetry delivers several samples with one receive time, so use the mean over the whole session
+	return (records.back().time - records.front().time) * 1e-6 / (records.size() - 1);
+}
\ No newline at end of file
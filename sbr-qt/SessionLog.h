@@ -0,0 +1,75 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file SessionLog.h
+* \brief Recorded sessions: MPU6050 samples paired with the motor command active at that time (CSV)
+* \copyright GNU GPLv3
+**/
+
+#ifndef SESSIONLOG_H_
+#define SESSIONLOG_H_
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+typedef struct
+{
+	uint64_t time; //host receive time in microseconds
+	float value[6]; //acc X, Y, Z in m/s^2, gyro X, Y, Z in rad/s
+	int16_t motorA; //motor A command active when the sample was received
+	int16_t motorB; //motor B command
+} SessionRecord_t;
+
+class SessionLog
+{
+private:
+	FILE *file;
+public:
+	SessionLog();
+	~SessionLog();
+	/**
+	* \brief Creates a log file and writes the header
+	* \param[in] *path File name
+	* \return True on success
+	**/
+	bool open(const char *path);
+	/**
+	* \brief Appends a record
+	* \param[in] *record Record
+	**/
+	void write(const SessionRecord_t *record);
+	/**
+	* \brief Closes the log file
+	**/
+	void close(void);
+	/**
+	* \brief Reads a whole log file
+	* \param[in] *path File name
+	* \param[out] &records Records
+	* \return True on success
+	**/
+	static bool read(const char *path, std::vector<SessionRecord_t> &records);
+	/**
+	* \brief Estimates the sample interval from record timestamps
+	* \param[in] &records Records
+	* \return Mean interval in seconds, 0 if it can't be estimated
+	**/
+	static double interval(const std::vector<SessionRecord_t> &records);
+};
+#endif
\ No newline at end of file
@@ -0,0 +1,125 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file StatePredictor.cpp
+* \brief Latency compensation: forward integration of the tilt state from the sample time to the expected actuation time
+* \copyright GNU GPLv3
+**/
+
+#include "StatePredictor.h"
+#include <math.h>
+#include <string.h>
+
+StatePredictor::StatePredictor(const PredictorConfig_t &config)
+{
+	this->config = config;
+	reset();
+}
+
+void StatePredictor::reset(void)
+{
+	commandCount = 0;
+	resetLatency();
+}
+
+void StatePredictor::command(uint64_t arrival, int16_t motorA, int16_t motorB)
+{
+	Command_t &c = commands[commandCount % PREDICTOR_COMMANDS];
+	c.applied = arrival + (uint64_t)(config.actuatorLag * 1e6f);
+	c.drive = (motorA + config.motorSignB * motorB) / 2.f;
+	//commands can't overtake each other on the link
+	if((commandCount > 0) && (c.applied < commands[(commandCount - 1) % PREDICTOR_COMMANDS].applied))
+		c.applied = commands[(commandCount - 1) % PREDICTOR_COMMANDS].applied;
+	commandCount++;
+}
+
+void StatePredictor::predict(float tilt, float rate, uint64_t sampleTime, uint64_t received, uint64_t actuation, float *predictedTilt, float *predictedRate)
+{
+	if(received < sampleTime) //clock sync error
+		sampleTime = received;
+	if(actuation < received)
+		actuation = received;
+	if(actuation - sampleTime > PREDICTOR_MAX_HORIZON_US)
+		actuation = sampleTime + PREDICTOR_MAX_HORIZON_US;
+
+	float age = received - sampleTime, lead = actuation - received;
+	latency.count++;
+	ageSum += age;
+	leadSum += lead;
+	latency.ageMean = ageSum / latency.count;
+	latency.leadMean = leadSum / latency.count;
+	latency.horizonMean = latency.ageMean + latency.leadMean;
+	if(age > latency.ageMax)
+		latency.ageMax = age;
+	if(lead > latency.leadMax)
+		latency.leadMax = lead;
+	if(age + lead > latency.horizonMax)
+		latency.horizonMax = age + lead;
+
+	//the command in effect at the sample time: the newest one applied before it
+	uint32_t n = (commandCount < PREDICTOR_COMMANDS) ? commandCount : PREDICTOR_COMMANDS;
+	uint32_t next = commandCount - n; //oldest kept command
+	while((next < commandCount) && (commands[next % PREDICTOR_COMMANDS].applied <= sampleTime))
+		next++;
+	float drive = (next > commandCount - n) ? commands[(next - 1) % PREDICTOR_COMMANDS].drive : 0.f;
+
+	//semi-implicit Euler as in PlantSimulator, steps end at command changes
+	const PlantModel_t &m = config.model;
+	double t = tilt, r = rate;
+	uint64_t time = sampleTime;
+	while(time < actuation)
+	{
+		uint64_t end = time + PREDICTOR_STEP_US;
+		if(end > actuation)
+			end = actuation;
+		if((next < commandCount) && (commands[next % PREDICTOR_COMMANDS].applied < end))
+			end = commands[next % PREDICTOR_COMMANDS].applied;
+		double h = (end - time) * 1e-6;
+		float effective = (fabsf(drive) > m.deadzone) ? drive - copysignf(m.deadzone, drive) : 0.f;
+		double accel = m.stiffness * t - m.damping * r + m.gain * effective + m.offset;
+		r += accel * h;
+		t += r * h;
+		time = end;
+		while((next < commandCount) && (commands[next % PREDICTOR_COMMANDS].applied <= time))
+			drive = commands[(next++) % PREDICTOR_COMMANDS].drive;
+	}
+	*predictedTilt = t;
+	*predictedRate = r;
+}
+
+LatencyStats_t StatePredictor::getLatency(void)
+{
+	return latency;
+}
+
+void StatePredictor::resetLatency(void)
+{
+	memset(&latency, 0, sizeof(latency));
+	ageSum = 0.;
+	leadSum = 0.;
+}
+
+PredictorConfig_t StatePredictor::defaultConfig(const PlantModel_t &model)
+{
+	PredictorConfig_t c;
+	c.model = model;
+	c.motorSignB = -1;
+	c.actuatorLag = 0.f;
+	return c;
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file StatePredictor.h
+* \brief Latency compensation: forward integration of the tilt state from the sample time to the expected actuation time
+* \copyright GNU GPLv3
+**/
+
+#ifndef STATEPREDICTOR_H_
+#define STATEPREDICTOR_H_
+#include <stdint.h>
+#include "SystemIdentifier.h"
+
+#define PREDICTOR_COMMANDS 64 //motor commands kept for the integration (power of 2)
+#define PREDICTOR_STEP_US 1000 //maximum integration step in microseconds
+#define PREDICTOR_MAX_HORIZON_US 200000 //longer predictions are cut (the model error grows quickly)
+
+typedef struct
+{
+	PlantModel_t model; //plant dynamics, a zero model gives constant tilt rate extrapolation
+	int8_t motorSignB; //drive command is (motorA + motorSignB * motorB) / 2, as in SysIdConfig_t
+	float actuatorLag; //delay from a command reaching the robot to its effect in seconds, used instead of model.lag
+} PredictorConfig_t;
+
+//latencies of the predicted samples in microseconds, means and maxima since the last resetLatency()
+typedef struct
+{
+	uint32_t count; //predictions
+	float ageMean, ageMax; //measured: sample time to reception on the host
+	float leadMean, leadMax; //predicted: reception to the expected actuation time
+	float horizonMean, horizonMax; //age + lead, the prediction length
+} LatencyStats_t;
+
+class StatePredictor
+{
+private:
+	typedef struct
+	{
+		uint64_t applied; //host time the command takes effect
+		float drive; //drive command
+	} Command_t;
+
+	PredictorConfig_t config;
+	Command_t commands[PREDICTOR_COMMANDS]; //ordered by applied time
+	uint32_t commandCount;
+	LatencyStats_t latency;
+	double ageSum, leadSum;
+public:
+	/**
+	* \brief Predictor initializer
+	* \param[in] &config Plant model and motor mounting
+	**/
+	StatePredictor(const PredictorConfig_t &config);
+	/**
+	* \brief Forgets commands and latency statistics
+	**/
+	void reset(void);
+	/**
+	* \brief Records a motor command
+	* \param[in] arrival Expected host time of the command reaching the robot (send time + downlink latency), in microseconds
+	* \param[in] motorA Motor A command
+	* \param[in] motorB Motor B command
+	**/
+	void command(uint64_t arrival, int16_t motorA, int16_t motorB);
+	/**
+	* \brief Predicts the state at the actuation time, with the commands that take effect in the meantime
+	* \param[in] tilt Tilt at the sample time in radians
+	* \param[in] rate Tilt rate at the sample time in rad/s
+	* \param[in] sampleTime Host time of the sample reading (ClockSync::toHost() of the robot timestamp), in microseconds
+	* \param[in] received Host time of the sample reception
+	* \param[in] actuation Host time the next command is expected to take effect
+	* \param[out] *predictedTilt Tilt at the actuation time
+	* \param[out] *predictedRate Tilt rate at the actuation time
+	**/
+	void predict(float tilt, float rate, uint64_t sampleTime, uint64_t received, uint64_t actuation, float *predictedTilt, float *predictedRate);
+	/**
+	* \brief Gets the measured and predicted latencies
+	**/
+	LatencyStats_t getLatency(void);
+	/**
+	* \brief Resets the latency statistics
+	**/
+	void resetLatency(void);
+	/**
+	* \brief Default settings: the model without its lag, no actuator delay
+	* \param[in] &model Plant model
+	**/
+	static PredictorConfig_t defaultConfig(const PlantModel_t &model);
+};
+#endif
\ No newline at end of file
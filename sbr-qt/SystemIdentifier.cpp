@@ -0,0 +1,234 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file SystemIdentifier.cpp
+* \brief Online plant identification (recursive least squares with forgetting) from motor commands and MPU6050 data
+* \copyright GNU GPLv3
+**/
+
+#include "SystemIdentifier.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define _RLS_P0 1e4 //initial inverse correlation diagonal
+#define _RLS_P_MAX 1e8 //covariance reset threshold, forgetting with poor excitation makes P grow without bounds
+#define _ERROR_SMOOTHING 0.995 //prediction error averaging factor
+
+RecursiveLeastSquares::RecursiveLeastSquares()
+{
+	reset(1., _RLS_P0);
+}
+
+void RecursiveLeastSquares::reset(double lambda, double p0)
+{
+	this->lambda = lambda;
+	memset(theta, 0, sizeof(theta));
+	memset(p, 0, sizeof(p));
+	for(int i = 0; i < SYSID_PARAMS; i++)
+		p[i][i] = p0;
+	error = 0.;
+}
+
+double RecursiveLeastSquares::update(const double *phi, double y)
+{
+	double pphi[SYSID_PARAMS]; //P * phi
+	double denom = lambda;
+	double e = y;
+	for(int i = 0; i < SYSID_PARAMS; i++)
+	{
+		pphi[i] = 0.;
+		for(int j = 0; j < SYSID_PARAMS; j++)
+			pphi[i] += p[i][j] * phi[j];
+		denom += phi[i] * pphi[i];
+		e -= phi[i] * theta[i];
+	}
+	double trace = 0.;
+	for(int i = 0; i < SYSID_PARAMS; i++)
+	{
+		double k = pphi[i] / denom; //gain
+		theta[i] += k * e;
+		for(int j = 0; j < SYSID_PARAMS; j++)
+			p[i][j] = (p[i][j] - k * pphi[j]) / lambda; //P is symmetric, so phi' * P = (P * phi)'
+		trace += p[i][i];
+	}
+	if(trace > _RLS_P_MAX) //no excitation (e.g. robot at rest), keep estimates but limit covariance
+	{
+		for(int i = 0; i < SYSID_PARAMS; i++)
+			for(int j = 0; j < SYSID_PARAMS; j++)
+				p[i][j] *= _RLS_P_MAX / trace;
+	}
+	error = _ERROR_SMOOTHING * error + (1. - _ERROR_SMOOTHING) * e * e;
+	return e;
+}
+
+const double *RecursiveLeastSquares::getParams(void)
+{
+	return theta;
+}
+
+double RecursiveLeastSquares::getError(void)
+{
+	return error;
+}
+
+
+
+SystemIdentifier::SystemIdentifier(const SysIdConfig_t &config)
+{
+	this->config = config;
+	if(this->config.maxLag > SYSID_MAX_LAG)
+		this->config.maxLag = SYSID_MAX_LAG;
+	reset();
+}
+
+void SystemIdentifier::reset(void)
+{
+	for(uint8_t i = 0; i <= config.maxLag; i++)
+		rls[i].reset(config.forgetting, _RLS_P0);
+	memset(commands, 0, sizeof(commands));
+	commandPos = 0;
+	tilt = 0.;
+	lastRate = 0.;
+	samples = 0;
+}
+
+void SystemIdentifier::update(const float *sample, int16_t motorA, int16_t motorB)
+{
+	const double dt = config.interval;
+	double rate = sample[config.gyroAxis];
+	double accelTilt = atan2(-sample[config.accelForward], sample[config.accelUp]);
+	double prevTilt = tilt;
+	if(samples == 0)
+		tilt = accelTilt;
+	else
+		tilt = config.complementary * (tilt + rate * dt) + (1. - config.complementary) * accelTilt;
+
+	if(samples > 0)
+	{
+		//tilt'' over the last interval is explained by the previous state and the command sent lag samples before that interval
+		double y = (rate - lastRate) / dt;
+		for(uint8_t lag = 0; lag <= config.maxLag; lag++)
+		{
+			double u = commands[(commandPos + SYSID_MAX_LAG + 2 - lag) % (SYSID_MAX_LAG + 2)];
+			double phi[SYSID_PARAMS] = {prevTilt, lastRate, u, (double)((u > 0.) - (u < 0.)), 1.};
+			rls[lag].update(phi, y);
+		}
+	}
+
+	//store the command active during the next interval
+	commandPos = (commandPos + 1) % (SYSID_MAX_LAG + 2);
+	commands[commandPos] = (motorA + config.motorSignB * motorB) / 2.f;
+	lastRate = rate;
+	samples++;
+}
+
+void SystemIdentifier::getModel(PlantModel_t *model)
+{
+	uint8_t best = 0;
+	for(uint8_t lag = 1; lag <= config.maxLag; lag++)
+	{
+		if(rls[lag].getError() < rls[best].getError())
+			best = lag;
+	}
+	const double *t = rls[best].getParams();
+	model->stiffness = t[0];
+	model->damping = -t[1];
+	model->gain = t[2];
+	model->deadzone = (fabs(t[2]) > 1e-9) ? -t[3] / t[2] : 0.; //gain * (u - deadzone * sign(u)) = gain * u + t[3] * sign(u)
+	if(model->deadzone < 0.f)
+		model->deadzone = 0.f;
+	model->offset = t[4];
+	model->lag = best * config.interval;
+	model->interval = config.interval;
+	model->residual = sqrt(rls[best].getError());
+	model->samples = samples;
+}
+
+double SystemIdentifier::getTilt(void)
+{
+	return tilt;
+}
+
+SysIdConfig_t SystemIdentifier::defaultConfig(float interval)
+{
+	SysIdConfig_t c;
+	c.interval = interval;
+	c.forgetting = 0.999f;
+	c.complementary = 0.98f;
+	c.maxLag = 10;
+	c.gyroAxis = 4;
+	c.accelForward = 0;
+	c.accelUp = 2;
+	c.motorSignB = -1; //without _INVERT_ROTATION in the firmware, equal speeds spin the robot around
+	return c;
+}
+
+bool SystemIdentifier::saveModel(const char *path, const PlantModel_t *model)
+{
+	FILE *f = fopen(path, "w");
+	if(f == NULL)
+		return false;
+	fprintf(f, "# SBR plant model: tilt'' = stiffness * tilt - damping * tilt' + gain * (u - deadzone * sign(u)) + offset\n");
+	fprintf(f, "stiffness=%g\ndamping=%g\ngain=%g\ndeadzone=%g\noffset=%g\nlag=%g\ninterval=%g\nresidual=%g\nsamples=%u\n",
+			model->stiffness, model->damping, model->gain, model->deadzone, model->offset, model->lag, model->interval,
+			model->residual, model->samples);
+	fclose(f);
+	return true;
+}
+
+bool SystemIdentifier::loadModel(const char *path, PlantModel_t *model)
+{
+	FILE *f = fopen(path, "r");
+	if(f == NULL)
+		return false;
+	memset(model, 0, sizeof(PlantModel_t));
+	char line[256];
+	int found = 0;
+	while(fgets(line, sizeof(line), f) != NULL)
+	{
+		char key[32];
+		double value;
+		if(sscanf(line, "%31[^=]=%lf", key, &value) != 2)
+			continue;
+		found++;
+		if(!strcmp(key, "stiffness"))
+			model->stiffness = value;
+		else if(!strcmp(key, "damping"))
+			model->damping = value;
+		else if(!strcmp(key, "gain"))
+			model->gain = value;
+		else if(!strcmp(key, "deadzone"))
+			model->deadzone = value;
+		else if(!strcmp(key, "offset"))
+			model->offset = value;
+		else if(!strcmp(key, "lag"))
+			model->lag = value;
+		else if(!strcmp(key, "interval"))
+			model->interval = value;
+		else if(!strcmp(key, "residual"))
+			model->residual = value;
+		else if(!strcmp(key, "samples"))
+			model->samples = value;
+		else
+			found--;
+	}
+	fclose(f);
+	return found > 0;
+}
\ No newline at end of file
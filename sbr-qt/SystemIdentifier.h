@@ -0,0 +1,143 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file SystemIdentifier.h
+* \brief Online plant identification (recursive least squares with forgetting) from motor commands and MPU6050 data
+* \copyright GNU GPLv3
+**/
+
+#ifndef SYSTEMIDENTIFIER_H_
+#define SYSTEMIDENTIFIER_H_
+#include <stdint.h>
+
+#define SYSID_PARAMS 5 //regressors: tilt, tilt rate, motor command, sign of the motor command, 1
+#define SYSID_MAX_LAG 16 //maximum command-to-sensor lag in samples
+
+//identification settings
+typedef struct
+{
+	float interval; //sample interval in seconds
+	float forgetting; //RLS forgetting factor, 1 for no forgetting (usually 0.995 - 0.9999)
+	float complementary; //complementary filter coefficient of the tilt estimate (gyro weight)
+	uint8_t maxLag; //candidate lags are 0 to maxLag samples
+	uint8_t gyroAxis; //gyroscope channel of the tilt axis (3, 4 or 5)
+	uint8_t accelForward; //accelerometer channel pointing forward (0, 1 or 2)
+	uint8_t accelUp; //accelerometer channel pointing up (0, 1 or 2)
+	int8_t motorSignB; //forward drive command is (motorA + motorSignB * motorB) / 2
+} SysIdConfig_t;
+
+//identified plant: tilt'' = stiffness * tilt - damping * tilt' + gain * (u - deadzone * sign(u)) + offset, u delayed by lag
+typedef struct
+{
+	float stiffness; //angular acceleration per radian of tilt in 1/s^2 (g / l for an inverted pendulum)
+	float damping; //angular deceleration per rad/s of tilt rate in 1/s
+	float gain; //angular acceleration per motor command unit in rad/s^2
+	float deadzone; //motor command with no effect (friction, motor dead band)
+	float offset; //constant angular acceleration (unbalance) in rad/s^2
+	float lag; //command-to-sensor delay in seconds on top of one sample interval
+	float interval; //sample interval the model was identified with, in seconds
+	float residual; //RMS prediction error in rad/s^2
+	uint32_t samples; //number of samples used
+} PlantModel_t;
+
+class RecursiveLeastSquares
+{
+private:
+	double theta[SYSID_PARAMS]; //parameter estimates
+	double p[SYSID_PARAMS][SYSID_PARAMS]; //inverse correlation matrix
+	double lambda; //forgetting factor
+	double error; //exponentially weighted mean squared a priori error
+public:
+	RecursiveLeastSquares();
+	/**
+	* \brief Resets estimates
+	* \param[in] lambda Forgetting factor
+	* \param[in] p0 Initial diagonal of the inverse correlation matrix (large value for unknown parameters)
+	**/
+	void reset(double lambda, double p0);
+	/**
+	* \brief Updates estimates with a new observation, O(SYSID_PARAMS^2)
+	* \param[in] *phi Regressors (SYSID_PARAMS values)
+	* \param[in] y Observed value
+	* \return A priori prediction error
+	**/
+	double update(const double *phi, double y);
+	/**
+	* \brief Gets parameter estimates (SYSID_PARAMS values)
+	**/
+	const double *getParams(void);
+	/**
+	* \brief Gets exponentially weighted mean squared prediction error
+	**/
+	double getError(void);
+};
+
+class SystemIdentifier
+{
+private:
+	SysIdConfig_t config;
+	RecursiveLeastSquares rls[SYSID_MAX_LAG + 1]; //one estimator for every candidate lag
+	float commands[SYSID_MAX_LAG + 2]; //past drive commands (ring buffer)
+	uint8_t commandPos;
+	double tilt; //complementary filter tilt estimate
+	double lastRate; //previous tilt rate
+	uint32_t samples;
+public:
+	/**
+	* \brief Identifier initializer
+	* \param[in] &config Identification settings
+	**/
+	SystemIdentifier(const SysIdConfig_t &config);
+	/**
+	* \brief Resets all estimates
+	**/
+	void reset(void);
+	/**
+	* \brief Updates the model with a sample, small enough to be called in the control thread for every sample
+	* \param[in] *sample Acc X, Y, Z in m/s^2, gyro X, Y, Z in rad/s
+	* \param[in] motorA Motor A command active when the sample was taken
+	* \param[in] motorB Motor B command
+	**/
+	void update(const float *sample, int16_t motorA, int16_t motorB);
+	/**
+	* \brief Gets the current model (the lag with the lowest prediction error)
+	* \param[out] *model Plant model
+	**/
+	void getModel(PlantModel_t *model);
+	/**
+	* \brief Gets the current tilt estimate in radians
+	**/
+	double getTilt(void);
+	/**
+	* \brief Default settings: forgetting 0.999, lags up to 10 samples, tilt about gyro Y, X forward, Z up, motors mounted mirrored
+	* \param[in] interval Sample interval in seconds
+	**/
+	static SysIdConfig_t defaultConfig(float interval);
+	/**
+	* \brief Writes a model as a "key=value" text file, readable by the simulator
+	* \return True on success
+	**/
+	static bool saveModel(const char *path, const PlantModel_t *model);
+	/**
+	* \brief Reads a model written by saveModel()
+	* \return True on success
+	**/
+	static bool loadModel(const char *path, PlantModel_t *model);
+};
+#endif
\ No newline at end of file
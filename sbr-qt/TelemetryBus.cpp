@@ -0,0 +1,301 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file TelemetryBus.cpp
+* \brief Shared-memory telemetry bus: the process owning the robot link publishes samples to a lock-free ring read by any number of local processes, motor commands come back through a single-writer command slot
+* \copyright GNU GPLv3
+**/
+
+#include "TelemetryBus.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "EventLoop.h"
+
+//the layout is shared with other processes and sbr-py/TelemetryBus.py
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared memory atomics must be lock-free");
+static_assert(sizeof(TelemetryBusSlot_t) == 64, "slot layout");
+static_assert(offsetof(TelemetryBusSlot_t, hostTime) == 8 && offsetof(TelemetryBusSlot_t, robotTime) == 16
+              && offsetof(TelemetryBusSlot_t, timestamped) == 24 && offsetof(TelemetryBusSlot_t, value) == 28, "slot layout");
+static_assert(offsetof(TelemetryBusLayout_t, head) == 24 && offsetof(TelemetryBusLayout_t, heartbeat) == 32, "header layout");
+static_assert(offsetof(TelemetryBusLayout_t, commandOwner) == 64 && offsetof(TelemetryBusLayout_t, command) == 72
+              && offsetof(TelemetryBusLayout_t, commandTime) == 80 && offsetof(TelemetryBusLayout_t, slot) == 128, "header layout");
+
+//kill() with signal 0 only checks the process, EPERM means it exists under another user
+static bool isAlive(uint32_t pid)
+{
+	return (kill(pid, 0) == 0) || (errno == EPERM);
+}
+
+static bool isCompatible(const TelemetryBusLayout_t *l)
+{
+	return (l->magic == TELEMETRY_BUS_MAGIC) && (l->version == TELEMETRY_BUS_VERSION) && (l->channels == TELEMETRY_CHANNELS)
+	       && (l->slots == TELEMETRY_BUS_SLOTS) && (l->slotSize == sizeof(TelemetryBusSlot_t));
+}
+
+TelemetryBus::TelemetryBus()
+{
+	layout = NULL;
+	producer = false;
+	writable = false;
+	lastCommand = 0;
+}
+
+TelemetryBus::~TelemetryBus()
+{
+	close();
+}
+
+bool TelemetryBus::create(const char *name)
+{
+	close();
+	int fd = shm_open(name, O_RDWR | O_CREAT, 0666);
+	if(fd < 0)
+		return false;
+	struct stat st;
+	bool existing = (fstat(fd, &st) == 0) && (st.st_size == sizeof(TelemetryBusLayout_t));
+	if(!existing && (ftruncate(fd, sizeof(TelemetryBusLayout_t)) != 0))
+	{
+		::close(fd);
+		return false;
+	}
+	void *p = mmap(NULL, sizeof(TelemetryBusLayout_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(p == MAP_FAILED)
+		return false;
+	TelemetryBusLayout_t *l = (TelemetryBusLayout_t*)p;
+	if(existing && isCompatible(l))
+	{
+		if((l->producerPid != 0) && (l->producerPid != (uint32_t)getpid()) && isAlive(l->producerPid))
+		{
+			munmap(p, sizeof(TelemetryBusLayout_t));
+			return false;
+		}
+	}
+	else
+	{
+		//a new object is zero-filled, an incompatible one is cleared; readers check the magic number, which is set last
+		l->magic = 0;
+		std::atomic_thread_fence(std::memory_order_release);
+		memset((void*)l, 0, sizeof(TelemetryBusLayout_t));
+		l->version = TELEMETRY_BUS_VERSION;
+		l->channels = TELEMETRY_CHANNELS;
+		l->slots = TELEMETRY_BUS_SLOTS;
+		l->slotSize = sizeof(TelemetryBusSlot_t);
+		std::atomic_thread_fence(std::memory_order_release);
+		l->magic = TELEMETRY_BUS_MAGIC;
+	}
+	l->producerPid = getpid();
+	l->heartbeat.store(EventLoop::now(), std::memory_order_release);
+	lastCommand = l->command.load(std::memory_order_acquire) >> 32; //commands written before the producer started are not sent
+	layout = l;
+	producer = true;
+	writable = true;
+	return true;
+}
+
+bool TelemetryBus::open(const char *name, bool commands)
+{
+	close();
+	int fd = shm_open(name, commands ? O_RDWR : O_RDONLY, 0);
+	if(fd < 0)
+		return false;
+	struct stat st;
+	if((fstat(fd, &st) != 0) || (st.st_size != sizeof(TelemetryBusLayout_t)))
+	{
+		::close(fd);
+		return false;
+	}
+	void *p = mmap(NULL, sizeof(TelemetryBusLayout_t), commands ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if(p == MAP_FAILED)
+		return false;
+	if(!isCompatible((TelemetryBusLayout_t*)p))
+	{
+		munmap(p, sizeof(TelemetryBusLayout_t));
+		return false;
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	layout = (TelemetryBusLayout_t*)p;
+	producer = false;
+	writable = commands;
+	return true;
+}
+
+void TelemetryBus::close(void)
+{
+	if(layout == NULL)
+		return;
+	if(writable)
+		releaseCommands();
+	if(producer && (layout->producerPid == (uint32_t)getpid()))
+		layout->producerPid = 0;
+	munmap(layout, sizeof(TelemetryBusLayout_t));
+	layout = NULL;
+	producer = false;
+	writable = false;
+}
+
+const TelemetryBusLayout_t *TelemetryBus::getLayout(void) const
+{
+	return layout;
+}
+
+void TelemetryBus::publish(uint64_t hostTime, const float *value, bool timestamped, uint64_t robotTime)
+{
+	uint64_t n = layout->head.load(std::memory_order_relaxed) + 1;
+	TelemetryBusSlot_t *s = &layout->slot[(n - 1) & (TELEMETRY_BUS_SLOTS - 1)];
+	s->sequence.store(0, std::memory_order_relaxed); //readers that copied the old sample see the change and drop the copy
+	std::atomic_thread_fence(std::memory_order_release);
+	s->hostTime = hostTime;
+	s->robotTime = robotTime;
+	s->timestamped = timestamped;
+	memcpy(s->value, value, sizeof(s->value));
+	s->sequence.store(n, std::memory_order_release);
+	layout->head.store(n, std::memory_order_release);
+}
+
+void TelemetryBus::setStatus(uint64_t now, uint32_t interval)
+{
+	layout->interval.store(interval, std::memory_order_relaxed);
+	layout->heartbeat.store(now, std::memory_order_release);
+}
+
+bool TelemetryBus::pollCommand(int16_t *motorA, int16_t *motorB)
+{
+	uint64_t c = layout->command.load(std::memory_order_acquire);
+	if((uint32_t)(c >> 32) == lastCommand)
+		return false;
+	lastCommand = c >> 32;
+	*motorA = (int16_t)(c >> 16);
+	*motorB = (int16_t)c;
+	return true;
+}
+
+bool TelemetryBus::releaseDeadOwner(void)
+{
+	uint32_t owner = layout->commandOwner.load(std::memory_order_acquire);
+	if((owner == 0) || isAlive(owner))
+		return false;
+	return layout->commandOwner.compare_exchange_strong(owner, 0, std::memory_order_acq_rel);
+}
+
+bool TelemetryBus::claimCommands(void)
+{
+	if((layout == NULL) || !writable)
+		return false;
+	uint32_t self = getpid();
+	uint32_t owner = layout->commandOwner.load(std::memory_order_acquire);
+	while(owner != self)
+	{
+		if((owner != 0) && isAlive(owner))
+			return false;
+		if(layout->commandOwner.compare_exchange_weak(owner, self, std::memory_order_acq_rel)) //owner is reloaded on failure
+			break;
+	}
+	return true;
+}
+
+void TelemetryBus::releaseCommands(void)
+{
+	uint32_t self = getpid();
+	layout->commandOwner.compare_exchange_strong(self, 0, std::memory_order_acq_rel);
+}
+
+bool TelemetryBus::sendMotors(int16_t motorA, int16_t motorB)
+{
+	if((layout == NULL) || !writable || (layout->commandOwner.load(std::memory_order_relaxed) != (uint32_t)getpid()))
+		return false;
+	//only the owner writes, so the sequence needs no read-modify-write
+	uint64_t sequence = (layout->command.load(std::memory_order_relaxed) >> 32) + 1;
+	layout->commandTime.store(EventLoop::now(), std::memory_order_relaxed);
+	layout->command.store((sequence << 32) | ((uint32_t)(uint16_t)motorA << 16) | (uint16_t)motorB, std::memory_order_release);
+	return true;
+}
+
+bool TelemetryBus::isProducerAlive(uint64_t now, uint64_t timeout) const
+{
+	if(layout == NULL)
+		return false;
+	uint64_t heartbeat = layout->heartbeat.load(std::memory_order_acquire);
+	return (now < heartbeat) || (now - heartbeat < timeout);
+}
+
+
+TelemetryBusReader::TelemetryBusReader(const TelemetryBus *bus, bool oldest)
+{
+	layout = bus->getLayout();
+	uint64_t head = layout->head.load(std::memory_order_acquire);
+	if(!oldest)
+		next = head + 1;
+	else
+		next = (head >= TELEMETRY_BUS_SLOTS) ? head - TELEMETRY_BUS_SLOTS + 1 : 1;
+	lost = 0;
+}
+
+bool TelemetryBusReader::read(BusSample_t *s)
+{
+	while(true)
+	{
+		uint64_t head = layout->head.load(std::memory_order_acquire);
+		if(next > head)
+			return false;
+		if(head - next < TELEMETRY_BUS_SLOTS)
+		{
+			const TelemetryBusSlot_t *slot = &layout->slot[(next - 1) & (TELEMETRY_BUS_SLOTS - 1)];
+			if(slot->sequence.load(std::memory_order_acquire) == next)
+			{
+				s->hostTime = slot->hostTime;
+				s->robotTime = slot->robotTime;
+				s->timestamped = slot->timestamped;
+				memcpy(s->value, slot->value, sizeof(s->value));
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if(slot->sequence.load(std::memory_order_relaxed) == next) //not overwritten while copying
+				{
+					s->sequence = next++;
+					return true;
+				}
+			}
+			head = layout->head.load(std::memory_order_acquire);
+		}
+		//overtaken by the producer, half a ring of margin so that the next samples aren't overwritten right away
+		uint64_t resume = (head > TELEMETRY_BUS_SLOTS / 2) ? head - TELEMETRY_BUS_SLOTS / 2 + 1 : next;
+		if(resume > next)
+		{
+			lost += resume - next;
+			next = resume;
+		}
+	}
+}
+
+uint64_t TelemetryBusReader::available(void) const
+{
+	uint64_t head = layout->head.load(std::memory_order_acquire);
+	return (head >= next) ? head - next + 1 : 0;
+}
+
+uint64_t TelemetryBusReader::getLost(void) const
+{
+	return lost;
+}
@@ -0,0 +1,185 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file TelemetryBus.h
+* \brief Shared-memory telemetry bus: the process owning the robot link publishes samples to a lock-free ring read by any number of local processes, motor commands come back through a single-writer command slot
+* \copyright GNU GPLv3
+**/
+
+#ifndef TELEMETRYBUS_H_
+#define TELEMETRYBUS_H_
+#include <stdint.h>
+#include <atomic>
+#include "TelemetryCodec.h"
+
+#define TELEMETRY_BUS_NAME "/sbr-telemetry" //default shared memory object (/dev/shm/sbr-telemetry)
+#define TELEMETRY_BUS_SLOTS 4096 //samples kept in the ring (power of 2), 20 s at 200 Hz
+#define TELEMETRY_BUS_MAGIC 0x53425242 //"BRBS"
+#define TELEMETRY_BUS_VERSION 1
+
+//one sample, written by the producer only
+//sequence is the sample number (from 1) once the slot is written and 0 while it is being written (seqlock)
+typedef struct alignas(64)
+{
+	std::atomic<uint64_t> sequence;
+	uint64_t hostTime; //EventLoop::now() when the packet was received, in microseconds (CLOCK_MONOTONIC, the same for all processes)
+	uint64_t robotTime; //robot time of the reading in microseconds, valid if timestamped is not 0
+	uint32_t timestamped;
+	float value[TELEMETRY_CHANNELS]; //acceleration X, Y, Z in m/s^2, angular rate X, Y, Z in rad/s
+} TelemetryBusSlot_t;
+
+//shared memory layout, sbr-py/TelemetryBus.py reads it with the same offsets (checked in TelemetryBus.cpp)
+typedef struct
+{
+	uint32_t magic; //TELEMETRY_BUS_MAGIC, set after the rest is initialized
+	uint16_t version;
+	uint16_t channels;
+	uint32_t slots;
+	uint32_t slotSize;
+	uint32_t producerPid;
+	std::atomic<uint32_t> interval; //MPU data interval in microseconds, 0 if not known
+	std::atomic<uint64_t> head; //samples published, the last one is in slot (head - 1) % slots
+	std::atomic<uint64_t> heartbeat; //producer EventLoop::now(), updated while the producer runs even without samples
+	alignas(64) std::atomic<uint32_t> commandOwner; //pid of the only process allowed to write commands, 0 if none
+	std::atomic<uint64_t> command; //sequence << 32 | (uint16_t)motorA << 16 | (uint16_t)motorB, one atomic word
+	std::atomic<uint64_t> commandTime; //EventLoop::now() when the last command was written
+	TelemetryBusSlot_t slot[TELEMETRY_BUS_SLOTS];
+} TelemetryBusLayout_t;
+
+//sample copied out of the ring
+typedef struct
+{
+	uint64_t sequence;
+	uint64_t hostTime;
+	bool timestamped;
+	uint64_t robotTime;
+	float value[TELEMETRY_CHANNELS];
+} BusSample_t;
+
+class TelemetryBus
+{
+private:
+	TelemetryBusLayout_t *layout;
+	bool producer; //created the object, clears producerPid on close()
+	bool writable;
+	uint32_t lastCommand; //sequence of the last command taken by pollCommand()
+public:
+	TelemetryBus();
+	~TelemetryBus();
+	/**
+	* \brief Creates the bus for the producer. A bus left by a previous producer is taken over and its sample numbering continues,
+	* so readers attached to it keep reading.
+	* \param[in] *name Shared memory object name, e.g. TELEMETRY_BUS_NAME
+	* \return False if the object can't be created or another living producer owns it
+	**/
+	bool create(const char *name);
+	/**
+	* \brief Attaches to a bus created by the producer
+	* \param[in] *name Shared memory object name
+	* \param[in] commands Maps the bus writable, needed for claimCommands() and sendMotors(); readers map it read-only
+	* \return False if the bus doesn't exist or has another layout version
+	**/
+	bool open(const char *name, bool commands = false);
+	/**
+	* \brief Unmaps the bus. The shared memory object is kept, so readers keep their mapping and continue when a producer takes it over.
+	**/
+	void close(void);
+	/**
+	* \brief Gets the mapped layout, NULL if not open
+	**/
+	const TelemetryBusLayout_t *getLayout(void) const;
+	/**
+	* \brief Publishes a sample (producer only), wait-free: readers never delay it, a lagging reader loses the overwritten samples
+	* \param[in] hostTime Reception time, EventLoop::now()
+	* \param[in] *value TELEMETRY_CHANNELS values
+	* \param[in] timestamped robotTime is valid
+	* \param[in] robotTime Robot time of the reading in microseconds
+	**/
+	void publish(uint64_t hostTime, const float *value, bool timestamped, uint64_t robotTime);
+	/**
+	* \brief Updates the producer heartbeat and the MPU data interval (producer only)
+	**/
+	void setStatus(uint64_t now, uint32_t interval);
+	/**
+	* \brief Gets a motor command written since the last call (producer only), older unread commands are replaced by the newest one
+	* \param[out] *motorA Motor A speed
+	* \param[out] *motorB Motor B speed
+	* \return True if there is a new command
+	**/
+	bool pollCommand(int16_t *motorA, int16_t *motorB);
+	/**
+	* \brief Releases the command slot if its owner process has exited (producer only)
+	* \return True if a dead owner was removed, the motors should be stopped
+	**/
+	bool releaseDeadOwner(void);
+	/**
+	* \brief Makes the calling process the only command writer, if there is no other living one
+	* \return True if the process owns the command slot
+	**/
+	bool claimCommands(void);
+	/**
+	* \brief Gives up the command slot
+	**/
+	void releaseCommands(void);
+	/**
+	* \brief Writes a motor command (command owner only). Commands are not queued, the producer sends the newest one.
+	* \param[in] motorA Motor A speed in range -255 to 255
+	* \param[in] motorB Motor B speed
+	* \return False if the process doesn't own the command slot
+	**/
+	bool sendMotors(int16_t motorA, int16_t motorB);
+	/**
+	* \brief Checks if the producer updated its heartbeat recently
+	* \param[in] now EventLoop::now()
+	* \param[in] timeout Heartbeat age in microseconds after which the producer is taken as dead
+	**/
+	bool isProducerAlive(uint64_t now, uint64_t timeout) const;
+};
+
+//read position of one consumer, nothing is written to the bus, so any number of readers can't affect the producer or each other
+class TelemetryBusReader
+{
+private:
+	const TelemetryBusLayout_t *layout;
+	uint64_t next; //number of the next sample to read
+	uint64_t lost; //samples overwritten before they were read
+public:
+	/**
+	* \brief Reader initializer
+	* \param[in] *bus Open bus
+	* \param[in] oldest Starts at the oldest sample in the ring, otherwise at the next published one
+	**/
+	TelemetryBusReader(const TelemetryBus *bus, bool oldest = false);
+	/**
+	* \brief Copies the next sample. A reader lagging by more than the ring size skips to the middle of the ring and counts the skipped
+	* samples as lost.
+	* \param[out] *s Sample
+	* \return False if there is no new sample
+	**/
+	bool read(BusSample_t *s);
+	/**
+	* \brief Gets the number of published samples not read yet
+	**/
+	uint64_t available(void) const;
+	/**
+	* \brief Gets the number of samples lost since the reader was created
+	**/
+	uint64_t getLost(void) const;
+};
+#endif
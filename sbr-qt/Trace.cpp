@@ -0,0 +1,143 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file Trace.cpp
+* \brief Low-overhead event tracing (per-thread ring buffers, Chrome trace JSON export), compiled only with SBR_TRACE defined
+* \copyright GNU GPLv3
+**/
+
+#include "Trace.h"
+
+#ifdef SBR_TRACE
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+thread_local TraceBuffer_t *Trace::buffer = nullptr;
+
+static std::mutex registryLock;
+static std::vector<TraceBuffer_t*> registry; //buffers are kept after their threads exit, so their events can still be exported
+static uint64_t startTicks; //timestamp and steady clock time of the first event, for tick to microsecond conversion
+static std::chrono::steady_clock::time_point startTime;
+
+TraceBuffer_t *Trace::registerThread(void)
+{
+	TraceBuffer_t *b = new TraceBuffer_t;
+	b->head = 0;
+	b->name[0] = '\0';
+	std::lock_guard<std::mutex> l(registryLock);
+	if(registry.empty())
+	{
+		startTime = std::chrono::steady_clock::now();
+		startTicks = now();
+	}
+	b->tid = registry.size() + 1;
+	registry.push_back(b);
+	buffer = b;
+	return b;
+}
+
+void Trace::setThreadName(const char *name)
+{
+	TraceBuffer_t *b = buffer;
+	if(b == nullptr)
+		b = registerThread();
+	strncpy(b->name, name, sizeof(b->name) - 1);
+	b->name[sizeof(b->name) - 1] = '\0';
+}
+
+//writes a JSON string, escaping quotes and backslashes
+static void writeString(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for(; *s; s++)
+	{
+		if((*s == '"') || (*s == '\\'))
+			fputc('\\', f);
+		fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+bool Trace::dump(const char *path)
+{
+	std::vector<TraceBuffer_t*> buffers;
+	{
+		std::lock_guard<std::mutex> l(registryLock);
+		buffers = registry;
+	}
+	FILE *f = fopen(path, "w");
+	if(f == NULL)
+		return false;
+
+	//ticks per microsecond, measured over the whole trace
+	double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - startTime).count();
+	double ticksPerUs = (elapsed > 0.) ? (now() - startTicks) / elapsed : 1000.;
+
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	bool first = true;
+	std::vector<TraceEvent_t> events;
+	for(size_t t = 0; t < buffers.size(); t++)
+	{
+		TraceBuffer_t *b = buffers[t];
+		if(b->name[0] != '\0')
+		{
+			fprintf(f, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", b->tid);
+			writeString(f, b->name);
+			fprintf(f, "}}");
+			first = false;
+		}
+
+		//copy the buffer, then drop events the writer could have overwritten while copying
+		uint64_t end = b->head.load(std::memory_order_acquire);
+		uint64_t start = (end > TRACE_BUFFER_SIZE) ? end - TRACE_BUFFER_SIZE : 0;
+		events.clear();
+		for(uint64_t i = start; i < end; i++)
+			events.push_back(b->events[i & (TRACE_BUFFER_SIZE - 1)]);
+		uint64_t after = b->head.load(std::memory_order_acquire);
+		//the writer may be filling event 'after' already, which shares its slot with event 'after - TRACE_BUFFER_SIZE'
+		uint64_t valid = (after + 1 > TRACE_BUFFER_SIZE) ? after + 1 - TRACE_BUFFER_SIZE : 0;
+		size_t skip = (valid > start) ? valid - start : 0;
+
+		int depth = 0;
+		for(size_t i = skip; i < events.size(); i++)
+		{
+			const TraceEvent_t &e = events[i];
+			if(e.phase == 'E')
+			{
+				if(depth == 0) //its begin event was overwritten
+					continue;
+				depth--;
+			}
+			else if(e.phase == 'B')
+				depth++;
+			double ts = ((int64_t)(e.time - startTicks)) / ticksPerUs;
+			fprintf(f, "%s{\"ph\":\"%c\",\"name\":", first ? "" : ",\n", e.phase);
+			writeString(f, e.name);
+			fprintf(f, ",\"pid\":1,\"tid\":%u,\"ts\":%.3f%s}", b->tid, ts, (e.phase == 'i') ? ",\"s\":\"t\"" : "");
+			first = false;
+		}
+	}
+	fprintf(f, "\n]}\n");
+	fclose(f);
+	return true;
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,134 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file Trace.h
+* \brief Low-overhead event tracing (per-thread ring buffers, Chrome trace JSON export), compiled only with SBR_TRACE defined
+* \copyright GNU GPLv3
+**/
+
+#ifndef TRACE_H_
+#define TRACE_H_
+#include <stdint.h>
+
+#define TRACE_BUFFER_SIZE 65536 //events per thread (power of 2), the oldest events are overwritten
+
+#ifdef SBR_TRACE
+#include <atomic>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+typedef struct
+{
+	uint64_t time; //timestamp in clock ticks
+	const char *name; //event name, must be a string literal (only the pointer is stored)
+	char phase; //'B' - begin, 'E' - end, 'i' - instant
+} TraceEvent_t;
+
+//events of one thread, written only by that thread
+typedef struct
+{
+	std::atomic<uint64_t> head; //number of events written
+	uint32_t tid;
+	char name[32];
+	TraceEvent_t events[TRACE_BUFFER_SIZE];
+} TraceBuffer_t;
+
+class Trace
+{
+private:
+	static thread_local TraceBuffer_t *buffer; //plain pointer, so the thread-local access needs no initialization guard
+	static TraceBuffer_t *registerThread(void);
+public:
+	/**
+	* \brief Gets a timestamp (TSC on x86, steady clock nanoseconds elsewhere)
+	**/
+	static inline uint64_t now(void)
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+	/**
+	* \brief Records an event in the calling thread's buffer (lock-free, no allocation after the first event of a thread)
+	* \param[in] *name Event name, must be a string literal
+	* \param[in] phase 'B' - begin, 'E' - end, 'i' - instant
+	**/
+	static inline void record(const char *name, char phase)
+	{
+		TraceBuffer_t *b = buffer;
+		if(__builtin_expect(b == nullptr, 0))
+			b = registerThread();
+		uint64_t h = b->head.load(std::memory_order_relaxed);
+		TraceEvent_t &e = b->events[h & (TRACE_BUFFER_SIZE - 1)];
+		e.time = now();
+		e.name = name;
+		e.phase = phase;
+		b->head.store(h + 1, std::memory_order_release);
+	}
+	/**
+	* \brief Names the calling thread in the exported trace
+	**/
+	static void setThreadName(const char *name);
+	/**
+	* \brief Writes events of all threads as Chrome trace JSON (opens in chrome://tracing and ui.perfetto.dev)
+	* \param[in] *path File name
+	* \return True on success
+	* \attention Can be called while other threads record events, events overwritten during the export are skipped
+	**/
+	static bool dump(const char *path);
+};
+
+//records a begin event now and the matching end event at the end of the scope
+class TraceScope
+{
+private:
+	const char *name;
+public:
+	inline TraceScope(const char *name) : name(name)
+	{
+		Trace::record(name, 'B');
+	}
+	inline ~TraceScope()
+	{
+		Trace::record(name, 'E');
+	}
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope_, __LINE__)(name)
+#define TRACE_BEGIN(name) Trace::record(name, 'B')
+#define TRACE_END(name) Trace::record(name, 'E')
+#define TRACE_INSTANT(name) Trace::record(name, 'i')
+#define TRACE_THREAD_NAME(name) Trace::setThreadName(name)
+#define TRACE_DUMP(path) Trace::dump(path)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#define TRACE_INSTANT(name) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#define TRACE_DUMP(path) (false)
+#endif
+#endif
\ No newline at end of file
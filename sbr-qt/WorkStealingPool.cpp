@@ -0,0 +1,129 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file WorkStealingPool.cpp
+* \brief Thread pool with per-worker task queues, idle workers steal tasks from busy ones
+* \copyright GNU GPLv3
+**/
+
+#include "WorkStealingPool.h"
+#include <chrono>
+
+#define _IDLE_WAIT_MS 10 //idle worker wake-up period, covers notifications lost between checking queues and sleeping
+
+WorkStealingPool::WorkStealingPool(unsigned threads) : pending(0), nextQueue(0), steals(0), stop(false)
+{
+	if(threads == 0)
+		threads = std::thread::hardware_concurrency();
+	if(threads == 0)
+		threads = 1;
+	for(unsigned i = 0; i < threads; i++)
+		queues.push_back(new Queue);
+	for(unsigned i = 0; i < threads; i++)
+		workers.push_back(std::thread(&WorkStealingPool::run, this, i));
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	wait();
+	stop = true;
+	wakeUp.notify_all();
+	for(size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	for(size_t i = 0; i < queues.size(); i++)
+		delete queues[i];
+}
+
+void WorkStealingPool::submit(std::function<void()> task)
+{
+	pending++;
+	Queue *q = queues[nextQueue++ % queues.size()];
+	{
+		std::lock_guard<std::mutex> l(q->lock);
+		q->tasks.push_back(std::move(task));
+	}
+	wakeUp.notify_one();
+}
+
+void WorkStealingPool::wait(void)
+{
+	std::unique_lock<std::mutex> l(sleepLock);
+	finished.wait(l, [this]() { return pending == 0; });
+}
+
+unsigned WorkStealingPool::getThreads(void)
+{
+	return workers.size();
+}
+
+uint64_t WorkStealingPool::getSteals(void)
+{
+	return steals;
+}
+
+//own queue from the back (most recently queued, still in cache), other queues from the front (oldest)
+bool WorkStealingPool::pop(size_t id, std::function<void()> &task)
+{
+	{
+		Queue *q = queues[id];
+		std::lock_guard<std::mutex> l(q->lock);
+		if(!q->tasks.empty())
+		{
+			task = std::move(q->tasks.back());
+			q->tasks.pop_back();
+			return true;
+		}
+	}
+	for(size_t i = 1; i < queues.size(); i++)
+	{
+		Queue *q = queues[(id + i) % queues.size()];
+		std::lock_guard<std::mutex> l(q->lock);
+		if(!q->tasks.empty())
+		{
+			task = std::move(q->tasks.front());
+			q->tasks.pop_front();
+			steals++;
+			return true;
+		}
+	}
+	return false;
+}
+
+void WorkStealingPool::run(size_t id)
+{
+	std::function<void()> task;
+	while(true)
+	{
+		if(pop(id, task))
+		{
+			task();
+			task = nullptr;
+			if(--pending == 0)
+			{
+				std::lock_guard<std::mutex> l(sleepLock);
+				finished.notify_all();
+			}
+			continue;
+		}
+		if(stop)
+			return;
+		std::unique_lock<std::mutex> l(sleepLock);
+		wakeUp.wait_for(l, std::chrono::milliseconds(_IDLE_WAIT_MS));
+	}
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file WorkStealingPool.h
+* \brief Thread pool with per-worker task queues, idle workers steal tasks from busy ones
+* \copyright GNU GPLv3
+**/
+
+#ifndef WORKSTEALINGPOOL_H_
+#define WORKSTEALINGPOOL_H_
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class WorkStealingPool
+{
+private:
+	struct Queue
+	{
+		std::mutex lock;
+		std::deque<std::function<void()>> tasks;
+	};
+	std::vector<Queue*> queues; //one queue per worker
+	std::vector<std::thread> workers;
+	std::atomic<size_t> pending; //submitted and not finished tasks
+	std::atomic<size_t> nextQueue; //round-robin queue for submitted tasks
+	std::atomic<uint64_t> steals;
+	std::atomic<bool> stop;
+	std::mutex sleepLock;
+	std::condition_variable wakeUp; //new tasks
+	std::condition_variable finished; //pending dropped to 0
+
+	void run(size_t id);
+	bool pop(size_t id, std::function<void()> &task);
+public:
+	/**
+	* \brief Starts workers
+	* \param[in] threads Number of workers, 0 for one per hardware thread
+	**/
+	WorkStealingPool(unsigned threads = 0);
+	/**
+	* \brief Waits for queued tasks and stops workers
+	**/
+	~WorkStealingPool();
+	/**
+	* \brief Queues a task, tasks are spread over worker queues round-robin
+	* \param[in] task Task
+	**/
+	void submit(std::function<void()> task);
+	/**
+	* \brief Blocks until all submitted tasks are finished
+	**/
+	void wait(void);
+	/**
+	* \brief Gets the number of workers
+	**/
+	unsigned getThreads(void);
+	/**
+	* \brief Gets the number of tasks taken from another worker's queue
+	**/
+	uint64_t getSteals(void);
+};
+#endif
\ No newline at end of file
@@ -1,9 +1,26 @@
 #include <QCoreApplication>
 #include <QSerialPort>
 #include <iostream>
+#include <cmath>
 #include <SBRCP.h>
+#include <TelemetryCodec.h>
+#include <FeaturePipeline.h>
+#include <SessionLog.h>
+#include <SystemIdentifier.h>
 #include <QUdpSocket>
 #include <QNetworkDatagram>
+#include <QTimer>
+#include <chrono>
+#include <Trace.h>
+#include <ReliableChannel.h>
+#ifdef SBR_TRACE
+#include <signal.h>
+#endif
+#ifdef SBR_PLOT
+#include <QApplication>
+#include <PlotBuffer.h>
+#include <PlotView.h>
+#endif
 
 
 //#define _MODE_WIFI //WiFi mode using UDP and ESP32 module
@@ -15,12 +32,86 @@
 #define _LOCAL_PORT 1234
 
 #define _SERIAL_PORT "ttyUSB0"
+#define _SERIAL_BAUD 115200 //robot baud rate after reset
+#define _SERIAL_FAST_BAUD 500000 //baud rate negotiated after the handshake (firmware 1.6), comment out to keep _SERIAL_BAUD
+#define _BAUD_PROBES 8 //probe exchanges at the new baud rate before it is committed
+#define _BAUD_TIMEOUT_MS 100 //answer timeout of every negotiation step
+#define _BAUD_SETTLE_MS 20 //wait after switching the port before the first probe
+
+#define _MAX_FRAME_SIZE (_SBRCP_MAX_PAYLOAD_SIZE + 4) //type byte, payload, CRC, LF-CR
+#define _MPU_INTERVAL_US 50000 //MPU data interval set after connecting
+#define _EVENT_MAX_GAP_US 65536000 //longer gaps between event packets (lost packets) restart the timeline instead of being filled
+#define _HELLO_TIMEOUT_MS 300 //answer timeout of one DATA_CMD_HELLO request
+#define _HELLO_ATTEMPTS 4 //robots that answer none of the requests run firmware without handshake, a single lost datagram isn't taken for one
+//#define _SESSION_LOG "session.csv" //records samples and motor commands for offline identification (tools/sysid), overwrites the file
+#define _MODEL_PRINT_INTERVAL 200 //samples between displays of the identified plant model
+#define _STATS_INTERVAL_MS 1000 //robot runtime statistics period requested after connecting
+#define _STATS_LOG "stats.csv" //robot runtime statistics time series, comment out to disable
+#define _TRACE_FILE "trace.json" //written on SIGUSR1 when built with CONFIG+=trace (kill -USR1 <pid>)
+#define _TRACE_POLL_MS 100 //how often the trace request flag set by the signal handler is checked
+#define _RELIABLE_POLL_MS 10 //retransmission check period of configuration commands
+#define _PLOT_CHANNELS 8 //acc X, Y, Z, gyro X, Y, Z, motor A, B commands, plotted when built with the plot window (default, not CONFIG+=noplot)
+
+//robot capabilities and configuration received in DATA_HELLO
+typedef struct
+{
+    bool valid; //false if the robot didn't answer the handshake
+    uint8_t protocolVersion;
+    uint8_t firmwareMajor;
+    uint8_t firmwareMinor;
+    uint16_t features; //FEATURE_... flags
+    uint8_t connection; //CONNECTION_SERIAL or CONNECTION_WIFI
+    uint8_t accelRange;
+    uint8_t gyroRange;
+    uint8_t filterBandwidth;
+    uint8_t telemetryMode;
+    uint32_t interval; //MPU data interval in microseconds
+    uint16_t minInterval; //minimum interval for full telemetry
+    uint16_t minCompressedInterval; //minimum interval for compressed telemetry
+    uint8_t maxPayload;
+    uint8_t maxBatch;
+} RobotCapabilities_t;
 
 void parseRxPacket(SBRCP_data_t *d);
+void publishFeatures(const FeatureVector_t *f);
+void printModel(void);
+void parseStats(const SBRCP_Stats_t *s, uint8_t size);
+void parseMemory(const SBRCP_Memory_t *m);
+void requestMemory(void);
+void onConnected(void);
+void startBaudNegotiation(void);
+void onBaud(const SBRCP_Baud_t *b, uint8_t size);
+bool sendReliable(SBRCP_data_t *d, void *arg);
+void onReliableResult(uint16_t sequence, uint8_t type, ReliableResult_t result, void *arg);
 
 SBRCP protocol(&parseRxPacket);
+ReliableChannel reliable(ReliableChannel::defaultConfig(), &sendReliable, &onReliableResult, NULL);
+TelemetryDecoder decoder;
+FeaturePipeline features(FeaturePipeline::defaultConfig(1e6f / _MPU_INTERVAL_US), 1, &publishFeatures);
+SystemIdentifier identifier(SystemIdentifier::defaultConfig(_MPU_INTERVAL_US * 1e-6f));
+SessionLog session;
+int16_t motorA = 0, motorB = 0; //last motor command
+FILE *statsLog = NULL;
+SBRCP_Memory_t robotMemory = {}; //last memory usage, logged with the statistics
+RobotCapabilities_t robot = {};
+float eventValues[TELEMETRY_CHANNELS]; //values of the last DATA_MPU_EVENT, held until the next one
+uint32_t eventTime = 0; //its robot time
+bool eventValid = false;
+bool connected = false; //handshake finished (or timed out)
+QTimer helloTimer; //answer timeout of the handshake request in progress
+uint8_t helloAttempts = 0; //DATA_CMD_HELLO requests sent
 QUdpSocket sock;
 QSerialPort port;
+QTimer baudTimer; //answer timeout of the baud rate negotiation step in progress
+uint32_t baudTarget = 0; //baud rate being negotiated
+uint16_t baudToken = 0; //token of the negotiation command waiting for an answer
+uint8_t baudStep = 0; //0 - proposal, 1 to _BAUD_PROBES - probes, _BAUD_PROBES + 1 - commit
+uint8_t baudPattern[sizeof(((SBRCP_CmdBaud_t*)0)->pattern)];
+
+#ifdef SBR_PLOT
+PlotBuffer plotBuffer(PlotBuffer::defaultConfig(_PLOT_CHANNELS));
+PlotView *plotView = NULL; //created after the application object
+#endif
 
 char data[50];
 uint8_t dlen = 0;
@@ -28,9 +119,11 @@ uint8_t dlen = 0;
 //handles udp "interrupt"
 void receiveDataUDP(void)
 {
+    TRACE_SCOPE("receiveDataUDP");
     while(sock.hasPendingDatagrams())
     {
         QNetworkDatagram d = sock.receiveDatagram();
+        TRACE_SCOPE("SBRCP::parseRx");
         protocol.parseRx((uint8_t*)d.data().data(), d.data().size());
     }
 }
@@ -38,97 +131,508 @@ void receiveDataUDP(void)
 //handles serial "interrupt"
 void receiveDataSerial(void)
 {
-    static char data[50];
-    static uint8_t dataLen = 0;
-    dataLen += port.read(&data[dataLen], sizeof(data) - dataLen);
-    if((dataLen > 1) && (data[dataLen - 1] == '\r') && (data[dataLen - 2] == '\n')) //wait for \n\r at the end, data may not always come in one piece
+    TRACE_SCOPE("receiveDataSerial");
+    static char data[4 * _MAX_FRAME_SIZE];
+    static uint16_t dataLen = 0;
+    while(port.bytesAvailable() > 0)
     {
-        protocol.parseRx((uint8_t*)data, dataLen);
-        dataLen = 0;
+        dataLen += port.read(&data[dataLen], sizeof(data) - dataLen);
+        //data may not always come in one piece and there can be more than one frame in the buffer
+        //\n\r can also appear inside the binary payload, so a frame is accepted only if its CRC matches
+        uint16_t start = 0;
+        for(uint16_t i = 1; i < dataLen; i++)
+        {
+            if((data[i - 1] != '\n') || (data[i] != '\r'))
+                continue;
+            for(uint16_t s = start; (s + 3) <= i; s++) //the longest candidate first
+            {
+                if((i + 1 - s) > _MAX_FRAME_SIZE)
+                    continue;
+                TRACE_BEGIN("SBRCP::parseRx");
+                bool valid = protocol.parseRx((uint8_t*)&data[s], i + 1 - s);
+                TRACE_END("SBRCP::parseRx");
+                if(valid)
+                {
+                    start = i + 1;
+                    break;
+                }
+            }
+        }
+        if(dataLen - start > _MAX_FRAME_SIZE) //older bytes can't belong to any valid frame
+            start = dataLen - _MAX_FRAME_SIZE;
+        memmove(data, &data[start], dataLen - start);
+        dataLen -= start;
     }
-    if(dataLen == sizeof(data))
-        dataLen = 0;
 }
 
-//converts 4 bytes (little endian) into a float type variable
-float bytesToFloat(uint8_t *data)
+//displays MPU data (acc X, Y, Z in m/s^2, gyro X, Y, Z in rad/s)
+void printMPUdata(float *v)
 {
-    uint32_t tmp = 0; //temporary variable for type conversion
-    tmp |= *data; //copy data to the buffer
-    tmp |= *(data + 1) << 8;
-    tmp |= *(data + 2) << 16;
-    tmp |= *(data + 3) << 24;
-    float ret = 0;
-    memcpy(&ret, &tmp, 4);
-    return ret;
+    std::cout << std::endl << "MPU data received" << std::endl;
+    std::cout << "Accelerometer: X=" << v[0] << " Y=" << v[1] << " Z=" << v[2] << std::endl;
+    std::cout << "Gyroscope: X=" << v[3] << " Y=" << v[4] << " Z=" << v[5] << std::endl;
+}
+
+//called for every received sample, after decoding
+void onSample(float *v)
+{
+    TRACE_SCOPE("onSample");
+#ifdef SBR_PLOT
+    {
+        TRACE_SCOPE("PlotBuffer::append");
+        float p[_PLOT_CHANNELS] = {v[0], v[1], v[2], v[3], v[4], v[5], (float)motorA, (float)motorB};
+        plotBuffer.append(p); //drawn by the frame clock of the plot window, not per sample
+    }
+#else
+    printMPUdata(v);
+#endif
+    {
+        TRACE_SCOPE("FeaturePipeline::push");
+        features.push(0, v);
+    }
+    {
+        TRACE_SCOPE("SystemIdentifier::update");
+        identifier.update(v, motorA, motorB);
+    }
+#ifdef _SESSION_LOG
+    SessionRecord_t r;
+    r.time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    memcpy(r.value, v, sizeof(r.value));
+    r.motorA = motorA;
+    r.motorB = motorB;
+    {
+        TRACE_SCOPE("SessionLog::write");
+        session.write(&r);
+    }
+#endif
+    static uint32_t samples = 0;
+    if((++samples % _MODEL_PRINT_INTERVAL) == 0)
+        printModel();
+}
+
+//displays the plant model identified so far
+void printModel(void)
+{
+    PlantModel_t m;
+    identifier.getModel(&m);
+    std::cout << "Plant model: stiffness=" << m.stiffness << " 1/s^2, damping=" << m.damping << " 1/s, gain=" << m.gain
+              << " rad/s^2, deadzone=" << m.deadzone << ", offset=" << m.offset << " rad/s^2, lag=" << m.lag * 1e3f
+              << " ms, residual=" << m.residual << " rad/s^2" << std::endl;
+}
+
+//called with features after every sample
+void publishFeatures(const FeatureVector_t *f)
+{
+    if((f->sample % 64) != 0) //display once per default window
+        return;
+    std::cout << "Rolling mean: acc X=" << f->mean[0] << " Y=" << f->mean[1] << " Z=" << f->mean[2]
+              << " gyro X=" << f->mean[3] << " Y=" << f->mean[4] << " Z=" << f->mean[5] << std::endl;
+    std::cout << "Rolling std. dev.: acc X=" << sqrtf(f->variance[0]) << " Y=" << sqrtf(f->variance[1]) << " Z=" << sqrtf(f->variance[2])
+              << " gyro X=" << sqrtf(f->variance[3]) << " Y=" << sqrtf(f->variance[4]) << " Z=" << sqrtf(f->variance[5]) << std::endl;
+}
+
+//host time in microseconds, for the retransmission timeouts
+uint64_t hostMicros(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
 //displays received packet
 void parseRxPacket(SBRCP_data_t *d)
 {
-    if(d->type == DATA_MPU)
+    if(reliable.onPacket(d, hostMicros())) //acknowledgement of a configuration command
+        return;
+    if(const SBRCP_Mpu_t *mpu = SBRCP_view<SBRCP_Mpu_t>(d))
+    {
+        float v[TELEMETRY_CHANNELS];
+        for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+            v[i] = mpu->values[i];
+        onSample(v);
+    }
+    else if(const SBRCP_MpuTs_t *mpuTs = SBRCP_view<SBRCP_MpuTs_t>(d)) //the robot time of the reading is not needed here
+    {
+        float v[TELEMETRY_CHANNELS];
+        for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+            v[i] = mpuTs->values[i];
+        onSample(v);
+    }
+    else if(const SBRCP_MpuEvent_t *event = SBRCP_view<SBRCP_MpuEvent_t>(d)) //send-on-delta, sent only on a change, the values hold until the next packet
+    {
+        //the feature pipeline and the identifier expect a sample every _MPU_INTERVAL_US: the held values are repeated up to the event time
+        uint32_t gap = event->robotTime - eventTime;
+        if(eventValid && !(event->reason & EVENT_START) && (gap <= _EVENT_MAX_GAP_US))
+        {
+            for(uint32_t i = (gap + _MPU_INTERVAL_US / 2) / _MPU_INTERVAL_US; i > 1; i--)
+                onSample(eventValues);
+        }
+        for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+            eventValues[i] = event->values[i];
+        eventTime = event->robotTime;
+        eventValid = true;
+        onSample(eventValues);
+    }
+    else if((d->type == DATA_MPU_KEY) || (d->type == DATA_MPU_DELTA)) //compressed telemetry, there can be more samples in one packet
+    {
+        int16_t raw[_TELEMETRY_MAX_BATCH * TELEMETRY_CHANNELS];
+        uint8_t n = decoder.decode(d, raw, _TELEMETRY_MAX_BATCH);
+        for(uint8_t i = 0; i < n; i++)
+        {
+            float v[TELEMETRY_CHANNELS];
+            decoder.toSI(&raw[i * TELEMETRY_CHANNELS], v);
+            onSample(v);
+        }
+    }
+    else if(const SBRCP_Hello_t *hello = SBRCP_view<SBRCP_Hello_t>(d)) //capabilities, sent as a response to DATA_CMD_HELLO and DATA_CMD_SENSOR
+    {
+        robot.valid = true;
+        robot.protocolVersion = hello->protocolVersion;
+        robot.firmwareMajor = hello->firmwareMajor;
+        robot.firmwareMinor = hello->firmwareMinor;
+        robot.features = hello->features;
+        robot.connection = hello->connection;
+        robot.accelRange = hello->accelRange;
+        robot.gyroRange = hello->gyroRange;
+        robot.filterBandwidth = hello->filterBandwidth;
+        robot.telemetryMode = hello->telemetryMode;
+        robot.interval = hello->interval;
+        robot.minInterval = hello->minInterval;
+        robot.minCompressedInterval = hello->minCompressedInterval;
+        robot.maxPayload = hello->maxPayload;
+        robot.maxBatch = hello->maxBatch;
+        std::cout << std::endl << "Robot: protocol v" << (int)robot.protocolVersion << ", firmware " << (int)robot.firmwareMajor
+                  << "." << (int)robot.firmwareMinor << ", features 0x" << std::hex << robot.features << std::dec << std::endl;
+        std::cout << "Sensor: accel range " << (2 << robot.accelRange) << " G, gyro range " << (250 << robot.gyroRange)
+                  << " deg/s, filter setting " << (int)robot.filterBandwidth << ", interval " << robot.interval << " us" << std::endl;
+        if(!connected)
+        {
+            helloTimer.stop();
+            connected = true;
+            startBaudNegotiation();
+        }
+    }
+    else if(const SBRCP_Baud_t *baud = SBRCP_view<SBRCP_Baud_t>(d))
+    {
+        onBaud(baud, d->size);
+    }
+    else if(const SBRCP_Stats_t *stats = SBRCP_view<SBRCP_Stats_t>(d))
+    {
+        parseStats(stats, d->size);
+    }
+    else if(const SBRCP_Memory_t *memory = SBRCP_view<SBRCP_Memory_t>(d))
+    {
+        parseMemory(memory);
+    }
+    else if(const SBRCP_Error_t *error = SBRCP_view<SBRCP_Error_t>(d))
+    {
+        std::cout << std::endl << "Error packet received! (code " << (int)error->code << ")" << std::endl;
+    }
+}
+
+
+//displays robot runtime statistics and appends them to the statistics log
+//counters are cumulative and wrap around at 65536, loop timing covers the time since the previous statistics packet
+void parseStats(const SBRCP_Stats_t *s, uint8_t size)
+{
+    uint32_t uptime = s->uptime;
+    uint16_t v[9] = {s->loopMax, s->loopMean, s->loops, s->frames, s->crcErrors, s->rxOverflows, s->txDropped, s->mpuFailures, s->freeSram};
+    std::cout << std::endl << "Robot stats at " << uptime << " ms: loop max " << v[0] << " us, mean " << v[1] << " us (" << v[2]
+              << " loops), frames " << v[3] << ", CRC errors " << v[4] << ", RX overflows " << v[5] << ", TX dropped " << v[6]
+              << ", MPU failures " << v[7] << ", free SRAM " << v[8] << " B" << std::endl;
+    uint16_t r[3] = {0, 0, 0}; //delivery counters, sent by firmware with FEATURE_RELIABLE
+    if(SBRCP_HAS(SBRCP_Stats_t, duplicateCommands, size))
     {
-        std::cout << std::endl << "MPU data received" << std::endl;
-        std::cout << "Accelerometer: X=" << bytesToFloat(&(d->payload[0]))
-                << " Y=" << bytesToFloat(&(d->payload[4])) << " Z=" << bytesToFloat(&(d->payload[8])) << std::endl;
-        std::cout << "Gyroscope: X=" << bytesToFloat(&(d->payload[12]))
-                << " Y=" << bytesToFloat(&(d->payload[16])) << " Z=" << bytesToFloat(&(d->payload[20])) << std::endl;
+        r[0] = s->motorCommands;
+        r[1] = s->staleMotors;
+        r[2] = s->duplicateCommands;
+        ReliableStats_t c = reliable.getStats();
+        std::cout << "Delivery: motor commands " << r[0] << " (" << 100.f * reliable.getMotorLoss() << " % lost), stale " << r[1]
+                  << ", duplicate commands " << r[2] << "; config " << c.configDelivered << " delivered, " << c.retransmissions
+                  << " retransmissions, rtt " << reliable.getRtt() / 1000. << " ms" << std::endl;
     }
-    else if(d->type == DATA_ERROR)
+    if(statsLog != NULL)
     {
-        std::cout << std::endl << "Error packet received!" << std::endl;
+        long long host = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        fprintf(statsLog, "%lld,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n", host, uptime, v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7],
+                v[8], r[0], r[1], r[2], robotMemory.stackPeak, robotMemory.unusedMin);
+        fflush(statsLog);
     }
+    if(robot.features & FEATURE_MEMORY) //the answer is logged with the next statistics
+        requestMemory();
 }
 
+//displays the robot memory usage when it is first received and when the stack peak grows
+void parseMemory(const SBRCP_Memory_t *m)
+{
+    uint16_t v[5] = {m->ramSize, m->staticSize, m->heapSize, m->stackPeak, m->unusedMin};
+    if((robotMemory.ramSize == 0) || (v[3] > robotMemory.stackPeak))
+    {
+        std::cout << std::endl << "Robot memory: static " << v[1] << " B, heap " << v[2] << " B"
+                  << ((m->flags & MEMORY_STATIC_ALLOCATION) ? " (static pool)" : "") << ", stack peak " << v[3] << " B, never used "
+                  << v[4] << " B of " << v[0] << " B" << ((m->flags & MEMORY_POOL_EXHAUSTED) ? ", STATIC POOL EXHAUSTED" : "")
+                  << std::endl;
+    }
+    robotMemory = *m;
+}
 
-//MPU rate in microseconds
-void setMPUrate(uint32_t rate)
+//converts packet to a frame and sends it to the robot
+//returns false if the frame couldn't be written
+bool sendPacket(SBRCP_data_t *d)
 {
-    SBRCP_data_t d;
-    d.type = DATA_CMD_RATE;
-    d.payload[0] = rate & 0xFF;
-    d.payload[1] = (rate & 0xFF00) >> 8;
-    d.payload[2] = (rate & 0xFF0000) >> 16;
-    d.payload[3] = (rate & 0xFF000000) >> 24;
-    d.size = 4;
-    uint8_t buf[20];
+    uint8_t buf[_MAX_FRAME_SIZE];
     uint8_t len = 0;
-    protocol.parseTx(&d, buf, &len);
+    TRACE_SCOPE("sendPacket");
+    TRACE_BEGIN("SBRCP::parseTx");
+    protocol.parseTx(d, buf, &len);
+    TRACE_END("SBRCP::parseTx");
+    TRACE_SCOPE("write");
 #ifdef _MODE_WIFI
-    sock.writeDatagram((char*)buf, len, QHostAddress(_ROBOT_IP), _DEST_PORT);
+    return sock.writeDatagram((char*)buf, len, QHostAddress(_ROBOT_IP), _DEST_PORT) == len;
 #else
-    port.write((char*)buf, len);
+    return port.write((char*)buf, len) == len;
+#endif
+}
+
+//transport of the reliable channel
+bool sendReliable(SBRCP_data_t *d, void*)
+{
+    return sendPacket(d);
+}
+
+//displays configuration commands that didn't take effect
+void onReliableResult(uint16_t sequence, uint8_t type, ReliableResult_t result, void*)
+{
+    if(result == rejected)
+        std::cout << "Command 0x" << std::hex << (int)type << std::dec << " (sequence " << sequence << ") rejected by the robot" << std::endl;
+    else if(result == undelivered)
+        std::cout << "Command 0x" << std::hex << (int)type << std::dec << " (sequence " << sequence << ") not acknowledged, giving up" << std::endl;
+}
+
+//sends the current baud rate negotiation step and starts its timeout
+void sendBaudStep(void)
+{
+    SBRCP_data_t d;
+    uint8_t length = ((baudStep > 0) && (baudStep <= _BAUD_PROBES)) ? sizeof(baudPattern) : 0;
+    SBRCP_CmdBaud_t *cmd = SBRCP_init<SBRCP_CmdBaud_t>(&d, offsetof(SBRCP_CmdBaud_t, pattern) + length);
+    if(++baudToken == 0x0D0A) //LF-CR would split the frame
+        baudToken++;
+    cmd->token = baudToken;
+    cmd->action = (baudStep == 0) ? BAUD_PROPOSE : (length > 0) ? BAUD_PROBE : BAUD_COMMIT;
+    for(uint8_t i = 0; i < length; i++)
+        baudPattern[i] = (uint8_t)(baudToken * 7 + i * 37) | 0x01; //odd bytes, never LF
+    memcpy(cmd->pattern, baudPattern, length);
+    cmd->baud = baudTarget;
+    sendPacket(&d);
+    baudTimer.start(_BAUD_TIMEOUT_MS);
+}
+
+//ends the baud rate negotiation, the port goes back to _SERIAL_BAUD if the new rate wasn't committed
+//the robot may have switched even if its proposal answer was lost, so every failure waits for its fallback
+void finishBaudNegotiation(bool switched)
+{
+    baudTimer.stop();
+    baudToken = 0;
+    if(switched)
+    {
+        std::cout << "Baud rate " << port.baudRate() << std::endl;
+        onConnected();
+        return;
+    }
+    port.setBaudRate(_SERIAL_BAUD);
+    std::cout << "Baud rate negotiation failed, keeping " << _SERIAL_BAUD << std::endl;
+    QTimer::singleShot(BAUD_PROBE_TIMEOUT + _BAUD_SETTLE_MS, []() //the robot falls back by itself without the commit
+    {
+        port.clear(QSerialPort::Input);
+        onConnected();
+    });
+}
+
+//proposes _SERIAL_FAST_BAUD to robots that support it, the rest of the configuration is done in onConnected() afterwards
+void startBaudNegotiation(void)
+{
+#if defined(_SERIAL_FAST_BAUD) && !defined(_MODE_WIFI)
+    if((robot.features & FEATURE_BAUD) && (robot.connection == CONNECTION_SERIAL) && (port.baudRate() != _SERIAL_FAST_BAUD))
+    {
+        baudTimer.setSingleShot(true);
+        QObject::connect(&baudTimer, &QTimer::timeout, []()
+        {
+            finishBaudNegotiation(false);
+        });
+        baudTarget = _SERIAL_FAST_BAUD;
+        baudStep = 0;
+        sendBaudStep();
+        return;
+    }
+#endif
+    onConnected();
+}
+
+//handles answers of the baud rate negotiation: switches after the accepted proposal, checks the probes and commits
+void onBaud(const SBRCP_Baud_t *b, uint8_t size)
+{
+    if((baudToken == 0) || (b->token != baudToken)) //late answer of a step that timed out
+        return;
+    baudTimer.stop();
+    if(baudStep == 0)
+    {
+        if(b->status != BAUD_ACCEPTED) //refused, the robot keeps its baud rate
+        {
+            baudToken = 0;
+            std::cout << "Baud rate " << baudTarget << " not supported by the robot" << std::endl;
+            onConnected();
+            return;
+        }
+        port.flush();
+        port.setBaudRate(b->baud);
+        baudStep++;
+        QTimer::singleShot(_BAUD_SETTLE_MS, []()
+        {
+            port.clear(QSerialPort::Input);
+            sendBaudStep();
+        });
+    }
+    else if(baudStep <= _BAUD_PROBES)
+    {
+        if((b->status != BAUD_PROBED) || (size != offsetof(SBRCP_Baud_t, pattern) + sizeof(baudPattern))
+           || memcmp(b->pattern, baudPattern, sizeof(baudPattern)))
+        {
+            finishBaudNegotiation(false);
+            return;
+        }
+        baudStep++;
+        sendBaudStep();
+    }
+    else
+    {
+        finishBaudNegotiation(((b->status == BAUD_COMMITTED) || (b->status == BAUD_NOT_PENDING)) && ((int)b->baud == port.baudRate()));
+    }
+}
+
+//MPU rate in microseconds
+void setMPUrate(uint32_t rate)
+{
+    SBRCP_data_t d;
+    SBRCP_init<SBRCP_CmdRate_t>(&d)->interval = rate;
+    reliable.sendConfig(&d, hostMicros());
+#ifdef SBR_PLOT
+    plotView->setInterval(rate);
 #endif
     std::cout << "Setting MPU rate" << std::endl;
 }
 
 //sets motors
 //m1, m2 speeds in range -255 to 255. 0 stops the motor
+//not acknowledged, the robot applies only the newest of the commands it receives
 void setMotors(int16_t m1, int16_t m2)
+{
+    reliable.sendMotors(m1, m2);
+    motorA = m1;
+    motorB = m2;
+    std::cout << "Setting motors" << std::endl;
+}
+
+//requests runtime statistics (DATA_STATS response)
+//interval period of further statistics packets in milliseconds, 0 for a single packet
+void requestStats(uint16_t interval)
 {
     SBRCP_data_t d;
-    d.type = DATA_CMD_MOTORS;
-    d.payload[0] = m1 & 0xFF;
-    d.payload[1] = (m1 & 0xFF00) >> 8;
-    d.payload[2] = (m2 & 0xFF);
-    d.payload[3] = (m2 & 0xFF00) >> 8;
-    d.size = 4;
-    uint8_t buf[20];
-    uint8_t len = 0;
-    protocol.parseTx(&d, buf, &len);
+    SBRCP_init<SBRCP_CmdStats_t>(&d)->interval = interval;
+    reliable.sendConfig(&d, hostMicros());
+}
 
-#ifdef _MODE_WIFI
-    sock.writeDatagram((char*)buf, len, QHostAddress(_ROBOT_IP), _DEST_PORT);
-#else
-    port.write((char*)buf, len);
-#endif
-    std::cout << "Setting motors" << std::endl;
+//requests the memory usage (DATA_MEMORY response), the stack peak since the robot started
+void requestMemory(void)
+{
+    SBRCP_data_t d;
+    SBRCP_init<SBRCP_CmdMemory_t>(&d, 0); //no repaint
+    reliable.sendConfig(&d, hostMicros());
+}
+
+//asks the robot for its capabilities and configuration (DATA_HELLO response) and starts the answer timeout
+void sendHello(void)
+{
+    SBRCP_data_t d;
+    SBRCP_init<SBRCP_CmdHello_t>(&d)->protocolVersion = SBRCP_PROTOCOL_VERSION;
+    sendPacket(&d);
+    helloAttempts++;
+    helloTimer.start(_HELLO_TIMEOUT_MS);
+}
+
+//sets sensor configuration, SENSOR_UNCHANGED leaves a setting unchanged
+//accelRange 0-3 for 2, 4, 8, 16 G
+//gyroRange 0-3 for 250, 500, 1000, 2000 deg/s
+//filterBandwidth 0-6 for 260, 184, 94, 44, 21, 10, 5 Hz. Lower bandwidth means less noise, but more delay.
+void setSensorConfig(uint8_t accelRange, uint8_t gyroRange, uint8_t filterBandwidth)
+{
+    SBRCP_data_t d;
+    SBRCP_CmdSensor_t *cmd = SBRCP_init<SBRCP_CmdSensor_t>(&d);
+    cmd->accelRange = accelRange;
+    cmd->gyroRange = gyroRange;
+    cmd->filterBandwidth = filterBandwidth;
+    reliable.sendConfig(&d, hostMicros());
+    std::cout << "Setting sensor configuration" << std::endl;
 }
 
+//sets telemetry mode
+//mode TELEMETRY_FULL, TELEMETRY_COMPRESSED, TELEMETRY_TIMESTAMPED or TELEMETRY_EVENT
+//batch number of samples per compressed packet (1 to _TELEMETRY_MAX_BATCH), more samples per packet save bandwidth but add latency
+//TELEMETRY_EVENT uses the robot default thresholds (EVENT_ACCEL_THRESHOLD, EVENT_GYRO_THRESHOLD, EVENT_MAX_SILENCE)
+void setTelemetry(uint8_t mode, uint8_t batch)
+{
+    SBRCP_data_t d;
+    SBRCP_CmdTelemetry_t *cmd = SBRCP_init<SBRCP_CmdTelemetry_t>(&d);
+    cmd->mode = mode;
+    cmd->batch = batch;
+    cmd->keyInterval = _TELEMETRY_KEYFRAME_INTERVAL;
+    cmd->accelThreshold = 0;
+    cmd->gyroThreshold = 0;
+    cmd->maxSilence = 0;
+    reliable.sendConfig(&d, hostMicros());
+    std::cout << "Setting telemetry mode" << std::endl;
+}
+
+#ifdef SBR_TRACE
+volatile sig_atomic_t traceRequested = 0;
+
+//SIGUSR1 handler, the trace is written from the event loop
+void requestTrace(int)
+{
+    traceRequested = 1;
+}
+#endif
+
 
 int main(int argc, char *argv[])
 {
+#ifdef SBR_PLOT
+    QApplication a(argc, argv); //also runs without a display with -platform offscreen
+    PlotView view(&plotBuffer, PlotView::defaultConfig(_MPU_INTERVAL_US));
+    view.addPanel("Acceleration [m/s^2]", QStringList() << "X" << "Y" << "Z", 0);
+    view.addPanel("Angular rate [rad/s]", QStringList() << "X" << "Y" << "Z", 3);
+    view.addPanel("Motor commands", QStringList() << "A" << "B", 6);
+    view.setWindowTitle("SBR telemetry");
+    view.resize(1200, 800);
+    view.show();
+    plotView = &view;
+#else
     QCoreApplication a(argc, argv);
+#endif
+    TRACE_THREAD_NAME("main");
+
+#ifdef SBR_TRACE
+    signal(SIGUSR1, requestTrace);
+    QTimer traceTimer;
+    QObject::connect(&traceTimer, &QTimer::timeout, []()
+    {
+        if(!traceRequested)
+            return;
+        traceRequested = 0;
+        if(TRACE_DUMP(_TRACE_FILE))
+            std::cout << "Trace written to " << _TRACE_FILE << std::endl;
+        else
+            std::cout << "Can't write trace " << _TRACE_FILE << std::endl;
+    });
+    traceTimer.start(_TRACE_POLL_MS);
+#endif
 
 #ifdef _MODE_WIFI
     sock.bind(QHostAddress(_LOCAL_IP), _LOCAL_PORT);
@@ -136,15 +640,63 @@ int main(int argc, char *argv[])
 #else
     QObject::connect(&port, &QSerialPort::readyRead, receiveDataSerial);
     port.setPortName(_SERIAL_PORT); //serial port name
-    port.setBaudRate(115200); //must be set to 115200
+    port.setBaudRate(_SERIAL_BAUD); //the robot starts at 115200 baud, faster rates are negotiated after the handshake
     if(!port.open(QIODevice::ReadWrite))
     {
         std::cout << "Connection failed";
         a.exit();
     }
 #endif
-    setMPUrate(50000); //example: set MPU rate to 1s
-    setMotors(-30, 30); //example: stop motors
+#ifdef _STATS_LOG
+    statsLog = fopen(_STATS_LOG, "w");
+    if(statsLog != NULL)
+        fprintf(statsLog, "host_ms,uptime_ms,loop_max_us,loop_mean_us,loops,frames,crc_errors,rx_overflows,tx_dropped,mpu_failures,free_sram,"
+                          "motor_commands,stale_motors,duplicate_commands,stack_peak,unused_min\n");
+#endif
+#ifdef _SESSION_LOG
+    if(!session.open(_SESSION_LOG))
+        std::cout << "Can't create session log " << _SESSION_LOG << std::endl;
+    else
+        std::cout << "Recording session to " << _SESSION_LOG << std::endl;
+#endif
+    QTimer reliableTimer;
+    QObject::connect(&reliableTimer, &QTimer::timeout, []()
+    {
+        reliable.poll(hostMicros());
+    });
+    reliableTimer.start(_RELIABLE_POLL_MS);
+    helloTimer.setSingleShot(true);
+    QObject::connect(&helloTimer, &QTimer::timeout, []()
+    {
+        if(connected)
+            return;
+        if(helloAttempts < _HELLO_ATTEMPTS) //the request or the answer may have been lost
+        {
+            sendHello();
+            return;
+        }
+        //no handshake, only DATA_CMD_RATE and DATA_CMD_MOTORS can be used
+        std::cout << "No handshake response after " << _HELLO_ATTEMPTS << " attempts, assuming firmware without capabilities" << std::endl;
+        connected = true;
+        onConnected();
+    });
+    sendHello(); //the rest of the configuration is done in onConnected()
 
     return a.exec();
 }
+
+//called once the robot capabilities are known
+void onConnected(void)
+{
+    reliable.setEnabled(robot.features & FEATURE_RELIABLE); //configuration commands acknowledged, motor commands sequenced
+    if(!reliable.isEnabled()) //counted in configUnreliable and motorsUnsequenced
+        std::cout << "Reliable delivery unavailable, configuration commands are sent once and motor commands unsequenced" << std::endl;
+    if(robot.features & FEATURE_COMPRESSED_TELEMETRY)
+        setTelemetry(TELEMETRY_COMPRESSED, 2); //example: compressed telemetry, 2 samples per packet
+    if(robot.features & FEATURE_SENSOR_CONFIG)
+        setSensorConfig(SENSOR_UNCHANGED, SENSOR_UNCHANGED, 3); //example: 44 Hz filter bandwidth, less delay than default 21 Hz
+    if(robot.features & FEATURE_STATS)
+        requestStats(_STATS_INTERVAL_MS);
+    setMPUrate(_MPU_INTERVAL_US); //example: set MPU rate to 50 ms
+    setMotors(-30, 30); //example: stop motors
+}
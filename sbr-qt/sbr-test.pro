@@ -17,11 +17,41 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# Event tracing (Trace.h), enabled with: qmake CONFIG+=trace
+# Without it all TRACE_... macros compile to nothing.
+trace: DEFINES += SBR_TRACE
+
+# Live plot window (PlotView), disabled with: qmake CONFIG+=noplot
+# Without it every sample is printed to the console instead.
+!noplot {
+    QT += gui widgets
+    DEFINES += SBR_PLOT
+    SOURCES += PlotBuffer.cpp PlotView.cpp
+    HEADERS += PlotBuffer.h PlotView.h
+}
+
+# Protocol library shared with the firmware, message definitions are generated from sbrcp.json
+SBRCP_DIR = ../firmware/lib/SBRCP/src
+INCLUDEPATH += $$SBRCP_DIR
+
 SOURCES += \
         main.cpp \
-        SBRCP.cpp
+        $$SBRCP_DIR/SBRCP.cpp \
+        $$SBRCP_DIR/TelemetryCodec.cpp \
+        FeaturePipeline.cpp \
+        ReliableChannel.cpp \
+        SessionLog.cpp \
+        SystemIdentifier.cpp \
+        Trace.cpp
 HEADERS += \
-        SBRCP.h
+        $$SBRCP_DIR/SBRCP.h \
+        $$SBRCP_DIR/SBRCPMessages.h \
+        $$SBRCP_DIR/TelemetryCodec.h \
+        FeaturePipeline.h \
+        ReliableChannel.h \
+        SessionLog.h \
+        SystemIdentifier.h \
+        Trace.h
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -0,0 +1,272 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file main.cpp
+* \brief Serial link benchmark: negotiates every baud rate from a list with the robot and measures the probe echo throughput and error rate
+* \copyright GNU GPLv3
+**/
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+#include <vector>
+#include "EventLoop.h"
+#include "RobotClient.h"
+
+#define _QUIET_INTERVAL_US 1000000 //MPU data interval during the benchmark, telemetry would share the link with the probes
+#define _STATS_REQUESTS 3
+
+typedef struct
+{
+    const char *device;
+    int baud; //initial baud rate, restored at the end
+    std::vector<int> rates; //baud rates to test
+    float duration; //per baud rate, in seconds
+    int window; //probes in flight
+    uint8_t length; //probe pattern length in bytes
+    const char *output;
+} Options_t;
+
+typedef struct
+{
+    int baud;
+    bool switched; //negotiated, false if the robot refused it or the probes failed
+    uint32_t probes, lost, corrupted; //lost: no answer, corrupted: answer with a different pattern
+    uint32_t robotCrcErrors, robotOverflows; //from DATA_STATS, UINT32_MAX if not available
+    uint64_t rttSum;
+    uint32_t rttMax;
+    double seconds;
+} Result_t;
+
+static Options_t options;
+static std::vector<Result_t> results;
+static volatile sig_atomic_t interrupted = 0;
+
+static void onSignal(int)
+{
+    interrupted = 1;
+}
+
+static void usage(void)
+{
+    printf("Usage: sbr-baud -d device [options]\n");
+    printf("  -d device          serial port (e.g. /dev/ttyUSB0)\n");
+    printf("  -b baud            current baud rate of the robot, restored at the end (default 115200)\n");
+    printf("  -r baud,baud,...   baud rates to test (default 115200,250000,500000,1000000,2000000)\n");
+    printf("  -t seconds         duration per baud rate (default 2)\n");
+    printf("  -w n               probes in flight (default 4)\n");
+    printf("  -n bytes           probe pattern length, 0 to %u (default %u)\n", (unsigned)sizeof(((SBRCP_CmdBaud_t*)0)->pattern),
+           (unsigned)sizeof(((SBRCP_CmdBaud_t*)0)->pattern));
+    printf("  -o results.csv     results (default baud.csv)\n");
+}
+
+//robot CRC errors and receive buffer overflows, false if not available
+static RobotTask readStats(Robot &robot, uint16_t *crcErrors, uint16_t *overflows, bool *ok)
+{
+    *ok = false;
+    if(!(robot.getInfo()->features & FEATURE_STATS))
+        co_return;
+    for(int i = 0; (i < _STATS_REQUESTS) && !*ok; i++)
+    {
+        RobotResponse_t r = co_await robot.requestStats();
+        const SBRCP_Stats_t *s = r.valid ? SBRCP_view<SBRCP_Stats_t>(&r.data) : NULL;
+        if(s == NULL)
+            continue;
+        *crcErrors = s->crcErrors;
+        *overflows = s->rxOverflows;
+        *ok = true;
+    }
+}
+
+//sends probes with random patterns until the end time, one at a time, several of these run concurrently
+static RobotTask prober(Robot &robot, Result_t *r, uint64_t end, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    uint8_t pattern[sizeof(((SBRCP_CmdBaud_t*)0)->pattern)];
+    while(!interrupted && (EventLoop::now() < end))
+    {
+        for(uint8_t i = 0; i < options.length; i++)
+        {
+            uint8_t b = rng();
+            pattern[i] = (b == '\n') ? b + 1 : b; //LF-CR inside the payload would split the frame on the robot
+        }
+        RobotResponse_t response = co_await robot.probeBaud(pattern, options.length);
+        r->probes++;
+        if(!response.valid)
+        {
+            r->lost++;
+            continue;
+        }
+        const SBRCP_Baud_t *answer = SBRCP_view<SBRCP_Baud_t>(&response.data);
+        if((answer == NULL) || (response.data.size != offsetof(SBRCP_Baud_t, pattern) + options.length)
+           || memcmp(answer->pattern, pattern, options.length))
+        {
+            r->corrupted++;
+            continue;
+        }
+        r->rttSum += response.rtt;
+        if(response.rtt > r->rttMax)
+            r->rttMax = response.rtt;
+    }
+}
+
+static RobotTask bench(Robot &robot, EventLoop &loop)
+{
+    RobotResponse_t hello = co_await robot.connect();
+    const RobotInfo_t *info = robot.getInfo();
+    if(!hello.valid || !(info->features & FEATURE_BAUD))
+    {
+        printf(hello.valid ? "Firmware without baud rate negotiation\n" : "No handshake response\n");
+        loop.stop();
+        co_return;
+    }
+    printf("Robot: firmware %d.%d, features 0x%04x\n", info->firmwareMajor, info->firmwareMinor, info->features);
+    uint32_t interval = info->interval;
+    co_await robot.setRate(_QUIET_INTERVAL_US);
+
+    printf("%8s %8s %7s %6s %9s %9s %10s %9s %8s %9s %9s %9s\n", "baud", "switched", "probes", "lost", "corrupted", "robot CRC",
+           "frames/s", "bytes/s", "line use", "MPU pkt/s", "rtt mean", "rtt max");
+    for(size_t i = 0; (i < options.rates.size()) && !interrupted; i++)
+    {
+        Result_t r;
+        memset(&r, 0, sizeof(r));
+        r.baud = options.rates[i];
+        r.robotCrcErrors = r.robotOverflows = UINT32_MAX;
+        co_await robot.negotiateBaud(r.baud, &r.switched);
+        if(!r.switched)
+        {
+            printf("%8d %8s\n", r.baud, "no");
+            results.push_back(r);
+            continue;
+        }
+
+        uint16_t crcBefore = 0, overflowsBefore = 0, crcAfter = 0, overflowsAfter = 0;
+        bool statsBefore, statsAfter;
+        co_await readStats(robot, &crcBefore, &overflowsBefore, &statsBefore);
+        uint64_t start = EventLoop::now();
+        std::vector<RobotTask> probers;
+        for(int k = 0; k < options.window; k++)
+        {
+            probers.push_back(prober(robot, &r, start + (uint64_t)(options.duration * 1e6f), i * options.window + k + 1));
+            probers.back().start();
+        }
+        for(size_t k = 0; k < probers.size(); k++) //started tasks can't be awaited, only polled
+        {
+            while(!probers[k].isDone())
+                co_await robot.sleep(10);
+        }
+        r.seconds = (EventLoop::now() - start) * 1e-6;
+        co_await readStats(robot, &crcAfter, &overflowsAfter, &statsAfter);
+        if(statsBefore && statsAfter) //the counters wrap around at 65536
+        {
+            r.robotCrcErrors = (uint16_t)(crcAfter - crcBefore);
+            r.robotOverflows = (uint16_t)(overflowsAfter - overflowsBefore);
+        }
+        results.push_back(r);
+
+        uint32_t good = r.probes - r.lost - r.corrupted;
+        double bytes = good * (offsetof(SBRCP_Baud_t, pattern) + options.length + 4.) / r.seconds; //each direction
+        printf("%8d %8s %7u %6u %9u %9d %10.0f %9.0f %7.1f%% %9.0f %7.2fms %7.2fms\n", r.baud, "yes", r.probes, r.lost, r.corrupted,
+               (r.robotCrcErrors == UINT32_MAX) ? -1 : (int)r.robotCrcErrors, good / r.seconds, bytes, 100. * bytes / (r.baud / 10.),
+               bytes / (sizeof(SBRCP_Mpu_t) + 4), (good > 0) ? r.rttSum / 1000. / good : 0., r.rttMax / 1000.);
+    }
+
+    bool restored;
+    co_await robot.negotiateBaud(options.baud, &restored);
+    if(!restored)
+        printf("Can't restore %d baud, the robot keeps %d baud until reset\n", options.baud, robot.getBaudRate());
+    co_await robot.setRate(interval);
+    loop.stop();
+}
+
+int main(int argc, char *argv[])
+{
+    options.device = NULL;
+    options.baud = 115200;
+    options.rates = {115200, 250000, 500000, 1000000, 2000000};
+    options.duration = 2.f;
+    options.window = 4;
+    options.length = sizeof(((SBRCP_CmdBaud_t*)0)->pattern);
+    options.output = "baud.csv";
+
+    for(int i = 1; i < argc; i++)
+    {
+        bool hasValue = (i + 1 < argc);
+        if(!strcmp(argv[i], "-d") && hasValue)
+            options.device = argv[++i];
+        else if(!strcmp(argv[i], "-b") && hasValue)
+            options.baud = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-r") && hasValue)
+        {
+            options.rates.clear();
+            for(char *p = strtok(argv[++i], ","); p != NULL; p = strtok(NULL, ","))
+                options.rates.push_back(atoi(p));
+        }
+        else if(!strcmp(argv[i], "-t") && hasValue)
+            options.duration = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-w") && hasValue)
+            options.window = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-n") && hasValue)
+            options.length = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-o") && hasValue)
+            options.output = argv[++i];
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if((options.device == NULL) || (options.window < 1) || (options.length > sizeof(((SBRCP_CmdBaud_t*)0)->pattern)))
+    {
+        usage();
+        return 1;
+    }
+
+    EventLoop loop;
+    Robot robot(&loop);
+    if(!robot.openSerial(options.device, options.baud))
+    {
+        printf("Can't open %s at %d baud\n", options.device, options.baud);
+        return 1;
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    RobotTask task = bench(robot, loop);
+    task.start();
+    loop.run();
+
+    FILE *f = fopen(options.output, "w");
+    if(f == NULL)
+    {
+        printf("Can't write %s\n", options.output);
+        return 1;
+    }
+    fprintf(f, "baud,switched,probes,lost,corrupted,robot_crc_errors,robot_rx_overflows,seconds,rtt_mean_ms,rtt_max_ms\n");
+    for(const Result_t &r : results)
+    {
+        uint32_t good = r.probes - r.lost - r.corrupted;
+        fprintf(f, "%d,%d,%u,%u,%u,%d,%d,%.3f,%.3f,%.3f\n", r.baud, r.switched, r.probes, r.lost, r.corrupted,
+                (r.robotCrcErrors == UINT32_MAX) ? -1 : (int)r.robotCrcErrors, (r.robotOverflows == UINT32_MAX) ? -1 : (int)r.robotOverflows,
+                r.seconds, (good > 0) ? r.rttSum / 1000. / good : 0., r.rttMax / 1000.);
+    }
+    fclose(f);
+    return 0;
+}
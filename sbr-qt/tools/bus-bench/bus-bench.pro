@@ -0,0 +1,17 @@
+TEMPLATE = app
+TARGET = sbr-bus-bench
+CONFIG += c++17 console thread
+CONFIG -= app_bundle qt
+LIBS += -lrt
+
+SBRCP_DIR = ../../../firmware/lib/SBRCP/src
+INCLUDEPATH += ../.. $$SBRCP_DIR
+
+SOURCES += \
+        main.cpp \
+        ../../EventLoop.cpp \
+        ../../TelemetryBus.cpp
+HEADERS += \
+        ../../EventLoop.h \
+        ../../TelemetryBus.h \
+        $$SBRCP_DIR/TelemetryCodec.h
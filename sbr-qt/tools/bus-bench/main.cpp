@@ -0,0 +1,312 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file main.cpp
+* \brief Telemetry bus benchmark: producer and reader cost in nanoseconds per sample with lagging and dying consumers, or the read cost and delivery latency on a live bus
+* \copyright GNU GPLv3
+**/
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "EventLoop.h"
+#include "TelemetryBus.h"
+
+#define _STALL_MS 200 //the lagging reader sleeps this long between reads, so the producer overtakes it
+#define _READ_BATCH 64 //samples read at once, their latency is computed after the timed reads
+
+typedef struct
+{
+    const char *name; //live bus to attach to, NULL for the self-contained benchmark
+    float duration; //in seconds
+    int readers; //reader threads
+    uint32_t rate; //published samples per second, 0 - as fast as possible
+} Options_t;
+
+typedef struct
+{
+    uint64_t samples;
+    uint64_t lost;
+    uint64_t nanoseconds; //spent in read(), including the empty read that ends a drained ring
+    uint64_t latencySum, latencyMax; //publish to read, in microseconds
+    uint64_t outOfOrder; //sequence numbers that didn't follow the previous one without a loss
+} ReaderStats_t;
+
+static Options_t options;
+static std::atomic<bool> running;
+static volatile sig_atomic_t interrupted = 0;
+
+static void onSignal(int)
+{
+    interrupted = 1;
+}
+
+static void usage(void)
+{
+    printf("Usage: sbr-bus-bench [options]\n");
+    printf("  -n name            attach to a live bus (e.g. %s) and measure reading it, otherwise a private bus is benchmarked\n",
+           TELEMETRY_BUS_NAME);
+    printf("  -t seconds         duration (default 3)\n");
+    printf("  -c n               reader threads (default 4)\n");
+    printf("  -r rate            samples per second published on the private bus, 0 as fast as possible (default 0)\n");
+}
+
+static inline uint64_t nanoseconds(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//reads until stopped, stall > 0 makes it a lagging reader
+static void reader(const TelemetryBus *bus, ReaderStats_t *stats, uint32_t stall)
+{
+    TelemetryBusReader r(bus);
+    BusSample_t batch[_READ_BATCH];
+    uint64_t expected = 0;
+    while(running.load(std::memory_order_relaxed))
+    {
+        uint64_t start = nanoseconds();
+        uint32_t n = 0;
+        while((n < _READ_BATCH) && r.read(&batch[n]))
+            n++;
+        if(n == 0)
+        {
+            if(stall > 0)
+                usleep(stall * 1000);
+            else
+                std::this_thread::yield();
+            continue;
+        }
+        stats->nanoseconds += nanoseconds() - start;
+        stats->samples += n;
+        uint64_t now = EventLoop::now();
+        bool lost = (r.getLost() != stats->lost);
+        stats->lost = r.getLost();
+        for(uint32_t i = 0; i < n; i++)
+        {
+            if((expected != 0) && (batch[i].sequence != expected) && !lost)
+                stats->outOfOrder++;
+            expected = batch[i].sequence + 1;
+            uint64_t latency = now - batch[i].hostTime;
+            stats->latencySum += latency;
+            if(latency > stats->latencyMax)
+                stats->latencyMax = latency;
+        }
+        if((stall > 0) && (n < _READ_BATCH))
+            usleep(stall * 1000);
+    }
+    stats->lost = r.getLost();
+}
+
+//publishes for the given time, returns the number of samples and the time spent in publish()
+static uint64_t produce(TelemetryBus *bus, double seconds, uint64_t *publishNs)
+{
+    float v[TELEMETRY_CHANNELS] = {0.f, 0.f, 9.81f, 0.f, 0.f, 0.f};
+    uint64_t end = nanoseconds() + (uint64_t)(seconds * 1e9);
+    uint64_t n = 0, spent = 0;
+    uint64_t period = (options.rate > 0) ? 1000000000ULL / options.rate : 0;
+    uint64_t due = nanoseconds();
+    while(!interrupted)
+    {
+        uint64_t now = nanoseconds();
+        if(now >= end)
+            break;
+        if(period > 0)
+        {
+            if(now < due)
+            {
+                struct timespec t = {0, (long)(due - now)};
+                nanosleep(&t, NULL);
+                continue;
+            }
+            due += period;
+        }
+        v[0] = (float)n;
+        uint64_t hostTime = EventLoop::now();
+        uint64_t start = nanoseconds();
+        bus->publish(hostTime, v, true, n);
+        spent += nanoseconds() - start;
+        n++;
+        if((n & 1023) == 0)
+            bus->setStatus(EventLoop::now(), (uint32_t)(period / 1000));
+    }
+    *publishNs = spent;
+    return n;
+}
+
+static void printReaders(const char *label, const std::vector<ReaderStats_t> &stats)
+{
+    for(size_t i = 0; i < stats.size(); i++)
+    {
+        const ReaderStats_t &s = stats[i];
+        printf("  %-8s %zu: %10llu samples, %9llu lost, %6.1f ns/sample, latency mean %7.1f us, max %7llu us%s\n", label, i,
+               (unsigned long long)s.samples, (unsigned long long)s.lost, (s.samples > 0) ? (double)s.nanoseconds / s.samples : 0.,
+               (s.samples > 0) ? (double)s.latencySum / s.samples : 0., (unsigned long long)s.latencyMax,
+               (s.outOfOrder > 0) ? ", OUT OF ORDER" : "");
+    }
+}
+
+//reader and command owner processes that are killed while the producer runs
+static pid_t spawnVictim(const char *name, bool commands)
+{
+    pid_t pid = fork();
+    if(pid != 0)
+        return pid;
+    TelemetryBus bus;
+    if(!bus.open(name, commands))
+        _exit(1);
+    if(commands && !bus.claimCommands())
+        _exit(1);
+    TelemetryBusReader r(&bus);
+    BusSample_t s;
+    for(int16_t i = 0; ; i++)
+    {
+        while(r.read(&s));
+        if(commands)
+            bus.sendMotors(i & 0xFF, -(i & 0xFF));
+        usleep(1000);
+    }
+}
+
+static int benchPrivate(void)
+{
+    char name[64];
+    snprintf(name, sizeof(name), "/sbr-bus-bench-%d", (int)getpid());
+    TelemetryBus bus;
+    if(!bus.create(name))
+    {
+        printf("Can't create %s\n", name);
+        return 1;
+    }
+
+    //baseline without readers
+    uint64_t publishNs;
+    uint64_t n = produce(&bus, options.duration / 3, &publishNs);
+    printf("Producer alone:        %llu samples, %.1f ns/sample\n", (unsigned long long)n, (double)publishNs / n);
+
+    //readers, a lagging one, and a reader and a command owner that are killed
+    std::vector<ReaderStats_t> stats(options.readers + 1);
+    memset(stats.data(), 0, stats.size() * sizeof(ReaderStats_t));
+    pid_t victimReader = spawnVictim(name, false); //forked before the threads start
+    pid_t victimOwner = spawnVictim(name, true);
+    running = true;
+    std::vector<std::thread> threads;
+    for(int i = 0; i <= options.readers; i++)
+        threads.emplace_back(reader, &bus, &stats[i], (i == options.readers) ? _STALL_MS : 0);
+    usleep(100000);
+    uint64_t killTime = EventLoop::now();
+    kill(victimReader, SIGKILL);
+    kill(victimOwner, SIGKILL);
+    waitpid(victimReader, NULL, 0);
+    waitpid(victimOwner, NULL, 0);
+    int16_t a, b;
+    bool commandSeen = bus.pollCommand(&a, &b);
+
+    n = produce(&bus, options.duration * 2 / 3, &publishNs);
+    running = false;
+    for(std::thread &t : threads)
+        t.join();
+    bool released = bus.releaseDeadOwner();
+    printf("Producer with readers: %llu samples, %.1f ns/sample\n", (unsigned long long)n, (double)publishNs / n);
+    std::vector<ReaderStats_t> active(stats.begin(), stats.end() - 1);
+    printReaders("reader", active);
+    printReaders("lagging", std::vector<ReaderStats_t>(stats.end() - 1, stats.end()));
+    printf("Reader and command owner killed %.1f ms before: command owner %s, last command %s (%d, %d)\n",
+           (EventLoop::now() - killTime) / 1000., released ? "released" : "NOT released", commandSeen ? "received" : "NOT received",
+           commandSeen ? a : 0, commandSeen ? b : 0);
+
+    //a new producer takes the bus over and the numbering continues
+    uint64_t head = bus.getLayout()->head.load();
+    bus.close();
+    TelemetryBus restarted;
+    bool takenOver = restarted.create(name) && (restarted.getLayout()->head.load() == head);
+    printf("Producer restart: %s\n", takenOver ? "taken over, sample numbering continues" : "FAILED");
+    restarted.close();
+    shm_unlink(name);
+    return takenOver && released ? 0 : 1;
+}
+
+static int benchLive(void)
+{
+    TelemetryBus bus;
+    if(!bus.open(options.name))
+    {
+        printf("Can't open %s\n", options.name);
+        return 1;
+    }
+    if(!bus.isProducerAlive(EventLoop::now(), 1000000))
+        printf("No producer heartbeat for a second, is sbr-bus running?\n");
+    std::vector<ReaderStats_t> stats(options.readers);
+    memset(stats.data(), 0, stats.size() * sizeof(ReaderStats_t));
+    running = true;
+    std::vector<std::thread> threads;
+    for(int i = 0; i < options.readers; i++)
+        threads.emplace_back(reader, &bus, &stats[i], 0);
+    uint64_t end = EventLoop::now() + (uint64_t)(options.duration * 1e6f);
+    while(!interrupted && (EventLoop::now() < end))
+        usleep(10000);
+    running = false;
+    for(std::thread &t : threads)
+        t.join();
+    printf("Interval %u us\n", bus.getLayout()->interval.load());
+    printReaders("reader", stats);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    options.name = NULL;
+    options.duration = 3.f;
+    options.readers = 4;
+    options.rate = 0;
+
+    for(int i = 1; i < argc; i++)
+    {
+        bool hasValue = (i + 1 < argc);
+        if(!strcmp(argv[i], "-n") && hasValue)
+            options.name = argv[++i];
+        else if(!strcmp(argv[i], "-t") && hasValue)
+            options.duration = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-c") && hasValue)
+            options.readers = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-r") && hasValue)
+            options.rate = atoi(argv[++i]);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if((options.readers < 0) || (options.duration <= 0.f))
+    {
+        usage();
+        return 1;
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    return (options.name != NULL) ? benchLive() : benchPrivate();
+}
@@ -0,0 +1,27 @@
+TEMPLATE = app
+TARGET = sbr-bus
+CONFIG += c++2a console
+CONFIG -= app_bundle qt
+LIBS += -lrt
+
+SBRCP_DIR = ../../../firmware/lib/SBRCP/src
+INCLUDEPATH += ../.. $$SBRCP_DIR
+
+SOURCES += \
+        main.cpp \
+        ../../ClockSync.cpp \
+        ../../EventLoop.cpp \
+        ../../ReliableChannel.cpp \
+        ../../RobotClient.cpp \
+        ../../TelemetryBus.cpp \
+        $$SBRCP_DIR/SBRCP.cpp \
+        $$SBRCP_DIR/TelemetryCodec.cpp
+HEADERS += \
+        ../../ClockSync.h \
+        ../../EventLoop.h \
+        ../../ReliableChannel.h \
+        ../../RobotClient.h \
+        ../../TelemetryBus.h \
+        $$SBRCP_DIR/SBRCP.h \
+        $$SBRCP_DIR/SBRCPMessages.h \
+        $$SBRCP_DIR/TelemetryCodec.h
@@ -0,0 +1,256 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file main.cpp
+* \brief Telemetry bus daemon: owns the robot link and publishes the samples to a shared-memory ring for local consumers, forwards motor commands from the command slot
+* \copyright GNU GPLv3
+**/
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "EventLoop.h"
+#include "RobotClient.h"
+#include "TelemetryBus.h"
+
+#define _POLL_US 1000 //command slot polling period, motor commands wait for the robot link up to this long
+#define _OWNER_CHECK_POLLS 100 //polls between checks of the command owner process
+#define _CONNECT_RETRY_MS 1000
+
+typedef struct
+{
+    const char *device; //serial port, NULL for UDP
+    int baud;
+    const char *robotIp;
+    uint16_t robotPort;
+    uint16_t localPort;
+    uint32_t interval; //MPU data interval in microseconds
+    const char *name; //shared memory object
+    bool timestamped; //ask for TELEMETRY_TIMESTAMPED, so consumers get the robot time of every sample
+    uint32_t statsPeriod; //in seconds, 0 to disable
+} Options_t;
+
+typedef struct
+{
+    uint64_t published;
+    uint32_t timeouts; //sample timeouts
+    uint64_t commands; //motor commands forwarded
+    uint32_t ownerExits; //command owners that exited without releasing the slot
+} Counters_t;
+
+typedef struct
+{
+    Robot *robot;
+    TelemetryBus *bus;
+    EventLoop *loop;
+    EventTimer_t timer;
+    uint32_t polls;
+    uint64_t statsTime;
+    Counters_t atStats; //counters at the last statistics line
+} Poller_t;
+
+static Options_t options;
+static Counters_t counters;
+static uint32_t interval = 0; //set on the robot, 0 until the rate setting
+static volatile sig_atomic_t interrupted = 0;
+
+static void onSignal(int)
+{
+    interrupted = 1;
+}
+
+static void usage(void)
+{
+    printf("Usage: sbr-bus -d device | -u ip[:port] [options]\n");
+    printf("  -d device          serial port (e.g. /dev/ttyUSB0)\n");
+    printf("  -b baud            serial baud rate (default 115200)\n");
+    printf("  -u ip[:port]       robot address for UDP (default port 1235)\n");
+    printf("  -l port            local UDP port (default 1234)\n");
+    printf("  -i us              MPU data interval (default 10000)\n");
+    printf("  -n name            shared memory object (default %s)\n", TELEMETRY_BUS_NAME);
+    printf("  -T                 timestamped telemetry, consumers get the robot time of every sample\n");
+    printf("  -s seconds         statistics period (default 5, 0 to disable)\n");
+}
+
+//heartbeat, motor commands from the command slot, command owner and statistics
+static void onPoll(void *arg)
+{
+    Poller_t *p = (Poller_t*)arg;
+    uint64_t now = EventLoop::now();
+    p->bus->setStatus(now, interval);
+    int16_t a, b;
+    if(p->bus->pollCommand(&a, &b)) //only the newest command, as with DATA_CMD_MOTORS_SEQ
+    {
+        p->robot->setMotors(a, b);
+        counters.commands++;
+    }
+    if((++p->polls % _OWNER_CHECK_POLLS == 0) && p->bus->releaseDeadOwner())
+    {
+        p->robot->setMotors(0, 0);
+        counters.ownerExits++;
+        printf("Command owner exited, motors stopped\n");
+    }
+    if((options.statsPeriod > 0) && (now - p->statsTime >= options.statsPeriod * 1000000ULL))
+    {
+        double seconds = (now - p->statsTime) * 1e-6;
+        printf("Published %llu samples (%.1f/s), %u timeouts, %llu motor commands (%.1f/s), %u samples dropped by the client\n",
+               (unsigned long long)counters.published, (counters.published - p->atStats.published) / seconds, counters.timeouts,
+               (unsigned long long)counters.commands, (counters.commands - p->atStats.commands) / seconds, p->robot->getDroppedSamples());
+        fflush(stdout);
+        p->atStats = counters;
+        p->statsTime = now;
+    }
+    p->loop->schedule(&p->timer, _POLL_US);
+}
+
+//handshake and rate setting, then every sample goes to the bus
+static RobotTask publisher(Robot &robot, TelemetryBus &bus, EventLoop &loop)
+{
+    RobotResponse_t hello = co_await robot.connect();
+    while(!hello.valid && !interrupted)
+    {
+        printf("No handshake response, retrying\n");
+        co_await robot.sleep(_CONNECT_RETRY_MS);
+        hello = co_await robot.connect();
+    }
+    if(interrupted)
+    {
+        loop.stop();
+        co_return;
+    }
+    const RobotInfo_t *info = robot.getInfo();
+    printf("Robot: protocol v%d, firmware %d.%d, features 0x%04x\n", info->protocolVersion, info->firmwareMajor, info->firmwareMinor,
+           info->features);
+    if(options.timestamped)
+    {
+        if(info->features & FEATURE_TIMESTAMPS)
+            co_await robot.setTelemetry(TELEMETRY_TIMESTAMPED, 1);
+        else
+            printf("Firmware without timestamped telemetry, samples carry only the host time\n");
+    }
+    co_await robot.setRate(options.interval);
+    interval = options.interval;
+    robot.flushSamples(); //samples at the old rate
+
+    uint32_t timeout = 10 * options.interval / 1000 + 100;
+    while(!interrupted)
+    {
+        RobotSample_t s = co_await robot.nextSample(timeout);
+        if(!s.valid)
+        {
+            counters.timeouts++;
+            continue;
+        }
+        bus.publish(s.time, s.value, s.timestamped, s.robotTime);
+        counters.published++;
+    }
+    co_await robot.setMotors(0, 0);
+    loop.stop();
+}
+
+int main(int argc, char *argv[])
+{
+    options.device = NULL;
+    options.baud = 115200;
+    options.robotIp = NULL;
+    options.robotPort = 1235;
+    options.localPort = 1234;
+    options.interval = 10000;
+    options.name = TELEMETRY_BUS_NAME;
+    options.timestamped = false;
+    options.statsPeriod = 5;
+
+    for(int i = 1; i < argc; i++)
+    {
+        bool hasValue = (i + 1 < argc);
+        if(!strcmp(argv[i], "-d") && hasValue)
+            options.device = argv[++i];
+        else if(!strcmp(argv[i], "-b") && hasValue)
+            options.baud = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-u") && hasValue)
+        {
+            options.robotIp = argv[++i];
+            char *port = strchr(argv[i], ':');
+            if(port != NULL)
+            {
+                *port = '\0';
+                options.robotPort = atoi(port + 1);
+            }
+        }
+        else if(!strcmp(argv[i], "-l") && hasValue)
+            options.localPort = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-i") && hasValue)
+            options.interval = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-n") && hasValue)
+            options.name = argv[++i];
+        else if(!strcmp(argv[i], "-T"))
+            options.timestamped = true;
+        else if(!strcmp(argv[i], "-s") && hasValue)
+            options.statsPeriod = atoi(argv[++i]);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if((options.device == NULL) == (options.robotIp == NULL))
+    {
+        usage();
+        return 1;
+    }
+
+    TelemetryBus bus;
+    if(!bus.create(options.name))
+    {
+        printf("Can't create %s (already published by another process?)\n", options.name);
+        return 1;
+    }
+    EventLoop loop;
+    Robot robot(&loop);
+    bool opened = (options.device != NULL) ? robot.openSerial(options.device, options.baud)
+                                           : robot.openUdp(options.robotIp, options.robotPort, options.localPort);
+    if(!opened)
+    {
+        printf("Can't connect to %s\n", (options.device != NULL) ? options.device : options.robotIp);
+        return 1;
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    memset(&counters, 0, sizeof(counters));
+    printf("Publishing to %s\n", options.name);
+
+    Poller_t poller;
+    memset(&poller, 0, sizeof(poller));
+    poller.robot = &robot;
+    poller.bus = &bus;
+    poller.loop = &loop;
+    poller.timer.callback = onPoll;
+    poller.timer.arg = &poller;
+    poller.statsTime = EventLoop::now();
+    loop.schedule(&poller.timer, 0);
+    RobotTask task = publisher(robot, bus, loop);
+    task.start();
+    loop.run();
+    loop.cancel(&poller.timer);
+
+    printf("Published %llu samples, %llu motor commands forwarded, %u command owners exited\n", (unsigned long long)counters.published,
+           (unsigned long long)counters.commands, counters.ownerExits);
+    return 0;
+}
@@ -0,0 +1,30 @@
+TEMPLATE = app
+TARGET = sbr-coro
+CONFIG += c++2a console
+CONFIG -= app_bundle qt
+
+SBRCP_DIR = ../../../firmware/lib/SBRCP/src
+INCLUDEPATH += ../.. $$SBRCP_DIR
+
+SOURCES += \
+        main.cpp \
+        ../../BalanceController.cpp \
+        ../../ClockSync.cpp \
+        ../../EventLoop.cpp \
+        ../../ReliableChannel.cpp \
+        ../../RobotClient.cpp \
+        ../../StatePredictor.cpp \
+        ../../SystemIdentifier.cpp \
+        $$SBRCP_DIR/SBRCP.cpp \
+        $$SBRCP_DIR/TelemetryCodec.cpp
+HEADERS += \
+        ../../BalanceController.h \
+        ../../ClockSync.h \
+        ../../EventLoop.h \
+        ../../ReliableChannel.h \
+        ../../RobotClient.h \
+        ../../StatePredictor.h \
+        ../../SystemIdentifier.h \
+        $$SBRCP_DIR/SBRCP.h \
+        $$SBRCP_DIR/SBRCPMessages.h \
+        $$SBRCP_DIR/TelemetryCodec.h
@@ -0,0 +1,331 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file main.cpp
+* \brief Robot session written with the coroutine client: handshake, rate setting, balance loop and a concurrent ping task,
+* with the command delivery counters at the end
+* \copyright GNU GPLv3
+**/
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "BalanceController.h"
+#include "EventLoop.h"
+#include "RobotClient.h"
+#include "StatePredictor.h"
+#include "SystemIdentifier.h"
+
+#define _SYNC_PINGS 8 //pings before the balance loop, for the first clock offset and drift estimate
+#define _STATS_REQUESTS 3 //statistics requests before the delivery counters are given up, either packet can be lost
+
+typedef struct
+{
+    const char *device; //serial port, NULL for UDP
+    int baud;
+    const char *robotIp;
+    uint16_t robotPort;
+    uint16_t localPort;
+    uint32_t interval; //MPU data interval in microseconds
+    float duration; //in seconds
+    uint32_t pingPeriod; //in milliseconds, 0 to disable
+    float kp, ki, kd; //all zero - motors are not driven
+    bool predict; //latency compensation
+    const char *modelPath; //plant model for the prediction, NULL for constant rate extrapolation
+} Options_t;
+
+typedef struct
+{
+    uint64_t samples;
+    uint64_t reactionSum, reactionMax; //sample reception to motor command sent, in microseconds
+    uint32_t pings, pingTimeouts;
+    uint32_t rttMin, rttMax;
+    uint64_t rttSum;
+} Results_t;
+
+static Options_t options;
+static Results_t results;
+static PlantModel_t model;
+static LatencyStats_t latency;
+static volatile sig_atomic_t interrupted = 0;
+static bool finished = false;
+
+static void onSignal(int)
+{
+    interrupted = 1;
+}
+
+static void usage(void)
+{
+    printf("Usage: sbr-coro [options]\n");
+    printf("  -d device          serial port (e.g. /dev/ttyUSB0)\n");
+    printf("  -b baud            serial baud rate (default 115200)\n");
+    printf("  -u ip[:port]       robot address for UDP (default port 1235)\n");
+    printf("  -l port            local UDP port (default 1234)\n");
+    printf("  -i us              MPU data interval (default 10000)\n");
+    printf("  -t seconds         session length (default 10)\n");
+    printf("  -p ms              ping period (default 1000, 0 to disable)\n");
+    printf("  --kp/--ki/--kd g   balance controller gains, motors are driven only if any gain is set\n");
+    printf("  --predict          compensate the link latency: timestamped telemetry, clock sync and state prediction\n");
+    printf("  -m model.txt       plant model for the prediction (sbr-sysid output), default constant rate extrapolation\n");
+}
+
+//handshake, rate setting, then one motor command per sample
+static RobotTask control(Robot &robot, EventLoop &loop)
+{
+    RobotResponse_t hello = co_await robot.connect();
+    const RobotInfo_t *info = robot.getInfo();
+    if(hello.valid)
+        printf("Robot: protocol v%d, firmware %d.%d, features 0x%04x, interval %u us (handshake %u us)\n", info->protocolVersion,
+               info->firmwareMajor, info->firmwareMinor, info->features, info->interval, hello.rtt);
+    else
+        printf("No handshake response, assuming firmware without capabilities\n");
+    bool stats = (info->features & FEATURE_STATS) && (info->features & FEATURE_RELIABLE);
+    if(stats) //baseline of the robot delivery counters
+        for(int i = 0; (i < _STATS_REQUESTS) && !(co_await robot.requestStats()).valid; i++);
+
+    if(options.predict)
+    {
+        if(info->features & FEATURE_TIMESTAMPS)
+            co_await robot.setTelemetry(TELEMETRY_TIMESTAMPED, 1);
+        else
+            printf("Firmware without timestamped telemetry, the sample age is estimated from the round trip time\n");
+        for(int i = 0; i < _SYNC_PINGS; i++)
+            co_await robot.ping();
+        ClockSync *clock = robot.getClock();
+        if(clock->isSynced())
+            printf("Clock offset %.3f ms, drift %.0f ppm, min. round trip %.2f ms\n", clock->getOffset(EventLoop::now()) / 1000.,
+                   clock->getDrift(), clock->getMinRtt() / 1000.);
+    }
+
+    uint64_t requested = EventLoop::now();
+    co_await robot.setRate(options.interval);
+    robot.flushSamples(); //samples at the old rate
+    RobotSample_t s = co_await robot.nextSample();
+    if(!s.valid)
+    {
+        printf("No samples received\n");
+        finished = true;
+        loop.stop();
+        co_return;
+    }
+    printf("First sample %.1f ms after the rate setting\n", (s.time - requested) / 1000.);
+
+    ControllerConfig_t config = BalanceController::defaultConfig(options.interval * 1e-6f);
+    config.kp = options.kp;
+    config.ki = options.ki;
+    config.kd = options.kd;
+    BalanceController controller(config);
+    PredictorConfig_t predictorConfig = StatePredictor::defaultConfig(model);
+    predictorConfig.motorSignB = config.motorSignB;
+    StatePredictor predictor(predictorConfig);
+    ClockSync *clock = robot.getClock();
+    bool drive = (options.kp != 0.f) || (options.ki != 0.f) || (options.kd != 0.f);
+    uint32_t timeout = 10 * options.interval / 1000 + 100;
+    uint64_t end = s.time + (uint64_t)(options.duration * 1e6f);
+    while(!interrupted && (s.time < end))
+    {
+        int16_t a, b;
+        if(options.predict)
+        {
+            //without timestamps the sample is assumed to be half a round trip old
+            uint64_t sampleTime = (s.timestamped && clock->isSynced()) ? clock->toHost(s.robotTime) : s.time - clock->getMinRtt() / 2;
+            uint64_t arrival = EventLoop::now() + clock->getMinRtt() / 2; //symmetric link
+            float tilt, rate;
+            predictor.predict(controller.estimate(s.value), s.value[config.gyroAxis], sampleTime, s.time, arrival, &tilt, &rate);
+            controller.control(tilt, rate, &a, &b);
+            predictor.command(arrival, a, b);
+        }
+        else
+            controller.update(s.value, &a, &b);
+        if(drive)
+            co_await robot.setMotors(a, b);
+        uint64_t reaction = EventLoop::now() - s.time;
+        results.samples++;
+        results.reactionSum += reaction;
+        if(reaction > results.reactionMax)
+            results.reactionMax = reaction;
+
+        s = co_await robot.nextSample(timeout);
+        if(!s.valid)
+        {
+            printf("Sample timeout\n");
+            break;
+        }
+    }
+    co_await robot.setMotors(0, 0);
+    if(stats)
+        for(int i = 0; (i < _STATS_REQUESTS) && !(co_await robot.requestStats()).valid; i++);
+    latency = predictor.getLatency();
+    finished = true;
+    loop.stop();
+}
+
+//round trip measurement running next to the control task
+static RobotTask pinger(Robot &robot)
+{
+    while(!finished)
+    {
+        co_await robot.sleep(options.pingPeriod);
+        RobotResponse_t r = co_await robot.ping();
+        results.pings++;
+        if(!r.valid)
+        {
+            results.pingTimeouts++;
+            continue;
+        }
+        results.rttSum += r.rtt;
+        if(r.rtt < results.rttMin)
+            results.rttMin = r.rtt;
+        if(r.rtt > results.rttMax)
+            results.rttMax = r.rtt;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    options.device = NULL;
+    options.baud = 115200;
+    options.robotIp = NULL;
+    options.robotPort = 1235;
+    options.localPort = 1234;
+    options.interval = 10000;
+    options.duration = 10.f;
+    options.pingPeriod = 1000;
+    options.kp = options.ki = options.kd = 0.f;
+    options.predict = false;
+    options.modelPath = NULL;
+
+    for(int i = 1; i < argc; i++)
+    {
+        bool hasValue = (i + 1 < argc);
+        if(!strcmp(argv[i], "-d") && hasValue)
+            options.device = argv[++i];
+        else if(!strcmp(argv[i], "-b") && hasValue)
+            options.baud = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-u") && hasValue)
+        {
+            options.robotIp = argv[++i];
+            char *port = strchr(argv[i], ':');
+            if(port != NULL)
+            {
+                *port = '\0';
+                options.robotPort = atoi(port + 1);
+            }
+        }
+        else if(!strcmp(argv[i], "-l") && hasValue)
+            options.localPort = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-i") && hasValue)
+            options.interval = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-t") && hasValue)
+            options.duration = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-p") && hasValue)
+            options.pingPeriod = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "--kp") && hasValue)
+            options.kp = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--ki") && hasValue)
+            options.ki = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--kd") && hasValue)
+            options.kd = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--predict"))
+            options.predict = true;
+        else if(!strcmp(argv[i], "-m") && hasValue)
+            options.modelPath = argv[++i];
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if((options.device == NULL) == (options.robotIp == NULL))
+    {
+        usage();
+        return 1;
+    }
+
+    memset(&model, 0, sizeof(model)); //zero model: constant tilt rate
+    if((options.modelPath != NULL) && !SystemIdentifier::loadModel(options.modelPath, &model))
+    {
+        printf("Can't read model %s\n", options.modelPath);
+        return 1;
+    }
+
+    EventLoop loop;
+    Robot robot(&loop);
+    bool opened = (options.device != NULL) ? robot.openSerial(options.device, options.baud)
+                                           : robot.openUdp(options.robotIp, options.robotPort, options.localPort);
+    if(!opened)
+    {
+        printf("Can't connect to %s\n", (options.device != NULL) ? options.device : options.robotIp);
+        return 1;
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    memset(&results, 0, sizeof(results));
+    results.rttMin = UINT32_MAX;
+
+    //tasks are destroyed before the robot and the loop
+    RobotTask controlTask = control(robot, loop);
+    RobotTask pingTask = pinger(robot);
+    controlTask.start();
+    if(options.pingPeriod > 0)
+        pingTask.start();
+    loop.run();
+
+    printf("Samples: %llu received, %llu processed, %u dropped, %u compressed packets lost\n", (unsigned long long)robot.getSamples(),
+           (unsigned long long)results.samples, robot.getDroppedSamples(), robot.getLostPackets());
+    if(results.samples > 0)
+        printf("Reaction (sample received to motor command sent): mean %.1f us, max %llu us\n",
+               (double)results.reactionSum / results.samples, (unsigned long long)results.reactionMax);
+    if(results.pings > results.pingTimeouts)
+        printf("Ping: %u sent, %u timeouts, rtt min %.2f ms, mean %.2f ms, max %.2f ms\n", results.pings, results.pingTimeouts,
+               results.rttMin / 1000., (double)results.rttSum / (results.pings - results.pingTimeouts) / 1000., results.rttMax / 1000.);
+    else if(results.pings > 0)
+        printf("Ping: %u sent, no answer\n", results.pings);
+    ReliableChannel *channel = robot.getChannel();
+    if(channel->isEnabled())
+    {
+        ReliableStats_t r = channel->getStats();
+        printf("Config commands: %u delivered, %u rejected, %u undelivered, %u superseded; %u packets, %u retransmitted (%.1f %%), "
+               "%u late acks, %u duplicates, rtt %.2f ms\n", r.configDelivered, r.configRejected, r.configUndelivered, r.configSuperseded,
+               r.transmissions, r.retransmissions, 100.f * channel->getConfigLoss(), r.lateAcks, r.duplicateCommands,
+               channel->getRtt() / 1000.);
+        if(r.motorsCounted > 0)
+            printf("Motor commands: %u sent, %u of %u received (%.1f %% lost), %u stale\n", r.motorsSent, r.motorsReceived, r.motorsCounted,
+                   100.f * channel->getMotorLoss(), r.motorsStale);
+        else
+            printf("Motor commands: %u sent\n", r.motorsSent);
+    }
+    else
+    {
+        ReliableStats_t r = channel->getStats();
+        printf("Reliable delivery unavailable: %u config commands sent once without acknowledgement, %u motor commands unsequenced\n",
+               r.configUnreliable, r.motorsUnsequenced);
+    }
+    if(latency.count > 0)
+    {
+        ClockSync *clock = robot.getClock();
+        printf("Clock: offset %.3f ms, drift %.0f ppm\n", clock->getOffset(EventLoop::now()) / 1000., clock->getDrift());
+        printf("Latency: sample age (measured) mean %.2f ms, max %.2f ms; actuation lead (predicted) mean %.2f ms, max %.2f ms; "
+               "prediction horizon mean %.2f ms, max %.2f ms\n", latency.ageMean / 1000., latency.ageMax / 1000., latency.leadMean / 1000.,
+               latency.leadMax / 1000., latency.horizonMean / 1000., latency.horizonMax / 1000.);
+    }
+    return 0;
+}
\ No newline at end of file
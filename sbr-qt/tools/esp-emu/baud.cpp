@@ -0,0 +1,39 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file baud.cpp
+* \brief Arbitrary serial port baud rates (e.g. 250000) on Linux
+* \copyright GNU GPLv3
+**/
+
+//termios2 can't be used in the same file as <termios.h>, which is why this is a separate file
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+
+bool setBaudRate(int fd, int baud)
+{
+	struct termios2 t;
+	if(ioctl(fd, TCGETS2, &t) < 0)
+		return false;
+	t.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+	t.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+	t.c_ispeed = baud;
+	t.c_ospeed = baud;
+	return ioctl(fd, TCSETS2, &t) == 0;
+}
\ No newline at end of file
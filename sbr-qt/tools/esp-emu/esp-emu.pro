@@ -0,0 +1,8 @@
+TEMPLATE = app
+TARGET = sbr-esp-emu
+CONFIG += c++11 console
+CONFIG -= app_bundle qt
+
+SOURCES += \
+        main.cpp \
+        baud.cpp
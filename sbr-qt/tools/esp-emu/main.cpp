@@ -0,0 +1,579 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file main.cpp
+* \brief ESP32 AT firmware emulator: answers the AT commands used by ESP_AT on a pty (or serial port) and bridges data to UDP
+* \copyright GNU GPLv3
+**/
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#define _MAX_SEND_LEN 2048 //AT+CIPSEND length limit of the ESP32 AT firmware
+#define _MAX_LINE_LEN 256 //longer command lines are rejected
+
+bool setBaudRate(int fd, int baud);
+
+typedef struct
+{
+    const char *device; //serial port instead of a pty
+    const char *link; //symlink to the pty slave
+    const char *bindIp; //local address of the emulated ESP32
+    const char *remoteIp; //replaces the AT+CIPSTART address, NULL to keep it
+    int baud; //UART speed, used for pacing data sent to the firmware
+    bool ipdCrlf; //CR-LF after +IPD data
+    uint32_t latency; //one-way WiFi latency in microseconds
+    uint32_t jitter; //uniform latency jitter in microseconds
+    uint32_t promptDelay; //time from AT+CIPSEND to the prompt, earlier data is discarded (ESP32 "busy")
+    float dropByte; //probability of losing a single UART byte (both directions)
+    float loss; //probability of losing a datagram (both directions)
+    float reorder; //probability of delaying a datagram by reorderDelay, so that the following datagrams overtake it
+    uint32_t reorderDelay; //in microseconds
+    uint32_t statsInterval; //in seconds, 0 to disable
+} Options_t;
+
+typedef struct
+{
+    uint64_t created; //time the data entered the emulator
+    bool toUart; //inbound datagram (true) or outbound datagram (false)
+    std::vector<uint8_t> data;
+} Event_t;
+
+typedef struct
+{
+    uint64_t datagramsOut, bytesOut; //UART -> UDP
+    uint64_t datagramsIn, bytesIn; //UDP -> UART
+    uint64_t droppedBytes, lostDatagrams, reordered, busy, errors, overruns;
+    uint64_t sendLatency; //sum of AT+CIPSEND to datagram times in microseconds
+} Stats_t;
+
+typedef enum
+{
+    command, //AT command lines
+    prompt, //AT+CIPSEND received, prompt not sent yet
+    payload, //receiving AT+CIPSEND data
+} UartState_t;
+
+static Options_t options;
+static Stats_t stats, lastStats;
+static std::mt19937 rng(1);
+static std::uniform_real_distribution<float> uni(0.f, 1.f);
+static std::multimap<uint64_t, Event_t> events; //delayed datagrams by due time
+static volatile bool running = true;
+
+static int uart = -1, uartSlave = -1, sock = -1;
+static UartState_t state = command;
+static std::string line;
+static std::vector<uint8_t> sendData;
+static uint16_t sendLen = 0;
+static uint64_t promptTime = 0, sendStart = 0, uartFreeAt = 0;
+static bool echo = true, dinfo = false, connected = false;
+static struct sockaddr_in remote;
+
+static uint64_t now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000ULL + t.tv_nsec / 1000;
+}
+
+static void onSignal(int)
+{
+    running = false;
+}
+
+static void usage(void)
+{
+    printf("Usage: sbr-esp-emu [options]\n");
+    printf("  -d device          use a serial port (e.g. Arduino USB) instead of creating a pty\n");
+    printf("  -l path            symlink to the created pty (e.g. /tmp/ttyESP)\n");
+    printf("  -B baud            UART baud rate (default 250000, as in the firmware)\n");
+    printf("  -a ip              local address of the emulated ESP32 (default 127.0.0.1)\n");
+    printf("  -r ip|keep         remote address instead of the AT+CIPSTART one (default 127.0.0.1)\n");
+    printf("  --latency ms[:jitter_ms]   one-way WiFi latency\n");
+    printf("  --prompt-delay ms  AT+CIPSEND prompt delay, data sent before the prompt is discarded (default 0)\n");
+    printf("  --drop-byte p      UART byte loss probability (both directions)\n");
+    printf("  --loss p           datagram loss probability (both directions)\n");
+    printf("  --reorder p[:ms]   probability of delaying a datagram by ms (default 20), so that the next ones overtake it\n");
+    printf("  --no-ipd-crlf      don't terminate +IPD data with CR-LF\n");
+    printf("  --seed n           fault random seed (default 1)\n");
+    printf("  -s seconds         statistics interval (default 5, 0 to disable)\n");
+}
+
+//writes to the firmware, applying byte loss
+static void uartWrite(const uint8_t *data, size_t len)
+{
+    uint8_t buf[_MAX_SEND_LEN + 64];
+    size_t n = 0;
+    for(size_t i = 0; (i < len) && (n < sizeof(buf)); i++)
+    {
+        if((options.dropByte > 0.f) && (uni(rng) < options.dropByte))
+            stats.droppedBytes++;
+        else
+            buf[n++] = data[i];
+    }
+    if((n > 0) && (write(uart, buf, n) != (ssize_t)n)) //nobody reads the pty or the UART can't keep up
+        stats.overruns++;
+}
+
+static void uartPrint(const char *s)
+{
+    uartWrite((const uint8_t*)s, strlen(s));
+}
+
+//schedules a datagram with latency, loss and reordering
+static void schedule(bool toUart, const uint8_t *data, size_t len, uint64_t created)
+{
+    if((options.loss > 0.f) && (uni(rng) < options.loss))
+    {
+        stats.lostDatagrams++;
+        return;
+    }
+    uint64_t due = now() + options.latency;
+    if(options.jitter > 0)
+        due += (uint64_t)(uni(rng) * options.jitter);
+    if((options.reorder > 0.f) && (uni(rng) < options.reorder))
+    {
+        due += options.reorderDelay;
+        stats.reordered++;
+    }
+    Event_t e;
+    e.created = created;
+    e.toUart = toUart;
+    e.data.assign(data, data + len);
+    events.insert(std::make_pair(due, e));
+}
+
+static void deliver(const Event_t &e)
+{
+    if(!e.toUart)
+    {
+        if(!connected)
+            return;
+        sendto(sock, e.data.data(), e.data.size(), 0, (struct sockaddr*)&remote, sizeof(remote));
+        stats.datagramsOut++;
+        stats.bytesOut += e.data.size();
+        stats.sendLatency += now() - e.created;
+        return;
+    }
+    char header[64];
+    if(dinfo)
+        snprintf(header, sizeof(header), "\r\n+IPD,%zu,%s,%u:", e.data.size(), inet_ntoa(remote.sin_addr), ntohs(remote.sin_port));
+    else
+        snprintf(header, sizeof(header), "\r\n+IPD,%zu:", e.data.size());
+    uartPrint(header);
+    uartWrite(e.data.data(), e.data.size());
+    if(options.ipdCrlf)
+        uartPrint("\r\n");
+    stats.datagramsIn++;
+    stats.bytesIn += e.data.size();
+}
+
+//AT+CIPSTART="UDP","ip",port[,localPort[,mode]]
+static bool startUdp(const char *args)
+{
+    char type[8], ip[64];
+    int port = 0, localPort = 0;
+    int n = sscanf(args, "\"%7[^\"]\",\"%63[^\"]\",%d,%d", type, ip, &port, &localPort);
+    if((n < 3) || strcmp(type, "UDP")) //TCP and SSL are not used by the firmware
+        return false;
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if(sock < 0)
+        return false;
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons((n == 4) ? localPort : 0);
+    inet_pton(AF_INET, options.bindIp, &local.sin_addr);
+    int on = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    if(bind(sock, (struct sockaddr*)&local, sizeof(local)) < 0)
+    {
+        fprintf(stderr, "Can't bind %s:%d: %s\n", options.bindIp, localPort, strerror(errno));
+        close(sock);
+        sock = -1;
+        return false;
+    }
+    memset(&remote, 0, sizeof(remote));
+    remote.sin_family = AF_INET;
+    remote.sin_port = htons(port);
+    inet_pton(AF_INET, (options.remoteIp != NULL) ? options.remoteIp : ip, &remote.sin_addr);
+    fprintf(stderr, "UDP %s:%d <-> %s:%d\n", options.bindIp, (n == 4) ? localPort : 0, inet_ntoa(remote.sin_addr), port);
+    connected = true;
+    return true;
+}
+
+static void closeUdp(void)
+{
+    if(sock >= 0)
+        close(sock);
+    sock = -1;
+    connected = false;
+}
+
+//handles a complete command line
+static void atCommand(const std::string &cmd)
+{
+    const char *c = cmd.c_str();
+    if(cmd.empty()) //CR-LF after AT+CIPSEND data
+        return;
+    if(echo)
+    {
+        uartPrint(c);
+        uartPrint("\r\n");
+    }
+    if(!strcmp(c, "AT") || !strncmp(c, "AT+CWMODE=", 10) || !strcmp(c, "AT+CIPMUX=0") || !strncmp(c, "AT+CWDHCP=", 10)
+        || !strncmp(c, "AT+CWSAP=", 9))
+    {
+        uartPrint("\r\nOK\r\n");
+    }
+    else if(!strcmp(c, "ATE0") || !strcmp(c, "ATE1"))
+    {
+        echo = (c[3] == '1');
+        uartPrint("\r\nOK\r\n");
+    }
+    else if(!strncmp(c, "AT+CIPDINFO=", 12))
+    {
+        dinfo = (c[12] == '1');
+        uartPrint("\r\nOK\r\n");
+    }
+    else if(!strcmp(c, "AT+RST"))
+    {
+        closeUdp();
+        echo = true;
+        dinfo = false;
+        uartPrint("\r\nOK\r\n\r\nready\r\n");
+    }
+    else if(!strcmp(c, "AT+GMR"))
+    {
+        uartPrint("AT version:2.2.0.0(sbr-esp-emu)\r\n\r\nOK\r\n");
+    }
+    else if(!strcmp(c, "AT+CIPCLOSE"))
+    {
+        if(connected)
+        {
+            closeUdp();
+            uartPrint("CLOSED\r\n\r\nOK\r\n");
+        }
+        else
+            uartPrint("\r\nERROR\r\n");
+    }
+    else if(!strncmp(c, "AT+CIPSTART=", 12))
+    {
+        if(connected)
+            uartPrint("ALREADY CONNECTED\r\n\r\nERROR\r\n");
+        else if(startUdp(c + 12))
+            uartPrint("CONNECT\r\n\r\nOK\r\n");
+        else
+        {
+            stats.errors++;
+            uartPrint("\r\nERROR\r\n");
+        }
+    }
+    else if(!strncmp(c, "AT+CIPSEND=", 11))
+    {
+        int len = atoi(c + 11);
+        if(!connected || (len <= 0) || (len > _MAX_SEND_LEN))
+        {
+            stats.errors++;
+            uartPrint("\r\nERROR\r\n");
+            return;
+        }
+        sendLen = len;
+        sendData.clear();
+        sendStart = now();
+        promptTime = sendStart + options.promptDelay;
+        state = prompt;
+    }
+    else
+    {
+        stats.errors++;
+        std::string printable(cmd); //garbage from lost bytes or data sent before the prompt
+        for(size_t i = 0; i < printable.size(); i++)
+            if((printable[i] < 0x20) || (printable[i] > 0x7E))
+                printable[i] = '.';
+        fprintf(stderr, "Unsupported command: %s\n", printable.c_str());
+        uartPrint("\r\nERROR\r\n");
+    }
+}
+
+//handles bytes received from the firmware
+static void uartReceive(const uint8_t *data, size_t len)
+{
+    for(size_t i = 0; i < len; i++)
+    {
+        if((options.dropByte > 0.f) && (uni(rng) < options.dropByte))
+        {
+            stats.droppedBytes++;
+            continue;
+        }
+        uint8_t b = data[i];
+        if(state == prompt) //the prompt has not been sent yet, real ESP32 answers "busy p..." and ignores the data
+        {
+            stats.busy++;
+            uartPrint("busy p...\r\n");
+            continue;
+        }
+        if(state == payload)
+        {
+            sendData.push_back(b);
+            if(sendData.size() == sendLen)
+            {
+                char resp[48];
+                snprintf(resp, sizeof(resp), "\r\nRecv %u bytes\r\n\r\nSEND OK\r\n", sendLen);
+                uartPrint(resp);
+                schedule(false, sendData.data(), sendData.size(), sendStart);
+                state = command;
+            }
+            continue;
+        }
+        if(b == '\n')
+        {
+            if(!line.empty() && (line[line.size() - 1] == '\r'))
+                line.erase(line.size() - 1);
+            atCommand(line);
+            line.clear();
+        }
+        else if(line.size() < _MAX_LINE_LEN)
+            line += (char)b;
+    }
+}
+
+static void printStats(double seconds)
+{
+    Stats_t d;
+    d.datagramsOut = stats.datagramsOut - lastStats.datagramsOut;
+    d.bytesOut = stats.bytesOut - lastStats.bytesOut;
+    d.datagramsIn = stats.datagramsIn - lastStats.datagramsIn;
+    d.bytesIn = stats.bytesIn - lastStats.bytesIn;
+    d.sendLatency = stats.sendLatency - lastStats.sendLatency;
+    fprintf(stderr, "out %.1f dgram/s %.2f kB/s (AT+CIPSEND to UDP %.2f ms), in %.1f dgram/s %.2f kB/s | "
+            "dropped bytes %llu, lost %llu, reordered %llu, busy %llu, errors %llu, overruns %llu\n",
+            d.datagramsOut / seconds, d.bytesOut / seconds / 1e3, d.datagramsOut ? d.sendLatency / 1e3 / d.datagramsOut : 0.,
+            d.datagramsIn / seconds, d.bytesIn / seconds / 1e3, (unsigned long long)stats.droppedBytes,
+            (unsigned long long)stats.lostDatagrams, (unsigned long long)stats.reordered, (unsigned long long)stats.busy,
+            (unsigned long long)stats.errors, (unsigned long long)stats.overruns);
+    lastStats = stats;
+}
+
+static bool openUart(void)
+{
+    if(options.device != NULL)
+    {
+        uart = open(options.device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if(uart < 0)
+        {
+            fprintf(stderr, "Can't open %s: %s\n", options.device, strerror(errno));
+            return false;
+        }
+    }
+    else
+    {
+        uart = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if((uart < 0) || (grantpt(uart) < 0) || (unlockpt(uart) < 0))
+        {
+            fprintf(stderr, "Can't create a pty: %s\n", strerror(errno));
+            return false;
+        }
+        //keeping the slave open avoids EIO on the master while the firmware side is not connected
+        uartSlave = open(ptsname(uart), O_RDWR | O_NOCTTY);
+    }
+    struct termios t;
+    int fd = (uartSlave >= 0) ? uartSlave : uart;
+    if(tcgetattr(fd, &t) == 0)
+    {
+        cfmakeraw(&t);
+        tcsetattr(fd, TCSANOW, &t);
+    }
+    if((options.device != NULL) && !setBaudRate(uart, options.baud))
+        fprintf(stderr, "Can't set %d baud, set it with stty\n", options.baud);
+    if(options.device == NULL)
+    {
+        printf("%s\n", ptsname(uart));
+        fflush(stdout);
+        if(options.link != NULL)
+        {
+            unlink(options.link);
+            if(symlink(ptsname(uart), options.link) < 0)
+                fprintf(stderr, "Can't create %s: %s\n", options.link, strerror(errno));
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    options.device = NULL;
+    options.link = NULL;
+    options.bindIp = "127.0.0.1";
+    options.remoteIp = "127.0.0.1";
+    options.baud = 250000;
+    options.ipdCrlf = true;
+    options.latency = 0;
+    options.jitter = 0;
+    options.promptDelay = 0;
+    options.dropByte = 0.f;
+    options.loss = 0.f;
+    options.reorder = 0.f;
+    options.reorderDelay = 20000;
+    options.statsInterval = 5;
+
+    for(int i = 1; i < argc; i++)
+    {
+        bool hasValue = (i + 1 < argc);
+        if(!strcmp(argv[i], "-d") && hasValue)
+            options.device = argv[++i];
+        else if(!strcmp(argv[i], "-l") && hasValue)
+            options.link = argv[++i];
+        else if(!strcmp(argv[i], "-B") && hasValue)
+            options.baud = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-a") && hasValue)
+            options.bindIp = argv[++i];
+        else if(!strcmp(argv[i], "-r") && hasValue)
+        {
+            i++;
+            options.remoteIp = strcmp(argv[i], "keep") ? argv[i] : NULL;
+        }
+        else if(!strcmp(argv[i], "--latency") && hasValue)
+        {
+            float l = 0.f, j = 0.f;
+            sscanf(argv[++i], "%f:%f", &l, &j);
+            options.latency = l * 1000.f;
+            options.jitter = j * 1000.f;
+        }
+        else if(!strcmp(argv[i], "--prompt-delay") && hasValue)
+            options.promptDelay = atof(argv[++i]) * 1000.f;
+        else if(!strcmp(argv[i], "--drop-byte") && hasValue)
+            options.dropByte = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--loss") && hasValue)
+            options.loss = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--reorder") && hasValue)
+        {
+            float d = options.reorderDelay / 1000.f;
+            sscanf(argv[++i], "%f:%f", &options.reorder, &d);
+            options.reorderDelay = d * 1000.f;
+        }
+        else if(!strcmp(argv[i], "--no-ipd-crlf"))
+            options.ipdCrlf = false;
+        else if(!strcmp(argv[i], "--seed") && hasValue)
+            rng.seed(atoi(argv[++i]));
+        else if(!strcmp(argv[i], "-s") && hasValue)
+            options.statsInterval = atoi(argv[++i]);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if(options.baud <= 0)
+        options.baud = 250000;
+
+    if(!openUart())
+        return 1;
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    memset(&stats, 0, sizeof(stats));
+    lastStats = stats;
+    uint64_t start = now(), nextStats = start + options.statsInterval * 1000000ULL;
+    const uint64_t byteTime = 10000000ULL / options.baud; //10 bits per UART byte, in 1/10 us
+
+    while(running)
+    {
+        uint64_t t = now();
+        //due datagrams, inbound ones paced at the UART speed
+        while(!events.empty() && (events.begin()->first <= t))
+        {
+            Event_t e = events.begin()->second;
+            events.erase(events.begin());
+            if(e.toUart)
+            {
+                if(uartFreeAt > t) //UART still busy with the previous datagram
+                {
+                    events.insert(std::make_pair(uartFreeAt, e));
+                    continue;
+                }
+                uartFreeAt = t + (e.data.size() + 16) * byteTime / 10; //+IPD header and CR-LF
+            }
+            deliver(e);
+        }
+        if((state == prompt) && (t >= promptTime))
+        {
+            uartPrint("\r\nOK\r\n\r\n> ");
+            state = payload;
+        }
+        if((options.statsInterval > 0) && (t >= nextStats))
+        {
+            printStats(options.statsInterval);
+            nextStats = t + options.statsInterval * 1000000ULL;
+        }
+
+        int timeout = 100;
+        if(!events.empty())
+            timeout = (events.begin()->first > t) ? (events.begin()->first - t + 999) / 1000 : 0;
+        if((state == prompt) && ((int64_t)(promptTime - t) / 1000 < timeout))
+            timeout = (promptTime > t) ? (promptTime - t + 999) / 1000 : 0;
+
+        struct pollfd fds[2];
+        fds[0].fd = uart;
+        fds[0].events = POLLIN;
+        fds[1].fd = sock;
+        fds[1].events = POLLIN;
+        if(poll(fds, (sock >= 0) ? 2 : 1, timeout) <= 0)
+            continue;
+        if(fds[0].revents & POLLIN)
+        {
+            uint8_t buf[512];
+            ssize_t n = read(uart, buf, sizeof(buf));
+            if(n > 0)
+                uartReceive(buf, n);
+        }
+        if((sock >= 0) && (fds[1].revents & POLLIN))
+        {
+            uint8_t buf[_MAX_SEND_LEN];
+            ssize_t n = recv(sock, buf, sizeof(buf), 0);
+            if(n > 0)
+                schedule(true, buf, n, now());
+        }
+    }
+    if(options.statsInterval > 0)
+    {
+        lastStats = Stats_t();
+        fprintf(stderr, "Mean: ");
+        printStats((now() - start) * 1e-6);
+    }
+    if(options.link != NULL)
+        unlink(options.link);
+    closeUdp();
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,257 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file main.cpp
+* \brief Live plot benchmark: fills a PlotBuffer with hours of samples, measures the frame time at every zoom level offscreen, then plots a live stream at 1 kHz on the frame clock and checks that no sample is delayed or dropped
+* \copyright GNU GPLv3
+**/
+
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QPainter>
+#include <QTimer>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "PlotBuffer.h"
+#include "PlotView.h"
+#include "SessionLog.h"
+
+#define _CHANNELS 8 //acc X, Y, Z, gyro X, Y, Z, motor A, B
+#define _FRAMES 20 //offscreen frames per measured view
+#define _SAMPLE_TICK_MS 1 //live samples are generated in this period, as many as are due
+
+typedef struct
+{
+    float hours; //history filled before the measurements
+    uint32_t rate; //samples per second
+    int width, height;
+    float live; //live plotting time in seconds
+    uint16_t fps;
+    const char *recording; //session log replayed instead of synthetic samples, NULL if not given
+    const char *image; //last live frame
+} Options_t;
+
+static Options_t options;
+static std::vector<SessionRecord_t> records;
+
+static void usage(void)
+{
+    printf("Usage: sbr-plot-bench [options]\n");
+    printf("  -H hours           history filled before the measurements (default 3)\n");
+    printf("  -r rate            samples per second (default 1000)\n");
+    printf("  -w width -g height image size (default 1920 x 900)\n");
+    printf("  -t seconds         live plotting time (default 5)\n");
+    printf("  -p fps             frame clock (default 30)\n");
+    printf("  -f session.csv     replay a session log (tools/sysid) instead of synthetic samples\n");
+    printf("  -o image.png       last live frame (default plot.png)\n");
+    printf("Runs offscreen unless another platform is given with -platform or QT_QPA_PLATFORM.\n");
+}
+
+//sample n: a recorded one, or a robot swaying around upright with sensor noise, motor commands against the tilt and a push every 10 minutes
+static void sample(uint64_t n, float *v)
+{
+    if(!records.empty())
+    {
+        const SessionRecord_t &r = records[n % records.size()];
+        memcpy(v, r.value, sizeof(r.value));
+        v[6] = r.motorA;
+        v[7] = r.motorB;
+        return;
+    }
+    static uint32_t noise = 2463534242u;
+    float e[4];
+    for(int i = 0; i < 4; i++)
+    {
+        noise ^= noise << 13;
+        noise ^= noise >> 17;
+        noise ^= noise << 5;
+        e[i] = (noise & 0xFFFF) / 65536.f - 0.5f;
+    }
+    double t = (double)n / options.rate;
+    double w1 = 2. * M_PI * 0.7, w2 = 2. * M_PI * 3.1;
+    double push = fmod(t, 600.);
+    float tilt = 0.05f * sin(w1 * t) + 0.02f * sin(w2 * t) + ((push < 0.2) ? 0.3f * sin(M_PI * push / 0.2) : 0.f);
+    float rate = 0.05f * w1 * cos(w1 * t) + 0.02f * w2 * cos(w2 * t);
+    v[0] = 9.81f * sinf(tilt) + 0.3f * e[0];
+    v[1] = 0.3f * e[1];
+    v[2] = 9.81f * cosf(tilt) + 0.3f * e[2];
+    v[3] = rate + 0.02f * e[3];
+    v[4] = 0.02f * e[0];
+    v[5] = 0.02f * e[1];
+    float command = fmaxf(-255.f, fminf(255.f, -1500.f * tilt - 100.f * rate));
+    v[6] = roundf(command);
+    v[7] = roundf(command);
+}
+
+static void addPanels(PlotView *view)
+{
+    view->addPanel("Acceleration [m/s^2]", QStringList() << "X" << "Y" << "Z", 0);
+    view->addPanel("Angular rate [rad/s]", QStringList() << "X" << "Y" << "Z", 3);
+    view->addPanel("Motor commands", QStringList() << "A" << "B", 6);
+}
+
+int main(int argc, char *argv[])
+{
+    options.hours = 3.f;
+    options.rate = 1000;
+    options.width = 1920;
+    options.height = 900;
+    options.live = 5.f;
+    options.fps = 30;
+    options.recording = NULL;
+    options.image = "plot.png";
+
+    if(!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv); //removes the Qt options from argc and argv
+    for(int i = 1; i < argc; i++)
+    {
+        bool hasValue = (i + 1 < argc);
+        if(!strcmp(argv[i], "-H") && hasValue)
+            options.hours = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-r") && hasValue)
+            options.rate = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-w") && hasValue)
+            options.width = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-g") && hasValue)
+            options.height = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-t") && hasValue)
+            options.live = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-p") && hasValue)
+            options.fps = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-f") && hasValue)
+            options.recording = argv[++i];
+        else if(!strcmp(argv[i], "-o") && hasValue)
+            options.image = argv[++i];
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if((options.rate == 0) || (options.width < 100) || (options.height < 100) || (options.fps == 0))
+    {
+        usage();
+        return 1;
+    }
+    if((options.recording != NULL) && (!SessionLog::read(options.recording, records) || records.empty()))
+    {
+        printf("Can't read %s\n", options.recording);
+        return 1;
+    }
+
+    //history
+    PlotBuffer buffer(PlotBuffer::defaultConfig(_CHANNELS));
+    uint64_t history = (uint64_t)(options.hours * 3600. * options.rate);
+    float v[_CHANNELS];
+    QElapsedTimer timer;
+    qint64 spent = 0;
+    for(uint64_t n = 0; n < history; n++)
+    {
+        sample(n, v);
+        timer.start();
+        buffer.append(v);
+        spent += timer.nsecsElapsed();
+    }
+    printf("History: %llu samples (%.1f h at %u Hz), append %.1f ns/sample, %.0f MiB\n", (unsigned long long)history, options.hours,
+           options.rate, history ? (double)spent / history : 0., (double)buffer.getConfig().capacity * _CHANNELS * 4 *
+           (2 * buffer.getConfig().levels - 1) / (1 << 20));
+
+    //offscreen frames at every zoom, at the newest and the oldest samples
+    uint32_t interval = 1000000 / options.rate;
+    {
+        PlotView view(&buffer, PlotView::defaultConfig(interval));
+        addPanels(&view);
+        QImage image(options.width, options.height, QImage::Format_RGB32);
+        QPainter painter(&image);
+        float whole = (buffer.getCount() - buffer.getOldest()) / (float)options.rate;
+        float spans[] = {1.f, 60.f, 3600.f, whole};
+        printf("Frame time, %d x %d, %d channels:\n", options.width, options.height, _CHANNELS);
+        for(float span : spans)
+        {
+            if(span > whole)
+                continue;
+            for(int oldest = 0; oldest < 2; oldest++)
+            {
+                view.setSpan(span);
+                if(oldest)
+                    view.setEnd(buffer.getOldest() + (uint64_t)(span * options.rate));
+                else
+                    view.setFollow(true);
+                uint64_t total = 0;
+                for(int f = 0; f < _FRAMES; f++)
+                {
+                    view.paint(&painter, image.rect());
+                    total += view.getStats().lastUs;
+                }
+                printf("  %9.1f s visible at the %s samples: level %u, %.2f ms/frame\n", span, oldest ? "oldest" : "newest",
+                       view.getStats().level, total / 1000. / _FRAMES);
+            }
+        }
+    }
+
+    //live: samples arrive at the rate while the frame clock repaints the shown widget
+    PlotView view(&buffer, PlotView::defaultConfig(interval));
+    addPanels(&view);
+    view.resize(options.width, options.height);
+    view.show();
+    QTimer sampleTimer;
+    sampleTimer.setTimerType(Qt::PreciseTimer);
+    QElapsedTimer clock;
+    uint64_t delivered = 0;
+    double maxLate = 0.; //delay of a sample after it was due, in seconds
+    QObject::connect(&sampleTimer, &QTimer::timeout, [&]()
+    {
+        double now = clock.nsecsElapsed() * 1e-9;
+        uint64_t due = (uint64_t)(now * options.rate);
+        if(due > delivered)
+        {
+            double late = now - (double)(delivered + 1) / options.rate;
+            if(late > maxLate)
+                maxLate = late;
+        }
+        for(; delivered < due; delivered++)
+        {
+            sample(history + delivered, v);
+            buffer.append(v);
+        }
+    });
+    clock.start();
+    sampleTimer.start(_SAMPLE_TICK_MS);
+    QTimer::singleShot((int)(options.live * 1000), &app, &QApplication::quit);
+    app.exec();
+    double seconds = clock.nsecsElapsed() * 1e-9;
+    const PlotViewStats_t &s = view.getStats();
+    uint64_t expected = (uint64_t)(seconds * options.rate);
+    printf("Live: %llu of %llu samples (%llu behind at the end), sample delay max %.1f ms, %llu frames (%.1f/s), frame mean %.2f ms, max %.2f ms\n",
+           (unsigned long long)delivered, (unsigned long long)expected, (unsigned long long)(expected - delivered), maxLate * 1e3,
+           (unsigned long long)s.frames, s.frames / seconds, s.frames ? s.totalUs / 1000. / s.frames : 0., s.maxUs / 1000.);
+
+    QImage image(options.width, options.height, QImage::Format_RGB32);
+    QPainter painter(&image);
+    view.paint(&painter, image.rect());
+    painter.end();
+    if(!image.save(options.image))
+        printf("Can't write %s\n", options.image);
+    return 0;
+}
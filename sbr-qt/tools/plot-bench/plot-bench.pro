@@ -0,0 +1,17 @@
+TEMPLATE = app
+TARGET = sbr-plot-bench
+CONFIG += c++11 console
+CONFIG -= app_bundle
+QT += widgets
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+        main.cpp \
+        ../../PlotBuffer.cpp \
+        ../../PlotView.cpp \
+        ../../SessionLog.cpp
+HEADERS += \
+        ../../PlotBuffer.h \
+        ../../PlotView.h \
+        ../../SessionLog.h
@@ -0,0 +1,275 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file main.cpp
+* \brief Replay buffer benchmark: insert, sync, sample and priority update cost, concurrent producers with a learner, torn-read check and sampling distribution
+* \copyright GNU GPLv3
+**/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "ReplayBuffer.h"
+
+#define _OBSERVATION_SIZE 14 //six DATA_MPU channels and 8 features
+#define _CHECK_SLOTS 64 //transitions of the sampling distribution check
+#define _CHECK_DRAWS 2000000
+
+typedef struct
+{
+    uint32_t capacity;
+    uint16_t batch;
+    int producers;
+    uint32_t rate; //transitions per second of every producer, 0 - as fast as possible
+    float duration; //concurrent phase in seconds
+} Options_t;
+
+static Options_t options;
+static std::atomic<bool> running;
+
+static void usage(void)
+{
+    printf("Usage: sbr-replay-bench [options]\n");
+    printf("  -c capacity        transitions (default 1048576)\n");
+    printf("  -b size            batch size (default 256)\n");
+    printf("  -p n               producer threads of the concurrent phase (default 2)\n");
+    printf("  -r rate            transitions per second of every producer, 0 as fast as possible (default 1000, a robot at 1 kHz)\n");
+    printf("  -t seconds         concurrent phase duration (default 3)\n");
+}
+
+static inline double seconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+//transition n carries its number, so a batch item mixing two transitions is detected
+static void transition(uint64_t n, float *observation, float *action, float *reward, float *nextObservation)
+{
+    float id = (float)(n & 0xFFFFFF);
+    for(int i = 0; i < _OBSERVATION_SIZE; i++)
+    {
+        observation[i] = id + i;
+        nextObservation[i] = id + i + 1;
+    }
+    action[0] = id;
+    action[1] = -id;
+    *reward = id;
+}
+
+static uint64_t inconsistent(const ReplayBatch_t *b)
+{
+    uint64_t errors = 0;
+    for(uint32_t k = 0; k < b->size; k++)
+    {
+        const float *o = &b->observation[k * _OBSERVATION_SIZE];
+        const float *next = &b->nextObservation[k * _OBSERVATION_SIZE];
+        float id = o[0];
+        bool ok = (b->reward[k] == id) && (b->action[2 * k] == id) && (b->action[2 * k + 1] == -id) && (next[_OBSERVATION_SIZE - 1] == id + _OBSERVATION_SIZE)
+                  && (o[_OBSERVATION_SIZE - 1] == id + _OBSERVATION_SIZE - 1);
+        if(!ok)
+            errors++;
+    }
+    return errors;
+}
+
+static void producer(ReplayBuffer *buffer, uint64_t *inserted)
+{
+    float o[_OBSERVATION_SIZE], a[REPLAY_ACTIONS], r, next[_OBSERVATION_SIZE];
+    uint64_t n = 0;
+    auto start = std::chrono::steady_clock::now();
+    while(running.load(std::memory_order_relaxed))
+    {
+        if((options.rate > 0) && (n >= seconds(start) * options.rate))
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            continue;
+        }
+        //the insert number is known only after insert(), so the number is set by the previous one; the check only needs consistency
+        transition(buffer->getInserted(), o, a, &r, next);
+        buffer->insert(o, a, r, next, (n & 1023) == 0);
+        n++;
+    }
+    *inserted = n;
+}
+
+int main(int argc, char *argv[])
+{
+    options.capacity = 1 << 20;
+    options.batch = 256;
+    options.producers = 2;
+    options.rate = 1000;
+    options.duration = 3.f;
+
+    for(int i = 1; i < argc; i++)
+    {
+        bool hasValue = (i + 1 < argc);
+        if(!strcmp(argv[i], "-c") && hasValue)
+            options.capacity = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-b") && hasValue)
+            options.batch = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-p") && hasValue)
+            options.producers = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-r") && hasValue)
+            options.rate = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-t") && hasValue)
+            options.duration = atof(argv[++i]);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if((options.capacity == 0) || (options.batch == 0) || (options.producers < 1) || (options.duration <= 0.f))
+    {
+        usage();
+        return 1;
+    }
+
+    ReplayConfig_t c = ReplayBuffer::defaultConfig(_OBSERVATION_SIZE);
+    c.capacity = options.capacity;
+    if(c.maxBatch < options.batch)
+        c.maxBatch = options.batch;
+    ReplayBuffer buffer(c);
+    uint32_t capacity = buffer.getConfig().capacity;
+    printf("Capacity %u transitions, observation %d values, %.0f MiB\n", capacity, _OBSERVATION_SIZE,
+           capacity * ((2. * _OBSERVATION_SIZE + REPLAY_ACTIONS + 1) * 4 + 1 + 8 + 4) / (1 << 20));
+
+    //single thread
+    float o[_OBSERVATION_SIZE], a[REPLAY_ACTIONS], r, next[_OBSERVATION_SIZE];
+    auto start = std::chrono::steady_clock::now();
+    for(uint32_t n = 0; n < capacity; n++)
+    {
+        transition(n, o, a, &r, next);
+        buffer.insert(o, a, r, next, false);
+    }
+    double insertNs = seconds(start) * 1e9 / capacity;
+    start = std::chrono::steady_clock::now();
+    uint32_t added = buffer.sync();
+    double syncNs = seconds(start) * 1e9 / added;
+    printf("Insert %.1f ns/transition (including the test data), sum tree update %.1f ns/transition\n", insertNs, syncNs);
+
+    std::vector<float> error(options.batch);
+    int rounds = 2000;
+    double sampleUs = 0., updateUs = 0.;
+    uint64_t errors = 0;
+    for(int i = 0; i < rounds; i++)
+    {
+        start = std::chrono::steady_clock::now();
+        const ReplayBatch_t *b = buffer.sample(options.batch, 0.4f);
+        sampleUs += seconds(start);
+        errors += inconsistent(b);
+        for(uint32_t k = 0; k < b->size; k++)
+            error[k] = fabsf(b->reward[k] - 0.5f * capacity) / capacity; //some TD error
+        start = std::chrono::steady_clock::now();
+        buffer.updatePriorities(b->index, b->sequence, error.data(), b->size);
+        updateUs += seconds(start);
+    }
+    printf("Batch of %u: sample %.2f us (%.1f ns/transition), priority update %.2f us, %llu inconsistent transitions\n", options.batch,
+           sampleUs * 1e6 / rounds, sampleUs * 1e9 / rounds / options.batch, updateUs * 1e6 / rounds, (unsigned long long)errors);
+
+    //producers overwrite the buffer while the learner samples from it
+    running = true;
+    std::vector<uint64_t> inserted(options.producers, 0);
+    std::vector<std::thread> threads;
+    for(int i = 0; i < options.producers; i++)
+        threads.emplace_back(producer, &buffer, &inserted[i]);
+    uint64_t batches = 0, transitions = 0, short_ = 0;
+    errors = 0;
+    double syncUs = 0., learnerUs = 0., maxUs = 0.;
+    start = std::chrono::steady_clock::now();
+    while(seconds(start) < options.duration)
+    {
+        auto t = std::chrono::steady_clock::now();
+        buffer.sync();
+        syncUs += seconds(t) * 1e6;
+        t = std::chrono::steady_clock::now();
+        const ReplayBatch_t *b = buffer.sample(options.batch, 0.4f);
+        double us = seconds(t) * 1e6;
+        learnerUs += us;
+        if(us > maxUs)
+            maxUs = us;
+        if(b->size < options.batch)
+            short_++;
+        errors += inconsistent(b);
+        transitions += b->size;
+        for(uint32_t k = 0; k < b->size; k++)
+            error[k] = (float)(k % 7);
+        buffer.updatePriorities(b->index, b->sequence, error.data(), b->size);
+        batches++;
+    }
+    double elapsed = seconds(start);
+    running = false;
+    uint64_t total = 0;
+    for(int i = 0; i < options.producers; i++)
+    {
+        threads[i].join();
+        total += inserted[i];
+    }
+    printf("Concurrent, %d producers: %.0f inserts/s, learner %.0f batches/s, sync %.2f us, sample %.2f us mean, %.1f us max, "
+           "%llu short batches, %llu inconsistent transitions of %llu\n", options.producers, total / elapsed, batches / elapsed,
+           syncUs / batches, learnerUs / batches, maxUs, (unsigned long long)short_, (unsigned long long)errors,
+           (unsigned long long)transitions);
+
+    //sampling frequency against priority
+    ReplayConfig_t s = ReplayBuffer::defaultConfig(_OBSERVATION_SIZE);
+    s.capacity = _CHECK_SLOTS;
+    s.alpha = 1.f;
+    s.epsilon = 0.f;
+    ReplayBuffer small(s);
+    std::vector<uint32_t> index(_CHECK_SLOTS);
+    std::vector<uint64_t> sequence(_CHECK_SLOTS);
+    std::vector<float> priority(_CHECK_SLOTS);
+    double sum = 0.;
+    for(uint32_t n = 0; n < _CHECK_SLOTS; n++)
+    {
+        transition(n, o, a, &r, next);
+        sequence[n] = small.insert(o, a, r, next, false);
+        index[n] = n;
+        priority[n] = 1.f + (n % 8) * (n % 5); //1 to 29
+        sum += priority[n];
+    }
+    small.sync();
+    small.updatePriorities(index.data(), sequence.data(), priority.data(), _CHECK_SLOTS);
+    std::vector<uint64_t> hits(_CHECK_SLOTS, 0);
+    for(uint32_t d = 0; d < _CHECK_DRAWS; d += options.batch)
+    {
+        const ReplayBatch_t *b = small.sample(options.batch, 0.f);
+        for(uint32_t k = 0; k < b->size; k++)
+            hits[b->index[k]]++;
+    }
+    double worst = 0.;
+    uint64_t draws = 0;
+    for(uint32_t n = 0; n < _CHECK_SLOTS; n++)
+        draws += hits[n];
+    for(uint32_t n = 0; n < _CHECK_SLOTS; n++)
+    {
+        double expected = draws * priority[n] / sum;
+        double deviation = fabs(hits[n] - expected) / sqrt(expected); //in standard deviations (approximately)
+        if(deviation > worst)
+            worst = deviation;
+    }
+    printf("Sampling distribution: %llu draws over %d priorities from 1 to 29, largest deviation %.1f standard deviations\n",
+           (unsigned long long)draws, _CHECK_SLOTS, worst);
+    return (errors == 0) ? 0 : 1;
+}
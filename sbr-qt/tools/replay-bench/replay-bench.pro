@@ -0,0 +1,12 @@
+TEMPLATE = app
+TARGET = sbr-replay-bench
+CONFIG += c++17 console thread
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+        main.cpp \
+        ../../ReplayBuffer.cpp
+HEADERS += \
+        ../../ReplayBuffer.h
@@ -0,0 +1,98 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file replay.cpp
+* \brief C interface of ReplayBuffer for sbr-py/ReplayBuffer.py (ctypes): the batch arrays are read from Python as numpy views without copying
+* \copyright GNU GPLv3
+**/
+
+#include <stddef.h>
+#include "ReplayBuffer.h"
+
+#define _EXPORT extern "C" __attribute__((visibility("default")))
+
+_EXPORT ReplayBuffer *sbr_replay_create(uint32_t capacity, uint16_t observationSize, uint16_t maxBatch, float alpha, float epsilon,
+                                        uint64_t seed)
+{
+    ReplayConfig_t c = ReplayBuffer::defaultConfig(observationSize);
+    c.capacity = capacity;
+    c.maxBatch = maxBatch;
+    c.alpha = alpha;
+    c.epsilon = epsilon;
+    c.seed = seed;
+    return new ReplayBuffer(c);
+}
+
+_EXPORT void sbr_replay_destroy(ReplayBuffer *b)
+{
+    delete b;
+}
+
+_EXPORT uint32_t sbr_replay_capacity(const ReplayBuffer *b)
+{
+    return b->getConfig().capacity;
+}
+
+_EXPORT uint64_t sbr_replay_insert(ReplayBuffer *b, const float *observation, const float *action, float reward, const float *nextObservation,
+                                   int done)
+{
+    return b->insert(observation, action, reward, nextObservation, done != 0);
+}
+
+//count transitions, one row per transition in every array
+_EXPORT uint64_t sbr_replay_insert_many(ReplayBuffer *b, uint32_t count, const float *observation, const float *action, const float *reward,
+                                        const float *nextObservation, const uint8_t *done)
+{
+    uint16_t size = b->getConfig().observationSize;
+    uint64_t n = 0;
+    for(uint32_t i = 0; i < count; i++)
+        n = b->insert(&observation[(size_t)i * size], &action[(size_t)i * REPLAY_ACTIONS], reward[i], &nextObservation[(size_t)i * size],
+                      done[i] != 0);
+    return n;
+}
+
+_EXPORT uint32_t sbr_replay_sync(ReplayBuffer *b)
+{
+    return b->sync();
+}
+
+_EXPORT const ReplayBatch_t *sbr_replay_sample(ReplayBuffer *b, uint32_t size, float beta)
+{
+    return b->sample(size, beta);
+}
+
+_EXPORT void sbr_replay_update(ReplayBuffer *b, const uint32_t *index, const uint64_t *sequence, const float *error, uint32_t count)
+{
+    b->updatePriorities(index, sequence, error, count);
+}
+
+_EXPORT uint64_t sbr_replay_inserted(const ReplayBuffer *b)
+{
+    return b->getInserted();
+}
+
+_EXPORT uint32_t sbr_replay_size(const ReplayBuffer *b)
+{
+    return b->getSize();
+}
+
+_EXPORT float sbr_replay_total(const ReplayBuffer *b)
+{
+    return b->getTotalPriority();
+}
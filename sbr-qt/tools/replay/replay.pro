@@ -0,0 +1,13 @@
+TEMPLATE = lib
+TARGET = sbr-replay
+CONFIG += c++17 plugin
+CONFIG -= qt
+QMAKE_CXXFLAGS += -fvisibility=hidden
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+        replay.cpp \
+        ../../ReplayBuffer.cpp
+HEADERS += \
+        ../../ReplayBuffer.h
@@ -0,0 +1,426 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file main.cpp
+* \brief Controller tuning sweep: closed-loop episodes (simulation or replayed sessions) on a work-stealing thread pool
+* \copyright GNU GPLv3
+**/
+
+#include <BalanceController.h>
+#include <PlantSimulator.h>
+#include <SessionLog.h>
+#include <StatePredictor.h>
+#include <SystemIdentifier.h>
+#include <WorkStealingPool.h>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define _SETTLE_BAND 0.035f //tilt band (2 degrees) the robot has to stay in to be settled
+#define _MAX_LINK_DELAY 64 //maximum simulated link delay in samples (each direction)
+
+typedef struct
+{
+    float min;
+    float max;
+    int steps; //grid steps, 1 for a fixed value
+} Range_t;
+
+typedef struct
+{
+    float kp, ki, kd;
+    float settle; //mean settle time in seconds, episode duration if not settled
+    float maxTilt; //mean maximum tilt in radians
+    float effort; //mean RMS drive command
+    float saturation; //fraction of saturated commands
+    float agreement; //replay only: RMS difference to the recorded drive command
+    int falls; //episodes in which the robot fell over
+} Result_t;
+
+typedef struct
+{
+    float settle, maxTilt, effort, saturation, agreement;
+    bool fell;
+} Episode_t;
+
+//simulated WiFi/Bluetooth link
+typedef struct
+{
+    uint32_t up; //sensor to controller delay in samples
+    uint32_t down; //controller to motor delay in samples
+    bool predict; //latency compensation (StatePredictor with the simulated model)
+} Link_t;
+
+static void usage(void)
+{
+    printf("Usage: sbr-sweep [options]\n");
+    printf("  --kp min[:max[:steps]]  proportional gain range (motor command per radian)\n");
+    printf("  --ki min[:max[:steps]]  integral gain range\n");
+    printf("  --kd min[:max[:steps]]  derivative gain range (motor command per rad/s)\n");
+    printf("  -r count                random search with count configurations instead of the grid\n");
+    printf("  -m model.txt            plant model (sbr-sysid output), default example model\n");
+    printf("  -s session.csv          replay recorded sessions through the controller instead of simulating (repeatable)\n");
+    printf("  -e episodes             simulated episodes per configuration (default 4)\n");
+    printf("  -t seconds              simulated episode duration (default 10)\n");
+    printf("  -i interval_s           sample interval without a model (default 0.005)\n");
+    printf("  --delay up[:down]       simulated link delay in ms, sensor to controller and controller to motor (default 0)\n");
+    printf("  --predict               compensate the link delay by predicting the state at the actuation time\n");
+    printf("  -j threads              worker threads (default all cores)\n");
+    printf("  -n rows                 rows of the summary table (default 20)\n");
+    printf("  -o results.csv          all results (default sweep.csv)\n");
+}
+
+static bool parseRange(const char *s, Range_t *r)
+{
+    r->steps = 1;
+    int n = sscanf(s, "%f:%f:%d", &r->min, &r->max, &r->steps);
+    if(n < 1)
+        return false;
+    if(n == 1)
+        r->max = r->min;
+    else if(n == 2)
+        r->steps = 2;
+    if(r->steps < 1)
+        r->steps = 1;
+    return true;
+}
+
+static float gridValue(const Range_t &r, int i)
+{
+    return (r.steps > 1) ? r.min + (r.max - r.min) * i / (r.steps - 1) : r.min;
+}
+
+//settle time: the end of the last sample outside the band
+static void finishEpisode(Episode_t *e, float lastOutside, float duration, double effort2, uint32_t saturated, uint32_t n)
+{
+    e->settle = e->fell ? duration : lastOutside;
+    e->effort = (n > 0) ? sqrt(effort2 / n) : 0.f;
+    e->saturation = (n > 0) ? (float)saturated / n : 0.f;
+}
+
+//one simulated episode, ends early if the robot falls over
+//samples reach the controller link.up samples late and commands reach the motors link.down samples late
+static void simulate(BalanceController &ctrl, PlantSimulator &sim, StatePredictor &predictor, const Link_t &link, uint8_t gyroAxis,
+                     float tilt0, uint32_t seed, float duration, float dt, Episode_t *e)
+{
+    uint32_t steps = duration / dt, saturated = 0, n = 0;
+    double effort2 = 0.;
+    float lastOutside = 0.f, samples[_MAX_LINK_DELAY][6];
+    int16_t commands[_MAX_LINK_DELAY][2] = {};
+    memset(e, 0, sizeof(Episode_t));
+    ctrl.reset();
+    predictor.reset();
+    sim.reset(tilt0, 0.f, seed);
+    for(n = 0; n < steps; n++)
+    {
+        float tilt = fabsf(sim.getTilt());
+        if(tilt > e->maxTilt)
+            e->maxTilt = tilt;
+        if(tilt > _SETTLE_BAND)
+            lastOutside = (n + 1) * dt;
+        int16_t a, b;
+        sim.sense(samples[n % _MAX_LINK_DELAY]);
+        if(n == 0) //the robot stood still before the episode
+            for(uint32_t i = 1; i <= link.up; i++)
+                memcpy(samples[_MAX_LINK_DELAY - i], samples[0], sizeof(samples[0]));
+        const float *sample = samples[(n + _MAX_LINK_DELAY - link.up) % _MAX_LINK_DELAY];
+        float u;
+        if(link.predict)
+        {
+            float predictedTilt, predictedRate;
+            uint64_t now = (uint64_t)n * dt * 1e6f;
+            predictor.predict(ctrl.estimate(sample), sample[gyroAxis], now - (uint64_t)(link.up * dt * 1e6f), now,
+                              now + (uint64_t)(link.down * dt * 1e6f), &predictedTilt, &predictedRate);
+            u = ctrl.control(predictedTilt, predictedRate, &a, &b);
+            predictor.command(now + (uint64_t)(link.down * dt * 1e6f), a, b);
+        }
+        else
+            u = ctrl.update(sample, &a, &b);
+        effort2 += (double)a * a;
+        saturated += fabsf(u) > _MOTOR_MAX;
+        commands[n % _MAX_LINK_DELAY][0] = a;
+        commands[n % _MAX_LINK_DELAY][1] = b;
+        const int16_t *applied = commands[(n + _MAX_LINK_DELAY - link.down) % _MAX_LINK_DELAY];
+        if(!sim.step(applied[0], applied[1]))
+        {
+            e->fell = true;
+            e->maxTilt = fabsf(sim.getTilt());
+            n++;
+            break;
+        }
+    }
+    finishEpisode(e, lastOutside, duration, effort2, saturated, n);
+}
+
+//recorded session through the controller (open loop, the recorded robot doesn't react to the controller)
+static void replay(BalanceController &ctrl, const std::vector<SessionRecord_t> &records, float dt, int8_t motorSignB, Episode_t *e)
+{
+    uint32_t saturated = 0;
+    double effort2 = 0., diff2 = 0.;
+    float lastOutside = 0.f;
+    memset(e, 0, sizeof(Episode_t));
+    ctrl.reset();
+    for(size_t n = 0; n < records.size(); n++)
+    {
+        int16_t a, b;
+        float u = ctrl.update(records[n].value, &a, &b);
+        float tilt = fabsf(ctrl.getTilt());
+        if(tilt > e->maxTilt)
+            e->maxTilt = tilt;
+        if(tilt > _SETTLE_BAND)
+            lastOutside = (n + 1) * dt;
+        effort2 += (double)a * a;
+        saturated += fabsf(u) > _MOTOR_MAX;
+        float recorded = (records[n].motorA + motorSignB * records[n].motorB) / 2.f;
+        diff2 += (a - recorded) * (a - recorded);
+    }
+    finishEpisode(e, lastOutside, records.size() * dt, effort2, saturated, records.size());
+    e->agreement = records.empty() ? 0.f : sqrt(diff2 / records.size());
+}
+
+//simulation: fewest falls, fastest settling, lowest effort
+static bool better(const Result_t &a, const Result_t &b)
+{
+    if(a.falls != b.falls)
+        return a.falls < b.falls;
+    if(fabsf(a.settle - b.settle) > 1e-4f)
+        return a.settle < b.settle;
+    return a.effort < b.effort;
+}
+
+int main(int argc, char *argv[])
+{
+    Range_t kp = {0.f, 0.f, 1}, ki = {0.f, 0.f, 1}, kd = {0.f, 0.f, 1};
+    int randomCount = 0, episodes = 4, rows = 20;
+    unsigned threads = 0;
+    float duration = 10.f, interval = 0.005f, delayUp = 0.f, delayDown = 0.f;
+    bool predict = false;
+    const char *modelPath = NULL, *output = "sweep.csv";
+    std::vector<const char*> sessionPaths;
+
+    for(int i = 1; i < argc; i++)
+    {
+        bool hasValue = (i + 1 < argc);
+        bool ok = hasValue;
+        if(!strcmp(argv[i], "--kp") && hasValue)
+            ok = parseRange(argv[++i], &kp);
+        else if(!strcmp(argv[i], "--ki") && hasValue)
+            ok = parseRange(argv[++i], &ki);
+        else if(!strcmp(argv[i], "--kd") && hasValue)
+            ok = parseRange(argv[++i], &kd);
+        else if(!strcmp(argv[i], "-r") && hasValue)
+            randomCount = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-m") && hasValue)
+            modelPath = argv[++i];
+        else if(!strcmp(argv[i], "-s") && hasValue)
+            sessionPaths.push_back(argv[++i]);
+        else if(!strcmp(argv[i], "-e") && hasValue)
+            episodes = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-t") && hasValue)
+            duration = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-i") && hasValue)
+            interval = atof(argv[++i]);
+        else if(!strcmp(argv[i], "--delay") && hasValue)
+        {
+            ok = sscanf(argv[++i], "%f:%f", &delayUp, &delayDown) >= 1;
+            if(strchr(argv[i], ':') == NULL)
+                delayDown = delayUp;
+        }
+        else if(!strcmp(argv[i], "--predict"))
+        {
+            predict = true;
+            ok = true;
+        }
+        else if(!strcmp(argv[i], "-j") && hasValue)
+            threads = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-n") && hasValue)
+            rows = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-o") && hasValue)
+            output = argv[++i];
+        else
+            ok = false;
+        if(!ok)
+        {
+            usage();
+            return 1;
+        }
+    }
+    if(episodes < 1)
+        episodes = 1;
+
+    PlantModel_t model = PlantSimulator::defaultModel(interval);
+    if((modelPath != NULL) && !SystemIdentifier::loadModel(modelPath, &model))
+    {
+        printf("Can't read model %s\n", modelPath);
+        return 1;
+    }
+    if(model.interval <= 0.f)
+        model.interval = interval;
+    Link_t link;
+    link.up = lrintf(delayUp * 1e-3f / model.interval);
+    link.down = lrintf(delayDown * 1e-3f / model.interval);
+    link.predict = predict;
+    if((link.up >= _MAX_LINK_DELAY) || (link.down >= _MAX_LINK_DELAY))
+    {
+        printf("Link delay must be shorter than %d samples\n", _MAX_LINK_DELAY);
+        return 1;
+    }
+
+    std::vector<std::vector<SessionRecord_t>> sessions(sessionPaths.size());
+    std::vector<float> sessionIntervals(sessionPaths.size());
+    for(size_t i = 0; i < sessionPaths.size(); i++)
+    {
+        if(!SessionLog::read(sessionPaths[i], sessions[i]) || ((sessionIntervals[i] = SessionLog::interval(sessions[i])) <= 0.f))
+        {
+            printf("Can't read session %s\n", sessionPaths[i]);
+            return 1;
+        }
+    }
+
+    //configurations: full grid or uniform random samples of the ranges
+    std::vector<Result_t> results;
+    if(randomCount > 0)
+    {
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<float> uni(0.f, 1.f);
+        for(int i = 0; i < randomCount; i++)
+        {
+            Result_t r = {};
+            r.kp = kp.min + (kp.max - kp.min) * uni(rng);
+            r.ki = ki.min + (ki.max - ki.min) * uni(rng);
+            r.kd = kd.min + (kd.max - kd.min) * uni(rng);
+            results.push_back(r);
+        }
+    }
+    else
+    {
+        for(int p = 0; p < kp.steps; p++)
+            for(int n = 0; n < ki.steps; n++)
+                for(int d = 0; d < kd.steps; d++)
+                {
+                    Result_t r = {};
+                    r.kp = gridValue(kp, p);
+                    r.ki = gridValue(ki, n);
+                    r.kd = gridValue(kd, d);
+                    results.push_back(r);
+                }
+    }
+
+    //one task per configuration, episode lengths differ (falls end early), so idle workers steal remaining tasks
+    SimConfig_t simConfig = PlantSimulator::defaultConfig(model);
+    PredictorConfig_t predictorConfig = StatePredictor::defaultConfig(model);
+    predictorConfig.actuatorLag = roundf(model.lag / model.interval) * model.interval; //the simulator delays commands by whole samples
+    WorkStealingPool pool(threads);
+    auto start = std::chrono::steady_clock::now();
+    for(size_t c = 0; c < results.size(); c++)
+    {
+        pool.submit([&, c]()
+        {
+            Result_t &r = results[c];
+            ControllerConfig_t cc = BalanceController::defaultConfig(model.interval);
+            cc.kp = r.kp;
+            cc.ki = r.ki;
+            cc.kd = r.kd;
+            cc.direction = (model.gain < 0.f) ? -1.f : 1.f;
+            std::vector<Episode_t> eps;
+            if(sessions.empty())
+            {
+                BalanceController ctrl(cc);
+                PlantSimulator sim(simConfig);
+                StatePredictor predictor(predictorConfig);
+                for(int e = 0; e < episodes; e++)
+                {
+                    Episode_t ep;
+                    float tilt0 = ((e & 1) ? -1.f : 1.f) * (0.05f + 0.2f * e / episodes); //3 to 14 degrees, both sides
+                    simulate(ctrl, sim, predictor, link, cc.gyroAxis, tilt0, e + 1, duration, model.interval, &ep);
+                    eps.push_back(ep);
+                }
+            }
+            else
+            {
+                for(size_t s = 0; s < sessions.size(); s++)
+                {
+                    Episode_t ep;
+                    cc.interval = sessionIntervals[s];
+                    BalanceController ctrl(cc);
+                    replay(ctrl, sessions[s], sessionIntervals[s], cc.motorSignB, &ep);
+                    eps.push_back(ep);
+                }
+            }
+            for(size_t e = 0; e < eps.size(); e++)
+            {
+                r.settle += eps[e].settle / eps.size();
+                r.maxTilt += eps[e].maxTilt / eps.size();
+                r.effort += eps[e].effort / eps.size();
+                r.saturation += eps[e].saturation / eps.size();
+                r.agreement += eps[e].agreement / eps.size();
+                r.falls += eps[e].fell;
+            }
+        });
+    }
+    pool.wait();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    FILE *f = fopen(output, "w");
+    if(f != NULL)
+    {
+        fprintf(f, "kp,ki,kd,falls,settle_s,max_tilt_deg,effort_rms,saturation,replay_rms_diff\n");
+        for(size_t i = 0; i < results.size(); i++)
+        {
+            const Result_t &r = results[i];
+            fprintf(f, "%g,%g,%g,%d,%g,%g,%g,%g,%g\n", r.kp, r.ki, r.kd, r.falls, r.settle, r.maxTilt * 180.f / M_PI, r.effort,
+                    r.saturation, r.agreement);
+        }
+        fclose(f);
+    }
+    else
+        printf("Can't write %s\n", output);
+
+    std::vector<Result_t> sorted(results);
+    if(sessions.empty())
+        std::sort(sorted.begin(), sorted.end(), better);
+    else //replay: tilt doesn't depend on the controller, so rank by closeness to the recorded commands
+        std::sort(sorted.begin(), sorted.end(), [](const Result_t &a, const Result_t &b) { return a.agreement < b.agreement; });
+    printf("%s: %zu configurations, %s, %.2f s on %u threads (%llu steals), %.1f configurations/s\n",
+           sessions.empty() ? "Simulation" : "Replay", results.size(), (randomCount > 0) ? "random search" : "grid",
+           seconds, pool.getThreads(), (unsigned long long)pool.getSteals(), results.size() / seconds);
+    if(sessions.empty() && (link.up + link.down > 0))
+        printf("Link delay %.1f ms up, %.1f ms down, %s\n", link.up * model.interval * 1e3f, link.down * model.interval * 1e3f,
+               link.predict ? "with state prediction" : "without compensation");
+    printf("%10s %10s %10s %6s %9s %9s %9s %7s", "kp", "ki", "kd", "falls", "settle_s", "tilt_deg", "effort", "sat_%");
+    printf(sessions.empty() ? "\n" : " %9s\n", "rec_diff");
+    for(size_t i = 0; (i < sorted.size()) && (i < (size_t)rows); i++)
+    {
+        const Result_t &r = sorted[i];
+        printf("%10.2f %10.2f %10.2f %6d %9.3f %9.2f %9.1f %7.1f", r.kp, r.ki, r.kd, r.falls, r.settle, r.maxTilt * 180.f / M_PI,
+               r.effort, r.saturation * 100.f);
+        if(sessions.empty())
+            printf("\n");
+        else
+            printf(" %9.1f\n", r.agreement);
+    }
+    if(f != NULL)
+        printf("All results written to %s\n", output);
+    return 0;
+}
\ No newline at end of file
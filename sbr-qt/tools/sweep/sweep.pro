@@ -0,0 +1,22 @@
+TEMPLATE = app
+TARGET = sbr-sweep
+CONFIG += c++11 console thread
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+        main.cpp \
+        ../../BalanceController.cpp \
+        ../../PlantSimulator.cpp \
+        ../../SessionLog.cpp \
+        ../../StatePredictor.cpp \
+        ../../SystemIdentifier.cpp \
+        ../../WorkStealingPool.cpp
+HEADERS += \
+        ../../BalanceController.h \
+        ../../PlantSimulator.h \
+        ../../SessionLog.h \
+        ../../StatePredictor.h \
+        ../../SystemIdentifier.h \
+        ../../WorkStealingPool.h
@@ -0,0 +1,180 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file main.cpp
+* \brief Batch system identification over recorded sessions (one worker thread per session)
+* \copyright GNU GPLv3
+**/
+
+#include <SessionLog.h>
+#include <SystemIdentifier.h>
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef struct
+{
+    std::string path;
+    bool valid;
+    PlantModel_t model;
+    double seconds; //identification time
+} SessionResult_t;
+
+static void usage(void)
+{
+    printf("Usage: sbr-sysid [-j threads] [-i interval_s] [-l max_lag] [-f forgetting] [-o model.txt] session.csv...\n");
+    printf("Identifies the plant model of every recorded session (see SessionLog.h) in parallel,\n");
+    printf("prints a summary and writes the sample-weighted mean model to -o (default plant.txt).\n");
+}
+
+//identifies one session, the interval is taken from the timestamps unless given
+static void identify(SessionResult_t *r, float interval, int maxLag, float forgetting)
+{
+    std::vector<SessionRecord_t> records;
+    r->valid = false;
+    if(!SessionLog::read(r->path.c_str(), records) || (records.size() < 2))
+        return;
+    if(interval <= 0.f)
+        interval = SessionLog::interval(records);
+    if(interval <= 0.f)
+        return;
+    SysIdConfig_t c = SystemIdentifier::defaultConfig(interval);
+    if(maxLag >= 0)
+        c.maxLag = maxLag;
+    if(forgetting > 0.f)
+        c.forgetting = forgetting;
+
+    auto start = std::chrono::steady_clock::now();
+    SystemIdentifier *id = new SystemIdentifier(c);
+    for(size_t i = 0; i < records.size(); i++)
+        id->update(records[i].value, records[i].motorA, records[i].motorB);
+    id->getModel(&r->model);
+    delete id;
+    r->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    r->valid = true;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned threads = std::thread::hardware_concurrency();
+    float interval = 0.f, forgetting = 0.f;
+    int maxLag = -1;
+    const char *output = "plant.txt";
+    std::vector<SessionResult_t> results;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "-j") && (i + 1 < argc))
+            threads = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-i") && (i + 1 < argc))
+            interval = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-l") && (i + 1 < argc))
+            maxLag = atoi(argv[++i]);
+        else if(!strcmp(argv[i], "-f") && (i + 1 < argc))
+            forgetting = atof(argv[++i]);
+        else if(!strcmp(argv[i], "-o") && (i + 1 < argc))
+            output = argv[++i];
+        else if(argv[i][0] == '-')
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            SessionResult_t r = {};
+            r.path = argv[i];
+            results.push_back(r);
+        }
+    }
+    if(results.empty())
+    {
+        usage();
+        return 1;
+    }
+    if(threads < 1)
+        threads = 1;
+    if(threads > results.size())
+        threads = results.size();
+
+    //every session is independent, workers take the next one until none are left
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> workers;
+    for(unsigned t = 0; t < threads; t++)
+    {
+        workers.push_back(std::thread([&]()
+        {
+            size_t i;
+            while((i = next++) < results.size())
+                identify(&results[i], interval, maxLag, forgetting);
+        }));
+    }
+    for(size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+
+    printf("%-32s %9s %9s %9s %9s %9s %7s %9s %9s %8s\n", "session", "stiffness", "damping", "gain", "deadzone", "offset",
+           "lag_ms", "residual", "samples", "us/upd");
+    PlantModel_t mean = {};
+    uint64_t total = 0;
+    for(size_t i = 0; i < results.size(); i++)
+    {
+        const SessionResult_t &r = results[i];
+        if(!r.valid)
+        {
+            printf("%-32s (can't read or too short)\n", r.path.c_str());
+            continue;
+        }
+        const PlantModel_t &m = r.model;
+        printf("%-32s %9.3f %9.3f %9.5f %9.2f %9.3f %7.1f %9.3f %9u %8.3f\n", r.path.c_str(), m.stiffness, m.damping, m.gain,
+               m.deadzone, m.offset, m.lag * 1e3f, m.residual, m.samples, r.seconds * 1e6 / m.samples);
+        double w = m.samples;
+        mean.stiffness += w * m.stiffness;
+        mean.damping += w * m.damping;
+        mean.gain += w * m.gain;
+        mean.deadzone += w * m.deadzone;
+        mean.offset += w * m.offset;
+        mean.lag += w * m.lag;
+        mean.interval += w * m.interval;
+        mean.residual += w * m.residual * m.residual;
+        total += m.samples;
+    }
+    if(total == 0)
+        return 1;
+    mean.stiffness /= total;
+    mean.damping /= total;
+    mean.gain /= total;
+    mean.deadzone /= total;
+    mean.offset /= total;
+    mean.lag /= total;
+    mean.interval /= total;
+    mean.residual = sqrtf(mean.residual / total);
+    mean.samples = total;
+    if(!SystemIdentifier::saveModel(output, &mean))
+    {
+        printf("Can't write %s\n", output);
+        return 1;
+    }
+    printf("Model written to %s\n", output);
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,14 @@
+TEMPLATE = app
+TARGET = sbr-sysid
+CONFIG += c++11 console thread
+CONFIG -= app_bundle qt
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+        main.cpp \
+        ../../SessionLog.cpp \
+        ../../SystemIdentifier.cpp
+HEADERS += \
+        ../../SessionLog.h \
+        ../../SystemIdentifier.h
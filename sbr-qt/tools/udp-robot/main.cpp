@@ -0,0 +1,579 @@
+/*
+    This file is part of the Self Balancing Robot Platform (SBR).
+
+    SBR is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    SBR is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with SBR.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+/**
+* \file main.cpp
+* \brief UDP robot stand-in: answers the SBRCP commands of the WiFi firmware and streams MPU samples, with injected datagram loss,
+* latency and stalls, for testing the host side without a robot
+* \copyright GNU GPLv3
+**/
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <map>
+#include <random>
+#include <vector>
+#include "SBRCP.h"
+#include "TelemetryCodec.h"
+
+#define _FIRMWARE_VERSION_MAJOR 1 //firmware version the stand-in reports
+#define _FIRMWARE_VERSION_MINOR 8
+#define _MIN_DATA_INTERVAL_US 5000 //as in the firmware
+#define _MIN_COMPRESSED_INTERVAL_US 2000
+#define _MIN_STATS_INTERVAL_MS 100
+
+typedef struct
+{
+    const char *bindIp; //local address of the robot
+    uint16_t port; //robot port
+    const char *hostIp; //address samples are sent to
+    uint16_t hostPort;
+    uint32_t latency; //one-way latency in microseconds
+    uint32_t jitter; //uniform latency jitter in microseconds
+    float lossIn; //probability of losing a datagram to the robot
+    float lossOut; //probability of losing a datagram from the robot
+    uint32_t stall; //datagrams to the robot are held and handled together every stall microseconds (busy ESP32 or firmware loop)
+    bool reliable; //FEATURE_RELIABLE, false emulates older firmware
+    uint32_t statsInterval; //in seconds, 0 to disable
+} Options_t;
+
+typedef struct
+{
+    uint64_t datagramsIn, datagramsOut, lostIn, lostOut;
+    uint64_t configApplied, motorsApplied; //commands taking effect
+    uint64_t samples;
+} Stats_t;
+
+typedef struct
+{
+    bool toRobot;
+    std::vector<uint8_t> data;
+} Event_t;
+
+static Options_t options;
+static Stats_t stats;
+static std::mt19937 rng(1);
+static std::uniform_real_distribution<float> uni(0.f, 1.f);
+static std::normal_distribution<float> noise(0.f, 0.02f);
+static std::multimap<uint64_t, Event_t> events; //delayed datagrams by due time
+static volatile bool running = true;
+static int sock = -1;
+static struct sockaddr_in host;
+static uint64_t start;
+
+//robot state, the same variables as in the firmware
+static uint32_t dataTimerInterval = 10000;
+static uint8_t telemetryMode = TELEMETRY_FULL;
+static uint8_t accelRange = 1, gyroRange = 1, filterBandwidth = 4;
+static uint16_t statsInterval = 0;
+static uint16_t framesIn = 0, motorCommands = 0, staleMotors = 0, duplicateCommands = 0;
+static uint16_t lastCommandSeq = 0, lastMotorSeq = 0;
+static bool commandSeqValid = false, motorSeqValid = false, motorsPending = false;
+static int16_t pendingMotorA = 0, pendingMotorB = 0, motorA = 0, motorB = 0;
+
+static void parseRxData(SBRCP_data_t *data);
+static void sendPacket(SBRCP_data_t *data);
+static SBRCP protocol(&parseRxData);
+static TelemetryEncoder encoder(&sendPacket);
+static EventEncoder eventEncoder;
+
+static uint64_t now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000ULL + t.tv_nsec / 1000;
+}
+
+//robot micros()
+static uint32_t micros(void)
+{
+    return (uint32_t)(now() - start);
+}
+
+static void onSignal(int)
+{
+    running = false;
+}
+
+static void usage(void)
+{
+    printf("Usage: sbr-udp-robot [options]\n");
+    printf("  -a ip[:port]       robot address (default 127.0.0.1:1235)\n");
+    printf("  -r ip[:port]       host address (default 127.0.0.1:1234)\n");
+    printf("  --latency ms[:jitter_ms]   one-way latency\n");
+    printf("  --loss p[:p_out]   datagram loss probability to the robot (and from the robot, the same by default)\n");
+    printf("  --stall ms         datagrams to the robot are handled together every ms, as by a busy ESP32\n");
+    printf("  --no-reliable      emulate firmware without FEATURE_RELIABLE\n");
+    printf("  --seed n           fault random seed (default 1)\n");
+    printf("  -s seconds         statistics interval (default 5, 0 to disable)\n");
+}
+
+//schedules a datagram with latency and loss
+static void schedule(bool toRobot, const uint8_t *data, size_t len)
+{
+    if(uni(rng) < (toRobot ? options.lossIn : options.lossOut))
+    {
+        (toRobot ? stats.lostIn : stats.lostOut)++;
+        return;
+    }
+    uint64_t due = now() + options.latency;
+    if(options.jitter > 0)
+        due += (uint64_t)(uni(rng) * options.jitter);
+    if(toRobot && (options.stall > 0)) //held until the next stall boundary
+        due = (due / options.stall + 1) * options.stall;
+    Event_t e;
+    e.toRobot = toRobot;
+    e.data.assign(data, data + len);
+    events.insert(std::make_pair(due, e));
+}
+
+static void sendPacket(SBRCP_data_t *data)
+{
+    uint8_t buf[_SBRCP_MAX_PAYLOAD_SIZE + 4];
+    uint8_t len = 0;
+    protocol.parseTx(data, buf, &len);
+    schedule(false, buf, len);
+}
+
+static void sendHello(void)
+{
+    SBRCP_data_t t;
+    SBRCP_Hello_t *hello = SBRCP_init<SBRCP_Hello_t>(&t);
+    hello->protocolVersion = SBRCP_PROTOCOL_VERSION;
+    hello->firmwareMajor = _FIRMWARE_VERSION_MAJOR;
+    hello->firmwareMinor = _FIRMWARE_VERSION_MINOR;
+    hello->features = FEATURE_COMPRESSED_TELEMETRY | FEATURE_SENSOR_CONFIG | FEATURE_STATS | FEATURE_PING | FEATURE_TIMESTAMPS
+                      | FEATURE_MEMORY | FEATURE_EVENT_TELEMETRY | (options.reliable ? FEATURE_RELIABLE : 0);
+    hello->connection = CONNECTION_WIFI;
+    hello->accelRange = accelRange;
+    hello->gyroRange = gyroRange;
+    hello->filterBandwidth = filterBandwidth;
+    hello->telemetryMode = telemetryMode;
+    hello->interval = dataTimerInterval;
+    hello->minInterval = _MIN_DATA_INTERVAL_US;
+    hello->minCompressedInterval = _MIN_COMPRESSED_INTERVAL_US;
+    hello->maxPayload = _SBRCP_MAX_PAYLOAD_SIZE;
+    hello->maxBatch = _TELEMETRY_MAX_BATCH;
+    sendPacket(&t);
+}
+
+static void sendStats(void)
+{
+    SBRCP_data_t t;
+    SBRCP_Stats_t *s = SBRCP_init<SBRCP_Stats_t>(&t, options.reliable ? sizeof(SBRCP_Stats_t)
+                                                                       : offsetof(SBRCP_Stats_t, motorCommands));
+    memset(s, 0, t.size);
+    s->uptime = micros() / 1000;
+    s->frames = framesIn;
+    s->crcErrors = protocol.getCrcErrors();
+    s->freeSram = 1024;
+    if(options.reliable)
+    {
+        s->motorCommands = motorCommands;
+        s->staleMotors = staleMotors;
+        s->duplicateCommands = duplicateCommands;
+    }
+    sendPacket(&t);
+}
+
+//robot standing still: gravity along Z and sensor noise
+static void sendSample(void)
+{
+    float values[TELEMETRY_CHANNELS] = {noise(rng), noise(rng), 9.81f + noise(rng), noise(rng), noise(rng), noise(rng)};
+    stats.samples++;
+    SBRCP_data_t t;
+    if(telemetryMode == TELEMETRY_COMPRESSED)
+    {
+        int16_t raw[TELEMETRY_CHANNELS];
+        for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+            raw[i] = (i < 3) ? TelemetryEncoder::accelToRaw(values[i], accelRange) : TelemetryEncoder::gyroToRaw(values[i], gyroRange);
+        encoder.push(raw);
+    }
+    else if(telemetryMode == TELEMETRY_EVENT)
+    {
+        if(eventEncoder.push(values, micros(), &t))
+        {
+            sendPacket(&t); //the emulated link has no TX buffer to overflow, so every built packet is sent
+            eventEncoder.sent(&t);
+        }
+    }
+    else if(telemetryMode == TELEMETRY_TIMESTAMPED)
+    {
+        SBRCP_MpuTs_t *mpu = SBRCP_init<SBRCP_MpuTs_t>(&t);
+        mpu->robotTime = micros();
+        for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+            mpu->values[i] = values[i];
+        sendPacket(&t);
+    }
+    else
+    {
+        SBRCP_Mpu_t *mpu = SBRCP_init<SBRCP_Mpu_t>(&t);
+        for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++)
+            mpu->values[i] = values[i];
+        sendPacket(&t);
+    }
+}
+
+//command handlers, the same behavior as in the firmware
+
+static void onCmdRate(const SBRCP_CmdRate_t *cmd, uint8_t)
+{
+    uint32_t minVal = ((telemetryMode == TELEMETRY_COMPRESSED) || (telemetryMode == TELEMETRY_EVENT)) ? _MIN_COMPRESSED_INTERVAL_US
+                                                                                                       : _MIN_DATA_INTERVAL_US;
+    dataTimerInterval = (cmd->interval < minVal) ? minVal : cmd->interval;
+    eventEncoder.reset();
+    stats.configApplied++;
+}
+
+static void onCmdMotors(const SBRCP_CmdMotors_t *cmd, uint8_t)
+{
+    motorA = cmd->motorA;
+    motorB = cmd->motorB;
+    stats.motorsApplied++;
+}
+
+static bool isOldSequence(uint16_t seq, uint16_t last, bool valid)
+{
+    int16_t diff = (int16_t)(seq - last);
+    return valid && (diff <= 0) && (diff >= -(int16_t)SEQ_WINDOW);
+}
+
+static void onCmdMotorsSeq(const SBRCP_CmdMotorsSeq_t *cmd, uint8_t)
+{
+    motorCommands++;
+    if(isOldSequence(cmd->sequence, lastMotorSeq, motorSeqValid))
+    {
+        staleMotors++;
+        return;
+    }
+    if(motorsPending)
+        staleMotors++;
+    lastMotorSeq = cmd->sequence;
+    motorSeqValid = true;
+    pendingMotorA = cmd->motorA;
+    pendingMotorB = cmd->motorB;
+    motorsPending = true;
+}
+
+static void onCmdTelemetry(const SBRCP_CmdTelemetry_t *cmd, uint8_t size)
+{
+    if(cmd->mode == TELEMETRY_COMPRESSED)
+    {
+        encoder.configure(SBRCP_HAS(SBRCP_CmdTelemetry_t, batch, size) ? cmd->batch : 1,
+                          SBRCP_HAS(SBRCP_CmdTelemetry_t, keyInterval, size) ? cmd->keyInterval : _TELEMETRY_KEYFRAME_INTERVAL);
+        telemetryMode = TELEMETRY_COMPRESSED;
+    }
+    else if(cmd->mode == TELEMETRY_EVENT)
+    {
+        eventEncoder.configure(SBRCP_HAS(SBRCP_CmdTelemetry_t, accelThreshold, size) ? cmd->accelThreshold : 0,
+                               SBRCP_HAS(SBRCP_CmdTelemetry_t, gyroThreshold, size) ? cmd->gyroThreshold : 0,
+                               SBRCP_HAS(SBRCP_CmdTelemetry_t, maxSilence, size) ? cmd->maxSilence : 0);
+        telemetryMode = TELEMETRY_EVENT;
+    }
+    else
+    {
+        telemetryMode = (cmd->mode == TELEMETRY_TIMESTAMPED) ? TELEMETRY_TIMESTAMPED : TELEMETRY_FULL;
+        if(dataTimerInterval < _MIN_DATA_INTERVAL_US)
+            dataTimerInterval = _MIN_DATA_INTERVAL_US;
+    }
+    stats.configApplied++;
+}
+
+static void onCmdHello(const SBRCP_CmdHello_t *, uint8_t)
+{
+    commandSeqValid = false; //new host session, its sequence numbers start at random
+    motorSeqValid = false;
+    sendHello();
+}
+
+static void onCmdSensor(const SBRCP_CmdSensor_t *cmd, uint8_t size)
+{
+    if(cmd->accelRange != SENSOR_UNCHANGED)
+        accelRange = cmd->accelRange & 0x03;
+    if(SBRCP_HAS(SBRCP_CmdSensor_t, gyroRange, size) && (cmd->gyroRange != SENSOR_UNCHANGED))
+        gyroRange = cmd->gyroRange & 0x03;
+    if(SBRCP_HAS(SBRCP_CmdSensor_t, filterBandwidth, size) && (cmd->filterBandwidth != SENSOR_UNCHANGED))
+        filterBandwidth = cmd->filterBandwidth;
+    encoder.setRanges(accelRange, gyroRange);
+    stats.configApplied++;
+    sendHello();
+}
+
+static void onCmdStats(const SBRCP_CmdStats_t *cmd, uint8_t size)
+{
+    if(SBRCP_HAS(SBRCP_CmdStats_t, interval, size))
+    {
+        statsInterval = cmd->interval;
+        if((statsInterval != 0) && (statsInterval < _MIN_STATS_INTERVAL_MS))
+            statsInterval = _MIN_STATS_INTERVAL_MS;
+    }
+    sendStats();
+}
+
+static void onCmdPing(const SBRCP_CmdPing_t *cmd, uint8_t size)
+{
+    SBRCP_data_t t;
+    SBRCP_Pong_t *pong = SBRCP_init<SBRCP_Pong_t>(&t);
+    pong->robotTime = micros();
+    pong->token = SBRCP_HAS(SBRCP_CmdPing_t, token, size) ? cmd->token : 0;
+    sendPacket(&t);
+}
+
+//WiFi connection, the baud rate can't be changed: proposals are refused, probes are echoed
+static void onCmdBaud(const SBRCP_CmdBaud_t *cmd, uint8_t size)
+{
+    SBRCP_data_t t;
+    SBRCP_Baud_t *answer = SBRCP_init<SBRCP_Baud_t>(&t, offsetof(SBRCP_Baud_t, pattern));
+    answer->baud = cmd->baud;
+    answer->token = cmd->token;
+    if(cmd->action == BAUD_PROPOSE)
+        answer->status = BAUD_UNSUPPORTED;
+    else if(cmd->action == BAUD_PROBE)
+    {
+        uint8_t length = size - offsetof(SBRCP_CmdBaud_t, pattern);
+        answer->status = BAUD_PROBED;
+        memcpy(answer->pattern, cmd->pattern, length);
+        t.size += length;
+    }
+    else if(cmd->action == BAUD_COMMIT)
+        answer->status = BAUD_NOT_PENDING;
+    else
+        SBRCP_init<SBRCP_Error_t>(&t)->code = ERROR_ILLEGAL_CMD;
+    sendPacket(&t);
+}
+
+//fixed Arduino UNO like numbers, consistent with the free SRAM in the statistics
+static void onCmdMemory(const SBRCP_CmdMemory_t *, uint8_t)
+{
+    SBRCP_data_t t;
+    SBRCP_Memory_t *m = SBRCP_init<SBRCP_Memory_t>(&t);
+    m->ramSize = 2048;
+    m->staticSize = 768;
+    m->heapSize = 0;
+    m->stackPeak = 256;
+    m->unusedMin = 1024;
+    m->flags = 0;
+    sendPacket(&t);
+}
+
+static void onCmdReliable(const SBRCP_CmdReliable_t *cmd, uint8_t size);
+
+static const SBRCP_handler_t commandHandlers[] = {SBRCP_PC_TO_ROBOT(SBRCP_HANDLER)};
+
+static void onCmdReliable(const SBRCP_CmdReliable_t *cmd, uint8_t size)
+{
+    SBRCP_data_t t;
+    SBRCP_Ack_t *ack = SBRCP_init<SBRCP_Ack_t>(&t);
+    ack->sequence = cmd->sequence;
+    if(isOldSequence(cmd->sequence, lastCommandSeq, commandSeqValid))
+    {
+        duplicateCommands++;
+        ack->status = ACK_DUPLICATE;
+        sendPacket(&t);
+        return;
+    }
+    SBRCP_data_t inner;
+    inner.type = cmd->command;
+    inner.size = size - offsetof(SBRCP_CmdReliable_t, payload);
+    memcpy(inner.payload, cmd->payload, inner.size);
+    ack->status = ACK_REJECTED;
+    if((inner.type != DATA_CMD_RELIABLE) && (inner.type != DATA_CMD_BAUD) && SBRCP::dispatch(commandHandlers, sizeof(commandHandlers) / sizeof(commandHandlers[0]), &inner))
+    {
+        lastCommandSeq = cmd->sequence;
+        commandSeqValid = true;
+        ack->status = ACK_APPLIED;
+    }
+    sendPacket(&t);
+}
+
+static void parseRxData(SBRCP_data_t *data)
+{
+    framesIn++;
+    bool reliableCommand = (data->type == DATA_CMD_MOTORS_SEQ) || (data->type == DATA_CMD_RELIABLE);
+    if((reliableCommand && !options.reliable) || !SBRCP::dispatch(commandHandlers, sizeof(commandHandlers) / sizeof(commandHandlers[0]), data))
+    {
+        SBRCP_data_t t;
+        SBRCP_init<SBRCP_Error_t>(&t)->code = ERROR_ILLEGAL_CMD;
+        sendPacket(&t);
+    }
+}
+
+static void printStats(void)
+{
+    fprintf(stderr, "in %llu dgrams (%llu lost), out %llu dgrams (%llu lost), %llu samples | config applied %llu, duplicates %u | "
+            "motor commands %u, stale %u, applied %llu, motors %d %d\n",
+            (unsigned long long)stats.datagramsIn, (unsigned long long)stats.lostIn, (unsigned long long)stats.datagramsOut,
+            (unsigned long long)stats.lostOut, (unsigned long long)stats.samples, (unsigned long long)stats.configApplied,
+            duplicateCommands, motorCommands, staleMotors, (unsigned long long)stats.motorsApplied, motorA, motorB);
+}
+
+//parses "ip[:port]"
+static void parseAddress(char *arg, const char **ip, uint16_t *port)
+{
+    char *p = strchr(arg, ':');
+    if(p != NULL)
+    {
+        *p = '\0';
+        *port = atoi(p + 1);
+    }
+    *ip = arg;
+}
+
+int main(int argc, char *argv[])
+{
+    options.bindIp = "127.0.0.1";
+    options.port = 1235;
+    options.hostIp = "127.0.0.1";
+    options.hostPort = 1234;
+    options.latency = 0;
+    options.jitter = 0;
+    options.lossIn = options.lossOut = 0.f;
+    options.stall = 0;
+    options.reliable = true;
+    options.statsInterval = 5;
+
+    for(int i = 1; i < argc; i++)
+    {
+        bool hasValue = (i + 1 < argc);
+        if(!strcmp(argv[i], "-a") && hasValue)
+            parseAddress(argv[++i], &options.bindIp, &options.port);
+        else if(!strcmp(argv[i], "-r") && hasValue)
+            parseAddress(argv[++i], &options.hostIp, &options.hostPort);
+        else if(!strcmp(argv[i], "--latency") && hasValue)
+        {
+            float l = 0.f, j = 0.f;
+            sscanf(argv[++i], "%f:%f", &l, &j);
+            options.latency = l * 1000.f;
+            options.jitter = j * 1000.f;
+        }
+        else if(!strcmp(argv[i], "--loss") && hasValue)
+        {
+            if(sscanf(argv[++i], "%f:%f", &options.lossIn, &options.lossOut) < 2)
+                options.lossOut = options.lossIn;
+        }
+        else if(!strcmp(argv[i], "--stall") && hasValue)
+            options.stall = atof(argv[++i]) * 1000.f;
+        else if(!strcmp(argv[i], "--no-reliable"))
+            options.reliable = false;
+        else if(!strcmp(argv[i], "--seed") && hasValue)
+            rng.seed(atoi(argv[++i]));
+        else if(!strcmp(argv[i], "-s") && hasValue)
+            options.statsInterval = atoi(argv[++i]);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(options.port);
+    memset(&host, 0, sizeof(host));
+    host.sin_family = AF_INET;
+    host.sin_port = htons(options.hostPort);
+    if((inet_pton(AF_INET, options.bindIp, &local.sin_addr) != 1) || (inet_pton(AF_INET, options.hostIp, &host.sin_addr) != 1))
+    {
+        usage();
+        return 1;
+    }
+    if((sock < 0) || (bind(sock, (struct sockaddr*)&local, sizeof(local)) < 0))
+    {
+        fprintf(stderr, "Can't bind %s:%u: %s\n", options.bindIp, options.port, strerror(errno));
+        return 1;
+    }
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    memset(&stats, 0, sizeof(stats));
+    start = now();
+    uint64_t nextSample = start, nextStats = start, nextPrint = start + options.statsInterval * 1000000ULL;
+
+    while(running)
+    {
+        uint64_t t = now();
+        //due datagrams, all the ones to the robot are handled in one loop pass
+        while(!events.empty() && (events.begin()->first <= t))
+        {
+            Event_t e = events.begin()->second;
+            events.erase(events.begin());
+            if(e.toRobot)
+            {
+                stats.datagramsIn++;
+                protocol.parseRx(e.data.data(), e.data.size());
+            }
+            else
+            {
+                stats.datagramsOut++;
+                sendto(sock, e.data.data(), e.data.size(), 0, (struct sockaddr*)&host, sizeof(host));
+            }
+        }
+        if(motorsPending) //the latest motor command of the pass
+        {
+            motorsPending = false;
+            motorA = pendingMotorA;
+            motorB = pendingMotorB;
+            stats.motorsApplied++;
+        }
+        if(t >= nextSample)
+        {
+            nextSample += dataTimerInterval;
+            if(nextSample < t) //the host set a shorter interval or the process was stopped
+                nextSample = t + dataTimerInterval;
+            sendSample();
+        }
+        if((statsInterval != 0) && (t >= nextStats + statsInterval * 1000ULL))
+        {
+            nextStats = t;
+            sendStats();
+        }
+        if((options.statsInterval > 0) && (t >= nextPrint))
+        {
+            printStats();
+            nextPrint = t + options.statsInterval * 1000000ULL;
+        }
+
+        uint64_t wake = nextSample;
+        if(!events.empty() && (events.begin()->first < wake))
+            wake = events.begin()->first;
+        t = now();
+        struct pollfd fds;
+        fds.fd = sock;
+        fds.events = POLLIN;
+        if(poll(&fds, 1, (wake > t) ? (wake - t + 999) / 1000 : 0) <= 0)
+            continue;
+        uint8_t buf[512];
+        ssize_t n;
+        while((n = recv(sock, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+            schedule(true, buf, n);
+    }
+    fprintf(stderr, "Total: ");
+    printStats();
+    close(sock);
+    return 0;
+}
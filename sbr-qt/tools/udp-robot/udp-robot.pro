@@ -0,0 +1,16 @@
+TEMPLATE = app
+TARGET = sbr-udp-robot
+CONFIG += c++11 console
+CONFIG -= app_bundle qt
+
+SBRCP_DIR = ../../../firmware/lib/SBRCP/src
+INCLUDEPATH += $$SBRCP_DIR
+
+SOURCES += \
+        main.cpp \
+        $$SBRCP_DIR/SBRCP.cpp \
+        $$SBRCP_DIR/TelemetryCodec.cpp
+HEADERS += \
+        $$SBRCP_DIR/SBRCP.h \
+        $$SBRCP_DIR/SBRCPMessages.h \
+        $$SBRCP_DIR/TelemetryCodec.h